@@ -0,0 +1,71 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "APU.h"
+
+// One frame of a pulse and the triangle playing with the noise silent, caught up either
+// after every CPU cycle (the worst case of eager synchronization) or once at the end
+static void RunMusic(benchmark::State& state, bool audio, bool every_cycle)
+{
+    Bus bus;
+    APU apu(bus);
+    if (audio)
+        apu.SetSampleRate(DEFAULT_SAMPLE_RATE);
+
+    apu.WriteRegister(APU_STATUS, 0x0F);
+    apu.WriteRegister(0x4000, 0xBF);
+    apu.WriteRegister(0x4002, 253);
+    apu.WriteRegister(0x4003, 0x00);
+    apu.WriteRegister(0x4008, 0xFF);
+    apu.WriteRegister(0x400A, 126);
+    apu.WriteRegister(0x400B, 0x00);
+    apu.WriteRegister(0x400C, 0x30);
+    apu.WriteRegister(0x400E, 0x00);
+    apu.WriteRegister(0x400F, 0x00);
+
+    std::vector<int16_t> samples(DEFAULT_SAMPLE_RATE / 4);
+    for (auto _ : state)
+    {
+        uint64_t end = apu.GetTime() + 29781;
+        if (every_cycle)
+        {
+            for (uint64_t cycle = apu.GetTime() + 1; cycle <= end; ++cycle)
+                apu.Run(cycle);
+        }
+        else
+            apu.Run(end);
+
+        apu.EndFrame();
+        apu.ReadSamples(samples.data(), static_cast<uint32_t>(samples.size()));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <bool Audio, bool EveryCycle>
+static void BM_APUFrame(benchmark::State& state)
+{
+    RunMusic(state, Audio, EveryCycle);
+}
+BENCHMARK_TEMPLATE(BM_APUFrame, false, true);
+BENCHMARK_TEMPLATE(BM_APUFrame, false, false);
+BENCHMARK_TEMPLATE(BM_APUFrame, true, true);
+BENCHMARK_TEMPLATE(BM_APUFrame, true, false);
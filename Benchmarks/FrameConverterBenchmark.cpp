@@ -0,0 +1,54 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "FrameConverter.h"
+#include "PPU.h"
+
+// A whole frame of random indices into a preallocated buffer
+static void BM_ConvertFrame(benchmark::State& state)
+{
+    PixelFormat format = static_cast<PixelFormat>(state.range(0));
+
+    uint32_t seed = 4;
+    std::vector<uint8_t> framebuffer(SCREEN_WIDTH * SCREEN_HEIGHT);
+    for (uint8_t& index : framebuffer)
+    {
+        seed = seed * 1103515245 + 12345;
+        index = static_cast<uint8_t>(seed >> 16) & 0x3F;
+    }
+
+    std::vector<uint8_t> emphasis(SCREEN_HEIGHT, 0);
+    std::vector<uint8_t> pixels(SCREEN_WIDTH * SCREEN_HEIGHT * GetBytesPerPixel(format));
+    FrameConverter converter;
+
+    for (auto _ : state)
+    {
+        converter.Convert(framebuffer.data(), emphasis.data(), format, pixels.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * SCREEN_WIDTH * SCREEN_HEIGHT);
+}
+BENCHMARK(BM_ConvertFrame)
+    ->Arg(static_cast<int>(PixelFormat::RGBA8888))
+    ->Arg(static_cast<int>(PixelFormat::BGRA8888))
+    ->Arg(static_cast<int>(PixelFormat::RGB565))
+    ->Arg(static_cast<int>(PixelFormat::Grayscale));
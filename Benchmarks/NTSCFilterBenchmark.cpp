@@ -0,0 +1,51 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "NTSCFilter.h"
+
+// A whole frame of random indices and emphasis, the argument is the number of bands
+static void BM_NTSCFilter(benchmark::State& state)
+{
+    uint32_t seed = 4;
+    std::vector<uint8_t> framebuffer(SCREEN_WIDTH * SCREEN_HEIGHT);
+    for (uint8_t& index : framebuffer)
+    {
+        seed = seed * 1103515245 + 12345;
+        index = static_cast<uint8_t>(seed >> 16) & 0x3F;
+    }
+
+    std::vector<uint8_t> emphasis(SCREEN_HEIGHT);
+    for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+        emphasis[y] = static_cast<uint8_t>(y & 0x07);
+
+    std::vector<uint8_t> pixels(NTSC_WIDTH * SCREEN_HEIGHT * 4);
+    NTSCFilter filter(static_cast<uint32_t>(state.range(0)));
+    uint64_t frame = 0;
+
+    for (auto _ : state)
+    {
+        filter.Filter(framebuffer.data(), emphasis.data(), frame++, pixels.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * SCREEN_WIDTH * SCREEN_HEIGHT);
+}
+BENCHMARK(BM_NTSCFilter)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
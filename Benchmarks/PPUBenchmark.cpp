@@ -0,0 +1,138 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <vector>
+#include "Console.h"
+
+static uint8_t Random(uint32_t& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return static_cast<uint8_t>(seed >> 16);
+}
+
+// Busy scene: random patterns, nametables, palette and sprites, everything shown.
+// region is the side of a centered square region of interest, 0 for the whole screen.
+template <class PPUType>
+static void RunBusyScene(benchmark::State& state, bool headless, uint32_t region)
+{
+    uint32_t seed = 1;
+    std::vector<uint8_t> CHR(PATTERN_TABLES_SIZE);
+    for (uint8_t& data : CHR)
+        data = Random(seed);
+
+    PPUBus ppu_bus;
+    ppu_bus.MapPages(0x0000, PATTERN_TABLES_SIZE, CHR.data(), CHR.data());
+    ppu_bus.SetMirroring(Mirroring::Vertical);
+
+    PPUType ppu(ppu_bus);
+    ppu.SetHeadless(headless);
+    if (region != 0)
+        ppu.SetRegionOfInterest({ (SCREEN_WIDTH - region) / 2, (SCREEN_HEIGHT - region) / 2, region, region, 1 });
+
+    ppu.WriteRegister(0x2006, 0x20);
+    ppu.WriteRegister(0x2006, 0x00);
+    for (uint32_t i = 0; i < 0x0800; ++i)
+        ppu.WriteRegister(0x2007, Random(seed));
+
+    ppu.WriteRegister(0x2006, 0x3F);
+    ppu.WriteRegister(0x2006, 0x00);
+    for (uint32_t i = 0; i < PALETTE_SIZE; ++i)
+        ppu.WriteRegister(0x2007, Random(seed));
+
+    for (uint8_t& data : ppu.OAM)
+        data = Random(seed);
+
+    ppu.WriteRegister(0x2005, 3);
+    ppu.WriteRegister(0x2005, 0);
+    ppu.WriteRegister(0x2001, 0x1E);
+
+    uint64_t time = 0;
+    for (auto _ : state)
+    {
+        time += PPU_DOTS_PER_FRAME;
+        ppu.Run(time);
+        benchmark::DoNotOptimize(ppu.GetFramebuffer());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <class PPUType, bool Headless>
+static void BM_PPUFrame(benchmark::State& state)
+{
+    RunBusyScene<PPUType>(state, Headless, 0);
+}
+BENCHMARK_TEMPLATE(BM_PPUFrame, ScanlinePPU, false);
+BENCHMARK_TEMPLATE(BM_PPUFrame, ScanlinePPU, true);
+BENCHMARK_TEMPLATE(BM_PPUFrame, DotPPU, false);
+BENCHMARK_TEMPLATE(BM_PPUFrame, DotPPU, true);
+
+// Cost against the side of the region of interest
+template <class PPUType>
+static void BM_PPUFrameRegion(benchmark::State& state)
+{
+    RunBusyScene<PPUType>(state, false, static_cast<uint32_t>(state.range(0)));
+}
+BENCHMARK_TEMPLATE(BM_PPUFrameRegion, ScanlinePPU)->Arg(16)->Arg(64)->Arg(128)->Arg(240);
+
+// Whole NROM system with rendering on: LDA #$1E, STA $2001, JMP $8005 (spin).
+// Pipelined draws on the render thread, only the emulation thread is timed.
+template <class PPUType, bool Pipelined = false>
+static void BM_ConsoleFrame(benchmark::State& state)
+{
+    uint32_t seed = 2;
+    std::vector<uint8_t> image(INES_HEADER_SIZE + 2 * 16384 + 8192, 0);
+    image[0] = 'N';
+    image[1] = 'E';
+    image[2] = 'S';
+    image[3] = 0x1A;
+    image[4] = 2;
+    image[5] = 1;
+
+    uint8_t* prg = image.data() + INES_HEADER_SIZE;
+    prg[0x0000] = static_cast<uint8_t>(Opcode::LDA_IM);
+    prg[0x0001] = 0x1E;
+    prg[0x0002] = static_cast<uint8_t>(Opcode::STA_ABS);
+    prg[0x0003] = 0x01;
+    prg[0x0004] = 0x20;
+    prg[0x0005] = static_cast<uint8_t>(Opcode::JMP_ABS);
+    prg[0x0006] = 0x05;
+    prg[0x0007] = 0x80;
+    prg[0x7FFD] = 0x80;
+
+    uint8_t* chr = prg + 2 * 16384;
+    for (uint32_t i = 0; i < 8192; ++i)
+        chr[i] = Random(seed);
+
+    Cartridge cartridge(image);
+    std::unique_ptr<ConsoleBase> console = CreateConsole<PPUType>(cartridge);
+    console->SetPipelinedRendering(Pipelined);
+
+    for (auto _ : state)
+        console->RunFrame();
+
+    console->WaitForRendering();
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_ConsoleFrame, ScanlinePPU);
+BENCHMARK_TEMPLATE(BM_ConsoleFrame, ScanlinePPU, true);
+BENCHMARK_TEMPLATE(BM_ConsoleFrame, DotPPU);
@@ -0,0 +1,82 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "TileDecoder.h"
+
+// A whole 8 KB pattern table worth of rows, 512 tiles of 8 rows
+static constexpr uint32_t ROWS = 4096;
+
+static void MakePlanes(std::vector<uint8_t>& low, std::vector<uint8_t>& high)
+{
+    uint32_t seed = 3;
+    low.resize(ROWS);
+    high.resize(ROWS);
+    for (uint32_t i = 0; i < ROWS; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        low[i] = static_cast<uint8_t>(seed >> 16);
+        high[i] = static_cast<uint8_t>(seed >> 24);
+    }
+}
+
+template <void (*Decode)(uint8_t, uint8_t, uint8_t*)>
+static void BM_DecodeTileRow(benchmark::State& state)
+{
+    std::vector<uint8_t> low;
+    std::vector<uint8_t> high;
+    std::vector<uint8_t> pixels(ROWS * 8);
+    MakePlanes(low, high);
+
+    for (auto _ : state)
+    {
+        for (uint32_t row = 0; row < ROWS; ++row)
+            Decode(low[row], high[row], pixels.data() + row * 8);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * ROWS);
+}
+BENCHMARK_TEMPLATE(BM_DecodeTileRow, DecodeTileRowBitwise);
+BENCHMARK_TEMPLATE(BM_DecodeTileRow, DecodeTileRow);
+BENCHMARK_TEMPLATE(BM_DecodeTileRow, DecodeTileRowFlipped);
+
+template <void (*Decode)(const uint8_t*, const uint8_t*, uint32_t, uint8_t*)>
+static void BM_DecodeTileRows(benchmark::State& state)
+{
+    std::vector<uint8_t> low;
+    std::vector<uint8_t> high;
+    std::vector<uint8_t> pixels(ROWS * 8);
+    MakePlanes(low, high);
+
+    // 33 rows is what a background scanline decodes
+    uint32_t batch = static_cast<uint32_t>(state.range(0));
+
+    for (auto _ : state)
+    {
+        for (uint32_t row = 0; row + batch <= ROWS; row += batch)
+            Decode(low.data() + row, high.data() + row, batch, pixels.data() + row * 8);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * (ROWS / batch) * batch);
+}
+BENCHMARK_TEMPLATE(BM_DecodeTileRows, DecodeTileRows)->Arg(33)->Arg(ROWS);
+BENCHMARK_TEMPLATE(BM_DecodeTileRows, DecodeTileRowsFlipped)->Arg(33)->Arg(ROWS);
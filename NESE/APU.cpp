@@ -0,0 +1,720 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "APU.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const uint8_t LENGTH_TABLE[32] =
+    {
+        10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+        12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+    };
+
+    const uint8_t DUTY_TABLE[4][8] =
+    {
+        { 0, 1, 0, 0, 0, 0, 0, 0 },
+        { 0, 1, 1, 0, 0, 0, 0, 0 },
+        { 0, 1, 1, 1, 1, 0, 0, 0 },
+        { 1, 0, 0, 1, 1, 1, 1, 1 },
+    };
+
+    const uint8_t TRIANGLE_TABLE[32] =
+    {
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    };
+
+    // In CPU cycles
+    const uint16_t NOISE_PERIODS[16] = { 4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068 };
+    const uint16_t DMC_PERIODS[16] = { 428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54 };
+
+    /** MIXER
+    *  The nonlinear DAC of the 2A03, the pulses share one output and triangle, noise and DMC
+    *  the other. Full scale (every channel at its maximum) is close to 32767.
+    **/
+    struct MixerTables
+    {
+        int32_t pulse[31];
+        int32_t TND[203];
+
+        MixerTables()
+        {
+            const double scale = 32767.0;
+
+            pulse[0] = 0;
+            for (uint32_t i = 1; i < 31; ++i)
+                pulse[i] = static_cast<int32_t>(scale * 95.52 / (8128.0 / i + 100.0) + 0.5);
+
+            TND[0] = 0;
+            for (uint32_t i = 1; i < 203; ++i)
+                TND[i] = static_cast<int32_t>(scale * 163.67 / (24329.0 / i + 100.0) + 0.5);
+        }
+    };
+
+    const MixerTables& GetMixerTables()
+    {
+        static const MixerTables tables;
+        return tables;
+    }
+
+    /** NOISE JUMPS
+    *  The noise shift register is linear over GF(2), stepping it n times multiplies it by
+    *  the n-th power of its matrix. columns[mode][i] is the 2^i-th power for each feedback
+    *  tap, a jump of any length takes one matrix product per bit of n.
+    **/
+    struct NoiseJumps
+    {
+        uint16_t columns[2][32][15];
+
+        NoiseJumps()
+        {
+            for (uint32_t mode = 0; mode < 2; ++mode)
+            {
+                uint32_t tap = mode ? 6 : 1;
+                for (uint32_t j = 0; j < 15; ++j)
+                {
+                    uint32_t bit = 1u << j;
+                    columns[mode][0][j] = static_cast<uint16_t>((bit >> 1) | (((bit ^ (bit >> tap)) & 0x01) << 14));
+                }
+
+                for (uint32_t i = 1; i < 32; ++i)
+                {
+                    for (uint32_t j = 0; j < 15; ++j)
+                        columns[mode][i][j] = Multiply(columns[mode][i - 1], columns[mode][i - 1][j]);
+                }
+            }
+        }
+
+        static uint16_t Multiply(const uint16_t* columns, uint16_t shift)
+        {
+            uint16_t result = 0;
+            for (uint32_t j = 0; j < 15; ++j)
+            {
+                if ((shift >> j) & 0x01)
+                    result ^= columns[j];
+            }
+
+            return result;
+        }
+    };
+
+    const NoiseJumps& GetNoiseJumps()
+    {
+        static const NoiseJumps jumps;
+        return jumps;
+    }
+
+    uint16_t JumpNoise(uint16_t shift, bool mode, uint32_t steps)
+    {
+        const NoiseJumps& jumps = GetNoiseJumps();
+        for (uint32_t i = 0; steps != 0; ++i, steps >>= 1)
+        {
+            if (steps & 0x01)
+                shift = NoiseJumps::Multiply(jumps.columns[mode ? 1 : 0][i], shift);
+        }
+
+        return shift;
+    }
+
+    // Clocks of a timer due before end, the timer moves past them
+    uint32_t SkipClocks(uint64_t& clock, uint32_t period, uint64_t end)
+    {
+        if (clock >= end)
+            return 0;
+
+        uint32_t clocks = static_cast<uint32_t>((end - 1 - clock) / period + 1);
+        clock += static_cast<uint64_t>(clocks) * period;
+        return clocks;
+    }
+}
+
+APU::APU(Bus& bus) : _bus(bus), _time(0), _sample_rate(0), _frame_start(0), _level(0)
+{
+    GetMixerTables();
+    GetNoiseJumps();
+    Reset();
+}
+
+void APU::Reset()
+{
+    std::memset(_pulse, 0, sizeof(_pulse));
+    std::memset(&_triangle, 0, sizeof(_triangle));
+    std::memset(&_noise, 0, sizeof(_noise));
+    std::memset(&_DMC, 0, sizeof(_DMC));
+
+    for (Pulse& pulse : _pulse)
+        pulse.clock = _time + 1;
+
+    _triangle.clock = _time;
+    _noise.period = NOISE_PERIODS[0];
+    _noise.clock = _time + _noise.period - 1;
+    _noise.shift = 1;
+    _DMC.period = DMC_PERIODS[0];
+    _DMC.clock = _time + _DMC.period - 1;
+    _DMC.bits = 8;
+    _DMC.silence = true;
+
+    _frame_cycle = 0;
+    _five_step = false;
+    _IRQ_inhibit = false;
+    _frame_IRQ = false;
+    _stall_cycles = 0;
+
+    UpdateOutput(_time);
+}
+
+void APU::Run(uint64_t cycle)
+{
+    while (_time < cycle)
+    {
+        // _frame_cycle counts the cycles of the sequence before _time
+        uint32_t step = GetNextFrameStep();
+        uint64_t step_time = _time + (step - _frame_cycle - 1);
+
+        if (step_time >= cycle)
+        {
+            RunChannels(cycle);
+            _frame_cycle += static_cast<uint32_t>(cycle - _time);
+            _time = cycle;
+            return;
+        }
+
+        // The frame counter goes before the timers of its cycle
+        RunChannels(step_time);
+        _frame_cycle = step;
+        ClockFrameStep(step);
+        UpdateOutput(step_time + 1);
+        RunChannels(step_time + 1);
+        _time = step_time + 1;
+    }
+}
+
+uint64_t APU::GetNextEventTime() const
+{
+    uint64_t event = NO_EVENT;
+
+    if (!_five_step && !_IRQ_inhibit)
+    {
+        uint32_t cycles = FRAME_COUNTER_4_STEP_LAST - _frame_cycle;
+        if (_frame_cycle >= FRAME_COUNTER_4_STEP_LAST)
+            cycles += FRAME_COUNTER_4_STEP_LAST + 1;
+
+        event = _time + cycles;
+    }
+
+    // A byte is fetched as soon as the last bit of the previous one leaves the output unit
+    if (_DMC.bytes_remaining > 0)
+        event = std::min(event, _DMC.clock + (_DMC.bits - 1u) * _DMC.period + 1);
+
+    return event;
+}
+
+uint32_t APU::GetNextFrameStep() const
+{
+    static const uint32_t FOUR_STEP[] = { FRAME_COUNTER_QUARTER_1, FRAME_COUNTER_HALF_1, FRAME_COUNTER_QUARTER_3, FRAME_COUNTER_4_STEP_LAST, FRAME_COUNTER_4_STEP_LAST + 1 };
+    static const uint32_t FIVE_STEP[] = { FRAME_COUNTER_QUARTER_1, FRAME_COUNTER_HALF_1, FRAME_COUNTER_QUARTER_3, FRAME_COUNTER_5_STEP_LAST, FRAME_COUNTER_5_STEP_LAST + 1 };
+
+    const uint32_t* steps = _five_step ? FIVE_STEP : FOUR_STEP;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        if (steps[i] > _frame_cycle)
+            return steps[i];
+    }
+
+    return steps[4];
+}
+
+void APU::ClockFrameStep(uint32_t step)
+{
+    switch (step)
+    {
+    case FRAME_COUNTER_QUARTER_1:
+    case FRAME_COUNTER_QUARTER_3:
+        ClockQuarterFrame();
+        break;
+    case FRAME_COUNTER_HALF_1:
+    case FRAME_COUNTER_5_STEP_LAST:
+        ClockQuarterFrame();
+        ClockHalfFrame();
+        break;
+    case FRAME_COUNTER_4_STEP_LAST:
+        ClockQuarterFrame();
+        ClockHalfFrame();
+
+        if (!_IRQ_inhibit)
+            _frame_IRQ = true;
+        break;
+    default:
+        // The last cycle of the sequence, it starts over
+        _frame_cycle = 0;
+        break;
+    }
+}
+
+void APU::RunChannels(uint64_t end)
+{
+    // Nothing changes the outputs until end, only the DMC can go idle
+    bool audio = _sample_rate != 0;
+    bool pulse1 = audio && IsPulseAudible(_pulse[0], true);
+    bool pulse2 = audio && IsPulseAudible(_pulse[1], false);
+    bool triangle = audio && IsTriangleRunning();
+    bool noise = audio && IsNoiseAudible();
+
+    // The clocks that can be heard go one at a time in time order, each change lands on its cycle
+    for (;;)
+    {
+        uint64_t next = end;
+        Channel channel = Channel::None;
+
+        if (pulse1 && _pulse[0].clock < next)
+        {
+            next = _pulse[0].clock;
+            channel = Channel::Pulse1;
+        }
+        if (pulse2 && _pulse[1].clock < next)
+        {
+            next = _pulse[1].clock;
+            channel = Channel::Pulse2;
+        }
+        if (triangle && _triangle.clock < next)
+        {
+            next = _triangle.clock;
+            channel = Channel::Triangle;
+        }
+        if (noise && _noise.clock < next)
+        {
+            next = _noise.clock;
+            channel = Channel::Noise;
+        }
+        if (!IsDMCIdle() && _DMC.clock < next)
+        {
+            next = _DMC.clock;
+            channel = Channel::DMC;
+        }
+
+        switch (channel)
+        {
+        case Channel::Pulse1:
+        case Channel::Pulse2:
+        {
+            Pulse& pulse = _pulse[channel == Channel::Pulse1 ? 0 : 1];
+            pulse.step = (pulse.step + 1) & 0x07;
+            pulse.clock += (pulse.period + 1u) * 2u;
+            break;
+        }
+        case Channel::Triangle:
+            _triangle.step = (_triangle.step + 1) & 0x1F;
+            _triangle.clock += _triangle.period + 1u;
+            break;
+        case Channel::Noise:
+            ClockNoise();
+            _noise.clock += _noise.period;
+            break;
+        case Channel::DMC:
+            ClockDMC();
+            _DMC.clock += _DMC.period;
+            break;
+        default:
+            break;
+        }
+
+        if (channel == Channel::None)
+            break;
+
+        if (audio)
+            UpdateOutput(next + 1);
+    }
+
+    // Whatever can't be heard jumps over its clocks, the timers stay in phase
+    for (Pulse& pulse : _pulse)
+        pulse.step = (pulse.step + SkipClocks(pulse.clock, (pulse.period + 1u) * 2u, end)) & 0x07;
+
+    // Ultrasonic periods are frozen instead of averaging to a pop
+    uint32_t triangle_clocks = SkipClocks(_triangle.clock, _triangle.period + 1u, end);
+    if (IsTriangleRunning())
+        _triangle.step = (_triangle.step + triangle_clocks) & 0x1F;
+
+    uint32_t noise_clocks = SkipClocks(_noise.clock, _noise.period, end);
+    if (noise_clocks != 0)
+        _noise.shift = JumpNoise(_noise.shift, _noise.mode, noise_clocks);
+
+    // Idle, the output unit only counts its bits and shifts out zeros
+    uint32_t DMC_clocks = SkipClocks(_DMC.clock, _DMC.period, end);
+    if (DMC_clocks != 0)
+    {
+        _DMC.bits = static_cast<uint8_t>(8 - (8 - _DMC.bits + DMC_clocks) % 8);
+        _DMC.shift = DMC_clocks >= 8 ? 0 : static_cast<uint8_t>(_DMC.shift >> DMC_clocks);
+    }
+}
+
+void APU::ClockNoise()
+{
+    uint16_t feedback = (_noise.shift ^ (_noise.shift >> (_noise.mode ? 6 : 1))) & 0x01;
+    _noise.shift = static_cast<uint16_t>((_noise.shift >> 1) | (feedback << 14));
+}
+
+void APU::ClockQuarterFrame()
+{
+    ClockEnvelope(_pulse[0].envelope);
+    ClockEnvelope(_pulse[1].envelope);
+    ClockEnvelope(_noise.envelope);
+
+    if (_triangle.linear_reload)
+        _triangle.linear = _triangle.linear_period;
+    else if (_triangle.linear > 0)
+        --_triangle.linear;
+
+    if (!_triangle.control)
+        _triangle.linear_reload = false;
+}
+
+void APU::ClockHalfFrame()
+{
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        if (!_pulse[i].envelope.loop && _pulse[i].length > 0)
+            --_pulse[i].length;
+
+        ClockSweep(_pulse[i], i == 0);
+    }
+
+    if (!_triangle.control && _triangle.length > 0)
+        --_triangle.length;
+
+    if (!_noise.envelope.loop && _noise.length > 0)
+        --_noise.length;
+}
+
+void APU::ClockEnvelope(Envelope& envelope)
+{
+    if (envelope.start)
+    {
+        envelope.start = false;
+        envelope.decay = 15;
+        envelope.divider = envelope.volume;
+    }
+    else if (envelope.divider > 0)
+        --envelope.divider;
+    else
+    {
+        envelope.divider = envelope.volume;
+
+        if (envelope.decay > 0)
+            --envelope.decay;
+        else if (envelope.loop)
+            envelope.decay = 15;
+    }
+}
+
+uint16_t APU::GetSweepTarget(const Pulse& pulse, bool ones_complement)
+{
+    int32_t change = pulse.period >> pulse.sweep_shift;
+    if (pulse.sweep_negate)
+        change = -change - (ones_complement ? 1 : 0);
+
+    return static_cast<uint16_t>(std::max(0, pulse.period + change));
+}
+
+void APU::ClockSweep(Pulse& pulse, bool ones_complement)
+{
+    uint16_t target = GetSweepTarget(pulse, ones_complement);
+
+    if (pulse.sweep_divider == 0 && pulse.sweep_enabled && pulse.sweep_shift > 0 && pulse.period >= 8 && target <= 0x7FF)
+        pulse.period = target;
+
+    if (pulse.sweep_divider == 0 || pulse.sweep_reload)
+    {
+        pulse.sweep_divider = pulse.sweep_period;
+        pulse.sweep_reload = false;
+    }
+    else
+        --pulse.sweep_divider;
+}
+
+bool APU::IsPulseAudible(const Pulse& pulse, bool ones_complement)
+{
+    // The sweep unit mutes too low periods and targets out of range, even when disabled
+    return pulse.length > 0 && pulse.envelope.GetVolume() > 0 && pulse.period >= 8 && GetSweepTarget(pulse, ones_complement) <= 0x7FF;
+}
+
+uint8_t APU::GetPulseOutput(const Pulse& pulse, bool ones_complement)
+{
+    return IsPulseAudible(pulse, ones_complement) && DUTY_TABLE[pulse.duty][pulse.step] ? pulse.envelope.GetVolume() : 0;
+}
+
+void APU::ClockDMC()
+{
+    if (!_DMC.silence)
+    {
+        if ((_DMC.shift & 0x01) != 0)
+        {
+            if (_DMC.level <= 125)
+                _DMC.level += 2;
+        }
+        else if (_DMC.level >= 2)
+            _DMC.level -= 2;
+    }
+
+    _DMC.shift >>= 1;
+
+    if (--_DMC.bits == 0)
+    {
+        _DMC.bits = 8;
+        _DMC.silence = !_DMC.buffer_full;
+
+        if (_DMC.buffer_full)
+        {
+            _DMC.shift = _DMC.buffer;
+            _DMC.buffer_full = false;
+            FetchDMCSample();
+        }
+    }
+}
+
+void APU::FetchDMCSample()
+{
+    if (_DMC.buffer_full || _DMC.bytes_remaining == 0)
+        return;
+
+    _DMC.buffer = _bus.Read(_DMC.address);
+    _DMC.buffer_full = true;
+    _stall_cycles += DMC_FETCH_CYCLES;
+
+    // The address wraps to $8000, not to zero page
+    _DMC.address = _DMC.address == 0xFFFF ? 0x8000 : _DMC.address + 1;
+
+    if (--_DMC.bytes_remaining == 0)
+    {
+        if (_DMC.loop)
+        {
+            _DMC.address = _DMC.sample_address;
+            _DMC.bytes_remaining = _DMC.sample_length;
+        }
+        else if (_DMC.IRQ_enabled)
+            _DMC.IRQ = true;
+    }
+}
+
+uint8_t APU::ReadStatus()
+{
+    uint8_t status = 0;
+
+    if (_pulse[0].length > 0)
+        status |= 0x01;
+    if (_pulse[1].length > 0)
+        status |= 0x02;
+    if (_triangle.length > 0)
+        status |= 0x04;
+    if (_noise.length > 0)
+        status |= 0x08;
+    if (_DMC.bytes_remaining > 0)
+        status |= APU_STATUS_DMC_ACTIVE;
+    if (_frame_IRQ)
+        status |= APU_STATUS_FRAME_IRQ;
+    if (_DMC.IRQ)
+        status |= APU_STATUS_DMC_IRQ;
+
+    _frame_IRQ = false;
+    return status;
+}
+
+void APU::WriteRegister(uint16_t address, uint8_t data)
+{
+    switch (address)
+    {
+    case 0x4000:
+    case 0x4004:
+    {
+        Pulse& pulse = _pulse[(address >> 2) & 0x01];
+        pulse.duty = data >> 6;
+        pulse.envelope.loop = (data & 0x20) != 0;
+        pulse.envelope.constant = (data & 0x10) != 0;
+        pulse.envelope.volume = data & 0x0F;
+        break;
+    }
+    case 0x4001:
+    case 0x4005:
+    {
+        Pulse& pulse = _pulse[(address >> 2) & 0x01];
+        pulse.sweep_enabled = (data & 0x80) != 0;
+        pulse.sweep_period = (data >> 4) & 0x07;
+        pulse.sweep_negate = (data & 0x08) != 0;
+        pulse.sweep_shift = data & 0x07;
+        pulse.sweep_reload = true;
+        break;
+    }
+    case 0x4002:
+    case 0x4006:
+    {
+        Pulse& pulse = _pulse[(address >> 2) & 0x01];
+        pulse.period = (pulse.period & 0x0700) | data;
+        break;
+    }
+    case 0x4003:
+    case 0x4007:
+    {
+        Pulse& pulse = _pulse[(address >> 2) & 0x01];
+        pulse.period = static_cast<uint16_t>((pulse.period & 0x00FF) | ((data & 0x07) << 8));
+        if (pulse.enabled)
+            pulse.length = LENGTH_TABLE[data >> 3];
+        pulse.step = 0;
+        pulse.envelope.start = true;
+        break;
+    }
+    case 0x4008:
+        _triangle.control = (data & 0x80) != 0;
+        _triangle.linear_period = data & 0x7F;
+        break;
+    case 0x400A:
+        _triangle.period = (_triangle.period & 0x0700) | data;
+        break;
+    case 0x400B:
+        _triangle.period = static_cast<uint16_t>((_triangle.period & 0x00FF) | ((data & 0x07) << 8));
+        if (_triangle.enabled)
+            _triangle.length = LENGTH_TABLE[data >> 3];
+        _triangle.linear_reload = true;
+        break;
+    case 0x400C:
+        _noise.envelope.loop = (data & 0x20) != 0;
+        _noise.envelope.constant = (data & 0x10) != 0;
+        _noise.envelope.volume = data & 0x0F;
+        break;
+    case 0x400E:
+        _noise.mode = (data & 0x80) != 0;
+        _noise.period = NOISE_PERIODS[data & 0x0F];
+        break;
+    case 0x400F:
+        if (_noise.enabled)
+            _noise.length = LENGTH_TABLE[data >> 3];
+        _noise.envelope.start = true;
+        break;
+    case 0x4010:
+        _DMC.IRQ_enabled = (data & 0x80) != 0;
+        _DMC.loop = (data & 0x40) != 0;
+        _DMC.period = DMC_PERIODS[data & 0x0F];
+        if (!_DMC.IRQ_enabled)
+            _DMC.IRQ = false;
+        break;
+    case 0x4011:
+        _DMC.level = data & 0x7F;
+        break;
+    case 0x4012:
+        _DMC.sample_address = static_cast<uint16_t>(0xC000 | (data << 6));
+        break;
+    case 0x4013:
+        _DMC.sample_length = static_cast<uint16_t>((data << 4) | 0x01);
+        break;
+    case APU_STATUS:
+        _pulse[0].enabled = (data & 0x01) != 0;
+        _pulse[1].enabled = (data & 0x02) != 0;
+        _triangle.enabled = (data & 0x04) != 0;
+        _noise.enabled = (data & 0x08) != 0;
+
+        if (!_pulse[0].enabled)
+            _pulse[0].length = 0;
+        if (!_pulse[1].enabled)
+            _pulse[1].length = 0;
+        if (!_triangle.enabled)
+            _triangle.length = 0;
+        if (!_noise.enabled)
+            _noise.length = 0;
+
+        _DMC.IRQ = false;
+        if ((data & 0x10) == 0)
+            _DMC.bytes_remaining = 0;
+        else if (_DMC.bytes_remaining == 0)
+        {
+            _DMC.address = _DMC.sample_address;
+            _DMC.bytes_remaining = _DMC.sample_length;
+            FetchDMCSample();
+        }
+        break;
+    case APU_FRAME_COUNTER:
+        // The sequence restarts at once, the real one waits 3 or 4 cycles
+        _five_step = (data & FRAME_COUNTER_5_STEP) != 0;
+        _IRQ_inhibit = (data & FRAME_COUNTER_IRQ_INHIBIT) != 0;
+        _frame_cycle = 0;
+
+        if (_IRQ_inhibit)
+            _frame_IRQ = false;
+
+        if (_five_step)
+        {
+            ClockQuarterFrame();
+            ClockHalfFrame();
+        }
+        break;
+    default:
+        return;
+    }
+
+    UpdateOutput(_time);
+}
+
+void APU::UpdateOutput(uint64_t time)
+{
+    const MixerTables& mixer = GetMixerTables();
+
+    uint32_t pulse = GetPulseOutput(_pulse[0], true) + GetPulseOutput(_pulse[1], false);
+
+    uint32_t noise = 0;
+    if (_noise.length > 0 && (_noise.shift & 0x01) == 0)
+        noise = _noise.envelope.GetVolume();
+
+    uint32_t TND = 3u * TRIANGLE_TABLE[_triangle.step] + 2u * noise + _DMC.level;
+
+    int32_t level = mixer.pulse[pulse] + mixer.TND[TND];
+    if (level == _level)
+        return;
+
+    if (_sample_rate != 0)
+        _blip.AddDelta(static_cast<uint32_t>(time - _frame_start), level - _level);
+
+    _level = level;
+}
+
+bool APU::SetSampleRate(uint32_t sample_rate)
+{
+    if (sample_rate != 0 && !_blip.SetRates(CPU_CLOCK_RATE, sample_rate, sample_rate / 4))
+        return false;
+
+    _sample_rate = sample_rate;
+    _frame_start = _time;
+
+    // The buffer starts from silence, the first delta brings it to the current level
+    _level = 0;
+    UpdateOutput(_time);
+    return true;
+}
+
+void APU::EndFrame()
+{
+    if (_sample_rate == 0)
+        return;
+
+    _blip.EndFrame(static_cast<uint32_t>(_time - _frame_start));
+    _frame_start = _time;
+
+    // Nobody reads the audio, the next frames must still fit
+    if (_blip.GetClocksFree() < 2 * FRAME_COUNTER_5_STEP_LAST)
+        _blip.ReadSamples(nullptr, _blip.GetSamplesAvailable());
+}
@@ -0,0 +1,241 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef APU_h__
+#define APU_h__
+
+#include <cstdint>
+#include "BlipBuffer.h"
+#include "Bus.h"
+#include "Scheduler.h"
+
+/* NTSC timing */
+constexpr double CPU_CLOCK_RATE = 236250000.0 / 11.0 / 12.0;
+constexpr uint32_t FRAME_COUNTER_QUARTER_1 = 7457;
+constexpr uint32_t FRAME_COUNTER_HALF_1 = 14913;
+constexpr uint32_t FRAME_COUNTER_QUARTER_3 = 22371;
+constexpr uint32_t FRAME_COUNTER_4_STEP_LAST = 29829; // Also raises the frame IRQ
+constexpr uint32_t FRAME_COUNTER_5_STEP_LAST = 37281;
+
+constexpr uint32_t DEFAULT_SAMPLE_RATE = 48000;
+
+/* Registers */
+constexpr uint16_t APU_REGISTERS_START = 0x4000;
+constexpr uint16_t APU_STATUS = 0x4015;
+constexpr uint16_t APU_FRAME_COUNTER = 0x4017;
+
+/* $4015 read */
+constexpr uint8_t APU_STATUS_DMC_ACTIVE = 0x10;
+constexpr uint8_t APU_STATUS_FRAME_IRQ = 0x40;
+constexpr uint8_t APU_STATUS_DMC_IRQ = 0x80;
+
+/* $4017 */
+constexpr uint8_t FRAME_COUNTER_IRQ_INHIBIT = 0x40;
+constexpr uint8_t FRAME_COUNTER_5_STEP = 0x80;
+
+// CPU cycles lost to each DMC sample fetch, the real stall is 1 to 4 cycles
+constexpr uint32_t DMC_FETCH_CYCLES = 4;
+
+/** APU
+*  The 2A03 sound generator: two pulses, triangle, noise and DMC channels, their length,
+*  envelope, sweep and linear counters and the frame counter driving them. Timers count
+*  CPU cycles, the pulse ones run at half rate so their periods are doubled.
+*  Channels only produce sound when their output level changes: the mixed level goes into
+*  a BlipBuffer as a delta at the cycle it changed, silence and held notes cost nothing.
+*  The APU is caught up on demand: Run() cuts the time at the frame counter steps, between
+*  them only the channels that can be heard (and a DMC fetching samples) are clocked one
+*  timer period at a time, the others jump to the end in closed form. The result is the
+*  same whatever the calls to Run() are. The CPU side must Run() the APU up to the access
+*  time before touching a register, and again by GetNextEventTime() for the IRQs and the
+*  DMC fetches to happen on time.
+**/
+class APU
+{
+public:
+    // DMC samples are fetched through the bus
+    APU(Bus& bus);
+
+    // Registers and channels to their power on state, the timing is not affected
+    void Reset();
+
+    // Runs every unit up to cycle, in CPU cycles since power on
+    void Run(uint64_t cycle);
+    uint64_t GetTime() const { return _time; }
+
+    // Cycle Run() must reach for the next frame IRQ or DMC fetch to happen, NO_EVENT if none
+    uint64_t GetNextEventTime() const;
+
+    // $4015, reading clears the frame IRQ
+    uint8_t ReadStatus();
+
+    // $4000-$4013, $4015 and $4017, other addresses are ignored
+    void WriteRegister(uint16_t address, uint8_t data);
+
+    // Level triggered IRQ line of the frame counter and the DMC
+    bool IRQAsserted() const { return _frame_IRQ || _DMC.IRQ; }
+
+    // CPU cycles the DMC took since the last call, the CPU loses them
+    uint32_t TakeStallCycles()
+    {
+        uint32_t cycles = _stall_cycles;
+        _stall_cycles = 0;
+        return cycles;
+    }
+
+    /** AUDIO
+    *  Off until SetSampleRate(), 0 turns it off again. EndFrame() after running up to the
+    *  end of each emulated frame makes its samples readable, when the reader falls behind
+    *  the buffer (a quarter of a second) the unread samples are dropped.
+    **/
+    bool SetSampleRate(uint32_t sample_rate);
+    uint32_t GetSampleRate() const { return _sample_rate; }
+    void EndFrame();
+    uint32_t GetSamplesAvailable() const { return _blip.GetSamplesAvailable(); }
+    uint32_t ReadSamples(int16_t* output, uint32_t count) { return _blip.ReadSamples(output, count); }
+
+private:
+    struct Envelope
+    {
+        bool start;
+        bool loop;     // Also halts the length counter
+        bool constant;
+        uint8_t volume; // Constant volume or divider period
+        uint8_t divider;
+        uint8_t decay;
+
+        uint8_t GetVolume() const { return constant ? volume : decay; }
+    };
+
+    struct Pulse
+    {
+        Envelope envelope;
+        bool enabled;
+        uint8_t length;
+        uint8_t duty;
+        uint8_t step;
+        uint16_t period;
+        uint64_t clock; // Cycle of the next timer clock
+
+        bool sweep_enabled;
+        bool sweep_negate;
+        bool sweep_reload;
+        uint8_t sweep_period;
+        uint8_t sweep_shift;
+        uint8_t sweep_divider;
+    };
+
+    struct Triangle
+    {
+        bool enabled;
+        bool control;  // Also halts the length counter
+        uint8_t length;
+        uint8_t step;
+        uint16_t period;
+        uint64_t clock;
+        bool linear_reload;
+        uint8_t linear_period;
+        uint8_t linear;
+    };
+
+    struct Noise
+    {
+        Envelope envelope;
+        bool enabled;
+        bool mode;
+        uint8_t length;
+        uint16_t period;
+        uint64_t clock;
+        uint16_t shift; // 15 bit LFSR
+    };
+
+    struct DMC
+    {
+        bool IRQ_enabled;
+        bool IRQ;
+        bool loop;
+        uint16_t period;
+        uint64_t clock;
+        uint8_t level;
+
+        uint16_t sample_address;
+        uint16_t sample_length;
+        uint16_t address;
+        uint16_t bytes_remaining;
+        uint8_t buffer;
+        bool buffer_full;
+
+        uint8_t shift;
+        uint8_t bits;
+        bool silence;
+    };
+
+    enum class Channel : uint8_t
+    {
+        Pulse1,
+        Pulse2,
+        Triangle,
+        Noise,
+        DMC,
+        None,
+    };
+
+    uint32_t GetNextFrameStep() const;
+    void ClockFrameStep(uint32_t step);
+    void ClockQuarterFrame();
+    void ClockHalfFrame();
+
+    // Channel timer clocks due before end, the frame counter doesn't step in between
+    void RunChannels(uint64_t end);
+
+    static void ClockEnvelope(Envelope& envelope);
+    static void ClockSweep(Pulse& pulse, bool ones_complement);
+    static uint16_t GetSweepTarget(const Pulse& pulse, bool ones_complement);
+    static uint8_t GetPulseOutput(const Pulse& pulse, bool ones_complement);
+    static bool IsPulseAudible(const Pulse& pulse, bool ones_complement);
+    bool IsTriangleRunning() const { return _triangle.length > 0 && _triangle.linear > 0 && _triangle.period >= 2; }
+    bool IsNoiseAudible() const { return _noise.length > 0 && _noise.envelope.GetVolume() > 0; }
+    bool IsDMCIdle() const { return _DMC.silence && !_DMC.buffer_full && _DMC.bytes_remaining == 0; }
+    void ClockNoise();
+    void ClockDMC();
+    void FetchDMCSample();
+
+    // Mixes the channels and adds the change of level to the audio at time
+    void UpdateOutput(uint64_t time);
+
+    Bus& _bus;
+    uint64_t _time; // CPU cycles since power on
+
+    Pulse _pulse[2];
+    Triangle _triangle;
+    Noise _noise;
+    DMC _DMC;
+
+    uint32_t _frame_cycle; // Since the frame counter sequence started
+    bool _five_step;
+    bool _IRQ_inhibit;
+    bool _frame_IRQ;
+    uint32_t _stall_cycles;
+
+    BlipBuffer _blip;
+    uint32_t _sample_rate;
+    uint64_t _frame_start; // Cycle where the current audio frame started
+    int32_t _level;        // Last mixed level
+};
+
+#endif // APU_h__
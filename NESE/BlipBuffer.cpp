@@ -0,0 +1,164 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "BlipBuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+    /** STEP KERNEL
+    *  Blackman windowed sinc centered BLIP_WIDTH / 2 samples after the delta, so samples
+    *  come out with a fixed latency of BLIP_WIDTH / 2. Every phase adds up to exactly
+    *  1 << BLIP_DELTA_BITS, a step reaches the same level wherever it falls in a sample.
+    **/
+    struct StepKernel
+    {
+        int32_t taps[BLIP_PHASES][BLIP_WIDTH];
+
+        StepKernel()
+        {
+            const double PI = 3.14159265358979323846;
+            const double cutoff = 0.92; // Of the Nyquist frequency, the rest is the transition band
+            const double half_width = BLIP_WIDTH / 2;
+
+            for (uint32_t phase = 0; phase < BLIP_PHASES; ++phase)
+            {
+                double weights[BLIP_WIDTH];
+                double total = 0.0;
+
+                for (uint32_t i = 0; i < BLIP_WIDTH; ++i)
+                {
+                    double x = static_cast<double>(i) - half_width - static_cast<double>(phase) / BLIP_PHASES;
+                    double window = std::fabs(x) < half_width ? 0.42 + 0.5 * std::cos(PI * x / half_width) + 0.08 * std::cos(2.0 * PI * x / half_width) : 0.0;
+                    double sinc = x == 0.0 ? 1.0 : std::sin(PI * cutoff * x) / (PI * cutoff * x);
+
+                    weights[i] = window * sinc;
+                    total += weights[i];
+                }
+
+                // The rounding error goes to the biggest tap
+                int32_t sum = 0;
+                uint32_t biggest = 0;
+                for (uint32_t i = 0; i < BLIP_WIDTH; ++i)
+                {
+                    taps[phase][i] = static_cast<int32_t>(std::lround(weights[i] / total * (1 << BLIP_DELTA_BITS)));
+                    sum += taps[phase][i];
+                    if (taps[phase][i] > taps[phase][biggest])
+                        biggest = i;
+                }
+
+                taps[phase][biggest] += (1 << BLIP_DELTA_BITS) - sum;
+            }
+        }
+    };
+
+    const StepKernel& GetStepKernel()
+    {
+        static const StepKernel kernel;
+        return kernel;
+    }
+}
+
+BlipBuffer::BlipBuffer() : _factor(0), _offset(0), _available(0), _capacity(0), _integrator(0)
+{
+    GetStepKernel();
+}
+
+bool BlipBuffer::SetRates(double clock_rate, double sample_rate, uint32_t capacity)
+{
+    if (sample_rate <= 0.0 || sample_rate >= clock_rate || capacity == 0)
+    {
+        std::cerr << "ERROR> Can't resample " << clock_rate << " Hz to " << sample_rate << " Hz.\n";
+        return false;
+    }
+
+    _factor = static_cast<uint64_t>(std::llround(sample_rate / clock_rate * 4294967296.0));
+    _capacity = capacity;
+    _buffer.assign(_capacity + BLIP_WIDTH + 1, 0);
+    Clear();
+    return true;
+}
+
+void BlipBuffer::Clear()
+{
+    _offset = 0;
+    _available = 0;
+    _integrator = 0;
+    std::fill(_buffer.begin(), _buffer.end(), 0);
+}
+
+void BlipBuffer::AddDelta(uint32_t time, int32_t delta)
+{
+    uint64_t position = _offset + time * _factor;
+    uint32_t index = static_cast<uint32_t>(position >> 32);
+    uint32_t phase = static_cast<uint32_t>(position >> (32 - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1);
+
+    // Past the capacity the frame was too long for the buffer, the change is lost
+    if (index > _capacity)
+        return;
+
+    const int32_t* taps = GetStepKernel().taps[phase];
+    int32_t* output = &_buffer[index];
+    for (uint32_t i = 0; i < BLIP_WIDTH; ++i)
+        output[i] += delta * taps[i];
+}
+
+void BlipBuffer::EndFrame(uint32_t time)
+{
+    _offset += time * _factor;
+    _available = std::min(static_cast<uint32_t>(_offset >> 32), _capacity);
+}
+
+uint32_t BlipBuffer::GetClocksFree() const
+{
+    if (_factor == 0)
+        return 0;
+
+    uint64_t end = static_cast<uint64_t>(_capacity) << 32;
+    return _offset < end ? static_cast<uint32_t>(std::min<uint64_t>((end - _offset) / _factor, UINT32_MAX)) : 0;
+}
+
+uint32_t BlipBuffer::ReadSamples(int16_t* output, uint32_t count)
+{
+    count = std::min(count, _available);
+
+    // Integrates the impulses back into steps, slowly pulling the sum towards zero
+    int32_t sum = _integrator;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        sum += _buffer[i];
+        int32_t sample = sum >> BLIP_DELTA_BITS;
+        sum -= sample * (1 << (BLIP_DELTA_BITS - BLIP_BASS_SHIFT));
+
+        if (output)
+            output[i] = static_cast<int16_t>(std::max(-32768, std::min(sample, 32767)));
+    }
+    _integrator = sum;
+
+    // Only the unread samples and the tail of the last delta hold anything
+    uint32_t used = std::min(_available + BLIP_WIDTH + 1, static_cast<uint32_t>(_buffer.size()));
+    std::copy(_buffer.begin() + count, _buffer.begin() + used, _buffer.begin());
+    std::fill(_buffer.begin() + (used - count), _buffer.begin() + used, 0);
+
+    _offset -= static_cast<uint64_t>(count) << 32;
+    _available -= count;
+    return count;
+}
@@ -0,0 +1,71 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BlipBuffer_h__
+#define BlipBuffer_h__
+
+#include <cstdint>
+#include <vector>
+
+/* Band-limited step kernel: BLIP_PHASES fractional positions of BLIP_WIDTH taps each */
+constexpr uint32_t BLIP_PHASE_BITS = 5;
+constexpr uint32_t BLIP_PHASES = 1 << BLIP_PHASE_BITS;
+constexpr uint32_t BLIP_WIDTH = 16;
+constexpr uint32_t BLIP_DELTA_BITS = 15; // Each kernel phase adds up to 1 << BLIP_DELTA_BITS
+constexpr uint32_t BLIP_BASS_SHIFT = 9;  // DC blocker of the output, about 15 Hz at 48 KHz
+
+/** BLIP BUFFER
+*  Turns amplitude changes at clock times into samples at the output rate. A change is
+*  added once as a band-limited impulse spread over BLIP_WIDTH samples and the output is
+*  the running sum of the buffer, so the cost follows the number of changes and not the
+*  number of clocks, and steps faster than the sample rate don't alias back as noise.
+*  Times are clocks since the start of the current frame, EndFrame() makes the samples
+*  of the frame readable and starts the next one where it ended.
+**/
+class BlipBuffer
+{
+public:
+    BlipBuffer();
+
+    // capacity samples can wait to be read, false if the rates are not usable
+    bool SetRates(double clock_rate, double sample_rate, uint32_t capacity);
+    void Clear();
+
+    // The whole frame (and BLIP_WIDTH more samples) must fit in the free capacity
+    void AddDelta(uint32_t time, int32_t delta);
+    void EndFrame(uint32_t time);
+
+    // Clocks of the next frame that still fit in the buffer
+    uint32_t GetClocksFree() const;
+
+    uint32_t GetSamplesAvailable() const { return _available; }
+
+    // Returns the samples written to output, a null output discards them
+    uint32_t ReadSamples(int16_t* output, uint32_t count);
+
+private:
+    uint64_t _factor;  // Samples per clock, 32.32 fixed point
+    uint64_t _offset;  // Start of the frame from the first unread sample, 32.32 fixed point
+    uint32_t _available;
+    uint32_t _capacity;
+    int32_t _integrator;
+    std::vector<int32_t> _buffer;
+};
+
+#endif // BlipBuffer_h__
@@ -0,0 +1,132 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BoundedQueue_h__
+#define BoundedQueue_h__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Keeps the producer and consumer counters on their own cache lines
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+/** BOUNDED QUEUE
+*  Lock-free multi producer multi consumer queue of fixed capacity (D. Vyukov's design).
+*  Every cell carries a sequence number that tells whether it is free for the producer of
+*  a lap or holds the value for the consumer of that lap, so a push or a pop is one
+*  compare and swap on the shared counter and never waits on another thread.
+*  Full and empty are reported, what to do then is up to the caller.
+**/
+template <class T>
+class BoundedQueue
+{
+public:
+    // The capacity is rounded up to a power of two
+    BoundedQueue(size_t capacity) : _enqueue(0), _dequeue(0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+
+        _cells.reset(new Cell[size]);
+        _mask = size - 1;
+
+        for (size_t i = 0; i < size; ++i)
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // False when full
+    bool TryPush(const T& value)
+    {
+        size_t position = _enqueue.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            Cell& cell = _cells[position & _mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t lap = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if (lap == 0)
+            {
+                if (_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (lap < 0)
+                return false; // The consumer of the last lap did not take it yet
+            else
+                position = _enqueue.load(std::memory_order_relaxed);
+        }
+    }
+
+    // False when empty
+    bool TryPop(T& value)
+    {
+        size_t position = _dequeue.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            Cell& cell = _cells[position & _mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t lap = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+            if (lap == 0)
+            {
+                if (_dequeue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(position + _mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (lap < 0)
+                return false;
+            else
+                position = _dequeue.load(std::memory_order_relaxed);
+        }
+    }
+
+    size_t GetCapacity() const { return _mask + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    size_t _mask;
+
+    char _padding_0[CACHE_LINE_SIZE];
+    std::atomic<size_t> _enqueue;
+    char _padding_1[CACHE_LINE_SIZE];
+    std::atomic<size_t> _dequeue;
+    char _padding_2[CACHE_LINE_SIZE];
+};
+
+#endif // BoundedQueue_h__
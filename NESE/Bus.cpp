@@ -22,9 +22,13 @@
 #include <sstream>
 #include <vector>
 
-Bus::Bus()
+Bus::Bus() : _io(nullptr), _cartridge(nullptr)
 {
     _data.resize(MAX_MEMORY, 0);
+
+    // Without a cartridge the whole address space is plain RAM
+    MapRead(0x0000, MAX_MEMORY, _data.data(), MAX_MEMORY);
+    MapWrite(0x0000, MAX_MEMORY, _data.data(), MAX_MEMORY);
 }
 
 Bus::~Bus()
@@ -34,14 +38,87 @@ Bus::~Bus()
 
 const uint8_t Bus::operator[](uint16_t address) const
 {
+    const MemoryPage& page = _pages[address >> CPU_PAGE_SHIFT];
+    if (page.read)
+        return page.read[address & page.mask];
+
     return _data.at(address);
 }
 
 uint8_t& Bus::operator[](uint16_t address)
 {
+    const MemoryPage& page = _pages[address >> CPU_PAGE_SHIFT];
+    if (page.write)
+        return page.write[address & page.mask];
+    if (page.read)
+        return const_cast<uint8_t&>(page.read[address & page.mask]);
+
     return _data.at(address);
 }
 
+void Bus::MapRead(uint16_t address, uint32_t size, const uint8_t* memory, uint32_t memory_size)
+{
+    for (uint32_t offset = 0; offset < size; offset += CPU_PAGE_SIZE)
+    {
+        MemoryPage& page = _pages[(address + offset) >> CPU_PAGE_SHIFT];
+
+        // Each page points to its own slice of the block, or to the whole block when it mirrors
+        page.read = memory ? memory + (offset % std::max(memory_size, CPU_PAGE_SIZE)) : nullptr;
+        if (memory)
+            page.mask = static_cast<uint16_t>(std::min(memory_size, CPU_PAGE_SIZE) - 1);
+    }
+}
+
+void Bus::MapWrite(uint16_t address, uint32_t size, uint8_t* memory, uint32_t memory_size)
+{
+    for (uint32_t offset = 0; offset < size; offset += CPU_PAGE_SIZE)
+    {
+        MemoryPage& page = _pages[(address + offset) >> CPU_PAGE_SHIFT];
+
+        page.write = memory ? memory + (offset % std::max(memory_size, CPU_PAGE_SIZE)) : nullptr;
+        if (memory)
+            page.mask = static_cast<uint16_t>(std::min(memory_size, CPU_PAGE_SIZE) - 1);
+    }
+}
+
+void Bus::ConnectCartridge(IOHandler* cartridge)
+{
+    _cartridge = cartridge;
+
+    // The first bytes of the old flat memory are reused as the internal RAM
+    MapRead(0x0000, CPU_PAGE_SIZE, _data.data(), INTERNAL_RAM_SIZE);
+    MapWrite(0x0000, CPU_PAGE_SIZE, _data.data(), INTERNAL_RAM_SIZE);
+
+    MapRead(CPU_PAGE_SIZE, MAX_MEMORY - CPU_PAGE_SIZE, nullptr);
+    MapWrite(CPU_PAGE_SIZE, MAX_MEMORY - CPU_PAGE_SIZE, nullptr);
+}
+
+void Bus::DisconnectCartridge()
+{
+    _cartridge = nullptr;
+
+    // Registers stay unmapped, only the cartridge space is released
+    MapRead(0x6000, MAX_MEMORY - 0x6000, nullptr);
+    MapWrite(0x6000, MAX_MEMORY - 0x6000, nullptr);
+}
+
+uint8_t Bus::ReadIO(uint16_t address)
+{
+    IOHandler* handler = address < CARTRIDGE_SPACE_START ? _io : _cartridge;
+    if (handler)
+        return handler->ReadIO(address);
+
+    // Open bus, the last byte on the bus is usually the high byte of the address
+    return address >> 8;
+}
+
+void Bus::WriteIO(uint16_t address, uint8_t data)
+{
+    IOHandler* handler = address < CARTRIDGE_SPACE_START ? _io : _cartridge;
+    if (handler)
+        handler->WriteIO(address, data);
+}
+
 bool Bus::LoadFile(std::string filepath)
 {
     std::ifstream fileStream;
@@ -25,17 +25,91 @@
 
 constexpr uint32_t MAX_MEMORY = 1024*64;
 
+/* CPU address map, 8 pages of 8 KB */
+constexpr uint32_t CPU_PAGE_SHIFT = 13;
+constexpr uint32_t CPU_PAGE_SIZE = 1 << CPU_PAGE_SHIFT;
+constexpr uint32_t CPU_PAGE_COUNT = MAX_MEMORY / CPU_PAGE_SIZE;
+
+constexpr uint32_t INTERNAL_RAM_SIZE = 2048;
+constexpr uint16_t CARTRIDGE_SPACE_START = 0x4020;
+
+/** A page of an address map
+*  Accesses go straight to read/write[address & mask], a smaller mask mirrors the memory
+*  over the whole page. A null pointer sends the access to the owner of that address range.
+**/
+struct MemoryPage
+{
+    const uint8_t* read;
+    uint8_t* write;
+    uint16_t mask;
+};
+
+/* Memory mapped registers (PPU, APU, mapper...) */
+class IOHandler
+{
+public:
+    virtual ~IOHandler() {}
+
+    virtual uint8_t ReadIO(uint16_t address) = 0;
+    virtual void WriteIO(uint16_t address, uint8_t data) = 0;
+};
+
 class Bus
 {
 public:
     Bus();
     ~Bus();
 
+    // Direct memory access without side effects, unmapped addresses use a scratch buffer
     const uint8_t operator[](uint16_t address) const;
     uint8_t& operator[](uint16_t address);
 
+    inline uint8_t Read(uint16_t address)
+    {
+        const MemoryPage& page = _pages[address >> CPU_PAGE_SHIFT];
+        if (page.read)
+            return page.read[address & page.mask];
+
+        return ReadIO(address);
+    }
+
+    inline void Write(uint16_t address, uint8_t data)
+    {
+        const MemoryPage& page = _pages[address >> CPU_PAGE_SHIFT];
+        if (page.write)
+            page.write[address & page.mask] = data;
+        else
+            WriteIO(address, data);
+    }
+
+    /** PAGE MAPPING
+    *  address and size must be multiples of CPU_PAGE_SIZE
+    *  memory_size: size of the memory block, smaller blocks get mirrored inside each page
+    *  A null memory unmaps the pages for that kind of access
+    *  The read and write side of a page share the mirroring mask
+    **/
+    void MapRead(uint16_t address, uint32_t size, const uint8_t* memory, uint32_t memory_size = CPU_PAGE_SIZE);
+    void MapWrite(uint16_t address, uint32_t size, uint8_t* memory, uint32_t memory_size = CPU_PAGE_SIZE);
+
+    // Switch from the flat 64 KB memory to the NES layout: internal RAM mirrored on $0000-$1FFF,
+    // registers on $2000-$401F and the cartridge (mapper) owning $4020-$FFFF
+    void ConnectCartridge(IOHandler* cartridge);
+    void DisconnectCartridge();
+
+    void SetIOHandler(IOHandler* io) { _io = io; }
+
+    // Replace the owner of the cartridge space without touching the mapped pages
+    void SetCartridgeHandler(IOHandler* cartridge) { _cartridge = cartridge; }
+
     bool LoadFile(std::string filepath);
 private:
+    uint8_t ReadIO(uint16_t address);
+    void WriteIO(uint16_t address, uint8_t data);
+
+    MemoryPage _pages[CPU_PAGE_COUNT];
+    IOHandler* _io;
+    IOHandler* _cartridge;
+
     std::vector<uint8_t> _data;
 };
 
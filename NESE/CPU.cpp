@@ -24,6 +24,7 @@ CPU::CPU(Bus& mem) : memory(mem)
     IRQ_pending = false;
     NMI_pending = false;
     RESET_pending = false;
+    access_cycle = 0;
     RESET();
 }
 
@@ -34,6 +35,7 @@ uint32_t CPU::Run(uint32_t instructions_to_execute)
     while (instructions_to_execute > 0)
     {
         uint8_t instruction_cycles = 0;
+        access_cycle = 0;
 
         // First handle any pending external interruption
         if (IRQ_pending)
@@ -51,11 +53,14 @@ uint32_t CPU::Run(uint32_t instructions_to_execute)
             else
             {
                 OpcodeHandler op_handler = opcodesHandlers.at(instruction);
+                access_cycle = op_handler.base_cycles - 1;
                 instruction_cycles += op_handler.base_cycles;
                 instruction_cycles += op_handler.callback(this);
             }
         }
 
+        access_cycle = 0;
+
         IRQ_pending = false;
         NMI_pending = false;
         RESET_pending = false;
@@ -69,16 +74,16 @@ uint32_t CPU::Run(uint32_t instructions_to_execute)
 
 uint8_t CPU::GetByteFromPC()
 {
-    uint8_t data = memory[PC];
+    uint8_t data = memory.Read(PC);
     ++PC;
     return data;
 }
 
 uint16_t CPU::GetWordFromPC()
 {
-    uint16_t data = memory[PC];
+    uint16_t data = memory.Read(PC);
     ++PC;
-    data |= static_cast<uint16_t>(memory[PC]) << 8;
+    data |= static_cast<uint16_t>(memory.Read(PC)) << 8;
     ++PC;
 
     return data;
@@ -86,47 +91,47 @@ uint16_t CPU::GetWordFromPC()
 
 uint8_t CPU::GetByteFromAddress(uint16_t address)
 {
-    uint8_t data = memory[address];
+    uint8_t data = memory.Read(address);
     return data;
 }
 
 uint16_t CPU::GetWordFromAddress(uint16_t address)
 {
-    uint16_t data = memory[address];
-    data |= static_cast<uint16_t>(memory[address + 1]) << 8;
+    uint16_t data = memory.Read(address);
+    data |= static_cast<uint16_t>(memory.Read(address + 1)) << 8;
 
     return data;
 }
 
 void CPU::SetByte(uint16_t address, uint8_t data)
 {
-    memory[address] = data;
+    memory.Write(address, data);
 }
 
 void CPU::SetWord(uint16_t address, uint16_t data)
 {
-    memory[address] = data & 0xFF;
-    memory[address + 1] = data >> 8;
+    memory.Write(address, data & 0xFF);
+    memory.Write(address + 1, data >> 8);
 }
 
 void CPU::PushByteToStack(uint8_t data)
 {
-    memory[STACK_VECTOR + SP] = data;
+    memory.Write(STACK_VECTOR + SP, data);
     --SP;
 }
 
 void CPU::PushWordToStack(uint16_t data)
 {
-    memory[STACK_VECTOR + SP] = data >> 8;
+    memory.Write(STACK_VECTOR + SP, data >> 8);
     --SP;
-    memory[STACK_VECTOR + SP] = data & 0xFF;
+    memory.Write(STACK_VECTOR + SP, data & 0xFF);
     --SP;
 }
 
 uint8_t CPU::PullByteFromStack()
 {
     ++SP;
-    uint8_t data = memory[STACK_VECTOR + SP];
+    uint8_t data = memory.Read(STACK_VECTOR + SP);
 
     return data;
 }
@@ -134,9 +139,9 @@ uint8_t CPU::PullByteFromStack()
 uint16_t CPU::PullWordFromStack()
 {
     ++SP;
-    uint16_t data = memory[STACK_VECTOR + SP];
+    uint16_t data = memory.Read(STACK_VECTOR + SP);
     ++SP;
-    data |= static_cast<uint16_t>(memory[STACK_VECTOR + SP]) << 8;
+    data |= static_cast<uint16_t>(memory.Read(STACK_VECTOR + SP)) << 8;
 
     return data;
 }
@@ -209,7 +214,10 @@ uint8_t CPU::GetDataAbsoluteX(uint8_t* extra_cycles, uint16_t* obtained_address)
     uint16_t final_address = base_address + X;
 
     if (extra_cycles && (final_address ^ base_address) >> 8)
+    {
         *extra_cycles = 1;
+        ++access_cycle; // The fixed up address is read one cycle later
+    }
     else if (extra_cycles)
         *extra_cycles = 0;
     if (obtained_address)
@@ -224,7 +232,10 @@ uint8_t CPU::GetDataAbsoluteY(uint8_t* extra_cycles, uint16_t* obtained_address)
     uint16_t final_address = base_address + Y;
 
     if (extra_cycles && (final_address ^ base_address) >> 8)
+    {
         *extra_cycles = 1;
+        ++access_cycle; // The fixed up address is read one cycle later
+    }
     else if (extra_cycles)
         *extra_cycles = 0;
     if (obtained_address)
@@ -255,7 +266,10 @@ uint8_t CPU::GetDataIndirectY(uint8_t* extra_cycles, uint16_t* obtained_address)
     uint16_t final_address = base_address + Y;
 
     if (extra_cycles && (final_address ^ base_address) >> 8)
+    {
         *extra_cycles = 1;
+        ++access_cycle; // The fixed up address is read one cycle later
+    }
     else if (extra_cycles)
         *extra_cycles = 0;
     if (obtained_address)
@@ -1887,7 +1901,9 @@ uint8_t CPU::RESET()
     X = 0;
     Y = 0;
 
+    // IRQs stay masked until the program clears I, the APU frame IRQ is on from power on
     P.Pbyte = 0b00000000;
+    P.Flags.I = 1;
 
     return 8;
 }
@@ -65,6 +65,11 @@ public:
 
     uint32_t Run(uint32_t instructions_to_execute);
 
+    // Cycles from the start of the instruction being executed to its last bus access, the one
+    // where loads and stores touch the I/O registers (read-modify-write ops read 2 cycles earlier).
+    // Counts the page crossing cycle of indexed loads, 0 outside of an instruction.
+    uint32_t GetAccessCycle() const { return access_cycle; }
+
     /* BUS FUNCTIONS */
     uint8_t CPU::GetByteFromPC();
     uint16_t CPU::GetWordFromPC();
@@ -112,6 +117,7 @@ private:
     bool IRQ_pending;
     bool NMI_pending;
     bool RESET_pending;
+    uint8_t access_cycle;
 public:
     void IRQ_Trigger() { if (P.Flags.I == 0) IRQ_pending = true; }
     void NMI_Trigger() { NMI_pending = true; }
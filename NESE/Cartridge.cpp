@@ -21,13 +21,58 @@
 #include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <cstring>
 
-Cartridge::Cartridge(std::string rom_path)
+namespace
 {
+    uint32_t AlignToArena(uint32_t size)
+    {
+        return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    }
+
+    // Anything above this can't come from a real file, and would overflow the region sizes
+    constexpr uint64_t MAX_ROM_REGION_SIZE = UINT32_MAX / 2;
+
+    // NES 2.0 ROM sizes, when the MSB nibble is 0xF the LSB is encoded as EEEEEEMM
+    // and the size in bytes is 2^E * (MM * 2 + 1), otherwise it is a count of units.
+    // False when the encoded size is above MAX_ROM_REGION_SIZE.
+    bool NES20RomSize(uint8_t LSB, uint8_t MSB_nibble, uint32_t unit_size, uint64_t& size)
+    {
+        if (MSB_nibble == 0x0F)
+        {
+            uint8_t exponent = LSB >> 2;
+            uint8_t multiplier = (LSB & 0x03) * 2 + 1;
+
+            // 2^31 alone is already too big, checked first so the shift can't overflow
+            if (exponent > 30)
+                return false;
+
+            size = (uint64_t(1) << exponent) * multiplier;
+        }
+        else
+            size = uint64_t((MSB_nibble << 8) | LSB) * unit_size;
+
+        return size <= MAX_ROM_REGION_SIZE;
+    }
+
+    // NES 2.0 RAM sizes are stored as a shift count, 0 means not present
+    uint32_t NES20RamSize(uint8_t shift_count)
+    {
+        return shift_count == 0 ? 0 : 64u << shift_count;
+    }
+}
+
+Cartridge::Cartridge(std::string rom_path, LoadMode load_mode, uint32_t max_resident_chunks)
+    : detected_format(FormatType::Unk), _arena(nullptr), _arena_size(0)
+{
+    if (load_mode == LoadMode::Lazy)
+    {
+        LoadLazy(rom_path, max_resident_chunks);
+        return;
+    }
+
     std::ifstream file_stream;
-    file_stream.open(rom_path, std::ios::binary | std::ios::ate);
-    std::streamoff file_size = file_stream.tellg();
-    file_stream.seekg(0, std::ios::beg);
+    file_stream.open(rom_path, std::ios::binary);
 
     if (!file_stream.is_open())
     {
@@ -35,74 +80,328 @@ Cartridge::Cartridge(std::string rom_path)
         return;
     }
 
-    // Load header, the struct is already aligned, so no padding risk.
-    file_stream.read((char*)&format_header, sizeof(format_header));
+    std::vector<uint8_t> image(std::istreambuf_iterator<char>(file_stream), {});
+    Load(image.data(), image.size());
+}
 
-    detected_format = FormatType::Unk;
+Cartridge::Cartridge(const std::vector<uint8_t>& rom_image) : detected_format(FormatType::Unk), _arena(nullptr), _arena_size(0)
+{
+    Load(rom_image.data(), rom_image.size());
+}
+
+Cartridge::Cartridge(const uint8_t* rom_image, size_t rom_image_size) : detected_format(FormatType::Unk), _arena(nullptr), _arena_size(0)
+{
+    Load(rom_image, rom_image_size);
+}
+
+Cartridge::Cartridge(const NES_2_0& header, const ArenaLayout& layout, std::unique_ptr<MappedFile> arena_mapping, size_t arena_offset)
+    : detected_format(FormatType::Unk), _arena(nullptr), _arena_size(0)
+{
+    format_header = header;
+
+    ArenaLayout decoded_layout;
+    FormatType format = DecodeHeader(decoded_layout);
+
+    if (format == FormatType::Unk || !(decoded_layout == layout))
+    {
+        std::cerr << "ERROR> The cached cartridge does not match its header.\n";
+        return;
+    }
+
+    if (!arena_mapping || arena_offset % ARENA_ALIGNMENT != 0 || arena_mapping->size() < arena_offset + layout.GetArenaSize())
+    {
+        std::cerr << "ERROR> The cached cartridge arena is truncated.\n";
+        return;
+    }
+
+    _arena_mapping = std::move(arena_mapping);
+    AssignRegions(_arena_mapping->data() + arena_offset, layout);
+    detected_format = format;
+}
+
+Cartridge::~Cartridge()
+{
+
+}
+
+size_t Cartridge::ArenaLayout::GetArenaSize() const
+{
+    return size_t(AlignToArena(trainer_size)) + AlignToArena(PGR_ROM_size) + AlignToArena(CHR_size)
+        + AlignToArena(PGR_RAM_size) + AlignToArena(PGR_NVRAM_size);
+}
+
+bool Cartridge::ArenaLayout::operator==(const ArenaLayout& other) const
+{
+    return trainer_size == other.trainer_size && PGR_ROM_size == other.PGR_ROM_size && CHR_size == other.CHR_size
+        && PGR_RAM_size == other.PGR_RAM_size && PGR_NVRAM_size == other.PGR_NVRAM_size;
+}
+
+Cartridge::ArenaLayout Cartridge::GetArenaLayout() const
+{
+    ArenaLayout layout;
+    layout.trainer_size = Trainer.size();
+    layout.PGR_ROM_size = PGR_ROM.size();
+    layout.CHR_size = CHR_ROM_RAM.size();
+    layout.PGR_RAM_size = PGR_RAM.size();
+    layout.PGR_NVRAM_size = PGR_NVRAM.size();
+
+    return layout;
+}
+
+Cartridge::FormatType Cartridge::DecodeHeader(ArenaLayout& layout)
+{
+    mapper_id = 0;
+    submapper_id = 0;
+    has_battery = false;
+    chr_is_ram = false;
+
+    FormatType format = FormatType::Unk;
 
     if (format_header.ID[0] == 'N' && format_header.ID[1] == 'E' && format_header.ID[2] == 'S' && format_header.ID[3] == 0x1A)
     {
-        detected_format = FormatType::iNES;
+        format = FormatType::iNES;
 
         if ((format_header.Flag_7 & 0x0C) == 0x08)
-            detected_format = FormatType::NES20;
+            format = FormatType::NES20;
     }
 
-    // Load trainer data if present
-    if ((format_header.Flag_6 & 0b00000100) != 0)
-        file_stream.read((char*)Trainer.data(), 512);
+    uint32_t trainer_size = (format_header.Flag_6 & 0b00000100) != 0 ? TRAINER_SIZE : 0;
+    has_battery = (format_header.Flag_6 & 0b00000010) != 0;
+
+    uint64_t PGR_ROM_size = 0;
+    uint64_t CHR_ROM_size = 0;
+    uint32_t PGR_RAM_size = 0;
+    uint32_t PGR_NVRAM_size = 0;
+    uint32_t CHR_RAM_size = 0;
 
-    switch (detected_format)
+    switch (format)
     {
     case Cartridge::FormatType::iNES:
     {
-        uint8_t PGR_16KB_units = format_header.PGR_ROM_LSB | ((format_header.PGR_CHR_ROM_MSB & 0x0F) << 8);
-        uint8_t CHR_8KB_units = format_header.CHR_ROM_LSB;
+        // Old dumping tools wrote garbage ("DiskDude!") from byte 7 onwards,
+        // none of those bytes can be trusted in that case.
+        if (format_header.Timing != 0 || format_header.VS_System != 0 || format_header.Flag_14 != 0 || format_header.Flag_15 != 0)
+            std::memset(&format_header.Flag_7, 0, sizeof(format_header) - offsetof(NES_2_0, Flag_7));
 
-        //When CHR_8KB_units == 0 then it uses CHR RAM instead of ROM
-        if (CHR_8KB_units == 0)
-            CHR_8KB_units = 1;
+        mapper_id = (format_header.Flag_6 >> 4) | (format_header.Flag_7 & 0xF0);
 
-        PGR_ROM.resize(PGR_16KB_units * 16384);
-        file_stream.read((char*)PGR_ROM.data(), PGR_16KB_units * 16384);
+        PGR_ROM_size = uint64_t(format_header.PGR_ROM_LSB) * 16384;
+        CHR_ROM_size = uint64_t(format_header.CHR_ROM_LSB) * 8192;
 
-        CHR_ROM_RAM.resize(CHR_8KB_units * 8192);
-        file_stream.read((char*)CHR_ROM_RAM.data(), CHR_8KB_units * 8192);
+        // Flag_8 is the PRG RAM size in 8 KB units, 0 infers 8 KB for compatibility
+        uint32_t PGR_any_RAM_size = (format_header.Flag_8 == 0 ? 1 : format_header.Flag_8) * 8192;
+        if (has_battery)
+            PGR_NVRAM_size = PGR_any_RAM_size;
+        else
+            PGR_RAM_size = PGR_any_RAM_size;
+
+        //When CHR_ROM_LSB == 0 then it uses CHR RAM instead of ROM
+        if (CHR_ROM_size == 0)
+            CHR_RAM_size = 8192;
 
         break;
     }
     case Cartridge::FormatType::NES20:
     {
-        //@todo: I think this is wrong, need to read more the documentation
-        uint16_t PGR_size = format_header.PGR_ROM_LSB | (format_header.PGR_CHR_ROM_MSB << 8);
-        uint16_t CHR_size = format_header.CHR_ROM_LSB | (format_header.PGR_CHR_ROM_MSB & 0xF0);
+        mapper_id = (format_header.Flag_6 >> 4) | (format_header.Flag_7 & 0xF0) | ((format_header.Flag_8 & 0x0F) << 8);
+        submapper_id = format_header.Flag_8 >> 4;
+
+        if (!NES20RomSize(format_header.PGR_ROM_LSB, format_header.PGR_CHR_ROM_MSB & 0x0F, 16384, PGR_ROM_size)
+            || !NES20RomSize(format_header.CHR_ROM_LSB, format_header.PGR_CHR_ROM_MSB >> 4, 8192, CHR_ROM_size))
+        {
+            std::cerr << "ERROR> The header declares a ROM size no file can hold.\n";
+            return FormatType::Unk;
+        }
 
-        //When CHR_8KB_units == 0 then it uses CHR RAM instead of ROM
-        if (CHR_size == 0)
-            CHR_size = 8192;
+        PGR_RAM_size = NES20RamSize(format_header.PGR_EEPROM_SIZE & 0x0F);
+        PGR_NVRAM_size = NES20RamSize(format_header.PGR_EEPROM_SIZE >> 4);
 
-        PGR_ROM.resize(PGR_size);
-        file_stream.read((char*)PGR_ROM.data(), PGR_size);
+        // CHR RAM and CHR NVRAM share the same window, the mapper decides which half is which
+        CHR_RAM_size = NES20RamSize(format_header.CHR_RAM_SIZE & 0x0F) + NES20RamSize(format_header.CHR_RAM_SIZE >> 4);
 
-        CHR_ROM_RAM.resize(CHR_size);
-        file_stream.read((char*)CHR_ROM_RAM.data(), CHR_size);
+        // A board without CHR ROM nor declared CHR RAM still needs a pattern table
+        if (CHR_ROM_size == 0 && CHR_RAM_size == 0)
+            CHR_RAM_size = 8192;
 
         break;
     }
     default:
+        return FormatType::Unk;
+    }
+
+    // Also keeps the sum against the file size from wrapping and the casts to the region sizes exact
+    if (PGR_ROM_size > MAX_ROM_REGION_SIZE || CHR_ROM_size > MAX_ROM_REGION_SIZE)
+    {
+        std::cerr << "ERROR> The header declares a ROM size no file can hold.\n";
+        return FormatType::Unk;
+    }
+
+    chr_is_ram = CHR_ROM_size == 0;
+
+    layout.trainer_size = trainer_size;
+    layout.PGR_ROM_size = static_cast<uint32_t>(PGR_ROM_size);
+    layout.CHR_size = static_cast<uint32_t>(chr_is_ram ? CHR_RAM_size : CHR_ROM_size);
+    layout.PGR_RAM_size = PGR_RAM_size;
+    layout.PGR_NVRAM_size = PGR_NVRAM_size;
+
+    return format;
+}
+
+bool Cartridge::Load(const uint8_t* image, size_t image_size)
+{
+    detected_format = FormatType::Unk;
+
+    if (image_size < INES_HEADER_SIZE)
+    {
+        std::cerr << "ERROR> The file is too small to be a NES rom.\n";
+        return false;
+    }
+
+    // The struct is already aligned, so no padding risk.
+    std::memcpy(&format_header, image, sizeof(format_header));
+
+    ArenaLayout layout;
+    FormatType format = DecodeHeader(layout);
+
+    if (format == FormatType::Unk)
+    {
         std::cerr << "ERROR> Trying to load unknown format type.\n";
-        exit(1);
-        break;
+        return false;
+    }
+
+    uint64_t rom_data_size = uint64_t(INES_HEADER_SIZE) + layout.trainer_size + layout.PGR_ROM_size + (chr_is_ram ? 0 : layout.CHR_size);
+    if (rom_data_size > image_size)
+    {
+        std::cerr << "ERROR> The rom is truncated, header declares " << rom_data_size
+            << " bytes but the file only has " << image_size << " bytes.\n";
+        return false;
+    }
+
+    AllocateArena(layout);
+
+    const uint8_t* file_data = image + INES_HEADER_SIZE;
+
+    // Load trainer data if present
+    std::memcpy(Trainer.data(), file_data, Trainer.size());
+    file_data += Trainer.size();
+
+    std::memcpy(PGR_ROM.data(), file_data, PGR_ROM.size());
+    file_data += PGR_ROM.size();
+
+    if (!chr_is_ram)
+    {
+        std::memcpy(CHR_ROM_RAM.data(), file_data, CHR_ROM_RAM.size());
+        file_data += CHR_ROM_RAM.size();
     }
 
+    detected_format = format;
+
+    PrintSummary();
+    std::cout << "MISC Size: " << (image + image_size - file_data) << " bytes\n";
+
+    return true;
+}
+
+bool Cartridge::LoadLazy(const std::string& rom_path, uint32_t max_resident_chunks)
+{
+    std::ifstream file_stream(rom_path, std::ios::binary | std::ios::ate);
+
+    if (!file_stream.is_open())
+    {
+        std::cerr << "Cant open the file\n";
+        return false;
+    }
+
+    uint64_t file_size = static_cast<uint64_t>(file_stream.tellg());
+    file_stream.seekg(0);
+
+    if (file_size < INES_HEADER_SIZE || !file_stream.read(reinterpret_cast<char*>(&format_header), sizeof(format_header)))
+    {
+        std::cerr << "ERROR> The file is too small to be a NES rom.\n";
+        return false;
+    }
+
+    ArenaLayout layout;
+    FormatType format = DecodeHeader(layout);
+
+    if (format == FormatType::Unk)
+    {
+        std::cerr << "ERROR> Trying to load unknown format type.\n";
+        return false;
+    }
+
+    uint64_t PGR_file_offset = uint64_t(INES_HEADER_SIZE) + layout.trainer_size;
+    uint64_t CHR_file_offset = PGR_file_offset + layout.PGR_ROM_size;
+    uint32_t CHR_ROM_size = chr_is_ram ? 0 : layout.CHR_size;
+
+    if (CHR_file_offset + CHR_ROM_size > file_size)
+    {
+        std::cerr << "ERROR> The rom is truncated, header declares " << CHR_file_offset + CHR_ROM_size
+            << " bytes but the file only has " << file_size << " bytes.\n";
+        return false;
+    }
+
+    // Only the trainer and the RAM regions live in the arena
+    ArenaLayout arena_layout = layout;
+    arena_layout.PGR_ROM_size = 0;
+    arena_layout.CHR_size = chr_is_ram ? layout.CHR_size : 0;
+    AllocateArena(arena_layout);
+
+    PGR_ROM = CartridgeRegion(nullptr, layout.PGR_ROM_size);
+    if (!chr_is_ram)
+        CHR_ROM_RAM = CartridgeRegion(nullptr, layout.CHR_size);
+
+    file_stream.read(reinterpret_cast<char*>(Trainer.data()), Trainer.size());
+
+    _pager.reset(new RomPager(rom_path, PGR_file_offset, layout.PGR_ROM_size, CHR_file_offset, CHR_ROM_size, max_resident_chunks));
+    if (!_pager->IsOpen())
+        return false;
+
+    detected_format = format;
+
+    PrintSummary();
+    std::cout << "Lazy loading, up to " << _pager->GetMaxResidentChunks() * ROM_PAGER_CHUNK_SIZE << " bytes of rom resident\n";
+
+    return true;
+}
+
+void Cartridge::AllocateArena(const ArenaLayout& layout)
+{
+    // Over allocate so the first region can be moved up to a cache line boundary
+    _arena_storage.reset(new uint8_t[layout.GetArenaSize() + ARENA_ALIGNMENT]());
+
+    uintptr_t raw_address = reinterpret_cast<uintptr_t>(_arena_storage.get());
+    AssignRegions(_arena_storage.get() + ((ARENA_ALIGNMENT - (raw_address % ARENA_ALIGNMENT)) % ARENA_ALIGNMENT), layout);
+}
+
+void Cartridge::PrintSummary() const
+{
     std::cout << "ROM Loaded> " << "Trainer: " << Trainer.size() << " bytes - PGR_ROM: "
         << PGR_ROM.size() << " bytes - CHR_ROM_RAM: " << CHR_ROM_RAM.size() << " bytes - Type: "
         << (detected_format == FormatType::iNES ? "iNES\n" : "NES 2.0\n");
 
-    std::cout << "MISC Size: " << (file_size - sizeof(format_header) - PGR_ROM.size() - CHR_ROM_RAM.size()) << " bytes\n";
+    std::cout << "PGR_RAM: " << PGR_RAM.size() << " bytes - PGR_NVRAM: " << PGR_NVRAM.size()
+        << " bytes - Mapper: " << mapper_id << "\n";
 }
 
-Cartridge::~Cartridge()
+void Cartridge::AssignRegions(uint8_t* arena, const ArenaLayout& layout)
 {
+    _arena = arena;
+    _arena_size = layout.GetArenaSize();
+
+    uint8_t* cursor = _arena;
+
+    Trainer = CartridgeRegion(cursor, layout.trainer_size);
+    cursor += AlignToArena(layout.trainer_size);
+
+    PGR_ROM = CartridgeRegion(cursor, layout.PGR_ROM_size);
+    cursor += AlignToArena(layout.PGR_ROM_size);
+
+    CHR_ROM_RAM = CartridgeRegion(cursor, layout.CHR_size);
+    cursor += AlignToArena(layout.CHR_size);
+
+    PGR_RAM = CartridgeRegion(cursor, layout.PGR_RAM_size);
+    cursor += AlignToArena(layout.PGR_RAM_size);
 
+    PGR_NVRAM = CartridgeRegion(cursor, layout.PGR_NVRAM_size);
 }
@@ -19,15 +19,56 @@
 #ifndef Cartridge_h__
 #define Cartridge_h__
 
+#include <cstdint>
+#include <cstddef>
+#include <memory>
 #include <vector>
 #include <string>
+#include "MappedFile.h"
+#include "RomPager.h"
+
+constexpr uint32_t INES_HEADER_SIZE = 16;
+constexpr uint32_t TRAINER_SIZE = 512;
+
+// Every region inside the cartridge arena starts on its own cache line
+constexpr uint32_t ARENA_ALIGNMENT = 64;
+
+/* A view into one region of the cartridge arena */
+class CartridgeRegion
+{
+public:
+    CartridgeRegion() : _data(nullptr), _size(0) {}
+    CartridgeRegion(uint8_t* data, uint32_t size) : _data(data), _size(size) {}
+
+    uint8_t* data() const { return _data; }
+    uint32_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    uint8_t& operator[](uint32_t offset) const { return _data[offset]; }
+
+private:
+    uint8_t* _data;
+    uint32_t _size;
+};
 
 class Cartridge
 {
 public:
-    Cartridge(std::string rom_path);
+    enum class LoadMode
+    {
+        Eager, // The whole rom is read into the arena
+        Lazy,  // PGR_ROM and CHR ROM are paged in from the file by the RomPager
+    };
+
+    Cartridge(std::string rom_path, LoadMode load_mode = LoadMode::Eager, uint32_t max_resident_chunks = ROM_PAGER_DEFAULT_RESIDENT_CHUNKS);
+    Cartridge(const std::vector<uint8_t>& rom_image);
+    Cartridge(const uint8_t* rom_image, size_t rom_image_size);
     ~Cartridge();
 
+    // The arena is owned by the cartridge, copying it would alias the regions
+    Cartridge(const Cartridge&) = delete;
+    Cartridge& operator=(const Cartridge&) = delete;
+
     struct NES_2_0
     {
         uint8_t ID[4];
@@ -53,9 +94,75 @@ public:
     };
     FormatType detected_format;
 
-    std::vector<uint8_t> Trainer;
-    std::vector<uint8_t> PGR_ROM;
-    std::vector<uint8_t> CHR_ROM_RAM;
+    uint16_t mapper_id;
+    uint8_t submapper_id;
+    bool has_battery;
+    bool chr_is_ram;
+
+    /** CARTRIDGE ARENA
+    *  All the cartridge memory lives in a single allocation, in this order:
+    *  Trainer | PGR_ROM | CHR_ROM_RAM | PGR_RAM | PGR_NVRAM
+    *  Regions are zero sized when the cartridge does not have them.
+    *  PGR_NVRAM is the battery backed (or EEPROM) PRG memory, when the cartridge uses
+    *  CHR NVRAM it is included in CHR_ROM_RAM.
+    *  Lazy cartridges keep the ROM regions out of the arena, they have a size but no data
+    *  and their banks must be requested through GetPager().
+    **/
+    CartridgeRegion Trainer;
+    CartridgeRegion PGR_ROM;
+    CartridgeRegion CHR_ROM_RAM;
+    CartridgeRegion PGR_RAM;
+    CartridgeRegion PGR_NVRAM;
+
+    // Region sizes, enough to rebuild the regions over an existing arena
+    struct ArenaLayout
+    {
+        uint32_t trainer_size;
+        uint32_t PGR_ROM_size;
+        uint32_t CHR_size;
+        uint32_t PGR_RAM_size;
+        uint32_t PGR_NVRAM_size;
+
+        size_t GetArenaSize() const;
+        bool operator==(const ArenaLayout& other) const;
+    };
+
+    /** Adopt an already laid out arena (used by the ROM cache)
+    *  header: normalized header the arena was built from, it must decode to the same layout
+    *  arena_mapping: memory holding the arena, the cartridge keeps it alive
+    **/
+    Cartridge(const NES_2_0& header, const ArenaLayout& layout, std::unique_ptr<MappedFile> arena_mapping, size_t arena_offset);
+
+    bool IsLoaded() const { return detected_format != FormatType::Unk; }
+
+    // Only on lazy cartridges
+    RomPager* GetPager() const { return _pager.get(); }
+
+    uint8_t* GetArena() const { return _arena; }
+    size_t GetArenaSize() const { return _arena_size; }
+    ArenaLayout GetArenaLayout() const;
+
+private:
+    bool Load(const uint8_t* image, size_t image_size);
+    bool LoadLazy(const std::string& rom_path, uint32_t max_resident_chunks);
+
+    // Zeroed arena for the layout, the regions are assigned over it
+    void AllocateArena(const ArenaLayout& layout);
+
+    // Fills the header derived fields and the layout from format_header,
+    // old iNES headers with garbage on the unused bytes are normalized here
+    FormatType DecodeHeader(ArenaLayout& layout);
+
+    void PrintSummary() const;
+
+    // Carve the regions out of the arena, the arena is never reallocated afterwards
+    void AssignRegions(uint8_t* arena, const ArenaLayout& layout);
+
+    std::unique_ptr<uint8_t[]> _arena_storage;
+    std::unique_ptr<MappedFile> _arena_mapping;
+    std::unique_ptr<RomPager> _pager;
+    uint8_t* _arena;
+    size_t _arena_size;
 };
 
 #endif // Cartridge_h__
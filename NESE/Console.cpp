@@ -0,0 +1,53 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Console.h"
+#include <iostream>
+
+#define INSTANTIATE_CONSOLE(id, MapperType) \
+    template class Console<MapperType, ScanlinePPU>; \
+    template class Console<MapperType, DotPPU>;
+NESE_MAPPER_LIST(INSTANTIATE_CONSOLE)
+#undef INSTANTIATE_CONSOLE
+
+template <class PPUType>
+std::unique_ptr<ConsoleBase> CreateConsole(Cartridge& cartridge)
+{
+    std::unique_ptr<ConsoleBase> console;
+
+    switch (cartridge.mapper_id)
+    {
+#define CREATE_CONSOLE(id, MapperType) \
+    case id: console.reset(new Console<MapperType, PPUType>(cartridge)); break;
+    NESE_MAPPER_LIST(CREATE_CONSOLE)
+#undef CREATE_CONSOLE
+    default:
+        std::cerr << "ERROR> Mapper " << cartridge.mapper_id << " is not supported.\n";
+        break;
+    }
+
+    return console;
+}
+
+template std::unique_ptr<ConsoleBase> CreateConsole<ScanlinePPU>(Cartridge& cartridge);
+template std::unique_ptr<ConsoleBase> CreateConsole<DotPPU>(Cartridge& cartridge);
+
+std::unique_ptr<ConsoleBase> CreateConsole(Cartridge& cartridge)
+{
+    return CreateConsole<DefaultPPU>(cartridge);
+}
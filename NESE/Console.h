@@ -0,0 +1,451 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef Console_h__
+#define Console_h__
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "APU.h"
+#include "Bus.h"
+#include "CPU.h"
+#include "Cartridge.h"
+#include "DotPPU.h"
+#include "Mappers.h"
+#include "PPUBus.h"
+#include "RenderPipeline.h"
+#include "ScanlinePPU.h"
+#include "Scheduler.h"
+
+constexpr uint16_t OAM_DMA_ADDRESS = 0x4014;
+constexpr uint32_t OAM_DMA_CYCLES = 513;
+
+// PPU backend of CreateConsole(), the DotPPU build option switches to the dot accurate one
+#ifdef NESE_DOT_PPU
+using DefaultPPU = DotPPU;
+#else
+using DefaultPPU = ScanlinePPU;
+#endif
+
+/* Runtime interface of the emulated system, the only virtual call is per frame */
+class ConsoleBase
+{
+public:
+    ConsoleBase() : _cycles(0), _frame(0), _eager_PPU_sync(false) {}
+    virtual ~ConsoleBase() {}
+
+    virtual void Reset() = 0;
+
+    // Runs until the end of the current frame, returns the CPU cycles executed
+    virtual uint32_t RunFrame() = 0;
+
+    virtual CPU& GetCPU() = 0;
+    virtual Bus& GetBus() = 0;
+    virtual PPUBus& GetPPUBus() = 0;
+    virtual Mapper& GetMapper() = 0;
+
+    // SCREEN_WIDTH x SCREEN_HEIGHT palette indices of the last frame and the emphasis of
+    // each scanline, FrameConverter makes host pixels out of them
+    virtual const uint8_t* GetFramebuffer() const = 0;
+    virtual const uint8_t* GetEmphasis() const = 0;
+
+    // Stops drawing the framebuffer, the emulation stays exactly the same
+    virtual void SetHeadless(bool headless) = 0;
+
+    // Draws only part of the screen, see PPU::SetRegionOfInterest()
+    virtual void SetRegionOfInterest(const RegionOfInterest& region) = 0;
+
+    // Hash of every frame drawn (see PPU::SetFrameHashing()), GetFrameHash() after RunFrame()
+    // is the one of that frame, after WaitForRendering() too with pipelined rendering
+    virtual void SetFrameHashing(bool frame_hashing) = 0;
+    virtual uint64_t GetFrameHash() const = 0;
+
+    // Redraws only what changed (see PPU::SetDirtyTracking()), GetDirtyRects() is what the last
+    // frame drew over, with the same timing as GetFrameHash()
+    virtual void SetDirtyTracking(bool dirty_tracking) = 0;
+    virtual const std::vector<DirtyRect>& GetDirtyRects() const = 0;
+
+    // Draws the frames on a render thread while the CPU runs the next one (see RenderPipeline),
+    // GetFramebuffer() is then the last frame the render thread finished. Scanline PPU only.
+    virtual bool SetPipelinedRendering(bool pipelined) = 0;
+
+    // Blocks until every frame run so far is drawn, returns at once without the pipeline
+    virtual void WaitForRendering() = 0;
+
+    // Mono 16 bit audio of the frames run so far, off until a sample rate is set (see APU)
+    virtual bool SetAudioSampleRate(uint32_t sample_rate) = 0;
+    virtual uint32_t GetAudioSamplesAvailable() const = 0;
+    virtual uint32_t ReadAudio(int16_t* samples, uint32_t count) = 0;
+
+    uint64_t GetCycles() const { return _cycles; }
+    uint64_t GetFrame() const { return _frame; }
+
+    // Runs the PPU and the APU on every instruction instead of on demand, the output is the
+    // same. Only useful to check the lazy synchronization.
+    void SetEagerPPUSync(bool eager) { _eager_PPU_sync = eager; }
+
+#ifdef NESE_MAPPER_TELEMETRY
+    // Dumps the mapper telemetry to std::cerr every frames frames, 0 disables it
+    void SetTelemetryDumpInterval(uint32_t frames) { _telemetry_dump_interval = frames; }
+#endif
+
+protected:
+    uint64_t _cycles; // CPU cycles since power on
+    uint64_t _frame;
+    bool _eager_PPU_sync;
+
+#ifdef NESE_MAPPER_TELEMETRY
+    uint32_t _telemetry_dump_interval = 0;
+#endif
+};
+
+/** CONSOLE
+*  The whole system instantiated for one mapper type and one PPU backend. The mapper is a
+*  member and every call to it is qualified with MapperType, so there is no virtual dispatch
+*  left between the CPU loop and the cartridge, the same goes for the PPU. The console itself owns the register space and the cartridge space
+*  of the bus, mapper register writes reach it through a single IOHandler call.
+*  Devices with timed side effects post them to the scheduler, the CPU runs uninterrupted
+*  until the next event or the end of the frame.
+*  The PPU is caught up lazily, only when the CPU touches its registers or the cartridge
+*  (bank switches change what it fetches), on VBlank for the NMI and at the end of the frame.
+*  Register accesses catch it up to their own bus cycle, not to the start of the instruction.
+*  Everything else the PPU does is invisible to the CPU, so the result is the same as
+*  running it before every instruction. The APU is caught up the same way: on its registers,
+*  at the end of the frame and on the scheduled frame IRQ and DMC fetches, where its IRQ
+*  and the cycles the DMC steals are seen by the next instruction.
+**/
+template <class MapperType, class PPUType = DefaultPPU>
+class Console final : public ConsoleBase, private IOHandler
+{
+public:
+    Console(Cartridge& cartridge) : _cartridge(cartridge), _ppu(_ppu_bus), _mapper(cartridge, _bus, _ppu_bus), _cpu(_bus), _apu(_bus),
+        _headless(false)
+    {
+        _bus.SetIOHandler(this);
+        _bus.SetCartridgeHandler(this);
+        _mapper.AttachScheduler(&_scheduler);
+        Reset();
+    }
+
+    void Reset() override
+    {
+        _scheduler.SetNow(GetDot());
+        _scheduler.Schedule(EventType::PPUVBlank, PPU::GetNextVBlankTime(_ppu.GetTime()));
+        _ppu.Reset();
+        _apu.Run(_cycles);
+        _apu.Reset();
+        ScheduleAPU();
+        _mapper.MapperType::Reset();
+        _cpu.RESET();
+
+        // The render thread starts over from the reset memory
+        if (_pipeline)
+            StartPipeline();
+    }
+
+    uint32_t RunFrame() override
+    {
+        uint64_t frame_end = (_frame + 1) * PPU_DOTS_PER_FRAME;
+        uint64_t start_cycles = _cycles;
+
+        while (GetDot() < frame_end)
+        {
+            // Instructions can schedule events, the next one is checked on every step
+            while (GetDot() < std::min(_scheduler.GetNextEventTime(), frame_end))
+                Step();
+
+            _scheduler.SetNow(GetDot());
+
+            EventType event;
+            while (_scheduler.PopDueEvent(event))
+                HandleEvent(event);
+        }
+
+        _ppu.Run(GetDot());
+        _apu.Run(_cycles);
+        _apu.EndFrame();
+        ++_frame;
+
+        if (_pipeline)
+            _pipeline->EndFrame();
+
+#ifdef NESE_MAPPER_TELEMETRY
+        _mapper.GetTelemetry().EndFrame();
+        if (_telemetry_dump_interval != 0 && _frame % _telemetry_dump_interval == 0)
+            _mapper.GetTelemetry().Dump(std::cerr);
+#endif
+
+        return static_cast<uint32_t>(_cycles - start_cycles);
+    }
+
+    CPU& GetCPU() override { return _cpu; }
+    Bus& GetBus() override { return _bus; }
+    PPUBus& GetPPUBus() override { return _ppu_bus; }
+    Mapper& GetMapper() override { return _mapper; }
+    const uint8_t* GetFramebuffer() const override { return _pipeline ? _pipeline->GetFramebuffer() : _ppu.GetFramebuffer(); }
+    const uint8_t* GetEmphasis() const override { return _pipeline ? _pipeline->GetEmphasis() : _ppu.GetEmphasis(); }
+
+    void SetHeadless(bool headless) override
+    {
+        _headless = headless;
+        _ppu.SetHeadless(_headless || _pipeline);
+    }
+
+    void SetRegionOfInterest(const RegionOfInterest& region) override { _ppu.SetRegionOfInterest(region); }
+
+    void SetFrameHashing(bool frame_hashing) override
+    {
+        _ppu.SetFrameHashing(frame_hashing);
+        if (_pipeline)
+            _pipeline->SetFrameHashing(frame_hashing);
+    }
+
+    uint64_t GetFrameHash() const override { return _pipeline ? _pipeline->GetFrameHash() : _ppu.GetFrameHash(); }
+
+    void SetDirtyTracking(bool dirty_tracking) override
+    {
+        _ppu.SetDirtyTracking(dirty_tracking);
+        if (_pipeline)
+            _pipeline->SetDirtyTracking(dirty_tracking);
+    }
+
+    const std::vector<DirtyRect>& GetDirtyRects() const override { return _pipeline ? _pipeline->GetDirtyRects() : _ppu.GetDirtyRects(); }
+
+    bool SetPipelinedRendering(bool pipelined) override
+    {
+        if (!pipelined)
+        {
+            StopPipeline();
+            return true;
+        }
+
+        // The dot PPU draws pixel by pixel, there are no scanlines to record
+        if (!std::is_same<PPUType, ScanlinePPU>::value)
+        {
+            std::cerr << "ERROR> Pipelined rendering needs the scanline PPU.\n";
+            return false;
+        }
+
+        if (!_pipeline)
+            _pipeline.reset(new RenderPipeline());
+
+        return StartPipeline();
+    }
+
+    void WaitForRendering() override
+    {
+        if (_pipeline)
+            _pipeline->Wait();
+    }
+
+    bool SetAudioSampleRate(uint32_t sample_rate) override
+    {
+        _apu.Run(_cycles);
+        return _apu.SetSampleRate(sample_rate);
+    }
+
+    uint32_t GetAudioSamplesAvailable() const override { return _apu.GetSamplesAvailable(); }
+    uint32_t ReadAudio(int16_t* samples, uint32_t count) override { return _apu.ReadSamples(samples, count); }
+
+    PPUType& GetPPU() { return _ppu; } // Only up to date at the end of a frame
+    APU& GetAPU() { return _apu; } // Only up to date at the end of a frame
+    Scheduler& GetScheduler() { return _scheduler; }
+
+private:
+    uint64_t GetDot() const { return _cycles * PPU_DOTS_PER_CPU_CYCLE; }
+
+    // Time of the bus access being served, _cycles is still the start of its instruction
+    uint64_t GetAccessCycle() const { return _cycles + _cpu.GetAccessCycle(); }
+    uint64_t GetAccessDot() const { return GetAccessCycle() * PPU_DOTS_PER_CPU_CYCLE; }
+
+    bool StartPipeline()
+    {
+        if (!_pipeline->Start(_ppu, _ppu_bus, _cartridge))
+        {
+            StopPipeline();
+            return false;
+        }
+
+        // The emulation side only keeps what the CPU can see
+        _ppu.AttachPipeline(_pipeline.get());
+        _ppu.SetHeadless(true);
+        return true;
+    }
+
+    void StopPipeline()
+    {
+        _ppu.AttachPipeline(nullptr);
+        _ppu.SetHeadless(_headless);
+        _pipeline.reset();
+    }
+
+    void HandleEvent(EventType event)
+    {
+        switch (event)
+        {
+        case EventType::MapperIRQ:
+            _mapper.MapperType::CatchUp();
+            break;
+        case EventType::PPUVBlank:
+            // Raises the NMI taken by the next Step()
+            _ppu.Run(GetDot());
+            _scheduler.Schedule(EventType::PPUVBlank, PPU::GetNextVBlankTime(GetDot()));
+            break;
+        case EventType::APUIRQ:
+            // Raises the IRQ asked by the next Step(), the DMC fetch halts the CPU first
+            _apu.Run(_cycles);
+            _cycles += _apu.TakeStallCycles();
+            ScheduleAPU();
+            break;
+        default:
+            break;
+        }
+    }
+
+    inline void Step()
+    {
+        if (_eager_PPU_sync)
+            _ppu.Run(GetDot());
+
+        // The CPU serves a single interrupt per instruction, NMI first. The IRQ line is
+        // level triggered, it is asked again on the next instruction while the cartridge holds it.
+        if (_ppu.TakeNMI())
+            _cpu.NMI_Trigger();
+        else if (_mapper.MapperType::IRQAsserted() || _apu.IRQAsserted())
+            _cpu.IRQ_Trigger();
+
+#ifdef NESE_MAPPER_TELEMETRY
+        uint16_t PC = _cpu.PC;
+        uint32_t cycles = _cpu.Run(1);
+        _cycles += cycles;
+        _mapper.GetTelemetry().AddCycles(PC, cycles);
+#else
+        _cycles += _cpu.Run(1);
+#endif
+
+        if (_eager_PPU_sync)
+            _apu.Run(_cycles);
+
+        // A $4015 write can start a DMC fetch at once, the CPU pays for it after the write
+        _cycles += _apu.TakeStallCycles();
+    }
+
+    void ScheduleAPU()
+    {
+        uint64_t event = _apu.GetNextEventTime();
+        _scheduler.Schedule(EventType::APUIRQ, event == NO_EVENT ? NO_EVENT : event * PPU_DOTS_PER_CPU_CYCLE);
+    }
+
+    uint8_t ReadIO(uint16_t address) override
+    {
+        _scheduler.SetNow(GetAccessDot());
+
+        if (address >= CARTRIDGE_SPACE_START)
+            return _mapper.MapperType::ReadIO(address);
+
+        if (address >= 0x2000 && address < 0x4000)
+        {
+            _ppu.Run(GetAccessDot());
+            return _ppu.ReadRegister(address);
+        }
+
+        if (address == APU_STATUS)
+        {
+            _apu.Run(GetAccessCycle());
+            return _apu.ReadStatus();
+        }
+
+        return address >> 8;
+    }
+
+    void WriteIO(uint16_t address, uint8_t data) override
+    {
+        _scheduler.SetNow(GetAccessDot());
+
+        if (address >= 0x8000)
+        {
+            // The PPU renders with the old banks up to the write
+            _ppu.Run(GetAccessDot());
+            _mapper.MapperType::WriteRegister(address, data);
+        }
+        else if (address >= 0x2000 && address < 0x4000)
+            WritePPURegister(address, data);
+        else if (address == OAM_DMA_ADDRESS)
+            OAMDMA(data);
+        else if (address <= APU_FRAME_COUNTER)
+        {
+            _apu.Run(GetAccessCycle());
+            _apu.WriteRegister(address, data);
+            ScheduleAPU();
+        }
+    }
+
+    void WritePPURegister(uint16_t address, uint8_t data)
+    {
+        _ppu.Run(GetAccessDot());
+        _ppu.WriteRegister(address, data);
+
+        // Pattern table selection and rendering decide when the cartridge sees A12 rise
+        if ((address & 0x07) <= 1)
+            _mapper.MapperType::PPUConfigurationChanged(_ppu.GetControl(), _ppu.GetMask());
+    }
+
+    void OAMDMA(uint8_t page)
+    {
+        uint8_t data[OAM_SIZE];
+        for (uint32_t i = 0; i < OAM_SIZE; ++i)
+            data[i] = _bus.Read(static_cast<uint16_t>((page << 8) | i));
+
+        _ppu.Run(GetAccessDot());
+        _ppu.WriteOAMDMA(data);
+
+        // The CPU is halted for the transfer, one more cycle when it starts on an odd cycle
+        _cycles += OAM_DMA_CYCLES + (_cycles & 0x01);
+    }
+
+    Cartridge& _cartridge;
+    Bus _bus;
+    PPUBus _ppu_bus;
+    PPUType _ppu;
+    Scheduler _scheduler;
+    MapperType _mapper;
+    CPU _cpu;
+    APU _apu;
+
+    std::unique_ptr<RenderPipeline> _pipeline; // Only with pipelined rendering
+    bool _headless;
+};
+
+// Instantiated once in Console.cpp
+#define DECLARE_CONSOLE(id, MapperType) \
+    extern template class Console<MapperType, ScanlinePPU>; \
+    extern template class Console<MapperType, DotPPU>;
+NESE_MAPPER_LIST(DECLARE_CONSOLE)
+#undef DECLARE_CONSOLE
+
+// Picks the console instantiation for the mapper on the cartridge header, nullptr when not supported
+template <class PPUType>
+std::unique_ptr<ConsoleBase> CreateConsole(Cartridge& cartridge);
+
+std::unique_ptr<ConsoleBase> CreateConsole(Cartridge& cartridge);
+
+#endif // Console_h__
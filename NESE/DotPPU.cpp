@@ -0,0 +1,268 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "DotPPU.h"
+
+DotPPU::DotPPU(PPUBus& ppu_bus) : PPU(ppu_bus), _scanline(0), _dot(0)
+{
+    Reset();
+}
+
+void DotPPU::Reset()
+{
+    PPU::Reset();
+
+    _next_tile = 0;
+    _next_palette = 0;
+    _next_low = 0;
+    _next_high = 0;
+
+    _pattern_low = 0;
+    _pattern_high = 0;
+    _palette_low = 0;
+    _palette_high = 0;
+
+    _sprite_count = 0;
+    _next_sprite_count = 0;
+}
+
+void DotPPU::Run(uint64_t time)
+{
+    while (_time < time)
+    {
+        ++_time;
+
+        if (++_dot == PPU_DOTS_PER_SCANLINE)
+        {
+            _dot = 0;
+            if (++_scanline == PPU_SCANLINES_PER_FRAME)
+                _scanline = 0;
+        }
+
+        Tick();
+    }
+}
+
+void DotPPU::Tick()
+{
+    uint32_t scanline = _scanline;
+    uint32_t dot = _dot;
+
+    if (scanline == PPU_VBLANK_SCANLINE && dot == 1)
+    {
+        StartVBlank();
+        return;
+    }
+
+    bool prerender = scanline == PPU_PRERENDER_SCANLINE;
+    if (scanline >= PPU_VISIBLE_SCANLINES && !prerender)
+        return;
+
+    if (prerender && dot == 1)
+        StartPrerender();
+
+    if (IsRenderingEnabled())
+    {
+        // The shifters move on every fetch dot, one dot behind the fetches
+        if ((dot >= 2 && dot <= 257) || (dot >= 322 && dot <= 337))
+        {
+            _pattern_low <<= 1;
+            _pattern_high <<= 1;
+            _palette_low <<= 1;
+            _palette_high <<= 1;
+        }
+
+        if ((dot >= 1 && dot <= 257) || (dot >= 321 && dot <= 337))
+            FetchBackground(dot);
+
+        if (dot == 256)
+            IncrementY();
+        else if (dot == 257)
+        {
+            CopyHorizontal();
+
+            // Nothing is drawn on the line after the pre-render scanline from its evaluation
+            if (prerender)
+                _next_sprite_count = 0;
+            else
+                EvaluateSprites(scanline + 1);
+        }
+        else if (prerender && dot >= 280 && dot <= 304)
+            CopyVertical();
+    }
+    else if (dot == 257)
+        _next_sprite_count = 0;
+
+    if (!prerender && dot >= 1 && dot <= SCREEN_WIDTH)
+    {
+        OutputPixel(scanline, dot - 1);
+        if (dot == SCREEN_WIDTH)
+            HashScanline(scanline);
+    }
+
+    if (dot == PPU_DOTS_PER_SCANLINE - 1)
+    {
+        for (uint32_t i = 0; i < _next_sprite_count; ++i)
+            _sprites[i] = _next_sprites[i];
+        _sprite_count = _next_sprite_count;
+    }
+}
+
+void DotPPU::FetchBackground(uint32_t dot)
+{
+    // Each fetch takes two dots, the tile is complete on the 8th dot of the group
+    switch ((dot - 1) & 0x07)
+    {
+    case 0:
+        LoadShifters();
+        _next_tile = _ppu_bus.Read(NAMETABLES_START | (_v & 0x0FFF));
+        break;
+    case 2:
+    {
+        uint8_t attribute = _ppu_bus.Read(0x23C0 | (_v & 0x0C00) | ((_v >> 4) & 0x38) | ((_v >> 2) & 0x07));
+        _next_palette = (attribute >> (((_v >> 4) & 0x04) | (_v & 0x02))) & 0x03;
+        break;
+    }
+    case 4:
+    case 6:
+    {
+        uint16_t pattern_base = (_control & PPUCTRL_BACKGROUND_TABLE) != 0 ? 0x1000 : 0x0000;
+        uint16_t pattern = static_cast<uint16_t>(pattern_base + _next_tile * 16 + ((_v >> 12) & 0x07));
+        if ((dot & 0x07) == 5)
+            _next_low = _ppu_bus.Read(pattern);
+        else
+            _next_high = _ppu_bus.Read(pattern + 8);
+        break;
+    }
+    case 7:
+        IncrementCoarseX();
+        break;
+    default:
+        break;
+    }
+}
+
+void DotPPU::LoadShifters()
+{
+    _pattern_low = (_pattern_low & 0xFF00) | _next_low;
+    _pattern_high = (_pattern_high & 0xFF00) | _next_high;
+    _palette_low = (_palette_low & 0xFF00) | ((_next_palette & 0x01) != 0 ? 0xFF : 0x00);
+    _palette_high = (_palette_high & 0xFF00) | ((_next_palette & 0x02) != 0 ? 0xFF : 0x00);
+}
+
+void DotPPU::EvaluateSprites(uint32_t scanline)
+{
+    uint32_t height = GetSpriteHeight();
+    _next_sprite_count = 0;
+
+    for (uint32_t sprite = 0; sprite < 64; ++sprite)
+    {
+        const uint8_t* entry = OAM + sprite * 4;
+
+        // Sprites are drawn one scanline below their Y
+        uint32_t row = scanline - (entry[0] + 1u);
+        if (row >= height)
+            continue;
+
+        // The evaluation stops looking after the 9th sprite
+        if (_next_sprite_count == MAX_SPRITES_PER_SCANLINE)
+        {
+            _status |= PPUSTATUS_SPRITE_OVERFLOW;
+            break;
+        }
+
+        LineSprite& line_sprite = _next_sprites[_next_sprite_count++];
+        line_sprite.x = entry[3];
+        line_sprite.attributes = entry[2];
+        line_sprite.sprite_zero = sprite == 0;
+        FetchSpriteRow(entry, row, line_sprite.low, line_sprite.high);
+    }
+}
+
+void DotPPU::OutputPixel(uint32_t scanline, uint32_t x)
+{
+    if (x == 0 && !_headless && IsScanlineOfInterest(scanline))
+        _emphasis[scanline] = _mask >> PPUMASK_EMPHASIS_SHIFT;
+
+    // Without a framebuffer only sprite 0 hit is left to find, sprite 0 is always the first
+    if (_headless || !IsPixelOfInterest(x, scanline))
+    {
+        if (_sprite_count != 0 && _sprites[0].sprite_zero && x != 255 && (_mask & PPUMASK_SHOW_SPRITES) != 0 &&
+            (x >= 8 || (_mask & PPUMASK_SPRITES_LEFT) != 0) && GetSpriteColor(_sprites[0], x) != 0 && GetBackgroundPixel(x) != 0)
+            _status |= PPUSTATUS_SPRITE_ZERO_HIT;
+        return;
+    }
+
+    uint8_t& pixel = _framebuffer[scanline * SCREEN_WIDTH + x];
+    if (!IsRenderingEnabled())
+    {
+        pixel = GetBackdropColor();
+        return;
+    }
+
+    uint8_t background = GetBackgroundPixel(x);
+
+    uint8_t sprite = 0;
+    if ((_mask & PPUMASK_SHOW_SPRITES) != 0 && (x >= 8 || (_mask & PPUMASK_SPRITES_LEFT) != 0))
+    {
+        for (uint32_t i = 0; i < _sprite_count; ++i)
+        {
+            const LineSprite& line_sprite = _sprites[i];
+            uint8_t color = GetSpriteColor(line_sprite, x);
+            if (color == 0)
+                continue;
+
+            // Both layers are shown and unclipped here once the background is opaque
+            if (line_sprite.sprite_zero && background != 0 && x != 255)
+                _status |= PPUSTATUS_SPRITE_ZERO_HIT;
+
+            // Lower OAM entries win
+            sprite = static_cast<uint8_t>(0x10 | (line_sprite.attributes & SPRITE_PALETTE) << 2 | color | (line_sprite.attributes & SPRITE_BEHIND_BACKGROUND));
+            break;
+        }
+    }
+
+    uint8_t index = background;
+    if (sprite != 0 && (background == 0 || (sprite & SPRITE_BEHIND_BACKGROUND) == 0))
+        index = sprite & 0x1F;
+
+    pixel = _palette[index] & GetColorMask();
+}
+
+uint8_t DotPPU::GetBackgroundPixel(uint32_t x) const
+{
+    if ((_mask & PPUMASK_SHOW_BACKGROUND) == 0 || (x < 8 && (_mask & PPUMASK_BACKGROUND_LEFT) == 0))
+        return 0;
+
+    uint16_t bit = 0x8000 >> _fine_x;
+    uint8_t color = ((_pattern_low & bit) != 0 ? 0x01 : 0x00) | ((_pattern_high & bit) != 0 ? 0x02 : 0x00);
+    if (color == 0)
+        return 0;
+
+    return color | ((_palette_low & bit) != 0 ? 0x04 : 0x00) | ((_palette_high & bit) != 0 ? 0x08 : 0x00);
+}
+
+uint8_t DotPPU::GetSpriteColor(const LineSprite& line_sprite, uint32_t x) const
+{
+    uint32_t column = x - line_sprite.x;
+    if (column >= 8)
+        return 0;
+
+    return ((line_sprite.low >> (7 - column)) & 0x01) | (((line_sprite.high >> (7 - column)) & 0x01) << 1);
+}
@@ -0,0 +1,87 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DotPPU_h__
+#define DotPPU_h__
+
+#include <cstdint>
+#include "PPU.h"
+
+/** DOT PPU
+*  Steps the PPU one dot at a time following the real fetch pattern: the background goes
+*  through the nametable/attribute/pattern fetches of each 8 dot group into the 16 bit
+*  shift registers, and every pixel is composed on its own dot. Register accesses land on
+*  the CPU cycle of the bus access, so with a 3 dot granularity, sprite 0 hit is set on the
+*  exact dot. Sprites for the next scanline are evaluated and fetched at once on dot 257
+*  instead of over dots 65-320, the odd frame skipped dot is not emulated.
+*  Much slower than ScanlinePPU, it is the reference for games with mid-scanline effects.
+**/
+class DotPPU final : public PPU
+{
+public:
+    DotPPU(PPUBus& ppu_bus);
+
+    void Reset();
+
+    // Advances to time, in PPU dots since power on
+    void Run(uint64_t time);
+
+private:
+    struct LineSprite
+    {
+        uint8_t x;
+        uint8_t low;
+        uint8_t high;
+        uint8_t attributes;
+        bool sprite_zero;
+    };
+
+    void Tick();
+
+    void FetchBackground(uint32_t dot);
+    void LoadShifters();
+    void EvaluateSprites(uint32_t scanline);
+    void OutputPixel(uint32_t scanline, uint32_t x);
+
+    // palette << 2 | color, 0 when transparent or clipped
+    uint8_t GetBackgroundPixel(uint32_t x) const;
+    uint8_t GetSpriteColor(const LineSprite& line_sprite, uint32_t x) const;
+
+    uint32_t _scanline;
+    uint32_t _dot;
+
+    // Background fetches of the next tile
+    uint8_t _next_tile;
+    uint8_t _next_palette;
+    uint8_t _next_low;
+    uint8_t _next_high;
+
+    // Bit 15 is the pixel on the current dot with fine x 0
+    uint16_t _pattern_low;
+    uint16_t _pattern_high;
+    uint16_t _palette_low;
+    uint16_t _palette_high;
+
+    LineSprite _sprites[MAX_SPRITES_PER_SCANLINE];
+    uint32_t _sprite_count;
+    LineSprite _next_sprites[MAX_SPRITES_PER_SCANLINE];
+    uint32_t _next_sprite_count;
+};
+
+#endif // DotPPU_h__
@@ -0,0 +1,259 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "FrameConverter.h"
+#include "PPU.h"
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSSE3__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// 2C02 colors as R, G, B
+static const uint8_t NTSC_PALETTE[NES_COLORS][3] = {
+    { 0x62, 0x62, 0x62 }, { 0x00, 0x1F, 0xB2 }, { 0x24, 0x04, 0xC8 }, { 0x52, 0x00, 0xB2 },
+    { 0x73, 0x00, 0x76 }, { 0x80, 0x00, 0x24 }, { 0x73, 0x0B, 0x00 }, { 0x52, 0x28, 0x00 },
+    { 0x24, 0x44, 0x00 }, { 0x00, 0x57, 0x00 }, { 0x00, 0x5C, 0x00 }, { 0x00, 0x53, 0x24 },
+    { 0x00, 0x3C, 0x76 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+    { 0xAB, 0xAB, 0xAB }, { 0x0D, 0x57, 0xFF }, { 0x4B, 0x30, 0xFF }, { 0x8A, 0x13, 0xFF },
+    { 0xBC, 0x08, 0xD6 }, { 0xD2, 0x12, 0x69 }, { 0xC7, 0x2E, 0x00 }, { 0x9D, 0x54, 0x00 },
+    { 0x60, 0x7B, 0x00 }, { 0x20, 0x98, 0x00 }, { 0x00, 0xA3, 0x00 }, { 0x00, 0x99, 0x42 },
+    { 0x00, 0x7D, 0xB4 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+    { 0xFF, 0xFF, 0xFF }, { 0x53, 0xAE, 0xFF }, { 0x90, 0x85, 0xFF }, { 0xD3, 0x65, 0xFF },
+    { 0xFF, 0x57, 0xFF }, { 0xFF, 0x5D, 0xCF }, { 0xFF, 0x77, 0x57 }, { 0xFA, 0x9E, 0x00 },
+    { 0xBD, 0xC7, 0x00 }, { 0x7A, 0xE7, 0x00 }, { 0x43, 0xF6, 0x11 }, { 0x26, 0xEF, 0x7E },
+    { 0x2C, 0xD5, 0xF6 }, { 0x4E, 0x4E, 0x4E }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+    { 0xFF, 0xFF, 0xFF }, { 0xB6, 0xE1, 0xFF }, { 0xCE, 0xD1, 0xFF }, { 0xE9, 0xC3, 0xFF },
+    { 0xFF, 0xBC, 0xFF }, { 0xFF, 0xBD, 0xF4 }, { 0xFF, 0xC6, 0xC3 }, { 0xFF, 0xD5, 0x9A },
+    { 0xE9, 0xE6, 0x81 }, { 0xCE, 0xF4, 0x81 }, { 0xB6, 0xFB, 0x9A }, { 0xA9, 0xFA, 0xC3 },
+    { 0xA9, 0xF0, 0xF4 }, { 0xB8, 0xB8, 0xB8 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+};
+
+uint32_t GetBytesPerPixel(PixelFormat format)
+{
+    switch (format)
+    {
+    case PixelFormat::RGBA8888:
+    case PixelFormat::BGRA8888:
+        return 4;
+    case PixelFormat::RGB565:
+        return 2;
+    case PixelFormat::Grayscale:
+    default:
+        return 1;
+    }
+}
+
+FrameConverter::FrameConverter()
+{
+    for (uint32_t emphasis = 0; emphasis < EMPHASIS_COMBINATIONS; ++emphasis)
+    {
+        for (uint32_t index = 0; index < NES_COLORS; ++index)
+        {
+            // Emphasis bits 0-2 are red, green and blue, they darken the other two channels
+            uint32_t channels[3];
+            for (uint32_t channel = 0; channel < 3; ++channel)
+            {
+                channels[channel] = NTSC_PALETTE[index][channel];
+                if (emphasis != 0 && (emphasis & (1 << channel)) == 0)
+                    channels[channel] = channels[channel] * 209 / 256;
+            }
+
+            uint32_t r = channels[0];
+            uint32_t g = channels[1];
+            uint32_t b = channels[2];
+
+            _RGBA[emphasis][index] = 0xFF000000 | b << 16 | g << 8 | r;
+            _BGRA[emphasis][index] = 0xFF000000 | r << 16 | g << 8 | b;
+
+            uint16_t rgb565 = static_cast<uint16_t>((r >> 3) << 11 | (g >> 2) << 5 | (b >> 3));
+            uint8_t rgb565_bytes[2];
+            std::memcpy(rgb565_bytes, &rgb565, sizeof(rgb565));
+            _RGB565_low[emphasis][index] = rgb565_bytes[0];
+            _RGB565_high[emphasis][index] = rgb565_bytes[1];
+            _RGB565[emphasis][index] = rgb565;
+
+            // BT.601 luma
+            _gray[emphasis][index] = static_cast<uint8_t>((r * 77 + g * 150 + b * 29) >> 8);
+        }
+    }
+
+    // The 32 bit tables are written as bytes in memory order
+    uint32_t probe = 1;
+    uint8_t first_byte;
+    std::memcpy(&first_byte, &probe, 1);
+    if (first_byte == 0)
+    {
+        for (uint32_t emphasis = 0; emphasis < EMPHASIS_COMBINATIONS; ++emphasis)
+        {
+            for (uint32_t index = 0; index < NES_COLORS; ++index)
+            {
+                uint32_t& rgba = _RGBA[emphasis][index];
+                uint32_t& bgra = _BGRA[emphasis][index];
+                rgba = (rgba & 0xFF) << 24 | (rgba & 0xFF00) << 8 | (rgba >> 8 & 0xFF00) | rgba >> 24;
+                bgra = (bgra & 0xFF) << 24 | (bgra & 0xFF00) << 8 | (bgra >> 8 & 0xFF00) | bgra >> 24;
+            }
+        }
+    }
+}
+
+void FrameConverter::Convert(const uint8_t* framebuffer, const uint8_t* emphasis, PixelFormat format, uint8_t* destination, size_t pitch) const
+{
+    if (pitch == 0)
+        pitch = SCREEN_WIDTH * GetBytesPerPixel(format);
+
+    for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+        ConvertRow(framebuffer + y * SCREEN_WIDTH, SCREEN_WIDTH, emphasis[y], format, destination + y * pitch);
+}
+
+void FrameConverter::ConvertRow(const uint8_t* indices, uint32_t count, uint8_t emphasis, PixelFormat format, uint8_t* destination) const
+{
+    emphasis &= 0x07;
+
+    switch (format)
+    {
+    case PixelFormat::RGBA8888:
+        ConvertRow32(indices, count, _RGBA[emphasis], destination);
+        break;
+    case PixelFormat::BGRA8888:
+        ConvertRow32(indices, count, _BGRA[emphasis], destination);
+        break;
+    case PixelFormat::RGB565:
+        ConvertRow16(indices, count, emphasis, destination);
+        break;
+    case PixelFormat::Grayscale:
+        ConvertRow8(indices, count, _gray[emphasis], destination);
+        break;
+    }
+}
+
+#if defined(__SSSE3__)
+// 16 lookups in a 64 byte table, one shuffle per 16 entries and the high index bits pick one
+static inline __m128i Lookup64(__m128i indices, const uint8_t* table)
+{
+    __m128i low_bits = _mm_and_si128(indices, _mm_set1_epi8(0x0F));
+    __m128i high_bits = _mm_and_si128(indices, _mm_set1_epi8(0x30));
+    __m128i result = _mm_setzero_si128();
+
+    for (int32_t quarter = 0; quarter < 4; ++quarter)
+    {
+        __m128i entries = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table + quarter * 16));
+        __m128i selected = _mm_cmpeq_epi8(high_bits, _mm_set1_epi8(static_cast<char>(quarter << 4)));
+        result = _mm_or_si128(result, _mm_and_si128(selected, _mm_shuffle_epi8(entries, low_bits)));
+    }
+
+    return result;
+}
+#endif
+
+void FrameConverter::ConvertRow32(const uint8_t* indices, uint32_t count, const uint32_t* table, uint8_t* destination) const
+{
+    uint32_t x = 0;
+
+#if defined(__AVX2__)
+    for (; x + 8 <= count; x += 8)
+    {
+        __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + x));
+        __m256i offsets = _mm256_and_si256(_mm256_cvtepu8_epi32(packed), _mm256_set1_epi32(0x3F));
+        __m256i pixels = _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), offsets, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + x * 4), pixels);
+    }
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+    // No gather, but one store per 4 pixels
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128i pixels = _mm_setr_epi32(static_cast<int>(table[indices[x] & 0x3F]), static_cast<int>(table[indices[x + 1] & 0x3F]),
+            static_cast<int>(table[indices[x + 2] & 0x3F]), static_cast<int>(table[indices[x + 3] & 0x3F]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 4), pixels);
+    }
+#endif
+
+    for (; x < count; ++x)
+        std::memcpy(destination + x * 4, &table[indices[x] & 0x3F], 4);
+}
+
+void FrameConverter::ConvertRow16(const uint8_t* indices, uint32_t count, uint8_t emphasis, uint8_t* destination) const
+{
+    const uint8_t* low = _RGB565_low[emphasis];
+    const uint8_t* high = _RGB565_high[emphasis];
+    uint32_t x = 0;
+
+#if defined(__SSSE3__)
+    for (; x + 16 <= count; x += 16)
+    {
+        __m128i packed = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + x)), _mm_set1_epi8(0x3F));
+        __m128i low_bytes = Lookup64(packed, low);
+        __m128i high_bytes = Lookup64(packed, high);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 2), _mm_unpacklo_epi8(low_bytes, high_bytes));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 2 + 16), _mm_unpackhi_epi8(low_bytes, high_bytes));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    // Without shuffles the words are looked up one by one, but stored 8 at a time
+    const uint16_t* words = _RGB565[emphasis];
+    for (; x + 8 <= count; x += 8)
+    {
+        const uint8_t* group = indices + x;
+        __m128i pixels = _mm_setr_epi16(static_cast<short>(words[group[0] & 0x3F]), static_cast<short>(words[group[1] & 0x3F]),
+            static_cast<short>(words[group[2] & 0x3F]), static_cast<short>(words[group[3] & 0x3F]),
+            static_cast<short>(words[group[4] & 0x3F]), static_cast<short>(words[group[5] & 0x3F]),
+            static_cast<short>(words[group[6] & 0x3F]), static_cast<short>(words[group[7] & 0x3F]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 2), pixels);
+    }
+#endif
+
+    for (; x < count; ++x)
+    {
+        destination[x * 2] = low[indices[x] & 0x3F];
+        destination[x * 2 + 1] = high[indices[x] & 0x3F];
+    }
+}
+
+void FrameConverter::ConvertRow8(const uint8_t* indices, uint32_t count, const uint8_t* table, uint8_t* destination) const
+{
+    uint32_t x = 0;
+
+#if defined(__SSSE3__)
+    for (; x + 16 <= count; x += 16)
+    {
+        __m128i packed = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + x)), _mm_set1_epi8(0x3F));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x), Lookup64(packed, table));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    // Bytes looked up one by one into two 64 bit halves, one store per 16 pixels
+    for (; x + 16 <= count; x += 16)
+    {
+        uint64_t halves[2];
+        for (uint32_t half = 0; half < 2; ++half)
+        {
+            const uint8_t* group = indices + x + half * 8;
+            uint64_t bytes = 0;
+            for (uint32_t i = 0; i < 8; ++i)
+                bytes |= uint64_t(table[group[i] & 0x3F]) << (i * 8);
+            halves[half] = bytes;
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x), _mm_set_epi64x(static_cast<long long>(halves[1]), static_cast<long long>(halves[0])));
+    }
+#endif
+
+    for (; x < count; ++x)
+        destination[x] = table[indices[x] & 0x3F];
+}
@@ -0,0 +1,75 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef FrameConverter_h__
+#define FrameConverter_h__
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint32_t NES_COLORS = 64;
+constexpr uint32_t EMPHASIS_COMBINATIONS = 8;
+
+enum class PixelFormat
+{
+    RGBA8888,   // R, G, B, A bytes
+    BGRA8888,   // B, G, R, A bytes
+    RGB565,     // Native endian 16 bit words
+    Grayscale,  // One luma byte
+};
+
+uint32_t GetBytesPerPixel(PixelFormat format);
+
+/** FRAME CONVERTER
+*  Palette indices (0x00-0x3F) from the PPU framebuffer to pixels of a host format, written
+*  straight into a buffer owned by the caller (a texture upload buffer, an image array...).
+*  The color tables of every format and emphasis are built once, the conversion allocates
+*  nothing. 32 bit formats gather 8 pixels per AVX2 instruction, 8 and 16 bit formats look
+*  up 16 pixels per group of SSSE3 shuffles. The SSE2 baseline reads the tables per pixel
+*  but writes whole 16 byte groups, other targets do everything per pixel.
+**/
+class FrameConverter
+{
+public:
+    FrameConverter();
+
+    // SCREEN_WIDTH x SCREEN_HEIGHT indices with the emphasis bits of each scanline.
+    // Rows of destination are pitch bytes apart, 0 packs them.
+    void Convert(const uint8_t* framebuffer, const uint8_t* emphasis, PixelFormat format, uint8_t* destination, size_t pitch = 0) const;
+
+    // count indices of one row, all with the same emphasis (0-7)
+    void ConvertRow(const uint8_t* indices, uint32_t count, uint8_t emphasis, PixelFormat format, uint8_t* destination) const;
+
+    // 0xAABBGGRR of an index and emphasis, what RGBA8888 writes on a little endian host
+    uint32_t GetColor(uint8_t index, uint8_t emphasis) const { return _RGBA[emphasis & 0x07][index & 0x3F]; }
+
+private:
+    void ConvertRow32(const uint8_t* indices, uint32_t count, const uint32_t* table, uint8_t* destination) const;
+    void ConvertRow16(const uint8_t* indices, uint32_t count, uint8_t emphasis, uint8_t* destination) const;
+    void ConvertRow8(const uint8_t* indices, uint32_t count, const uint8_t* table, uint8_t* destination) const;
+
+    uint32_t _RGBA[EMPHASIS_COMBINATIONS][NES_COLORS];
+    uint32_t _BGRA[EMPHASIS_COMBINATIONS][NES_COLORS];
+    uint8_t _RGB565_low[EMPHASIS_COMBINATIONS][NES_COLORS]; // Split in bytes for the shuffles
+    uint8_t _RGB565_high[EMPHASIS_COMBINATIONS][NES_COLORS];
+    uint16_t _RGB565[EMPHASIS_COMBINATIONS][NES_COLORS]; // Native words for the SSE2 path
+    uint8_t _gray[EMPHASIS_COMBINATIONS][NES_COLORS];
+};
+
+#endif // FrameConverter_h__
@@ -0,0 +1,479 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "FrameDumper.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+// Idle polls of an encoder before it starts sleeping between them
+constexpr uint32_t FRAME_DUMPER_SPINS = 64;
+
+// Stored deflate blocks hold at most 64 KB
+constexpr uint32_t DEFLATE_STORED_BLOCK = 65535;
+
+// NTSC frame rate, 39375000 / 655171 = 60.0988 Hz, with the 8:7 pixel aspect of the PPU
+static const char Y4M_HEADER[] = "YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C444\n";
+static const char Y4M_NTSC_HEADER[] = "YUV4MPEG2 W512 H240 F39375000:655171 Ip A4:7 C444\n";
+static const char Y4M_FRAME[] = "FRAME\n";
+
+static const uint8_t PNG_SIGNATURE[] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+
+static uint32_t CRC32(uint32_t crc, const uint8_t* data, size_t size)
+{
+    struct Table
+    {
+        Table()
+        {
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t value = i;
+                for (uint32_t bit = 0; bit < 8; ++bit)
+                    value = (value & 1) ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+
+                entries[i] = value;
+            }
+        }
+
+        uint32_t entries[256];
+    };
+
+    static const Table table;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+static void AppendBE32(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Chunk length, type and data are already at start, appends the CRC of type and data
+static void EndChunk(std::vector<uint8_t>& out, size_t start)
+{
+    size_t size = out.size() - start - 8;
+    out[start + 0] = static_cast<uint8_t>(size >> 24);
+    out[start + 1] = static_cast<uint8_t>(size >> 16);
+    out[start + 2] = static_cast<uint8_t>(size >> 8);
+    out[start + 3] = static_cast<uint8_t>(size);
+
+    AppendBE32(out, CRC32(0, out.data() + start + 4, size + 4));
+}
+
+static size_t BeginChunk(std::vector<uint8_t>& out, const char* type)
+{
+    size_t start = out.size();
+    AppendBE32(out, 0);
+    out.insert(out.end(), type, type + 4);
+    return start;
+}
+
+/** STORED DEFLATE
+*  zlib stream of uncompressed blocks, the data is cut in blocks as it comes.
+*  The total size is known up front so the last block can be flagged as final.
+**/
+class StoredDeflate
+{
+public:
+    StoredDeflate(std::vector<uint8_t>& out, uint32_t size) : _out(out), _remaining(size), _block_left(0), _s1(1), _s2(0)
+    {
+        _out.push_back(0x78); // 32 KB window, deflate
+        _out.push_back(0x01); // No preset dictionary, fastest
+    }
+
+    void Put(const uint8_t* data, uint32_t size)
+    {
+        while (size > 0)
+        {
+            if (_block_left == 0)
+                BeginBlock();
+
+            uint32_t count = size < _block_left ? size : _block_left;
+            _out.insert(_out.end(), data, data + count);
+
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                _s1 += data[i];
+                _s2 += _s1;
+            }
+
+            // Less than 5552 bytes between reductions can't overflow
+            _s1 %= 65521;
+            _s2 %= 65521;
+
+            data += count;
+            size -= count;
+            _block_left -= count;
+        }
+    }
+
+    void End()
+    {
+        AppendBE32(_out, (_s2 << 16) | _s1);
+    }
+
+private:
+    void BeginBlock()
+    {
+        uint16_t length = static_cast<uint16_t>(_remaining < DEFLATE_STORED_BLOCK ? _remaining : DEFLATE_STORED_BLOCK);
+        _remaining -= length;
+        _block_left = length;
+
+        _out.push_back(_remaining == 0 ? 1 : 0); // BFINAL, BTYPE 00 stored
+        _out.push_back(static_cast<uint8_t>(length));
+        _out.push_back(static_cast<uint8_t>(length >> 8));
+        uint16_t complement = static_cast<uint16_t>(~length);
+        _out.push_back(static_cast<uint8_t>(complement));
+        _out.push_back(static_cast<uint8_t>(complement >> 8));
+    }
+
+    std::vector<uint8_t>& _out;
+    uint32_t _remaining;
+    uint32_t _block_left;
+    uint32_t _s1;
+    uint32_t _s2;
+};
+
+FrameDumper::FrameDumper() : frames_written(0), frames_dropped(0), _format(DumpFormat::Y4M), _backpressure(Backpressure::Drop), _file(nullptr),
+    _closing(false), _failed(false), _submitted(0), _next_write(0)
+{
+    for (uint8_t emphasis = 0; emphasis < EMPHASIS_COMBINATIONS; ++emphasis)
+    {
+        for (uint8_t index = 0; index < NES_COLORS; ++index)
+        {
+            uint32_t color = _converter.GetColor(index, emphasis);
+            double r = color & 0xFF;
+            double g = (color >> 8) & 0xFF;
+            double b = (color >> 16) & 0xFF;
+
+            _YUV[0][emphasis][index] = static_cast<uint8_t>(16.0 + (65.481 * r + 128.553 * g + 24.966 * b) / 255.0 + 0.5);
+            _YUV[1][emphasis][index] = static_cast<uint8_t>(128.0 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255.0 + 0.5);
+            _YUV[2][emphasis][index] = static_cast<uint8_t>(128.0 + (112.0 * r - 93.786 * g - 18.214 * b) / 255.0 + 0.5);
+        }
+    }
+}
+
+FrameDumper::~FrameDumper()
+{
+    Close();
+}
+
+bool FrameDumper::Open(const std::string& path, DumpFormat format, Backpressure backpressure, uint32_t threads, uint32_t buffers)
+{
+    if (IsOpen())
+    {
+        std::cerr << "ERROR> The frame dump is already open.\n";
+        return false;
+    }
+
+    if (threads == 0 || buffers == 0)
+    {
+        std::cerr << "ERROR> A frame dump needs at least one encoder and one buffer.\n";
+        return false;
+    }
+
+    _failed = false;
+
+    if (format == DumpFormat::Y4M)
+    {
+        _file = path == "-" ? stdout : fopen(path.c_str(), "wb");
+        if (!_file)
+        {
+            std::cerr << "ERROR> Can't open " << path << ".\n";
+            return false;
+        }
+
+        const char* header = _NTSC_filter ? Y4M_NTSC_HEADER : Y4M_HEADER;
+        size_t header_size = _NTSC_filter ? sizeof(Y4M_NTSC_HEADER) - 1 : sizeof(Y4M_HEADER) - 1;
+        if (fwrite(header, 1, header_size, _file) != header_size)
+            _failed = true;
+    }
+
+    _path = path;
+    _format = format;
+    _backpressure = backpressure;
+    _submitted = 0;
+    _next_write = 0;
+    _closing = false;
+    frames_written = 0;
+    frames_dropped = 0;
+
+    _frames = std::vector<Frame>(buffers);
+    if (_NTSC_filter)
+    {
+        for (Frame& frame : _frames)
+            frame.filtered.resize(NTSC_WIDTH * SCREEN_HEIGHT * 4);
+    }
+    _free.reset(new BoundedQueue<uint32_t>(buffers));
+    _ready.reset(new BoundedQueue<uint32_t>(buffers));
+
+    for (uint32_t i = 0; i < buffers; ++i)
+        _free->TryPush(i);
+
+    for (uint32_t i = 0; i < threads; ++i)
+        _encoders.emplace_back(&FrameDumper::EncoderLoop, this);
+
+    return true;
+}
+
+void FrameDumper::SetNTSCFilter(bool enabled)
+{
+    if (IsOpen())
+    {
+        std::cerr << "ERROR> The NTSC filter can't change while the frame dump is open.\n";
+        return;
+    }
+
+    // Each encoder filters a whole frame, the frames are already spread over the pool
+    if (enabled && !_NTSC_filter)
+        _NTSC_filter.reset(new NTSCFilter());
+    else if (!enabled)
+        _NTSC_filter.reset();
+}
+
+bool FrameDumper::Submit(const uint8_t* framebuffer, const uint8_t* emphasis)
+{
+    if (!IsOpen())
+        return false;
+
+    uint32_t index;
+    while (!_free->TryPop(index))
+    {
+        if (_backpressure == Backpressure::Drop)
+        {
+            frames_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        std::this_thread::yield();
+    }
+
+    Frame& frame = _frames[index];
+    memcpy(frame.framebuffer, framebuffer, sizeof(frame.framebuffer));
+    memcpy(frame.emphasis, emphasis, sizeof(frame.emphasis));
+    frame.sequence = _submitted++;
+
+    // As many slots as buffers, a buffer taken from the free queue always fits
+    _ready->TryPush(index);
+    return true;
+}
+
+bool FrameDumper::Close()
+{
+    if (!IsOpen())
+        return !_failed;
+
+    _closing.store(true, std::memory_order_release);
+    for (std::thread& encoder : _encoders)
+        encoder.join();
+
+    _encoders.clear();
+
+    if (_file)
+    {
+        if (_file == stdout ? fflush(_file) != 0 : fclose(_file) != 0)
+            _failed = true;
+
+        _file = nullptr;
+    }
+
+    if (_failed)
+        std::cerr << "ERROR> Failed to write the frame dump " << _path << ".\n";
+
+    return !_failed;
+}
+
+void FrameDumper::EncoderLoop()
+{
+    uint32_t idle_polls = 0;
+
+    while (true)
+    {
+        uint32_t index;
+        if (!_ready->TryPop(index))
+        {
+            // Submit runs on the thread that closes, everything queued is visible by now
+            if (_closing.load(std::memory_order_acquire))
+            {
+                if (!_ready->TryPop(index))
+                    break;
+            }
+            else
+            {
+                if (++idle_polls < FRAME_DUMPER_SPINS)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+                continue;
+            }
+        }
+
+        idle_polls = 0;
+        Frame& frame = _frames[index];
+
+        if (_NTSC_filter)
+            _NTSC_filter->FilterRows(frame.framebuffer, frame.emphasis, frame.sequence, 0, SCREEN_HEIGHT, frame.filtered.data());
+
+        bool written;
+        if (_format == DumpFormat::Y4M)
+        {
+            EncodeY4M(frame);
+            written = WriteY4M(frame);
+        }
+        else
+        {
+            EncodePNG(frame);
+            written = WritePNG(frame);
+        }
+
+        if (written)
+            frames_written.fetch_add(1, std::memory_order_relaxed);
+        else
+            _failed = true;
+
+        _free->TryPush(index);
+    }
+}
+
+void FrameDumper::EncodeY4M(Frame& frame) const
+{
+    const uint32_t width = _NTSC_filter ? NTSC_WIDTH : SCREEN_WIDTH;
+    const uint32_t plane_size = width * SCREEN_HEIGHT;
+    const uint32_t header_size = sizeof(Y4M_FRAME) - 1;
+
+    frame.encoded.resize(header_size + 3 * plane_size);
+    memcpy(frame.encoded.data(), Y4M_FRAME, header_size);
+    uint8_t* Y = frame.encoded.data() + header_size;
+
+    if (_NTSC_filter)
+    {
+        // The same BT.601 matrix as the tables, in 8 bit fixed point
+        const uint8_t* RGBA = frame.filtered.data();
+        for (uint32_t i = 0; i < plane_size; ++i)
+        {
+            int32_t r = RGBA[i * 4];
+            int32_t g = RGBA[i * 4 + 1];
+            int32_t b = RGBA[i * 4 + 2];
+
+            Y[i] = static_cast<uint8_t>((66 * r + 129 * g + 25 * b + 128 + (16 << 8)) >> 8);
+            Y[plane_size + i] = static_cast<uint8_t>((-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8);
+            Y[2 * plane_size + i] = static_cast<uint8_t>((112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8);
+        }
+
+        return;
+    }
+
+    for (uint32_t plane = 0; plane < 3; ++plane)
+    {
+        uint8_t* out = Y + plane * plane_size;
+
+        for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+        {
+            const uint8_t* table = _YUV[plane][frame.emphasis[y] & 0x07];
+            const uint8_t* row = frame.framebuffer + y * SCREEN_WIDTH;
+
+            for (uint32_t x = 0; x < SCREEN_WIDTH; ++x)
+                out[x] = table[row[x] & 0x3F];
+
+            out += SCREEN_WIDTH;
+        }
+    }
+}
+
+void FrameDumper::EncodePNG(Frame& frame) const
+{
+    std::vector<uint8_t>& out = frame.encoded;
+    out.clear();
+    out.insert(out.end(), PNG_SIGNATURE, PNG_SIGNATURE + sizeof(PNG_SIGNATURE));
+
+    const uint32_t width = _NTSC_filter ? NTSC_WIDTH : SCREEN_WIDTH;
+
+    size_t chunk = BeginChunk(out, "IHDR");
+    AppendBE32(out, width);
+    AppendBE32(out, SCREEN_HEIGHT);
+    out.push_back(8);   // Bits per channel
+    out.push_back(2);   // RGB
+    out.push_back(0);   // Deflate
+    out.push_back(0);   // Adaptive filtering
+    out.push_back(0);   // No interlace
+    EndChunk(out, chunk);
+
+    // Every row starts with filter type 0
+    chunk = BeginChunk(out, "IDAT");
+    StoredDeflate deflate(out, SCREEN_HEIGHT * (1 + width * 3));
+
+    uint8_t converted[SCREEN_WIDTH * 4];
+    uint8_t row[1 + NTSC_WIDTH * 3];
+    row[0] = 0;
+
+    for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+    {
+        const uint8_t* RGBA = converted;
+        if (_NTSC_filter)
+            RGBA = frame.filtered.data() + y * NTSC_WIDTH * 4;
+        else
+            _converter.ConvertRow(frame.framebuffer + y * SCREEN_WIDTH, SCREEN_WIDTH, frame.emphasis[y], PixelFormat::RGBA8888, converted);
+
+        for (uint32_t x = 0; x < width; ++x)
+            memcpy(row + 1 + x * 3, RGBA + x * 4, 3);
+
+        deflate.Put(row, 1 + width * 3);
+    }
+
+    deflate.End();
+    EndChunk(out, chunk);
+
+    chunk = BeginChunk(out, "IEND");
+    EndChunk(out, chunk);
+}
+
+bool FrameDumper::WritePNG(const Frame& frame) const
+{
+    char number[24];
+    snprintf(number, sizeof(number), "%06llu.png", static_cast<unsigned long long>(frame.sequence));
+
+    std::string path = _path + number;
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool written = fwrite(frame.encoded.data(), 1, frame.encoded.size(), file) == frame.encoded.size();
+    return fclose(file) == 0 && written;
+}
+
+bool FrameDumper::WriteY4M(const Frame& frame)
+{
+    // Encoders pop frames in submission order, the one holding the next frame never waits here
+    std::unique_lock<std::mutex> lock(_write_mutex);
+    _write_turn.wait(lock, [&] { return _next_write == frame.sequence; });
+
+    bool written = fwrite(frame.encoded.data(), 1, frame.encoded.size(), _file) == frame.encoded.size();
+
+    ++_next_write;
+    _write_turn.notify_all();
+    return written;
+}
@@ -0,0 +1,125 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef FrameDumper_h__
+#define FrameDumper_h__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BoundedQueue.h"
+#include "FrameConverter.h"
+#include "NTSCFilter.h"
+#include "PPU.h"
+
+enum class DumpFormat
+{
+    Y4M,    // One raw 4:4:4 stream, "-" writes it to stdout for an external encoder
+    PNG,    // One file per frame, the path is the prefix of the names
+};
+
+// What Submit does when every pooled buffer is still queued or being encoded
+enum class Backpressure
+{
+    Drop,   // Skip the frame, the emulation never waits
+    Block,  // Wait for an encoder, every frame ends in the dump
+};
+
+/** FRAME DUMPER
+*  Hands finished frames from the emulation thread to a pool of encoder threads.
+*  Submit copies the frame into one of a fixed set of buffers and queues its index, the
+*  free and ready buffers travel on two bounded lock-free queues so neither side takes
+*  a lock on the frame path and nothing is allocated after Open. Y4M frames go out in
+*  submission order whichever encoder finishes first, PNG frames are independent files.
+*  PNGs use stored deflate blocks, bigger than a real compressor's but dependency free.
+*  With the NTSC filter on, frames are NTSC_WIDTH wide and filtered by the encoders.
+**/
+class FrameDumper
+{
+public:
+    FrameDumper();
+    ~FrameDumper();
+
+    FrameDumper(const FrameDumper&) = delete;
+    FrameDumper& operator=(const FrameDumper&) = delete;
+
+    // threads encoders share buffers pooled frames, more buffers absorb longer encoder stalls
+    bool Open(const std::string& path, DumpFormat format, Backpressure backpressure, uint32_t threads = 2, uint32_t buffers = 8);
+
+    // Before Open
+    void SetNTSCFilter(bool enabled);
+
+    // Emulation thread, SCREEN_WIDTH x SCREEN_HEIGHT indices with the emphasis of each scanline.
+    // False when the frame was dropped.
+    bool Submit(const uint8_t* framebuffer, const uint8_t* emphasis);
+
+    // Encodes everything submitted and closes the output, false if any write failed
+    bool Close();
+
+    bool IsOpen() const { return !_encoders.empty(); }
+
+    std::atomic<uint64_t> frames_written;
+    std::atomic<uint64_t> frames_dropped;
+
+private:
+    struct Frame
+    {
+        uint8_t framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+        uint8_t emphasis[SCREEN_HEIGHT];
+        uint64_t sequence;
+        std::vector<uint8_t> filtered; // NTSC_WIDTH RGBA rows when the NTSC filter is on
+        std::vector<uint8_t> encoded;  // Keeps its capacity between frames
+    };
+
+    void EncoderLoop();
+    void EncodeY4M(Frame& frame) const;
+    void EncodePNG(Frame& frame) const;
+    bool WritePNG(const Frame& frame) const;
+    bool WriteY4M(const Frame& frame);
+
+    FrameConverter _converter;
+    uint8_t _YUV[3][EMPHASIS_COMBINATIONS][NES_COLORS]; // BT.601 limited range
+    std::unique_ptr<NTSCFilter> _NTSC_filter;
+
+    std::string _path;
+    DumpFormat _format;
+    Backpressure _backpressure;
+    FILE* _file;
+
+    std::vector<Frame> _frames;
+    std::unique_ptr<BoundedQueue<uint32_t>> _free;
+    std::unique_ptr<BoundedQueue<uint32_t>> _ready;
+    std::vector<std::thread> _encoders;
+    std::atomic<bool> _closing;
+    std::atomic<bool> _failed;
+    uint64_t _submitted;
+
+    // Y4M frames wait for their turn to be written
+    std::mutex _write_mutex;
+    std::condition_variable _write_turn;
+    uint64_t _next_write; // Guarded by _write_mutex
+};
+
+#endif // FrameDumper_h__
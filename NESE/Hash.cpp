@@ -0,0 +1,187 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Hash.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t RotateLeft(uint64_t value, uint32_t amount)
+    {
+        return (value << amount) | (value >> (64 - amount));
+    }
+
+    // Unaligned little endian reads, the data comes straight from files
+    inline uint64_t Read64(const uint8_t* data)
+    {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t Read32(const uint8_t* data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    inline uint64_t Round(uint64_t accumulator, uint64_t input)
+    {
+        accumulator += input * PRIME64_2;
+        accumulator = RotateLeft(accumulator, 31);
+        return accumulator * PRIME64_1;
+    }
+
+    inline uint64_t MergeRound(uint64_t accumulator, uint64_t value)
+    {
+        accumulator ^= Round(0, value);
+        return accumulator * PRIME64_1 + PRIME64_4;
+    }
+
+    inline uint64_t MergeAccumulators(const uint64_t* v)
+    {
+        uint64_t hash = RotateLeft(v[0], 1) + RotateLeft(v[1], 7) + RotateLeft(v[2], 12) + RotateLeft(v[3], 18);
+        for (uint32_t i = 0; i < 4; ++i)
+            hash = MergeRound(hash, v[i]);
+
+        return hash;
+    }
+
+    // Remaining bytes after the 32 byte stripes and the final avalanche
+    uint64_t Finalize(uint64_t hash, const uint8_t* cursor, const uint8_t* end)
+    {
+        while (cursor + 8 <= end)
+        {
+            hash ^= Round(0, Read64(cursor));
+            hash = RotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+            cursor += 8;
+        }
+
+        if (cursor + 4 <= end)
+        {
+            hash ^= static_cast<uint64_t>(Read32(cursor)) * PRIME64_1;
+            hash = RotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+            cursor += 4;
+        }
+
+        while (cursor < end)
+        {
+            hash ^= (*cursor) * PRIME64_5;
+            hash = RotateLeft(hash, 11) * PRIME64_1;
+            ++cursor;
+        }
+
+        hash ^= hash >> 33;
+        hash *= PRIME64_2;
+        hash ^= hash >> 29;
+        hash *= PRIME64_3;
+        hash ^= hash >> 32;
+
+        return hash;
+    }
+}
+
+uint64_t XXH64(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* cursor = static_cast<const uint8_t*>(data);
+    const uint8_t* end = cursor + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        const uint8_t* limit = end - 32;
+        uint64_t v[4] = { seed + PRIME64_1 + PRIME64_2, seed + PRIME64_2, seed, seed - PRIME64_1 };
+
+        do
+        {
+            v[0] = Round(v[0], Read64(cursor));
+            v[1] = Round(v[1], Read64(cursor + 8));
+            v[2] = Round(v[2], Read64(cursor + 16));
+            v[3] = Round(v[3], Read64(cursor + 24));
+            cursor += 32;
+        } while (cursor <= limit);
+
+        hash = MergeAccumulators(v);
+    }
+    else
+        hash = seed + PRIME64_5;
+
+    hash += static_cast<uint64_t>(size);
+
+    return Finalize(hash, cursor, end);
+}
+
+void XXH64State::Reset(uint64_t seed)
+{
+    _seed = seed;
+    _total_size = 0;
+    _accumulators[0] = seed + PRIME64_1 + PRIME64_2;
+    _accumulators[1] = seed + PRIME64_2;
+    _accumulators[2] = seed;
+    _accumulators[3] = seed - PRIME64_1;
+    _buffer_size = 0;
+}
+
+void XXH64State::Update(const void* data, size_t size)
+{
+    const uint8_t* cursor = static_cast<const uint8_t*>(data);
+    const uint8_t* end = cursor + size;
+    _total_size += size;
+
+    // Completes the stripe left over by the last update first
+    if (_buffer_size != 0)
+    {
+        size_t fill = std::min(size, sizeof(_buffer) - _buffer_size);
+        std::memcpy(_buffer + _buffer_size, cursor, fill);
+        _buffer_size += static_cast<uint32_t>(fill);
+        cursor += fill;
+
+        if (_buffer_size < sizeof(_buffer))
+            return;
+
+        for (uint32_t i = 0; i < 4; ++i)
+            _accumulators[i] = Round(_accumulators[i], Read64(_buffer + i * 8));
+        _buffer_size = 0;
+    }
+
+    while (end - cursor >= 32)
+    {
+        for (uint32_t i = 0; i < 4; ++i)
+            _accumulators[i] = Round(_accumulators[i], Read64(cursor + i * 8));
+        cursor += 32;
+    }
+
+    std::memcpy(_buffer, cursor, end - cursor);
+    _buffer_size = static_cast<uint32_t>(end - cursor);
+}
+
+uint64_t XXH64State::Digest() const
+{
+    uint64_t hash = _total_size >= 32 ? MergeAccumulators(_accumulators) : _seed + PRIME64_5;
+    hash += _total_size;
+
+    return Finalize(hash, _buffer, _buffer + _buffer_size);
+}
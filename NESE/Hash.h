@@ -0,0 +1,46 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef Hash_h__
+#define Hash_h__
+
+#include <cstdint>
+#include <cstddef>
+
+// xxHash64, fast non cryptographic hash used to identify rom contents
+uint64_t XXH64(const void* data, size_t size, uint64_t seed = 0);
+
+// Streaming XXH64, the digest of data fed in any number of pieces is XXH64() of all of it
+class XXH64State
+{
+public:
+    XXH64State(uint64_t seed = 0) { Reset(seed); }
+
+    void Reset(uint64_t seed = 0);
+    void Update(const void* data, size_t size);
+    uint64_t Digest() const;
+
+private:
+    uint64_t _seed;
+    uint64_t _total_size;
+    uint64_t _accumulators[4];
+    uint8_t _buffer[32]; // Input short of a whole stripe
+    uint32_t _buffer_size;
+};
+
+#endif // Hash_h__
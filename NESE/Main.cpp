@@ -16,12 +16,236 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 #include "Cartridge.h"
+#include "Console.h"
+#include "FrameDumper.h"
+#include "RomCache.h"
+#include "SaveFile.h"
 
-int main()
+// The save sits next to the rom, "game.nes" saves to "game.sav"
+static std::string GetSavePath(const std::string& rom_path)
 {
-    Cartridge test("TestRom.nes");
+    size_t extension = rom_path.find_last_of('.');
+    size_t directory = rom_path.find_last_of("/\\");
+
+    if (extension == std::string::npos || (directory != std::string::npos && extension < directory))
+        return rom_path + ".sav";
+
+    return rom_path.substr(0, extension) + ".sav";
+}
+
+// 16 bit mono PCM header, written again with the real size once the samples are in
+static void WriteWaveHeader(std::ostream& stream, uint32_t sample_rate, uint32_t samples)
+{
+    auto write32 = [&stream](uint32_t value)
+    {
+        for (uint32_t i = 0; i < 4; ++i)
+            stream.put(static_cast<char>(value >> (i * 8)));
+    };
+    auto write16 = [&stream](uint16_t value)
+    {
+        stream.put(static_cast<char>(value));
+        stream.put(static_cast<char>(value >> 8));
+    };
+
+    stream.write("RIFF", 4);
+    write32(36 + samples * 2);
+    stream.write("WAVEfmt ", 8);
+    write32(16);
+    write16(1);
+    write16(1);
+    write32(sample_rate);
+    write32(sample_rate * 2);
+    write16(2);
+    write16(16);
+    stream.write("data", 4);
+    write32(samples * 2);
+}
+
+int main(int argc, char* argv[])
+{
+    std::string rom_path = "TestRom.nes";
+    std::string rom_cache_directory;
+    uint32_t frames = 0;
+    bool lazy_rom = false;
+    bool headless = false;
+    bool pipelined = false;
+    uint32_t telemetry_dump_interval = 0;
+    std::string frame_hashes_path;
+    std::string dump_path;
+    Backpressure dump_backpressure = Backpressure::Block;
+    uint32_t dump_threads = 2;
+    bool dump_NTSC = false;
+    std::string audio_path;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+
+        if (argument == "--rom-cache" && i + 1 < argc)
+            rom_cache_directory = argv[++i];
+        else if (argument == "--lazy-rom")
+            lazy_rom = true;
+        else if (argument == "--headless")
+            headless = true;
+        else if (argument == "--pipelined")
+            pipelined = true;
+        else if (argument == "--telemetry-dump" && i + 1 < argc)
+            telemetry_dump_interval = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--frame-hashes" && i + 1 < argc)
+            frame_hashes_path = argv[++i];
+        else if (argument == "--dump" && i + 1 < argc)
+            dump_path = argv[++i];
+        else if (argument == "--dump-drop")
+            dump_backpressure = Backpressure::Drop;
+        else if (argument == "--ntsc")
+            dump_NTSC = true;
+        else if (argument == "--dump-threads" && i + 1 < argc)
+            dump_threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (argument == "--audio" && i + 1 < argc)
+            audio_path = argv[++i];
+        else if (argument == "--frames" && i + 1 < argc)
+            frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else
+            rom_path = argument;
+    }
+
+    std::unique_ptr<Cartridge> cartridge;
+
+    // A lazy cartridge has no arena to cache, it takes precedence
+    if (lazy_rom)
+        cartridge.reset(new Cartridge(rom_path, Cartridge::LoadMode::Lazy));
+    else if (!rom_cache_directory.empty())
+    {
+        RomCache rom_cache(rom_cache_directory);
+        cartridge = rom_cache.Load(rom_path);
+    }
+    else
+        cartridge.reset(new Cartridge(rom_path));
+
+    if (!cartridge || !cartridge->IsLoaded())
+        return 1;
+
+    // Before the console exists, the mapper maps the battery RAM from the save file
+    SaveFile save_file;
+    if (cartridge->has_battery && !cartridge->PGR_NVRAM.empty())
+        save_file.Attach(*cartridge, GetSavePath(rom_path));
+
+    std::unique_ptr<ConsoleBase> console = CreateConsole(*cartridge);
+    if (!console)
+        return 1;
+
+    // Nothing shows the frames yet, only a dump needs them drawn
+    console->SetHeadless(headless && dump_path.empty());
+
+    // Falls back to drawing on the emulation thread
+    if (pipelined)
+        console->SetPipelinedRendering(true);
+
+#ifdef NESE_MAPPER_TELEMETRY
+    console->SetTelemetryDumpInterval(telemetry_dump_interval);
+#else
+    if (telemetry_dump_interval != 0)
+        std::cerr << "Mapper telemetry is not available, build with NESE_MAPPER_TELEMETRY.\n";
+#endif
+
+    // One line per frame, two runs showed the same video when the files are the same
+    std::ofstream frame_hashes;
+    if (!frame_hashes_path.empty())
+    {
+        frame_hashes.open(frame_hashes_path);
+        if (!frame_hashes)
+        {
+            std::cerr << "ERROR> Can't open " << frame_hashes_path << ".\n";
+            return 1;
+        }
+
+        console->SetFrameHashing(true);
+        frame_hashes << std::hex << std::setfill('0');
+    }
+
+    // "name.y4m" or "-" streams Y4M, anything else is the prefix of a PNG sequence
+    FrameDumper frame_dumper;
+    if (!dump_path.empty())
+    {
+        frame_dumper.SetNTSCFilter(dump_NTSC);
+
+        bool y4m = dump_path == "-" || (dump_path.size() > 4 && dump_path.compare(dump_path.size() - 4, 4, ".y4m") == 0);
+        if (!frame_dumper.Open(dump_path, y4m ? DumpFormat::Y4M : DumpFormat::PNG, dump_backpressure, dump_threads))
+            return 1;
+    }
+
+    // Nothing plays the audio yet, it can be written to a WAV file
+    std::ofstream audio;
+    std::vector<int16_t> samples;
+    uint32_t audio_samples = 0;
+    if (!audio_path.empty())
+    {
+        audio.open(audio_path, std::ios::binary);
+        if (!audio || !console->SetAudioSampleRate(DEFAULT_SAMPLE_RATE))
+        {
+            std::cerr << "ERROR> Can't open " << audio_path << ".\n";
+            return 1;
+        }
+
+        WriteWaveHeader(audio, DEFAULT_SAMPLE_RATE, 0);
+    }
+
+    for (uint32_t i = 0; i < frames; ++i)
+    {
+        console->RunFrame();
+        save_file.Update();
+
+        if (audio.is_open())
+        {
+            samples.resize(console->GetAudioSamplesAvailable());
+            uint32_t count = console->ReadAudio(samples.data(), static_cast<uint32_t>(samples.size()));
+
+            // WAV samples are little endian
+            for (uint32_t j = 0; j < count; ++j)
+            {
+                audio.put(static_cast<char>(samples[j]));
+                audio.put(static_cast<char>(samples[j] >> 8));
+            }
+            audio_samples += count;
+        }
+
+        if (frame_hashes.is_open() || frame_dumper.IsOpen())
+            console->WaitForRendering();
+
+        if (frame_hashes.is_open())
+            frame_hashes << std::setw(16) << console->GetFrameHash() << '\n';
+
+        if (frame_dumper.IsOpen())
+            frame_dumper.Submit(console->GetFramebuffer(), console->GetEmphasis());
+    }
+
+    if (audio.is_open())
+    {
+        audio.seekp(0);
+        WriteWaveHeader(audio, DEFAULT_SAMPLE_RATE, audio_samples);
+        audio.close();
+        if (!audio)
+        {
+            std::cerr << "ERROR> Can't write " << audio_path << ".\n";
+            return 1;
+        }
+    }
+
+    if (frame_dumper.IsOpen())
+    {
+        if (!frame_dumper.Close())
+            return 1;
+
+        if (frame_dumper.frames_dropped != 0)
+            std::cerr << "Dropped " << frame_dumper.frames_dropped << " of " << frames << " frames from the dump.\n";
+    }
 
     return 0;
 }
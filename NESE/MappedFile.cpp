@@ -0,0 +1,151 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "MappedFile.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : _data(nullptr), _size(0), _mode(Mode::ReadOnly)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path, Mode mode, size_t size)
+{
+    Close();
+
+#ifndef _WIN32
+    int fd = mode == Mode::Shared ? open(path.c_str(), O_RDWR | O_CREAT, 0644) : open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t map_size = static_cast<size_t>(file_stat.st_size);
+    if (mode == Mode::Shared && size != 0)
+    {
+        // New bytes read as zero
+        if (map_size < size && ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        map_size = size;
+    }
+
+    if (map_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    int protection = mode == Mode::ReadOnly ? PROT_READ : PROT_READ | PROT_WRITE;
+    int flags = mode == Mode::Shared ? MAP_SHARED : MAP_PRIVATE;
+    void* address = mmap(nullptr, map_size, protection, flags, fd, 0);
+
+    // The mapping keeps its own reference to the file
+    close(fd);
+
+    if (address == MAP_FAILED)
+        return false;
+
+    _data = static_cast<uint8_t*>(address);
+    _size = map_size;
+#else
+    std::ifstream file_stream(path, std::ios::binary);
+    if (file_stream.is_open())
+        _fallback_buffer.assign(std::istreambuf_iterator<char>(file_stream), {});
+    else if (mode != Mode::Shared)
+        return false;
+
+    if (mode == Mode::Shared && size != 0)
+        _fallback_buffer.resize(size, 0);
+
+    if (_fallback_buffer.empty())
+        return false;
+
+    _data = _fallback_buffer.data();
+    _size = _fallback_buffer.size();
+#endif
+
+    _mode = mode;
+    _path = path;
+
+    return true;
+}
+
+bool MappedFile::Sync(size_t offset, size_t length)
+{
+    if (!_data || _mode != Mode::Shared || offset >= _size)
+        return false;
+
+    length = std::min(length, _size - offset);
+
+#ifndef _WIN32
+    // msync wants a page aligned start
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = offset & ~(page_size - 1);
+
+    return msync(_data + start, length + (offset - start), MS_SYNC) == 0;
+#else
+    // Without a real mapping the buffer is written back in place
+    std::fstream file_stream(_path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!file_stream.is_open())
+        file_stream.open(_path, std::ios::binary | std::ios::out | std::ios::trunc);
+
+    file_stream.seekp(static_cast<std::streamoff>(offset));
+    file_stream.write(reinterpret_cast<const char*>(_data + offset), static_cast<std::streamsize>(length));
+    file_stream.flush();
+
+    return file_stream.good();
+#endif
+}
+
+void MappedFile::Close()
+{
+    if (!_data)
+        return;
+
+#ifndef _WIN32
+    munmap(_data, _size);
+#else
+    _fallback_buffer.clear();
+    _fallback_buffer.shrink_to_fit();
+#endif
+
+    _data = nullptr;
+    _size = 0;
+}
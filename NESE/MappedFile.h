@@ -0,0 +1,66 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MappedFile_h__
+#define MappedFile_h__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/** A whole file mapped in memory
+*  On POSIX systems this is a real mmap, elsewhere the file is read into a buffer
+*  so the callers don't need to care about the platform.
+**/
+class MappedFile
+{
+public:
+    enum class Mode
+    {
+        ReadOnly,
+        CopyOnWrite, // Writes stay private to the process, the file is never modified
+        Shared,      // Writes reach the file, it is created or grown to the requested size
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // size: bytes to map in Shared mode, 0 maps the whole file
+    bool Open(const std::string& path, Mode mode, size_t size = 0);
+    void Close();
+
+    // Shared mode only, blocks until [offset, offset + length) is on disk
+    bool Sync(size_t offset, size_t length);
+
+    bool IsOpen() const { return _data != nullptr; }
+    uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+
+private:
+    uint8_t* _data;
+    size_t _size;
+    Mode _mode;
+    std::string _path;
+    std::vector<uint8_t> _fallback_buffer;
+};
+
+#endif // MappedFile_h__
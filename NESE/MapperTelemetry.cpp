@@ -0,0 +1,124 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "MapperTelemetry.h"
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+
+namespace
+{
+    constexpr uint32_t PGR_UNIT_SIZE = CPU_PAGE_SIZE;
+    constexpr uint32_t CHR_UNIT_SIZE = PPU_PAGE_SIZE;
+
+    // Indices of the top entries of values, highest first, zero entries left out
+    std::vector<uint32_t> TopUnits(const std::vector<uint64_t>& values, uint32_t count)
+    {
+        std::vector<uint32_t> units(values.size());
+        std::iota(units.begin(), units.end(), 0);
+
+        units.erase(std::remove_if(units.begin(), units.end(), [&](uint32_t unit) { return values[unit] == 0; }), units.end());
+        std::sort(units.begin(), units.end(), [&](uint32_t a, uint32_t b) { return values[a] > values[b]; });
+
+        if (units.size() > count)
+            units.resize(count);
+
+        return units;
+    }
+}
+
+MapperTelemetry::MapperTelemetry()
+{
+    Reset(0, 0);
+}
+
+void MapperTelemetry::Reset(uint32_t PGR_size, uint32_t CHR_size)
+{
+    _PGR_map_counts.assign((PGR_size + PGR_UNIT_SIZE - 1) / PGR_UNIT_SIZE, 0);
+    _CHR_map_counts.assign((CHR_size + CHR_UNIT_SIZE - 1) / CHR_UNIT_SIZE, 0);
+    _PGR_cycles.assign(_PGR_map_counts.size(), 0);
+    _unbanked_cycles = 0;
+
+    std::fill(std::begin(_cpu_page_units), std::end(_cpu_page_units), -1);
+    std::fill(std::begin(_ppu_page_units), std::end(_ppu_page_units), -1);
+
+    _frame_switches = 0;
+    _last_frame_switches = 0;
+    _max_frame_switches = 0;
+    _total_switches = 0;
+    _frames = 0;
+}
+
+void MapperTelemetry::RecordPGRMap(uint32_t cpu_page, uint32_t rom_offset)
+{
+    int32_t unit = static_cast<int32_t>(rom_offset / PGR_UNIT_SIZE);
+    if (_cpu_page_units[cpu_page] == unit)
+        return;
+
+    _cpu_page_units[cpu_page] = unit;
+    ++_PGR_map_counts[unit];
+    ++_frame_switches;
+}
+
+void MapperTelemetry::RecordCHRMap(uint32_t ppu_page, uint32_t chr_offset)
+{
+    int32_t unit = static_cast<int32_t>(chr_offset / CHR_UNIT_SIZE);
+    if (_ppu_page_units[ppu_page] == unit)
+        return;
+
+    _ppu_page_units[ppu_page] = unit;
+    ++_CHR_map_counts[unit];
+    ++_frame_switches;
+}
+
+void MapperTelemetry::EndFrame()
+{
+    _last_frame_switches = _frame_switches;
+    _max_frame_switches = std::max(_max_frame_switches, _frame_switches);
+    _total_switches += _frame_switches;
+    _frame_switches = 0;
+    ++_frames;
+}
+
+void MapperTelemetry::Dump(std::ostream& stream, uint32_t top_banks) const
+{
+    uint64_t banked_cycles = std::accumulate(_PGR_cycles.begin(), _PGR_cycles.end(), uint64_t(0));
+    uint64_t total_cycles = banked_cycles + _unbanked_cycles;
+
+    stream << "MAPPER TELEMETRY> Frames: " << _frames << " - Switches: " << _total_switches
+        << " (last frame " << _last_frame_switches << ", max " << _max_frame_switches
+        << ", avg " << (_frames ? _total_switches / _frames : 0) << ")\n";
+
+    stream << "  Hot PRG 8KB banks (cycles):";
+    for (uint32_t unit : TopUnits(_PGR_cycles, top_banks))
+    {
+        stream << " " << unit << "=" << std::fixed << std::setprecision(1)
+            << (total_cycles ? 100.0 * _PGR_cycles[unit] / total_cycles : 0.0) << "%";
+    }
+    stream << " RAM=" << (total_cycles ? 100.0 * _unbanked_cycles / total_cycles : 0.0) << "%\n";
+
+    stream << "  Most mapped PRG 8KB banks:";
+    for (uint32_t unit : TopUnits(_PGR_map_counts, top_banks))
+        stream << " " << unit << "x" << _PGR_map_counts[unit];
+    stream << "\n";
+
+    stream << "  Most mapped CHR 1KB banks:";
+    for (uint32_t unit : TopUnits(_CHR_map_counts, top_banks))
+        stream << " " << unit << "x" << _CHR_map_counts[unit];
+    stream << std::defaultfloat << "\n";
+}
@@ -0,0 +1,87 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MapperTelemetry_h__
+#define MapperTelemetry_h__
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "Bus.h"
+#include "PPUBus.h"
+
+/** MAPPER TELEMETRY
+*  Bank switching profile of a cartridge, only fed when built with NESE_MAPPER_TELEMETRY.
+*  Banks are counted in the smallest unit any supported mapper switches:
+*  8 KB for PRG (a CPU page) and 1 KB for CHR (a PPU page), bigger windows count once per unit.
+*  A switch is a page of the address map pointing to a different unit than before.
+*  Cycles are charged to the PRG unit the instruction was fetched from.
+**/
+class MapperTelemetry
+{
+public:
+    MapperTelemetry();
+
+    // Sizes of the PGR_ROM and CHR_ROM_RAM regions, clears every counter
+    void Reset(uint32_t PGR_size, uint32_t CHR_size);
+
+    void RecordPGRMap(uint32_t cpu_page, uint32_t rom_offset);
+    void RecordCHRMap(uint32_t ppu_page, uint32_t chr_offset);
+
+    inline void AddCycles(uint16_t pc, uint32_t cycles)
+    {
+        int32_t unit = _cpu_page_units[pc >> CPU_PAGE_SHIFT];
+        if (unit >= 0)
+            _PGR_cycles[unit] += cycles;
+        else
+            _unbanked_cycles += cycles;
+    }
+
+    void EndFrame();
+
+    const std::vector<uint64_t>& GetPGRMapCounts() const { return _PGR_map_counts; }
+    const std::vector<uint64_t>& GetCHRMapCounts() const { return _CHR_map_counts; }
+    const std::vector<uint64_t>& GetPGRCycles() const { return _PGR_cycles; }
+    uint64_t GetUnbankedCycles() const { return _unbanked_cycles; } // Code running from RAM
+
+    uint32_t GetFrameSwitches() const { return _frame_switches; } // Current frame so far
+    uint32_t GetLastFrameSwitches() const { return _last_frame_switches; }
+    uint32_t GetMaxFrameSwitches() const { return _max_frame_switches; }
+    uint64_t GetTotalSwitches() const { return _total_switches; }
+    uint64_t GetFrames() const { return _frames; }
+
+    // Human readable summary, the hottest units first
+    void Dump(std::ostream& stream, uint32_t top_banks = 8) const;
+
+private:
+    std::vector<uint64_t> _PGR_map_counts;
+    std::vector<uint64_t> _CHR_map_counts;
+    std::vector<uint64_t> _PGR_cycles;
+    uint64_t _unbanked_cycles;
+
+    int32_t _cpu_page_units[CPU_PAGE_COUNT];
+    int32_t _ppu_page_units[PPU_PAGE_COUNT];
+
+    uint32_t _frame_switches;
+    uint32_t _last_frame_switches;
+    uint32_t _max_frame_switches;
+    uint64_t _total_switches;
+    uint64_t _frames;
+};
+
+#endif // MapperTelemetry_h__
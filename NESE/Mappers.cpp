@@ -17,3 +17,501 @@
 */
 
 #include "Mappers.h"
+#include "PPU.h"
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+    uint32_t WrapBank(int32_t bank, uint32_t bank_count)
+    {
+        int32_t count = static_cast<int32_t>(bank_count);
+        return static_cast<uint32_t>(((bank % count) + count) % count);
+    }
+
+    // Visible scanlines plus the pre-render one fetch tiles
+    constexpr uint32_t A12_CLOCKS_PER_FRAME = PPU_VISIBLE_SCANLINES + 1;
+
+    // Amount of A12 rising edges on [0, time], clock_dot is the dot where A12 rises on each rendered scanline
+    uint64_t CountA12Clocks(uint64_t time, uint16_t clock_dot)
+    {
+        uint64_t frame = time / PPU_DOTS_PER_FRAME;
+        uint32_t position = static_cast<uint32_t>(time % PPU_DOTS_PER_FRAME);
+        uint32_t scanline = position / PPU_DOTS_PER_SCANLINE;
+        uint32_t dot = position % PPU_DOTS_PER_SCANLINE;
+
+        uint64_t clocks = frame * A12_CLOCKS_PER_FRAME + std::min(scanline, PPU_VISIBLE_SCANLINES);
+        if ((scanline < PPU_VISIBLE_SCANLINES || scanline == PPU_PRERENDER_SCANLINE) && dot >= clock_dot)
+            ++clocks;
+
+        return clocks;
+    }
+
+    // Time of the A12 rising edge number index (1 based, same numbering as CountA12Clocks)
+    uint64_t A12ClockTime(uint64_t index, uint16_t clock_dot)
+    {
+        uint64_t frame = (index - 1) / A12_CLOCKS_PER_FRAME;
+        uint32_t clock = static_cast<uint32_t>((index - 1) % A12_CLOCKS_PER_FRAME);
+        uint32_t scanline = clock < PPU_VISIBLE_SCANLINES ? clock : PPU_PRERENDER_SCANLINE;
+
+        return frame * PPU_DOTS_PER_FRAME + scanline * PPU_DOTS_PER_SCANLINE + clock_dot;
+    }
+}
+
+Mapper::Mapper(Cartridge& cartridge, Bus& bus, PPUBus& ppu_bus) : _cartridge(cartridge), _bus(bus), _ppu_bus(ppu_bus), _scheduler(nullptr),
+    _tile_cache(cartridge.CHR_ROM_RAM.size())
+{
+    _bus.ConnectCartridge(this);
+    _ppu_bus.ConnectTileCache(&_tile_cache);
+
+    // Paged CHR ROM, the decoded tiles live as long as their chunk
+    if (_cartridge.GetPager() && !_cartridge.chr_is_ram)
+        _cartridge.GetPager()->ConnectTileCache(&_tile_cache);
+
+#ifdef NESE_MAPPER_TELEMETRY
+    _telemetry.Reset(_cartridge.PGR_ROM.size(), _cartridge.CHR_ROM_RAM.size());
+#endif
+}
+
+Mapper::~Mapper()
+{
+    _bus.DisconnectCartridge();
+    _ppu_bus.DisconnectTileCache();
+
+    if (_cartridge.GetPager())
+        _cartridge.GetPager()->DisconnectTileCache();
+}
+
+void Mapper::Reset()
+{
+    // Fixed layout: first 32 KB of PRG (16 KB ones get mirrored) and the first 8 KB of CHR
+    MapPGR(0x8000, 0x8000, 0);
+    MapCHR(0x0000, 0x2000, 0);
+    MapPGRRAM(true, true);
+    SetMirroring(GetHeaderMirroring());
+}
+
+void Mapper::WriteRegister(uint16_t /*address*/, uint8_t /*data*/)
+{
+}
+
+uint8_t Mapper::ReadIO(uint16_t address)
+{
+    // Nothing drives the bus, open bus
+    return address >> 8;
+}
+
+void Mapper::WriteIO(uint16_t address, uint8_t data)
+{
+    if (address >= 0x8000)
+        WriteRegister(address, data);
+}
+
+void Mapper::MapPGR(uint16_t address, uint32_t size, int32_t bank)
+{
+    uint32_t rom_size = _cartridge.PGR_ROM.size();
+    if (rom_size == 0)
+        return;
+
+    uint32_t bank_count = std::max<uint32_t>(rom_size / size, 1);
+    uint32_t bank_offset = WrapBank(bank, bank_count) * size;
+
+    RomPager* pager = _cartridge.GetPager();
+
+    for (uint32_t offset = 0; offset < size; offset += CPU_PAGE_SIZE)
+    {
+        uint32_t rom_offset = (bank_offset + offset) % rom_size;
+        const uint8_t* page = pager ? pager->MapPage(RomPager::Owner::CPU, (address + offset) >> CPU_PAGE_SHIFT, RomPager::Region::PGR_ROM, rom_offset)
+            : _cartridge.PGR_ROM.data() + rom_offset;
+
+        _bus.MapRead(address + offset, CPU_PAGE_SIZE, page, std::min(rom_size, CPU_PAGE_SIZE));
+
+#ifdef NESE_MAPPER_TELEMETRY
+        _telemetry.RecordPGRMap((address + offset) >> CPU_PAGE_SHIFT, rom_offset);
+#endif
+    }
+}
+
+void Mapper::MapCHR(uint16_t address, uint32_t size, int32_t bank)
+{
+    uint32_t chr_size = _cartridge.CHR_ROM_RAM.size();
+    if (chr_size == 0)
+        return;
+
+    uint32_t bank_count = std::max<uint32_t>(chr_size / size, 1);
+    uint32_t bank_offset = WrapBank(bank, bank_count) * size;
+
+    // CHR RAM always lives in the arena
+    RomPager* pager = _cartridge.chr_is_ram ? nullptr : _cartridge.GetPager();
+
+    for (uint32_t offset = 0; offset < size; offset += PPU_PAGE_SIZE)
+    {
+        uint32_t chr_offset = (bank_offset + offset) % chr_size;
+        uint8_t* page = pager ? pager->MapPage(RomPager::Owner::PPU, (address + offset) >> PPU_PAGE_SHIFT, RomPager::Region::CHR_ROM, chr_offset)
+            : _cartridge.CHR_ROM_RAM.data() + chr_offset;
+
+        _ppu_bus.MapPages(address + offset, PPU_PAGE_SIZE, page, _cartridge.chr_is_ram ? page : nullptr, chr_offset);
+
+#ifdef NESE_MAPPER_TELEMETRY
+        _telemetry.RecordCHRMap((address + offset) >> PPU_PAGE_SHIFT, chr_offset);
+#endif
+    }
+}
+
+void Mapper::MapPGRRAM(bool enabled, bool writable)
+{
+    const CartridgeRegion& ram = _cartridge.PGR_NVRAM.empty() ? _cartridge.PGR_RAM : _cartridge.PGR_NVRAM;
+
+    if (!enabled || ram.empty())
+    {
+        _bus.MapRead(0x6000, CPU_PAGE_SIZE, nullptr);
+        _bus.MapWrite(0x6000, CPU_PAGE_SIZE, nullptr);
+        return;
+    }
+
+    uint32_t ram_size = std::min(ram.size(), CPU_PAGE_SIZE);
+    _bus.MapRead(0x6000, CPU_PAGE_SIZE, ram.data(), ram_size);
+    _bus.MapWrite(0x6000, CPU_PAGE_SIZE, writable ? ram.data() : nullptr, ram_size);
+}
+
+Mirroring Mapper::GetHeaderMirroring() const
+{
+    if ((_cartridge.format_header.Flag_6 & 0b00001000) != 0)
+        return Mirroring::FourScreen;
+
+    return (_cartridge.format_header.Flag_6 & 0b00000001) != 0 ? Mirroring::Vertical : Mirroring::Horizontal;
+}
+
+void MMC1::Reset()
+{
+    _shift_register = 0x10;
+    _control = 0x0C; // PRG mode 3, last bank fixed on $C000
+    _CHR_bank_0 = 0;
+    _CHR_bank_1 = 0;
+    _PGR_bank = 0;
+
+    UpdateBanks();
+}
+
+void MMC1::WriteRegister(uint16_t address, uint8_t data)
+{
+    // Bit 7 resets the shift register and locks the PRG mode with the last bank fixed
+    if ((data & 0x80) != 0)
+    {
+        _shift_register = 0x10;
+        _control |= 0x0C;
+        UpdateBanks();
+        return;
+    }
+
+    // The register is full when the initial marker bit reaches bit 0
+    bool complete = (_shift_register & 0x01) != 0;
+    _shift_register = (_shift_register >> 1) | ((data & 0x01) << 4);
+
+    if (!complete)
+        return;
+
+    switch ((address >> 13) & 0x03)
+    {
+    case 0: _control = _shift_register; break;
+    case 1: _CHR_bank_0 = _shift_register; break;
+    case 2: _CHR_bank_1 = _shift_register; break;
+    case 3: _PGR_bank = _shift_register; break;
+    }
+
+    _shift_register = 0x10;
+    UpdateBanks();
+}
+
+void MMC1::UpdateBanks()
+{
+    static const Mirroring mirroring_modes[4] = { Mirroring::SingleScreenLow, Mirroring::SingleScreenHigh, Mirroring::Vertical, Mirroring::Horizontal };
+    SetMirroring(mirroring_modes[_control & 0x03]);
+
+    // 512 KB boards (SUROM) use CHR bit 4 to select the 256 KB PRG half
+    int32_t outer_bank = 0;
+    if (_cartridge.PGR_ROM.size() > 0x40000)
+        outer_bank = (_CHR_bank_0 & 0x10) != 0 ? 16 : 0;
+
+    int32_t bank = outer_bank | (_PGR_bank & 0x0F);
+    switch ((_control >> 2) & 0x03)
+    {
+    case 0:
+    case 1:
+        MapPGR(0x8000, 0x8000, bank >> 1);
+        break;
+    case 2:
+        MapPGR(0x8000, 0x4000, outer_bank);
+        MapPGR(0xC000, 0x4000, bank);
+        break;
+    case 3:
+        MapPGR(0x8000, 0x4000, bank);
+        MapPGR(0xC000, 0x4000, outer_bank | 0x0F);
+        break;
+    }
+
+    if ((_control & 0x10) != 0)
+    {
+        MapCHR(0x0000, 0x1000, _CHR_bank_0);
+        MapCHR(0x1000, 0x1000, _CHR_bank_1);
+    }
+    else
+        MapCHR(0x0000, 0x2000, _CHR_bank_0 >> 1);
+
+    // MMC1B: bit 4 of the PRG register disables the PRG RAM
+    MapPGRRAM((_PGR_bank & 0x10) == 0, true);
+}
+
+void UxROM::Reset()
+{
+    Mapper::Reset();
+    MapPGR(0x8000, 0x4000, 0);
+    MapPGR(0xC000, 0x4000, -1);
+}
+
+void UxROM::WriteRegister(uint16_t /*address*/, uint8_t data)
+{
+    MapPGR(0x8000, 0x4000, data);
+}
+
+void CNROM::WriteRegister(uint16_t /*address*/, uint8_t data)
+{
+    MapCHR(0x0000, 0x2000, data & 0x03);
+}
+
+void MMC3::Reset()
+{
+    _bank_select = 0;
+    _bank_registers[0] = 0;
+    _bank_registers[1] = 2;
+    _bank_registers[2] = 4;
+    _bank_registers[3] = 5;
+    _bank_registers[4] = 6;
+    _bank_registers[5] = 7;
+    _bank_registers[6] = 0;
+    _bank_registers[7] = 1;
+
+    _IRQ_latch = 0;
+    _IRQ_counter = 0;
+    _IRQ_reload = false;
+    _IRQ_enabled = false;
+    _IRQ_asserted = false;
+    _IRQ_sync_time = _scheduler ? _scheduler->GetNow() : 0;
+    _A12_clock_dot = 0;
+
+    if (_scheduler)
+        _scheduler->Cancel(EventType::MapperIRQ);
+
+    Mapper::Reset();
+    UpdatePGRBanks();
+    UpdateCHRBanks();
+}
+
+void MMC3::WriteRegister(uint16_t address, uint8_t data)
+{
+    bool even = (address & 0x01) == 0;
+
+    // The IRQ registers change the counter, bring it up to date first
+    if (address >= 0xC000)
+        SyncScanlineCounter();
+
+    switch (address & 0xE000)
+    {
+    case 0x8000:
+        if (even)
+            _bank_select = data;
+        else
+            _bank_registers[_bank_select & 0x07] = data;
+
+        UpdatePGRBanks();
+        UpdateCHRBanks();
+        break;
+    case 0xA000:
+        if (even)
+        {
+            if (GetHeaderMirroring() != Mirroring::FourScreen)
+                SetMirroring((data & 0x01) != 0 ? Mirroring::Horizontal : Mirroring::Vertical);
+        }
+        else
+            MapPGRRAM((data & 0x80) != 0, (data & 0x40) == 0);
+        break;
+    case 0xC000:
+        if (even)
+            _IRQ_latch = data;
+        else
+        {
+            _IRQ_counter = 0;
+            _IRQ_reload = true;
+        }
+        break;
+    case 0xE000:
+        _IRQ_enabled = !even;
+        if (even)
+            _IRQ_asserted = false;
+        break;
+    }
+
+    if (address >= 0xC000)
+        ScheduleIRQ();
+}
+
+void MMC3::CatchUp()
+{
+    SyncScanlineCounter();
+    ScheduleIRQ();
+}
+
+void MMC3::PPUConfigurationChanged(uint8_t control, uint8_t mask)
+{
+    // A12 only rises when the sprite and background fetches use different pattern tables.
+    // 8x16 sprites count as $1000 sprites, the unused slots fetch tile $FF from there.
+    uint16_t clock_dot = 0;
+
+    if ((mask & (PPUMASK_SHOW_BACKGROUND | PPUMASK_SHOW_SPRITES)) != 0)
+    {
+        bool sprites_high = (control & (PPUCTRL_SPRITE_TABLE | PPUCTRL_SPRITE_SIZE)) != 0;
+        bool background_high = (control & PPUCTRL_BACKGROUND_TABLE) != 0;
+
+        if (sprites_high && !background_high)
+            clock_dot = 260; // First sprite pattern fetch
+        else if (background_high && !sprites_high)
+            clock_dot = 324; // Background prefetch for the next scanline
+    }
+
+    // Most PPUCTRL/PPUMASK writes don't change the A12 pattern, nothing to recompute
+    if (clock_dot == _A12_clock_dot)
+        return;
+
+    SyncScanlineCounter();
+    _A12_clock_dot = clock_dot;
+    ScheduleIRQ();
+}
+
+void MMC3::SyncScanlineCounter()
+{
+    if (!_scheduler)
+        return;
+
+    uint64_t now = _scheduler->GetNow();
+    if (now <= _IRQ_sync_time)
+        return;
+
+    uint64_t clocks = 0;
+    if (_A12_clock_dot != 0)
+        clocks = CountA12Clocks(now, _A12_clock_dot) - CountA12Clocks(_IRQ_sync_time, _A12_clock_dot);
+
+    _IRQ_sync_time = now;
+
+    if (clocks == 0)
+        return;
+
+    // The first clock reloads or decrements, from there the counter cycles latch..0
+    uint8_t first = (_IRQ_counter == 0 || _IRQ_reload) ? _IRQ_latch : _IRQ_counter - 1;
+    uint64_t remaining = clocks - 1;
+    _IRQ_reload = false;
+
+    if (remaining <= first)
+        _IRQ_counter = static_cast<uint8_t>(first - remaining);
+    else
+    {
+        remaining -= uint64_t(first) + 1;
+        _IRQ_counter = static_cast<uint8_t>(_IRQ_latch - remaining % (uint64_t(_IRQ_latch) + 1));
+    }
+
+    // The counter reaches zero on clock number first + 1
+    if (_IRQ_enabled && clocks >= uint64_t(first) + 1)
+        _IRQ_asserted = true;
+}
+
+void MMC3::ScheduleIRQ()
+{
+    if (!_scheduler)
+        return;
+
+    if (!_IRQ_enabled || _A12_clock_dot == 0)
+    {
+        _scheduler->Cancel(EventType::MapperIRQ);
+        return;
+    }
+
+    uint8_t first = (_IRQ_counter == 0 || _IRQ_reload) ? _IRQ_latch : _IRQ_counter - 1;
+    uint64_t clock_index = CountA12Clocks(_IRQ_sync_time, _A12_clock_dot) + first + 1;
+
+    _scheduler->Schedule(EventType::MapperIRQ, A12ClockTime(clock_index, _A12_clock_dot));
+}
+
+void MMC3::ClockScanlineCounter()
+{
+    if (_IRQ_counter == 0 || _IRQ_reload)
+    {
+        _IRQ_counter = _IRQ_latch;
+        _IRQ_reload = false;
+    }
+    else
+        --_IRQ_counter;
+
+    if (_IRQ_counter == 0 && _IRQ_enabled)
+        _IRQ_asserted = true;
+}
+
+void MMC3::UpdatePGRBanks()
+{
+    // Bit 6 swaps the switchable $8000 window with the fixed second to last bank on $C000
+    if ((_bank_select & 0x40) != 0)
+    {
+        MapPGR(0x8000, 0x2000, -2);
+        MapPGR(0xC000, 0x2000, _bank_registers[6] & 0x3F);
+    }
+    else
+    {
+        MapPGR(0x8000, 0x2000, _bank_registers[6] & 0x3F);
+        MapPGR(0xC000, 0x2000, -2);
+    }
+
+    MapPGR(0xA000, 0x2000, _bank_registers[7] & 0x3F);
+    MapPGR(0xE000, 0x2000, -1);
+}
+
+void MMC3::UpdateCHRBanks()
+{
+    // Bit 7 swaps the 2 KB banks half with the 1 KB banks half
+    uint16_t inversion = (_bank_select & 0x80) != 0 ? 0x1000 : 0x0000;
+
+    MapCHR(0x0000 ^ inversion, 0x0800, _bank_registers[0] >> 1);
+    MapCHR(0x0800 ^ inversion, 0x0800, _bank_registers[1] >> 1);
+    MapCHR(0x1000 ^ inversion, 0x0400, _bank_registers[2]);
+    MapCHR(0x1400 ^ inversion, 0x0400, _bank_registers[3]);
+    MapCHR(0x1800 ^ inversion, 0x0400, _bank_registers[4]);
+    MapCHR(0x1C00 ^ inversion, 0x0400, _bank_registers[5]);
+}
+
+void AxROM::Reset()
+{
+    Mapper::Reset();
+    SetMirroring(Mirroring::SingleScreenLow);
+}
+
+void AxROM::WriteRegister(uint16_t /*address*/, uint8_t data)
+{
+    MapPGR(0x8000, 0x8000, data & 0x07);
+    SetMirroring((data & 0x10) != 0 ? Mirroring::SingleScreenHigh : Mirroring::SingleScreenLow);
+}
+
+std::unique_ptr<Mapper> CreateMapper(Cartridge& cartridge, Bus& bus, PPUBus& ppu_bus)
+{
+    std::unique_ptr<Mapper> mapper;
+
+    switch (cartridge.mapper_id)
+    {
+#define CREATE_MAPPER(id, MapperType) \
+    case id: mapper.reset(new MapperType(cartridge, bus, ppu_bus)); break;
+    NESE_MAPPER_LIST(CREATE_MAPPER)
+#undef CREATE_MAPPER
+    default:
+        std::cerr << "ERROR> Mapper " << cartridge.mapper_id << " is not supported.\n";
+        return nullptr;
+    }
+
+    mapper->Reset();
+    return mapper;
+}
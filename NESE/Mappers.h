@@ -19,5 +19,189 @@
 #ifndef Mappers_h__
 #define Mappers_h__
 
+#include <cstdint>
+#include <memory>
+#include "Bus.h"
+#include "PPUBus.h"
+#include "Cartridge.h"
+#include "Scheduler.h"
 
-#endif // Mappers_h__
\ No newline at end of file
+#ifdef NESE_MAPPER_TELEMETRY
+#include "MapperTelemetry.h"
+#endif
+
+/** MAPPER
+*  Owns the cartridge space of the CPU ($4020-$FFFF) and the pattern tables of the PPU.
+*  Banks are selected by pointing the pages of both address maps into the cartridge arena,
+*  so reads never go through the mapper and a bank switch is a couple of pointer stores.
+*  Only writes to unmapped pages (the mapper registers) reach WriteRegister.
+*  The concrete mappers are final, Console<MapperType> calls them without virtual dispatch.
+**/
+class Mapper : public IOHandler
+{
+public:
+    Mapper(Cartridge& cartridge, Bus& bus, PPUBus& ppu_bus);
+    virtual ~Mapper();
+
+    // Power on state, maps the initial banks
+    virtual void Reset();
+
+    virtual void WriteRegister(uint16_t address, uint8_t data);
+
+    // Level of the cartridge IRQ line
+    virtual bool IRQAsserted() const { return false; }
+
+    // Timed features (IRQ counters) need the console timeline
+    void AttachScheduler(Scheduler* scheduler) { _scheduler = scheduler; }
+
+    // Brings the time dependent state up to the scheduler time, the console calls it
+    // when the MapperIRQ event the mapper scheduled is due
+    virtual void CatchUp() {}
+
+    // PPUCTRL or PPUMASK were written
+    virtual void PPUConfigurationChanged(uint8_t /*control*/, uint8_t /*mask*/) {}
+
+    uint8_t ReadIO(uint16_t address) override;
+    void WriteIO(uint16_t address, uint8_t data) override;
+
+#ifdef NESE_MAPPER_TELEMETRY
+    MapperTelemetry& GetTelemetry() { return _telemetry; }
+#endif
+
+protected:
+    /** BANK SWITCHING
+    *  address: first address of the window, size: window (and bank) size in bytes
+    *  bank: bank index in units of size, negative values count from the end (-1 is the last bank)
+    *  Out of range banks wrap around, like the unconnected address lines of the real boards.
+    **/
+    void MapPGR(uint16_t address, uint32_t size, int32_t bank);
+    void MapCHR(uint16_t address, uint32_t size, int32_t bank);
+
+    // PRG RAM (or battery backed RAM) on $6000-$7FFF
+    void MapPGRRAM(bool enabled, bool writable);
+
+    void SetMirroring(Mirroring mirroring) { _ppu_bus.SetMirroring(mirroring); }
+    Mirroring GetHeaderMirroring() const;
+
+    Cartridge& _cartridge;
+    Bus& _bus;
+    PPUBus& _ppu_bus;
+    Scheduler* _scheduler;
+    TileCache _tile_cache;
+
+#ifdef NESE_MAPPER_TELEMETRY
+    MapperTelemetry _telemetry;
+#endif
+};
+
+// Mapper 000
+class NROM final : public Mapper
+{
+public:
+    NROM(Cartridge& cartridge, Bus& bus, PPUBus& ppu_bus) : Mapper(cartridge, bus, ppu_bus) {}
+};
+
+// Mapper 001
+class MMC1 final : public Mapper
+{
+public:
+    MMC1(Cartridge& cartridge, Bus& bus, PPUBus& ppu_bus) : Mapper(cartridge, bus, ppu_bus) {}
+
+    void Reset() override;
+    void WriteRegister(uint16_t address, uint8_t data) override;
+
+private:
+    void UpdateBanks();
+
+    uint8_t _shift_register;
+    uint8_t _control;
+    uint8_t _CHR_bank_0;
+    uint8_t _CHR_bank_1;
+    uint8_t _PGR_bank;
+};
+
+// Mapper 002
+class UxROM final : public Mapper
+{
+public:
+    UxROM(Cartridge& cartridge, Bus& bus, PPUBus& ppu_bus) : Mapper(cartridge, bus, ppu_bus) {}
+
+    void Reset() override;
+    void WriteRegister(uint16_t address, uint8_t data) override;
+};
+
+// Mapper 003
+class CNROM final : public Mapper
+{
+public:
+    CNROM(Cartridge& cartridge, Bus& bus, PPUBus& ppu_bus) : Mapper(cartridge, bus, ppu_bus) {}
+
+    void WriteRegister(uint16_t address, uint8_t data) override;
+};
+
+// Mapper 004
+class MMC3 final : public Mapper
+{
+public:
+    MMC3(Cartridge& cartridge, Bus& bus, PPUBus& ppu_bus) : Mapper(cartridge, bus, ppu_bus) {}
+
+    void Reset() override;
+    void WriteRegister(uint16_t address, uint8_t data) override;
+    bool IRQAsserted() const override { return _IRQ_asserted; }
+
+    void CatchUp() override;
+    void PPUConfigurationChanged(uint8_t control, uint8_t mask) override;
+
+    // Scanline counter, clocked by each rising edge of PPU A12
+    void ClockScanlineCounter();
+
+private:
+    void UpdatePGRBanks();
+    void UpdateCHRBanks();
+
+    /** PREDICTIVE SCANLINE COUNTER
+    *  A12 rises once per rendered scanline on a dot fixed by the pattern table setup,
+    *  so instead of watching the PPU fetches the clocks are counted in closed form
+    *  between syncs and the IRQ is scheduled for the clock that reaches zero.
+    *  Syncs only happen on writes to the IRQ registers, to PPUCTRL/PPUMASK and on the event.
+    **/
+    void SyncScanlineCounter();
+    void ScheduleIRQ();
+
+    uint64_t _IRQ_sync_time;
+    uint16_t _A12_clock_dot; // 0 when A12 never rises (rendering off, both tables on $0000)
+
+    uint8_t _bank_select;
+    uint8_t _bank_registers[8];
+
+    uint8_t _IRQ_latch;
+    uint8_t _IRQ_counter;
+    bool _IRQ_reload;
+    bool _IRQ_enabled;
+    bool _IRQ_asserted;
+};
+
+// Mapper 007
+class AxROM final : public Mapper
+{
+public:
+    AxROM(Cartridge& cartridge, Bus& bus, PPUBus& ppu_bus) : Mapper(cartridge, bus, ppu_bus) {}
+
+    void Reset() override;
+    void WriteRegister(uint16_t address, uint8_t data) override;
+};
+
+// Every supported mapper as MAPPER(iNES number, class). CreateMapper, CreateConsole and the
+// console instantiations all expand it, a new mapper only has to be added here.
+#define NESE_MAPPER_LIST(MAPPER) \
+    MAPPER(0, NROM) \
+    MAPPER(1, MMC1) \
+    MAPPER(2, UxROM) \
+    MAPPER(3, CNROM) \
+    MAPPER(4, MMC3) \
+    MAPPER(7, AxROM)
+
+// Builds and resets the mapper declared on the cartridge header, nullptr when not supported
+std::unique_ptr<Mapper> CreateMapper(Cartridge& cartridge, Bus& bus, PPUBus& ppu_bus);
+
+#endif // Mappers_h__
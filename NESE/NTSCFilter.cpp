@@ -0,0 +1,309 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "NTSCFilter.h"
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// Voltages of the PPU output relative to sync, low and high level of each luma step
+static const double SIGNAL_LEVELS[8] = { 0.350, 0.518, 0.962, 1.550, 1.094, 1.506, 1.962, 1.962 };
+static const double SIGNAL_BLACK = 0.518;
+static const double SIGNAL_WHITE = 1.962;
+static const double EMPHASIS_ATTENUATION = 0.746;
+
+// Phase of the decoder's subcarrier against the PPU's, in twelfths of a cycle, lines the hues up with a TV's
+static const double HUE_OFFSET = 3.9;
+
+// Kernels hold 64 times the channel value, the shift back drops the fraction
+constexpr int32_t KERNEL_SCALE = 64;
+constexpr int32_t KERNEL_SHIFT = 6;
+
+static const double PI = 3.14159265358979323846;
+
+// Sample of the square wave of an index at a color phase (0-11), 0 is black and 1 white
+static double GetSignal(uint32_t index, uint32_t emphasis, uint32_t phase)
+{
+    uint32_t color = index & 0x0F;
+    uint32_t level = color > 13 ? 1 : (index >> 4) & 0x03;
+
+    // Color 0 stays high, 13-15 stay low, the rest alternate half a cycle each
+    double low = SIGNAL_LEVELS[level];
+    double high = SIGNAL_LEVELS[4 + level];
+    if (color == 0)
+        low = high;
+    if (color > 12)
+        high = low;
+
+    auto InColorPhase = [phase](uint32_t hue) { return (hue + phase) % 12 < 6; };
+
+    double signal = InColorPhase(color) ? high : low;
+
+    // Red, green and blue emphasis attenuate the signal during their own third of the cycle
+    if (((emphasis & 1) && InColorPhase(0x0C)) || ((emphasis & 2) && InColorPhase(0x04)) || ((emphasis & 4) && InColorPhase(0x08)))
+        signal *= EMPHASIS_ATTENUATION;
+
+    return (signal - SIGNAL_BLACK) / (SIGNAL_WHITE - SIGNAL_BLACK);
+}
+
+static int16_t ToFixed(double value)
+{
+    double scaled = std::floor(value * 255.0 * KERNEL_SCALE + 0.5);
+    if (scaled < INT16_MIN)
+        return INT16_MIN;
+    if (scaled > INT16_MAX)
+        return INT16_MAX;
+
+    return static_cast<int16_t>(scaled);
+}
+
+NTSCFilter::NTSCFilter(uint32_t threads) : _generation(0), _pending(0), _stop(false),
+    _framebuffer(nullptr), _emphasis(nullptr), _frame(0), _destination(nullptr), _pitch(0)
+{
+    // Samples of a pixel each output pixel of the pair sees, the window is 12 samples centered
+    // on sample 0 (even output) or 4 (odd output) of its own pixel
+    static const uint32_t WINDOWS[Kernels][2][2] = {
+        { { 2, 8 }, { 6, 8 } },     // Left neighbour
+        { { 0, 6 }, { 0, 8 } },     // Own pixel
+        { { 0, 0 }, { 0, 2 } },     // Right neighbour
+    };
+
+    for (uint32_t kernel = 0; kernel < Kernels; ++kernel)
+    {
+        for (uint32_t phase = 0; phase < NTSC_PHASES; ++phase)
+        {
+            for (uint32_t emphasis = 0; emphasis < EMPHASIS_COMBINATIONS; ++emphasis)
+            {
+                for (uint32_t index = 0; index < KERNEL_COLORS; ++index)
+                {
+                    int16_t* entry = _kernels[kernel][emphasis][phase * KERNEL_COLORS + index];
+
+                    for (uint32_t output = 0; output < 2; ++output)
+                    {
+                        double Y = 0.0;
+                        double I = 0.0;
+                        double Q = 0.0;
+
+                        if (index < NES_COLORS)
+                        {
+                            for (uint32_t sample = WINDOWS[kernel][output][0]; sample < WINDOWS[kernel][output][1]; ++sample)
+                            {
+                                uint32_t sample_phase = (phase * 4 + sample) % 12;
+                                double level = GetSignal(index, emphasis, sample_phase) / 12.0;
+                                Y += level;
+                                I += level * std::cos(PI * (sample_phase + HUE_OFFSET) / 6.0);
+                                Q += level * std::sin(PI * (sample_phase + HUE_OFFSET) / 6.0);
+                            }
+                        }
+
+                        int16_t* pixel = entry + output * 4;
+                        pixel[0] = ToFixed(Y + 0.946882 * I + 0.623557 * Q);
+                        pixel[1] = ToFixed(Y - 0.274788 * I - 0.635691 * Q);
+                        pixel[2] = ToFixed(Y - 1.108545 * I + 1.709007 * Q);
+                        pixel[3] = 0;
+
+                        // Every output pixel has exactly one own pixel, it carries the opaque alpha
+                        // and half a unit so that the final shift rounds
+                        if (kernel == Center)
+                        {
+                            for (uint32_t channel = 0; channel < 3; ++channel)
+                                pixel[channel] = static_cast<int16_t>(pixel[channel] < INT16_MAX - KERNEL_SCALE / 2 ? pixel[channel] + KERNEL_SCALE / 2 : INT16_MAX);
+
+                            pixel[3] = static_cast<int16_t>(255 * KERNEL_SCALE + KERNEL_SCALE / 2);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (uint32_t band = 1; band < threads; ++band)
+        _workers.emplace_back(&NTSCFilter::WorkerLoop, this, band);
+}
+
+NTSCFilter::~NTSCFilter()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+
+    _start.notify_all();
+    for (std::thread& worker : _workers)
+        worker.join();
+}
+
+void NTSCFilter::Filter(const uint8_t* framebuffer, const uint8_t* emphasis, uint64_t frame, uint8_t* destination, size_t pitch)
+{
+    if (pitch == 0)
+        pitch = NTSC_WIDTH * 4;
+
+    uint32_t bands = GetThreads();
+    if (bands == 1)
+    {
+        FilterRows(framebuffer, emphasis, frame, 0, SCREEN_HEIGHT, destination, pitch);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _framebuffer = framebuffer;
+        _emphasis = emphasis;
+        _frame = frame;
+        _destination = destination;
+        _pitch = pitch;
+        _pending = bands - 1;
+        ++_generation;
+    }
+
+    _start.notify_all();
+    FilterRows(framebuffer, emphasis, frame, 0, SCREEN_HEIGHT / bands, destination, pitch);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this] { return _pending == 0; });
+}
+
+void NTSCFilter::FilterRows(const uint8_t* framebuffer, const uint8_t* emphasis, uint64_t frame, uint32_t first, uint32_t end, uint8_t* destination, size_t pitch) const
+{
+    if (pitch == 0)
+        pitch = NTSC_WIDTH * 4;
+
+    // Each scanline is 341 * 8 samples, 4 more than a whole number of cycles. The short odd
+    // frame drops one dot, so the phase of the first scanline alternates between frames.
+    for (uint32_t y = first; y < end; ++y)
+        FilterRow(framebuffer + y * SCREEN_WIDTH, emphasis[y], static_cast<uint32_t>(((frame & 1) + y) % NTSC_PHASES), destination + y * pitch);
+}
+
+void NTSCFilter::WorkerLoop(uint32_t band)
+{
+    uint64_t generation = 0;
+
+    while (true)
+    {
+        const uint8_t* framebuffer;
+        const uint8_t* emphasis;
+        uint64_t frame;
+        uint8_t* destination;
+        size_t pitch;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _start.wait(lock, [&] { return _stop || _generation != generation; });
+            if (_stop)
+                return;
+
+            generation = _generation;
+            framebuffer = _framebuffer;
+            emphasis = _emphasis;
+            frame = _frame;
+            destination = _destination;
+            pitch = _pitch;
+        }
+
+        uint32_t bands = GetThreads();
+        FilterRows(framebuffer, emphasis, frame, SCREEN_HEIGHT * band / bands, SCREEN_HEIGHT * (band + 1) / bands, destination, pitch);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_pending == 0)
+            _done.notify_one();
+    }
+}
+
+#if defined(__AVX2__)
+// Kernel entries of two pixels in the low and high lane
+static inline __m256i Load2(const int16_t* kernels, uint16_t low, uint16_t high)
+{
+    __m128i low_entry = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kernels + low * 8));
+    __m128i high_entry = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kernels + high * 8));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(low_entry), high_entry, 1);
+}
+#endif
+
+void NTSCFilter::FilterRow(const uint8_t* indices, uint8_t emphasis, uint32_t phase, uint8_t* destination) const
+{
+    emphasis &= 0x07;
+
+    // Kernel entry of each pixel of the row and of a silent pixel past each edge, keys[x + 1] is
+    // pixel x. Pixel x starts at phase (phase + 2x) % 3.
+    uint16_t keys[SCREEN_WIDTH + 2];
+    keys[0] = NES_COLORS;
+    keys[SCREEN_WIDTH + 1] = NES_COLORS;
+    for (uint32_t x = 0; x < SCREEN_WIDTH; ++x)
+    {
+        keys[x + 1] = static_cast<uint16_t>(phase * KERNEL_COLORS + (indices[x] & 0x3F));
+        phase = phase == 0 ? 2 : phase - 1;
+    }
+
+    const int16_t* left = _kernels[Left][emphasis][0];
+    const int16_t* center = _kernels[Center][emphasis][0];
+    const int16_t* right = _kernels[Right][emphasis][0];
+
+    uint32_t x = 0;
+
+#if defined(__AVX2__)
+    // Two pixels per register, the packs work per lane and leave them as x, x + 2, x + 1, x + 3
+    for (; x + 4 <= SCREEN_WIDTH; x += 4)
+    {
+        __m256i sums[2];
+        for (uint32_t pair = 0; pair < 2; ++pair)
+        {
+            const uint16_t* key = keys + x + pair * 2;
+            __m256i sum = Load2(left, key[0], key[1]);
+            sum = _mm256_adds_epi16(sum, Load2(center, key[1], key[2]));
+            sum = _mm256_adds_epi16(sum, Load2(right, key[2], key[3]));
+            sums[pair] = _mm256_srai_epi16(sum, KERNEL_SHIFT);
+        }
+
+        __m256i pixels = _mm256_permute4x64_epi64(_mm256_packus_epi16(sums[0], sums[1]), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + x * 8), pixels);
+    }
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; x + 2 <= SCREEN_WIDTH; x += 2)
+    {
+        __m128i sums[2];
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            const uint16_t* key = keys + x + i;
+            __m128i sum = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + key[0] * 8));
+            sum = _mm_adds_epi16(sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + key[1] * 8)));
+            sum = _mm_adds_epi16(sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + key[2] * 8)));
+            sums[i] = _mm_srai_epi16(sum, KERNEL_SHIFT);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 8), _mm_packus_epi16(sums[0], sums[1]));
+    }
+#endif
+
+    for (; x < SCREEN_WIDTH; ++x)
+    {
+        const int16_t* a = left + keys[x] * 8;
+        const int16_t* b = center + keys[x + 1] * 8;
+        const int16_t* c = right + keys[x + 2] * 8;
+
+        for (uint32_t channel = 0; channel < 8; ++channel)
+        {
+            int32_t sum = a[channel] + b[channel] + c[channel];
+            destination[x * 8 + channel] = static_cast<uint8_t>(sum < 0 ? 0 : (sum >> KERNEL_SHIFT) > 255 ? 255 : sum >> KERNEL_SHIFT);
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef NTSCFilter_h__
+#define NTSCFilter_h__
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FrameConverter.h"
+#include "PPU.h"
+
+// Two output pixels per PPU pixel, 4 samples of the composite signal apart
+constexpr uint32_t NTSC_WIDTH = SCREEN_WIDTH * 2;
+
+// The PPU puts out 8 samples per pixel, 12 per cycle of the color subcarrier,
+// so every pixel starts at color phase 0, 4 or 8
+constexpr uint32_t NTSC_SAMPLES_PER_PIXEL = 8;
+constexpr uint32_t NTSC_PHASES = 3;
+
+/** NTSC FILTER
+*  Composite video look for the palette indices of the PPU framebuffer: the square wave the
+*  PPU generates for each pixel is decoded back to RGB with a 12 sample YIQ window, which
+*  gives the color fringes, the blur and the dot crawl of a real TV.
+*  Both steps are linear, so the signal of a pixel only ever adds one of a few kernels to its
+*  two neighbours. The kernels of every color, emphasis and phase are built once as RGB in
+*  16 bit fixed point, an output pixel pair is then three table loads and two saturated adds
+*  (SSE2 per pair, AVX2 two pairs at a time). Scanlines are split in bands over a pool of
+*  threads, the caller filters the first band.
+**/
+class NTSCFilter
+{
+public:
+    // threads 1 filters on the calling thread only
+    NTSCFilter(uint32_t threads = 1);
+    ~NTSCFilter();
+
+    NTSCFilter(const NTSCFilter&) = delete;
+    NTSCFilter& operator=(const NTSCFilter&) = delete;
+
+    // SCREEN_WIDTH x SCREEN_HEIGHT indices with the emphasis of each scanline, to NTSC_WIDTH x SCREEN_HEIGHT
+    // RGBA8888. The color phase of the frame alternates with frame parity. Rows of destination are
+    // pitch bytes apart, 0 packs them. One frame at a time.
+    void Filter(const uint8_t* framebuffer, const uint8_t* emphasis, uint64_t frame, uint8_t* destination, size_t pitch = 0);
+
+    // Scanlines [first, end) on the calling thread only, safe to call from several threads at once
+    void FilterRows(const uint8_t* framebuffer, const uint8_t* emphasis, uint64_t frame, uint32_t first, uint32_t end, uint8_t* destination, size_t pitch = 0) const;
+
+    uint32_t GetThreads() const { return static_cast<uint32_t>(_workers.size()) + 1; }
+
+private:
+    // 64 colors and a silent one for the pixels past both edges
+    static constexpr uint32_t KERNEL_COLORS = NES_COLORS + 1;
+
+    // What a pixel adds to the output pair of its left neighbour, its own and its right neighbour's
+    enum Kernel
+    {
+        Left,
+        Center,
+        Right,
+        Kernels,
+    };
+
+    void FilterRow(const uint8_t* indices, uint8_t emphasis, uint32_t phase, uint8_t* destination) const;
+    void WorkerLoop(uint32_t band);
+
+    // R, G, B, A of both output pixels, 64 times the 0-255 value, by phase * KERNEL_COLORS + color
+    int16_t _kernels[Kernels][EMPHASIS_COMBINATIONS][NTSC_PHASES * KERNEL_COLORS][8];
+
+    // Band 0 is filtered by the caller, band i by _workers[i - 1]
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _start;
+    std::condition_variable _done;
+    uint64_t _generation;   // Guarded by _mutex, a new frame to filter
+    uint32_t _pending;      // Guarded by _mutex, bands still being filtered
+    bool _stop;             // Guarded by _mutex
+
+    // The frame being filtered, set before _generation moves
+    const uint8_t* _framebuffer;
+    const uint8_t* _emphasis;
+    uint64_t _frame;
+    uint8_t* _destination;
+    size_t _pitch;
+};
+
+#endif // NTSCFilter_h__
@@ -17,3 +17,424 @@
 */
 
 #include "PPU.h"
+#include "RenderPipeline.h"
+#include "TileDecoder.h"
+#include <algorithm>
+#include <cstring>
+
+PPU::PPU(PPUBus& ppu_bus) : _ppu_bus(ppu_bus), _time(0), _frame_count(0), _headless(false), _region(FULL_SCREEN), _pipeline(nullptr),
+    _frame_hashing(false), _dirty_tracking(false), _scanlines_drawn(0), _CIRAM_write(0), _palette_write(0), _memory_write(0)
+{
+    std::memset(_CIRAM_writes, 0, sizeof(_CIRAM_writes));
+    std::memset(_dirty_blocks, 0, sizeof(_dirty_blocks));
+
+    // At most every other block column is a separate run
+    _dirty_rects.reserve(DIRTY_ROWS * DIRTY_COLUMNS / 2);
+    _dirty_rects.push_back({ 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT });
+
+    Reset();
+}
+
+void PPU::Reset()
+{
+    _control = 0;
+    _mask = 0;
+    _status = 0;
+    _OAM_address = 0;
+    _data_buffer = 0;
+    _io_latch = 0;
+
+    _v = 0;
+    _t = 0;
+    _fine_x = 0;
+    _w = false;
+
+    _NMI_pending = false;
+    _VBlank_suppressed = false;
+    _OAM_changed = true;
+
+    std::memset(OAM, 0, sizeof(OAM));
+    std::memset(_palette, 0, sizeof(_palette));
+    std::memset(_framebuffer, 0, sizeof(_framebuffer));
+    std::memset(_emphasis, 0, sizeof(_emphasis));
+
+    _hashed_scanlines = 0;
+    _frame_hash = 0;
+}
+
+uint8_t PPU::ReadRegister(uint16_t address)
+{
+    uint8_t data = _io_latch;
+
+    switch (address & 0x07)
+    {
+    case 2:
+    {
+        // Racing the VBlank start: a read on the dot before hides the flag and the NMI of the
+        // frame, a read on the dot itself or the next one sees the flag but still cancels the NMI
+        uint32_t position = static_cast<uint32_t>(_time % PPU_DOTS_PER_FRAME);
+        uint32_t vblank_position = PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE + 1;
+        if (position + 1 == vblank_position)
+            _VBlank_suppressed = true;
+        else if (position == vblank_position || position == vblank_position + 1)
+            _NMI_pending = false;
+
+        data = (_status & 0xE0) | (_io_latch & 0x1F);
+        _status &= ~PPUSTATUS_VBLANK;
+        _w = false;
+        break;
+    }
+    case 4:
+        data = OAM[_OAM_address];
+        break;
+    case 7:
+    {
+        uint16_t vram_address = _v & 0x3FFF;
+
+        // Palette reads are immediate, the buffer gets the nametable "under" the palette
+        if (vram_address >= PALETTE_START)
+        {
+            data = ReadPalette(vram_address) | (_io_latch & 0xC0);
+            _data_buffer = _ppu_bus.Read(vram_address - 0x1000);
+        }
+        else
+        {
+            data = _data_buffer;
+            _data_buffer = _ppu_bus.Read(vram_address);
+        }
+
+        _v = (_v + ((_control & PPUCTRL_INCREMENT_32) != 0 ? 32 : 1)) & 0x7FFF;
+        break;
+    }
+    default:
+        break;
+    }
+
+    return data;
+}
+
+void PPU::WriteRegister(uint16_t address, uint8_t data)
+{
+    _io_latch = data;
+
+    switch (address & 0x07)
+    {
+    case 0:
+        // Enabling NMI in the middle of VBlank fires it right away
+        if ((_control & PPUCTRL_NMI_ENABLE) == 0 && (data & PPUCTRL_NMI_ENABLE) != 0 && (_status & PPUSTATUS_VBLANK) != 0)
+            _NMI_pending = true;
+
+        _control = data;
+        _t = static_cast<uint16_t>((_t & ~0x0C00) | ((data & PPUCTRL_NAMETABLE) << 10));
+        break;
+    case 1:
+        _mask = data;
+        break;
+    case 3:
+        _OAM_address = data;
+        break;
+    case 4:
+        if (_pipeline)
+            _pipeline->RecordOAMWrite(_OAM_address, data);
+
+        OAM[_OAM_address++] = data;
+        _OAM_changed = true;
+        break;
+    case 5:
+        if (!_w)
+        {
+            _t = static_cast<uint16_t>((_t & ~0x001F) | (data >> 3));
+            _fine_x = data & 0x07;
+        }
+        else
+            _t = static_cast<uint16_t>((_t & ~0x73E0) | ((data & 0x07) << 12) | ((data & 0xF8) << 2));
+
+        _w = !_w;
+        break;
+    case 6:
+        if (!_w)
+            _t = static_cast<uint16_t>((_t & 0x00FF) | ((data & 0x3F) << 8));
+        else
+        {
+            _t = static_cast<uint16_t>((_t & 0xFF00) | data);
+            _v = _t;
+        }
+
+        _w = !_w;
+        break;
+    case 7:
+    {
+        uint16_t vram_address = _v & 0x3FFF;
+
+        if (_pipeline)
+            _pipeline->RecordVRAMWrite(vram_address, data);
+
+        WriteVRAM(vram_address, data);
+        _v = (_v + ((_control & PPUCTRL_INCREMENT_32) != 0 ? 32 : 1)) & 0x7FFF;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void PPU::WriteOAMDMA(const uint8_t* page)
+{
+    if (_pipeline)
+        _pipeline->RecordOAMDMA(_OAM_address, page);
+
+    // The DMA goes through $2004, so it starts at the current OAM address
+    WriteOAM(_OAM_address, page, OAM_SIZE);
+}
+
+void PPU::SetRegionOfInterest(const RegionOfInterest& region)
+{
+    _region.x = std::min(region.x, SCREEN_WIDTH);
+    _region.y = std::min(region.y, SCREEN_HEIGHT);
+    _region.width = std::min(region.width, SCREEN_WIDTH - _region.x);
+    _region.height = std::min(region.height, SCREEN_HEIGHT - _region.y);
+    _region.stride = std::max(region.stride, 1u);
+
+    // An empty region has no scanlines either
+    if (_region.width == 0)
+        _region.height = 0;
+
+    if (_pipeline)
+        _pipeline->RecordRegionOfInterest(_region);
+}
+
+void PPU::WriteVRAM(uint16_t address, uint8_t data)
+{
+    if (address >= PALETTE_START)
+    {
+        _palette[PaletteIndex(address)] = data & 0x3F;
+        _palette_write = _scanlines_drawn;
+        return;
+    }
+
+    _ppu_bus.Write(address, data);
+
+    uint32_t index = (address & (PPU_MEMORY_SIZE - 1)) < PATTERN_TABLES_SIZE ? CIRAM_SIZE : GetCIRAMIndex(address);
+    if (index < CIRAM_SIZE)
+    {
+        _CIRAM_writes[index] = _scanlines_drawn;
+        _CIRAM_write = _scanlines_drawn;
+    }
+    else
+        _memory_write = _scanlines_drawn;
+}
+
+uint32_t PPU::GetCIRAMIndex(uint16_t address) const
+{
+    const MemoryPage& page = _ppu_bus.GetPage(address);
+    if (!page.read)
+        return CIRAM_SIZE;
+
+    uintptr_t data = reinterpret_cast<uintptr_t>(page.read + (address & page.mask));
+    uintptr_t CIRAM = reinterpret_cast<uintptr_t>(_ppu_bus.CIRAM);
+
+    return data - CIRAM < CIRAM_SIZE ? static_cast<uint32_t>(data - CIRAM) : CIRAM_SIZE;
+}
+
+void PPU::WriteOAM(uint8_t address, const uint8_t* data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; ++i)
+        OAM[static_cast<uint8_t>(address + i)] = data[i];
+
+    _OAM_changed = true;
+}
+
+void PPU::CopyMemory(const PPU& source)
+{
+    std::memcpy(OAM, source.OAM, sizeof(OAM));
+    _OAM_changed = true;
+    std::memcpy(_palette, source._palette, sizeof(_palette));
+    _palette_write = _scanlines_drawn;
+}
+
+void PPU::HashScanline(uint32_t scanline)
+{
+    if (!_frame_hashing || _headless)
+        return;
+
+    if (scanline == 0)
+    {
+        _frame_hash_state.Reset();
+        _hashed_scanlines = 0;
+    }
+
+    // Hashing turned on mid-frame, the first hash is of the next whole frame
+    if (scanline != _hashed_scanlines)
+        return;
+
+    _frame_hash_state.Update(_framebuffer + scanline * SCREEN_WIDTH, SCREEN_WIDTH);
+    ++_hashed_scanlines;
+
+    if (_hashed_scanlines == SCREEN_HEIGHT)
+    {
+        _frame_hash_state.Update(_emphasis, SCREEN_HEIGHT);
+        _frame_hash = _frame_hash_state.Digest();
+    }
+}
+
+void PPU::MarkDirty(uint32_t scanline, uint32_t columns)
+{
+    _dirty_blocks[scanline / DIRTY_BLOCK_SIZE] |= columns;
+    if (scanline != SCREEN_HEIGHT - 1)
+        return;
+
+    // Runs of blocks on each row, a rect of the row above grows down when the run is the same
+    _dirty_rects.clear();
+    uint32_t open[DIRTY_COLUMNS / 2];
+    uint32_t open_count = 0;
+
+    for (uint32_t row = 0; row < DIRTY_ROWS; ++row)
+    {
+        uint32_t blocks = _dirty_blocks[row];
+        _dirty_blocks[row] = 0;
+
+        uint32_t continued[DIRTY_COLUMNS / 2];
+        uint32_t continued_count = 0;
+
+        while (blocks != 0)
+        {
+            uint32_t first = CountTrailingZeros(blocks);
+            uint32_t run = blocks >> first;
+            uint32_t length = run == ALL_DIRTY_COLUMNS ? DIRTY_COLUMNS : CountTrailingZeros(~run);
+            blocks = length == DIRTY_COLUMNS ? 0 : blocks & ~(((1u << length) - 1) << first);
+
+            DirtyRect rect = { first * DIRTY_BLOCK_SIZE, row * DIRTY_BLOCK_SIZE, length * DIRTY_BLOCK_SIZE, DIRTY_BLOCK_SIZE };
+
+            uint32_t index = static_cast<uint32_t>(_dirty_rects.size());
+            for (uint32_t i = 0; i < open_count; ++i)
+            {
+                DirtyRect& above = _dirty_rects[open[i]];
+                if (above.x == rect.x && above.width == rect.width)
+                {
+                    above.height += DIRTY_BLOCK_SIZE;
+                    index = open[i];
+                    break;
+                }
+            }
+
+            if (index == _dirty_rects.size())
+                _dirty_rects.push_back(rect);
+
+            continued[continued_count++] = index;
+        }
+
+        std::memcpy(open, continued, continued_count * sizeof(uint32_t));
+        open_count = continued_count;
+    }
+}
+
+void PPU::StartVBlank()
+{
+    ++_frame_count;
+
+    if (_VBlank_suppressed)
+    {
+        _VBlank_suppressed = false;
+        return;
+    }
+
+    _status |= PPUSTATUS_VBLANK;
+    if ((_control & PPUCTRL_NMI_ENABLE) != 0)
+        _NMI_pending = true;
+}
+
+void PPU::StartPrerender()
+{
+    _status &= ~(PPUSTATUS_VBLANK | PPUSTATUS_SPRITE_ZERO_HIT | PPUSTATUS_SPRITE_OVERFLOW);
+}
+
+void PPU::IncrementCoarseX()
+{
+    // Wraps into the horizontal nametable
+    if ((_v & 0x001F) == 31)
+        _v = (_v & ~0x001F) ^ 0x0400;
+    else
+        ++_v;
+}
+
+void PPU::IncrementY()
+{
+    if ((_v & 0x7000) != 0x7000)
+    {
+        _v += 0x1000;
+        return;
+    }
+
+    _v &= ~0x7000;
+    uint16_t coarse_y = (_v & 0x03E0) >> 5;
+
+    if (coarse_y == 29)
+    {
+        coarse_y = 0;
+        _v ^= 0x0800;
+    }
+    else if (coarse_y == 31)
+        coarse_y = 0; // Attribute rows as coarse y wrap without switching nametable
+    else
+        ++coarse_y;
+
+    _v = static_cast<uint16_t>((_v & ~0x03E0) | (coarse_y << 5));
+}
+
+void PPU::CopyHorizontal()
+{
+    _v = static_cast<uint16_t>((_v & ~0x041F) | (_t & 0x041F));
+}
+
+void PPU::CopyVertical()
+{
+    _v = static_cast<uint16_t>((_v & ~0x7BE0) | (_t & 0x7BE0));
+}
+
+uint16_t PPU::GetSpritePatternAddress(const uint8_t* entry, uint32_t row) const
+{
+    uint8_t tile = entry[1];
+    uint32_t height = GetSpriteHeight();
+
+    if ((entry[2] & SPRITE_FLIP_VERTICAL) != 0)
+        row = height - 1 - row;
+
+    // 8x16 sprites take the pattern table from bit 0 of the tile
+    if (height == 16)
+        return static_cast<uint16_t>((tile & 0x01) * 0x1000 + ((tile & 0xFE) + (row >> 3)) * 16 + (row & 0x07));
+
+    return static_cast<uint16_t>(((_control & PPUCTRL_SPRITE_TABLE) != 0 ? 0x1000 : 0x0000) + tile * 16 + row);
+}
+
+void PPU::FetchSpriteRow(const uint8_t* entry, uint32_t row, uint8_t& low, uint8_t& high) const
+{
+    uint16_t pattern = GetSpritePatternAddress(entry, row);
+    low = _ppu_bus.Read(pattern);
+    high = _ppu_bus.Read(pattern + 8);
+
+    if ((entry[2] & SPRITE_FLIP_HORIZONTAL) != 0)
+    {
+        low = ReverseBits(low);
+        high = ReverseBits(high);
+    }
+}
+
+uint8_t PPU::GetBackdropColor() const
+{
+    // The backdrop, or the palette entry v points to when it is inside the palette
+    uint16_t vram_address = _v & 0x3FFF;
+    uint8_t backdrop = vram_address >= PALETTE_START ? ReadPalette(vram_address) : _palette[0];
+
+    return backdrop & GetColorMask();
+}
+
+uint8_t PPU::PaletteIndex(uint16_t address)
+{
+    uint8_t index = address & 0x1F;
+
+    // Color 0 of the sprite palettes is the backdrop entry of the background palettes
+    if ((index & 0x13) == 0x10)
+        index &= 0x0F;
+
+    return index;
+}
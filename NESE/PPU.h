@@ -19,5 +19,264 @@
 #ifndef PPU_h__
 #define PPU_h__
 
+#include <cstdint>
+#include <vector>
+#include "Hash.h"
+#include "PPUBus.h"
+
+class RenderPipeline;
+
+/* NTSC timing */
+constexpr uint32_t PPU_DOTS_PER_SCANLINE = 341;
+constexpr uint32_t PPU_SCANLINES_PER_FRAME = 262;
+constexpr uint32_t PPU_DOTS_PER_FRAME = PPU_DOTS_PER_SCANLINE * PPU_SCANLINES_PER_FRAME;
+constexpr uint32_t PPU_DOTS_PER_CPU_CYCLE = 3;
+constexpr uint32_t PPU_VISIBLE_SCANLINES = 240;
+constexpr uint32_t PPU_VBLANK_SCANLINE = 241;
+constexpr uint32_t PPU_PRERENDER_SCANLINE = 261;
+
+constexpr uint32_t SCREEN_WIDTH = 256;
+constexpr uint32_t SCREEN_HEIGHT = PPU_VISIBLE_SCANLINES;
+
+constexpr uint32_t OAM_SIZE = 256;
+constexpr uint32_t PALETTE_SIZE = 32;
+constexpr uint16_t PALETTE_START = 0x3F00;
+constexpr uint32_t MAX_SPRITES_PER_SCANLINE = 8;
+
+/* PPUCTRL ($2000) */
+constexpr uint8_t PPUCTRL_NAMETABLE = 0x03;
+constexpr uint8_t PPUCTRL_INCREMENT_32 = 0x04;
+constexpr uint8_t PPUCTRL_SPRITE_TABLE = 0x08;
+constexpr uint8_t PPUCTRL_BACKGROUND_TABLE = 0x10;
+constexpr uint8_t PPUCTRL_SPRITE_SIZE = 0x20;
+constexpr uint8_t PPUCTRL_NMI_ENABLE = 0x80;
+
+/* PPUMASK ($2001) */
+constexpr uint8_t PPUMASK_GRAYSCALE = 0x01;
+constexpr uint8_t PPUMASK_BACKGROUND_LEFT = 0x02;
+constexpr uint8_t PPUMASK_SPRITES_LEFT = 0x04;
+constexpr uint8_t PPUMASK_SHOW_BACKGROUND = 0x08;
+constexpr uint8_t PPUMASK_SHOW_SPRITES = 0x10;
+constexpr uint8_t PPUMASK_EMPHASIS_SHIFT = 5; // Red, green, blue emphasis on bits 5-7
+
+/* PPUSTATUS ($2002) */
+constexpr uint8_t PPUSTATUS_SPRITE_OVERFLOW = 0x20;
+constexpr uint8_t PPUSTATUS_SPRITE_ZERO_HIT = 0x40;
+constexpr uint8_t PPUSTATUS_VBLANK = 0x80;
+
+/* OAM sprite attributes */
+constexpr uint8_t SPRITE_PALETTE = 0x03;
+constexpr uint8_t SPRITE_BEHIND_BACKGROUND = 0x20;
+constexpr uint8_t SPRITE_FLIP_HORIZONTAL = 0x40;
+constexpr uint8_t SPRITE_FLIP_VERTICAL = 0x80;
+
+// Part of the screen the caller wants drawn
+struct RegionOfInterest
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride; // Every stride-th scanline counting from y
+};
+
+constexpr RegionOfInterest FULL_SCREEN = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 1 };
+
+// Area of the framebuffer, in pixels
+struct DirtyRect
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Dirty tracking works on 8x8 blocks, a scanline has one bit per block column
+constexpr uint32_t DIRTY_BLOCK_SIZE = 8;
+constexpr uint32_t DIRTY_COLUMNS = SCREEN_WIDTH / DIRTY_BLOCK_SIZE;
+constexpr uint32_t DIRTY_ROWS = SCREEN_HEIGHT / DIRTY_BLOCK_SIZE;
+constexpr uint32_t ALL_DIRTY_COLUMNS = 0xFFFFFFFF;
+
+/** PPU
+*  State shared by the PPU backends: registers, OAM, palette, the loopy scroll registers
+*  (v/t/x/w) and the framebuffer. The backends decide when the frame advances and draw it,
+*  Console<MapperType, PPUType> calls them directly, so nothing here is virtual.
+*  The CPU side must Run() the backend up to the access time before touching a register.
+**/
+class PPU
+{
+public:
+    // Registers to their power on state, the timing is not affected
+    void Reset();
+
+    // $2000-$2007 (mirrored up to $3FFF)
+    uint8_t ReadRegister(uint16_t address);
+    void WriteRegister(uint16_t address, uint8_t data);
+
+    // $4014, page holds the 256 bytes read by the DMA
+    void WriteOAMDMA(const uint8_t* page);
+
+    // True once per NMI, the edge is consumed by the call
+    bool TakeNMI()
+    {
+        bool NMI = _NMI_pending;
+        _NMI_pending = false;
+        return NMI;
+    }
+
+    uint64_t GetTime() const { return _time; }
+
+    // First VBlank start (scanline 241, dot 1) after time
+    static uint64_t GetNextVBlankTime(uint64_t time)
+    {
+        uint64_t vblank = time - time % PPU_DOTS_PER_FRAME + PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE + 1;
+        return vblank > time ? vblank : vblank + PPU_DOTS_PER_FRAME;
+    }
+
+    uint64_t GetFrameCount() const { return _frame_count; } // Frames completed (VBlank starts)
+
+    uint8_t GetControl() const { return _control; }
+    uint8_t GetMask() const { return _mask; }
+    bool IsRenderingEnabled() const { return (_mask & (PPUMASK_SHOW_BACKGROUND | PPUMASK_SHOW_SPRITES)) != 0; }
+
+    // SCREEN_WIDTH x SCREEN_HEIGHT palette indices (0x00-0x3F)
+    const uint8_t* GetFramebuffer() const { return _framebuffer; }
+
+    // Color emphasis (PPUMASK bits 5-7 as 0-7) of each scanline, taken when it starts.
+    // FrameConverter turns both into host pixels.
+    const uint8_t* GetEmphasis() const { return _emphasis; }
+
+    // Headless backends draw nothing, the framebuffer keeps its last contents. Everything the
+    // CPU can see (status flags and their timing, VRAM address, NMI) stays the same.
+    void SetHeadless(bool headless) { _headless = headless; }
+    bool IsHeadless() const { return _headless; }
+
+    // Only the pixels of the region are drawn, the rest of the framebuffer keeps its last
+    // contents. Like headless, the CPU sees no difference, and the drawing cost follows the area.
+    void SetRegionOfInterest(const RegionOfInterest& region);
+    const RegionOfInterest& GetRegionOfInterest() const { return _region; }
+
+    // XXH64 of each frame drawn, fed a scanline at a time as they are finished: the
+    // framebuffer rows followed by the emphasis of every scanline. Two runs with the same
+    // hashes showed the same video.
+    void SetFrameHashing(bool frame_hashing) { _frame_hashing = frame_hashing; }
+    bool IsFrameHashing() const { return _frame_hashing; }
+
+    // Hash of the last frame drawn whole with hashing on, 0 before the first one
+    uint64_t GetFrameHash() const { return _frame_hash; }
+
+    // The scanline PPU then redraws only the 8x8 blocks whose inputs changed since the frame
+    // before: nametable entries, attributes, palette, pattern memory and its banks, scroll and
+    // registers of the scanline, or the sprites on it. The other blocks keep their pixels.
+    // Only writes through the registers and WriteVRAM() are seen, not straight to CIRAM.
+    void SetDirtyTracking(bool dirty_tracking) { _dirty_tracking = dirty_tracking; }
+    bool IsDirtyTracking() const { return _dirty_tracking; }
+
+    // Blocks of the framebuffer the last frame drew over, merged in rectangles. Everything else
+    // is the same as the frame before. The whole screen on backends that don't report them.
+    const std::vector<DirtyRect>& GetDirtyRects() const { return _dirty_rects; }
+
+    // Every VRAM, palette and OAM write is recorded on the pipeline, nullptr stops it
+    void AttachPipeline(RenderPipeline* pipeline) { _pipeline = pipeline; }
+
+    // $2007 write without the address increment, for replaying recorded writes
+    void WriteVRAM(uint16_t address, uint8_t data);
+
+    // OAM write of size bytes from address on, wrapping around, the OAM address is not used
+    void WriteOAM(uint8_t address, const uint8_t* data, uint32_t size);
+
+    // OAM and palette of another PPU
+    void CopyMemory(const PPU& source);
+
+    // The scanline PPU sees writes straight to the array from the next frame on,
+    // $2004, the DMA and WriteOAM() right away
+    uint8_t OAM[OAM_SIZE];
+
+protected:
+    PPU(PPUBus& ppu_bus);
+
+    // Dot 1 of the VBlank and of the pre-render scanlines
+    void StartVBlank();
+    void StartPrerender();
+
+    // Loopy scroll updates
+    void IncrementCoarseX();
+    void IncrementY();
+    void CopyHorizontal();
+    void CopyVertical();
+
+    // Pattern row of a sprite, row counts from the top of the sprite before flipping.
+    // Horizontal flip is applied, so the leftmost pixel is always bit 7.
+    uint16_t GetSpritePatternAddress(const uint8_t* entry, uint32_t row) const;
+    void FetchSpriteRow(const uint8_t* entry, uint32_t row, uint8_t& low, uint8_t& high) const;
+    uint32_t GetSpriteHeight() const { return (_control & PPUCTRL_SPRITE_SIZE) != 0 ? 16 : 8; }
+
+    bool IsScanlineOfInterest(uint32_t scanline) const
+    {
+        return scanline - _region.y < _region.height && (scanline - _region.y) % _region.stride == 0;
+    }
+    bool IsPixelOfInterest(uint32_t x, uint32_t scanline) const { return x - _region.x < _region.width && IsScanlineOfInterest(scanline); }
+    bool IsFullWidth() const { return _region.width == SCREEN_WIDTH; }
+
+    // Adds a finished scanline to the frame hash
+    void HashScanline(uint32_t scanline);
+
+    // Block columns a scanline drew over, the rects are built after the last scanline
+    void MarkDirty(uint32_t scanline, uint32_t columns);
+
+    // CIRAM byte behind a nametable address, CIRAM_SIZE when the page maps other memory
+    uint32_t GetCIRAMIndex(uint16_t address) const;
+
+    // Color of the pixels while rendering is disabled
+    uint8_t GetBackdropColor() const;
+    uint8_t GetColorMask() const { return (_mask & PPUMASK_GRAYSCALE) != 0 ? 0x30 : 0x3F; }
+
+    uint8_t ReadPalette(uint16_t address) const { return _palette[PaletteIndex(address)]; }
+    static uint8_t PaletteIndex(uint16_t address);
+
+    PPUBus& _ppu_bus;
+
+    uint64_t _time; // Last dot processed
+    uint64_t _frame_count;
+    bool _headless;
+    RegionOfInterest _region;
+    RenderPipeline* _pipeline;
+
+    uint8_t _control;
+    uint8_t _mask;
+    uint8_t _status;
+    uint8_t _OAM_address;
+    uint8_t _data_buffer; // $2007 read buffer
+    uint8_t _io_latch;    // Last value written to any register, read back from write only ones
+
+    uint16_t _v;    // Current VRAM address
+    uint16_t _t;    // Temporary VRAM address, top left of the screen
+    uint8_t _fine_x;
+    bool _w;        // Write toggle of $2005/$2006
+
+    bool _NMI_pending;
+    bool _VBlank_suppressed; // $2002 was read the dot before VBlank, this frame sets no flag nor NMI
+    bool _OAM_changed; // Through $2004 or the DMA, cleared by the backend that cares
+
+    uint8_t _palette[PALETTE_SIZE];
+    uint8_t _framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+    uint8_t _emphasis[SCREEN_HEIGHT];
+
+    bool _frame_hashing;
+    XXH64State _frame_hash_state;
+    uint32_t _hashed_scanlines; // Of the current frame, in order from scanline 0
+    uint64_t _frame_hash;
+
+    // Writes are stamped with the count of scanlines drawn, a scanline drawn again sees
+    // the ones stamped from its last drawing on
+    bool _dirty_tracking;
+    uint64_t _scanlines_drawn;
+    uint64_t _CIRAM_writes[CIRAM_SIZE];
+    uint64_t _CIRAM_write; // Latest of them
+    uint64_t _palette_write;
+    uint64_t _memory_write; // Pattern tables, nametables outside CIRAM
+    uint32_t _dirty_blocks[DIRTY_ROWS];
+    std::vector<DirtyRect> _dirty_rects;
+};
 
 #endif // PPU_h__
\ No newline at end of file
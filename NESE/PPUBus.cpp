@@ -0,0 +1,97 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PPUBus.h"
+#include "TileDecoder.h"
+#include <cstring>
+
+PPUBus::PPUBus() : _tile_cache(nullptr)
+{
+    std::memset(CIRAM, 0, sizeof(CIRAM));
+
+    for (uint32_t i = 0; i < PPU_PAGE_COUNT; ++i)
+    {
+        _pages[i].read = nullptr;
+        _pages[i].write = nullptr;
+        _pages[i].mask = PPU_PAGE_SIZE - 1;
+        _chr_offsets[i] = NO_CHR_OFFSET;
+    }
+
+    SetMirroring(Mirroring::Horizontal);
+}
+
+void PPUBus::MapPages(uint16_t address, uint32_t size, const uint8_t* read, uint8_t* write, uint32_t chr_offset)
+{
+    for (uint32_t offset = 0; offset < size; offset += PPU_PAGE_SIZE)
+    {
+        uint32_t index = (address + offset) >> PPU_PAGE_SHIFT;
+        MemoryPage& page = _pages[index];
+        page.read = read ? read + offset : nullptr;
+        page.write = write ? write + offset : nullptr;
+        page.mask = PPU_PAGE_SIZE - 1;
+        _chr_offsets[index] = read && chr_offset != NO_CHR_OFFSET ? chr_offset + offset : NO_CHR_OFFSET;
+    }
+}
+
+const uint8_t* PPUBus::DecodePatternRow(uint16_t address, bool flipped)
+{
+    uint8_t low = Read(address);
+    uint8_t high = Read(address + 8);
+
+    if (flipped)
+        DecodeTileRowFlipped(low, high, _pattern_row);
+    else
+        DecodeTileRow(low, high, _pattern_row);
+
+    return _pattern_row;
+}
+
+void PPUBus::SetMirroring(Mirroring mirroring)
+{
+    _mirroring = mirroring;
+
+    // CIRAM page used by each of the four logical nametables
+    uint8_t nametables[4];
+
+    switch (mirroring)
+    {
+    case Mirroring::Horizontal:
+        nametables[0] = 0; nametables[1] = 0; nametables[2] = 1; nametables[3] = 1;
+        break;
+    case Mirroring::Vertical:
+        nametables[0] = 0; nametables[1] = 1; nametables[2] = 0; nametables[3] = 1;
+        break;
+    case Mirroring::SingleScreenLow:
+        nametables[0] = 0; nametables[1] = 0; nametables[2] = 0; nametables[3] = 0;
+        break;
+    case Mirroring::SingleScreenHigh:
+        nametables[0] = 1; nametables[1] = 1; nametables[2] = 1; nametables[3] = 1;
+        break;
+    case Mirroring::FourScreen:
+    default:
+        nametables[0] = 0; nametables[1] = 1; nametables[2] = 2; nametables[3] = 3;
+        break;
+    }
+
+    // $3000-$3EFF mirrors $2000-$2EFF, the palette on $3F00 is handled by the PPU itself
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        uint8_t* nametable = CIRAM + nametables[i % 4] * NAMETABLE_SIZE;
+        MapPages(NAMETABLES_START + i * NAMETABLE_SIZE, NAMETABLE_SIZE, nametable, nametable);
+    }
+}
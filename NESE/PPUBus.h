@@ -0,0 +1,122 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PPUBus_h__
+#define PPUBus_h__
+
+#include <cstdint>
+#include "Bus.h"
+#include "TileCache.h"
+
+/* PPU address map ($0000-$3FFF), 16 pages of 1 KB */
+constexpr uint32_t PPU_MEMORY_SIZE = 0x4000;
+constexpr uint32_t PPU_PAGE_SHIFT = 10;
+constexpr uint32_t PPU_PAGE_SIZE = 1 << PPU_PAGE_SHIFT;
+constexpr uint32_t PPU_PAGE_COUNT = PPU_MEMORY_SIZE / PPU_PAGE_SIZE;
+
+constexpr uint16_t PATTERN_TABLES_SIZE = 0x2000;
+constexpr uint16_t NAMETABLES_START = 0x2000;
+constexpr uint16_t NAMETABLE_SIZE = 0x0400;
+
+// Console VRAM is 2 KB, four screen boards add another 2 KB
+constexpr uint32_t CIRAM_SIZE = 4096;
+
+enum class Mirroring
+{
+    Horizontal,
+    Vertical,
+    SingleScreenLow,
+    SingleScreenHigh,
+    FourScreen,
+};
+
+class PPUBus
+{
+public:
+    PPUBus();
+
+    inline uint8_t Read(uint16_t address) const
+    {
+        const MemoryPage& page = _pages[(address & (PPU_MEMORY_SIZE - 1)) >> PPU_PAGE_SHIFT];
+        if (page.read)
+            return page.read[address & page.mask];
+
+        return 0;
+    }
+
+    inline void Write(uint16_t address, uint8_t data)
+    {
+        uint32_t index = (address & (PPU_MEMORY_SIZE - 1)) >> PPU_PAGE_SHIFT;
+        const MemoryPage& page = _pages[index];
+        if (page.write)
+        {
+            page.write[address & page.mask] = data;
+
+            // CHR RAM, the decoded tile is stale now
+            if (_tile_cache && _chr_offsets[index] != NO_CHR_OFFSET)
+                _tile_cache->Invalidate(_chr_offsets[index] + (address & page.mask));
+        }
+    }
+
+    // 8 pixels of a pattern row, address is tile * 16 + row (0-7) on the pattern tables.
+    // Comes from the tile cache when the page is CHR memory of the connected cache.
+    inline const uint8_t* GetPatternRow(uint16_t address, bool flipped)
+    {
+        uint32_t index = (address & (PATTERN_TABLES_SIZE - 1)) >> PPU_PAGE_SHIFT;
+        const MemoryPage& page = _pages[index];
+        uint32_t tile_offset = address & page.mask & ~(TILE_SIZE - 1);
+
+        if (_tile_cache && _chr_offsets[index] != NO_CHR_OFFSET)
+            return _tile_cache->GetRow(_chr_offsets[index] + tile_offset, page.read + tile_offset, address & 0x07, flipped);
+
+        return DecodePatternRow(address, flipped);
+    }
+
+    // address and size must be multiples of PPU_PAGE_SIZE, a null write pointer makes the pages read only.
+    // chr_offset is the offset of the first page in the cartridge CHR memory, for the tile cache.
+    void MapPages(uint16_t address, uint32_t size, const uint8_t* read, uint8_t* write, uint32_t chr_offset = NO_CHR_OFFSET);
+
+    // Cache of the cartridge CHR memory, set by the mapper
+    void ConnectTileCache(TileCache* tile_cache) { _tile_cache = tile_cache; }
+    void DisconnectTileCache() { _tile_cache = nullptr; }
+    const TileCache* GetTileCache() const { return _tile_cache; }
+
+    // Points the nametable pages ($2000-$3EFF) to the console VRAM
+    void SetMirroring(Mirroring mirroring);
+    Mirroring GetMirroring() const { return _mirroring; }
+
+    const MemoryPage& GetPage(uint16_t address) const { return _pages[(address & (PPU_MEMORY_SIZE - 1)) >> PPU_PAGE_SHIFT]; }
+
+    // CHR memory offset of the page holding address, NO_CHR_OFFSET when it is not CHR
+    uint32_t GetCHROffset(uint16_t address) const { return _chr_offsets[(address & (PPU_MEMORY_SIZE - 1)) >> PPU_PAGE_SHIFT]; }
+
+    uint8_t CIRAM[CIRAM_SIZE];
+
+private:
+    // Decodes the row on the spot, for pages without a tile cache
+    const uint8_t* DecodePatternRow(uint16_t address, bool flipped);
+
+    MemoryPage _pages[PPU_PAGE_COUNT];
+    uint32_t _chr_offsets[PPU_PAGE_COUNT];
+    Mirroring _mirroring;
+
+    TileCache* _tile_cache;
+    uint8_t _pattern_row[8];
+};
+
+#endif // PPUBus_h__
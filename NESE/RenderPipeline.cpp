@@ -0,0 +1,311 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "RenderPipeline.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+// Idle polls of the render thread before it starts sleeping between them
+constexpr uint32_t RENDER_PIPELINE_SPINS = 64;
+
+static void Append16(std::vector<uint8_t>& log, uint16_t value)
+{
+    log.push_back(static_cast<uint8_t>(value));
+    log.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+static void Append32(std::vector<uint8_t>& log, uint32_t value)
+{
+    Append16(log, static_cast<uint16_t>(value));
+    Append16(log, static_cast<uint16_t>(value >> 16));
+}
+
+static uint16_t Read16(const uint8_t* data)
+{
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+static uint32_t Read32(const uint8_t* data)
+{
+    return Read16(data) | (static_cast<uint32_t>(Read16(data + 2)) << 16);
+}
+
+RenderPipeline::RenderPipeline() : _ppu(_ppu_bus), _CHR_ROM(nullptr), _banks_recorded(false),
+    _mirroring(Mirroring::Horizontal), _head(0), _tail(0), _stop(false),
+    _frame_hashing(false), _dirty_tracking(false)
+{
+    for (uint32_t& chr_offset : _chr_offsets)
+        chr_offset = NO_CHR_OFFSET;
+}
+
+RenderPipeline::~RenderPipeline()
+{
+    Stop();
+}
+
+bool RenderPipeline::Start(const PPU& ppu, const PPUBus& ppu_bus, const Cartridge& cartridge)
+{
+    Stop();
+
+    if (!cartridge.chr_is_ram && cartridge.GetPager())
+    {
+        std::cerr << "ERROR> Pipelined rendering needs the whole CHR ROM in memory.\n";
+        return false;
+    }
+
+    // CHR ROM never changes, CHR RAM gets a copy kept up to date by the recorded writes
+    const CartridgeRegion& CHR = cartridge.CHR_ROM_RAM;
+    if (cartridge.chr_is_ram)
+    {
+        _CHR_ROM = nullptr;
+        _CHR_RAM.assign(CHR.data(), CHR.data() + CHR.size());
+    }
+    else
+    {
+        _CHR_ROM = CHR.data();
+        _CHR_RAM.clear();
+    }
+
+    _tile_cache.reset(new TileCache(static_cast<uint32_t>(CHR.size())));
+    _ppu_bus.ConnectTileCache(_tile_cache.get());
+    std::memcpy(_ppu_bus.CIRAM, ppu_bus.CIRAM, sizeof(_ppu_bus.CIRAM));
+
+    _ppu.Reset();
+    _ppu.CopyMemory(ppu);
+    _ppu.SetRegionOfInterest(ppu.GetRegionOfInterest());
+    _frame_hashing.store(ppu.IsFrameHashing(), std::memory_order_relaxed);
+    _dirty_tracking.store(ppu.IsDirtyTracking(), std::memory_order_relaxed);
+
+    // Banks go on the log with the first scanline
+    _banks_recorded = false;
+
+    _head.store(0, std::memory_order_relaxed);
+    _tail.store(0, std::memory_order_relaxed);
+    for (Slot& slot : _slots)
+    {
+        slot.log.clear();
+        std::memcpy(slot.framebuffer, ppu.GetFramebuffer(), sizeof(slot.framebuffer));
+        std::memcpy(slot.emphasis, ppu.GetEmphasis(), sizeof(slot.emphasis));
+        slot.frame_hash = ppu.GetFrameHash();
+        slot.dirty_rects.assign(1, { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT });
+    }
+
+    _stop.store(false, std::memory_order_relaxed);
+    _thread = std::thread(&RenderPipeline::RenderLoop, this);
+
+    return true;
+}
+
+void RenderPipeline::Stop()
+{
+    if (!_thread.joinable())
+        return;
+
+    // Frames already ended are still drawn
+    _stop.store(true, std::memory_order_release);
+    _thread.join();
+}
+
+void RenderPipeline::RecordScanline(const PPUBus& ppu_bus, uint32_t scanline, uint8_t control, uint8_t mask, uint16_t v, uint8_t fine_x)
+{
+    std::vector<uint8_t>& log = GetLog();
+
+    // The PPU is caught up before every bank switch, so the scanline uses what is mapped now
+    bool banks_changed = !_banks_recorded || ppu_bus.GetMirroring() != _mirroring;
+    for (uint32_t i = 0; i < PATTERN_TABLES_SIZE / PPU_PAGE_SIZE; ++i)
+    {
+        uint32_t chr_offset = ppu_bus.GetCHROffset(static_cast<uint16_t>(i * PPU_PAGE_SIZE));
+        banks_changed |= chr_offset != _chr_offsets[i];
+        _chr_offsets[i] = chr_offset;
+    }
+
+    if (banks_changed)
+    {
+        _mirroring = ppu_bus.GetMirroring();
+        _banks_recorded = true;
+
+        log.push_back(static_cast<uint8_t>(Command::Banks));
+        log.push_back(static_cast<uint8_t>(_mirroring));
+        for (uint32_t chr_offset : _chr_offsets)
+            Append32(log, chr_offset);
+    }
+
+    log.push_back(static_cast<uint8_t>(Command::Scanline));
+    log.push_back(static_cast<uint8_t>(scanline));
+    log.push_back(control);
+    log.push_back(mask);
+    Append16(log, v);
+    log.push_back(fine_x);
+}
+
+void RenderPipeline::RecordVRAMWrite(uint16_t address, uint8_t data)
+{
+    std::vector<uint8_t>& log = GetLog();
+    log.push_back(static_cast<uint8_t>(Command::VRAMWrite));
+    Append16(log, address);
+    log.push_back(data);
+}
+
+void RenderPipeline::RecordOAMWrite(uint8_t address, uint8_t data)
+{
+    std::vector<uint8_t>& log = GetLog();
+    log.push_back(static_cast<uint8_t>(Command::OAMWrite));
+    log.push_back(address);
+    log.push_back(data);
+}
+
+void RenderPipeline::RecordOAMDMA(uint8_t address, const uint8_t* page)
+{
+    std::vector<uint8_t>& log = GetLog();
+    log.push_back(static_cast<uint8_t>(Command::OAMDMA));
+    log.push_back(address);
+    log.insert(log.end(), page, page + OAM_SIZE);
+}
+
+void RenderPipeline::RecordRegionOfInterest(const RegionOfInterest& region)
+{
+    std::vector<uint8_t>& log = GetLog();
+    log.push_back(static_cast<uint8_t>(Command::Region));
+    Append32(log, region.x);
+    Append32(log, region.y);
+    Append32(log, region.width);
+    Append32(log, region.height);
+    Append32(log, region.stride);
+}
+
+void RenderPipeline::EndFrame()
+{
+    uint64_t head = _head.load(std::memory_order_relaxed) + 1;
+    _head.store(head, std::memory_order_release);
+
+    // The log of the next slot is reused once the render thread is done with it
+    while (head - _tail.load(std::memory_order_acquire) >= RENDER_PIPELINE_DEPTH)
+        std::this_thread::yield();
+
+    GetLog().clear();
+}
+
+void RenderPipeline::Wait() const
+{
+    while (_tail.load(std::memory_order_acquire) != _head.load(std::memory_order_relaxed))
+        std::this_thread::yield();
+}
+
+void RenderPipeline::RenderLoop()
+{
+    uint32_t idle_polls = 0;
+
+    while (true)
+    {
+        // Stop is set after the last frame is published, so it is read first
+        bool stop = _stop.load(std::memory_order_acquire);
+        uint64_t tail = _tail.load(std::memory_order_relaxed);
+
+        if (tail == _head.load(std::memory_order_acquire))
+        {
+            if (stop)
+                break;
+
+            if (++idle_polls < RENDER_PIPELINE_SPINS)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+            continue;
+        }
+
+        idle_polls = 0;
+
+        Slot& slot = _slots[tail % RENDER_PIPELINE_DEPTH];
+        _ppu.SetFrameHashing(_frame_hashing.load(std::memory_order_relaxed));
+        _ppu.SetDirtyTracking(_dirty_tracking.load(std::memory_order_relaxed));
+        Replay(slot.log);
+        std::memcpy(slot.framebuffer, _ppu.GetFramebuffer(), sizeof(slot.framebuffer));
+        std::memcpy(slot.emphasis, _ppu.GetEmphasis(), sizeof(slot.emphasis));
+        slot.frame_hash = _ppu.GetFrameHash();
+        slot.dirty_rects = _ppu.GetDirtyRects();
+
+        _tail.store(tail + 1, std::memory_order_release);
+    }
+}
+
+void RenderPipeline::Replay(const std::vector<uint8_t>& log)
+{
+    const uint8_t* data = log.data();
+    const uint8_t* end = data + log.size();
+
+    while (data < end)
+    {
+        switch (static_cast<Command>(*data++))
+        {
+        case Command::Scanline:
+            _ppu.ReplayScanline(data[0], data[1], data[2], Read16(data + 3), data[5]);
+            data += 6;
+            break;
+        case Command::Banks:
+        {
+            uint32_t chr_offsets[PATTERN_TABLES_SIZE / PPU_PAGE_SIZE];
+            for (uint32_t i = 0; i < PATTERN_TABLES_SIZE / PPU_PAGE_SIZE; ++i)
+                chr_offsets[i] = Read32(data + 1 + i * 4);
+
+            MapBanks(static_cast<Mirroring>(data[0]), chr_offsets);
+            data += 1 + sizeof(chr_offsets);
+            break;
+        }
+        case Command::VRAMWrite:
+            _ppu.WriteVRAM(Read16(data), data[2]);
+            data += 3;
+            break;
+        case Command::OAMWrite:
+            _ppu.WriteOAM(data[0], data + 1, 1);
+            data += 2;
+            break;
+        case Command::OAMDMA:
+            _ppu.WriteOAM(data[0], data + 1, OAM_SIZE);
+            data += 1 + OAM_SIZE;
+            break;
+        case Command::Region:
+        {
+            RegionOfInterest region = { Read32(data), Read32(data + 4), Read32(data + 8), Read32(data + 12), Read32(data + 16) };
+            _ppu.SetRegionOfInterest(region);
+            data += 20;
+            break;
+        }
+        }
+    }
+}
+
+void RenderPipeline::MapBanks(Mirroring mirroring, const uint32_t* chr_offsets)
+{
+    for (uint32_t i = 0; i < PATTERN_TABLES_SIZE / PPU_PAGE_SIZE; ++i)
+    {
+        uint16_t address = static_cast<uint16_t>(i * PPU_PAGE_SIZE);
+        uint32_t chr_offset = chr_offsets[i];
+
+        if (chr_offset == NO_CHR_OFFSET)
+            _ppu_bus.MapPages(address, PPU_PAGE_SIZE, nullptr, nullptr);
+        else if (_CHR_ROM)
+            _ppu_bus.MapPages(address, PPU_PAGE_SIZE, _CHR_ROM + chr_offset, nullptr, chr_offset);
+        else
+            _ppu_bus.MapPages(address, PPU_PAGE_SIZE, _CHR_RAM.data() + chr_offset, _CHR_RAM.data() + chr_offset, chr_offset);
+    }
+
+    _ppu_bus.SetMirroring(mirroring);
+}
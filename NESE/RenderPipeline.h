@@ -0,0 +1,136 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef RenderPipeline_h__
+#define RenderPipeline_h__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "Cartridge.h"
+#include "PPUBus.h"
+#include "ScanlinePPU.h"
+#include "TileCache.h"
+
+// Frames the emulation thread can run ahead of the render thread
+constexpr uint32_t RENDER_PIPELINE_DEPTH = 3;
+
+/** RENDER PIPELINE
+*  Draws the frames of a headless ScanlinePPU on a render thread, so the pixels of frame N
+*  are composed while the CPU emulates frame N+1.
+*  The emulation thread keeps everything the CPU can see (status flags, sprite 0 hit, NMI)
+*  and records a log per frame: the registers at the start of every visible scanline, the
+*  pattern banks and mirroring when they change, and every VRAM, palette and OAM write in
+*  between. The render thread replays the log on its own copy of the PPU memory and draws
+*  each scanline with the same ScanlinePPU code, so the result is the same frame.
+*  Logs go through a single producer single consumer ring of RENDER_PIPELINE_DEPTH slots,
+*  the emulation thread only waits when the render thread is that many frames behind.
+**/
+class RenderPipeline
+{
+public:
+    RenderPipeline();
+    ~RenderPipeline();
+
+    RenderPipeline(const RenderPipeline&) = delete;
+    RenderPipeline& operator=(const RenderPipeline&) = delete;
+
+    // Copies the PPU memory and starts the render thread, again to restart after a reset.
+    // CHR ROM is shared with the cartridge, so it can't come from a lazy pager.
+    bool Start(const PPU& ppu, const PPUBus& ppu_bus, const Cartridge& cartridge);
+    void Stop();
+
+    bool IsRunning() const { return _thread.joinable(); }
+
+    // Emulation thread, in the order the PPU sees them
+    void RecordScanline(const PPUBus& ppu_bus, uint32_t scanline, uint8_t control, uint8_t mask, uint16_t v, uint8_t fine_x);
+    void RecordVRAMWrite(uint16_t address, uint8_t data);
+    void RecordOAMWrite(uint8_t address, uint8_t data);
+    void RecordOAMDMA(uint8_t address, const uint8_t* page);
+    void RecordRegionOfInterest(const RegionOfInterest& region);
+
+    // Hands the log of the frame to the render thread
+    void EndFrame();
+
+    // Blocks until every frame ended so far is drawn
+    void Wait() const;
+
+    // Last frame drawn, valid until the emulation thread ends RENDER_PIPELINE_DEPTH - 1 more frames
+    const uint8_t* GetFramebuffer() const { return GetLastSlot().framebuffer; }
+    const uint8_t* GetEmphasis() const { return GetLastSlot().emphasis; }
+    uint64_t GetFrameHash() const { return GetLastSlot().frame_hash; }
+    const std::vector<DirtyRect>& GetDirtyRects() const { return GetLastSlot().dirty_rects; }
+
+    // Apply from the next frame the render thread starts
+    void SetFrameHashing(bool frame_hashing) { _frame_hashing.store(frame_hashing, std::memory_order_relaxed); }
+    void SetDirtyTracking(bool dirty_tracking) { _dirty_tracking.store(dirty_tracking, std::memory_order_relaxed); }
+
+    uint64_t GetFramesDrawn() const { return _tail.load(std::memory_order_acquire); }
+
+private:
+    enum class Command : uint8_t
+    {
+        Scanline,   // scanline, control, mask, v (2), fine x
+        Banks,      // mirroring, 8 pattern page CHR offsets (4 each)
+        VRAMWrite,  // address (2), data
+        OAMWrite,   // address, data
+        OAMDMA,     // address, 256 bytes
+        Region,     // Region of interest: x, y, width, height, stride (4 each)
+    };
+
+    struct Slot
+    {
+        std::vector<uint8_t> log;
+        uint8_t framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+        uint8_t emphasis[SCREEN_HEIGHT];
+        uint64_t frame_hash;
+        std::vector<DirtyRect> dirty_rects;
+    };
+
+    void RenderLoop();
+    void Replay(const std::vector<uint8_t>& log);
+    void MapBanks(Mirroring mirroring, const uint32_t* chr_offsets);
+
+    const Slot& GetLastSlot() const { return _slots[(GetFramesDrawn() + RENDER_PIPELINE_DEPTH - 1) % RENDER_PIPELINE_DEPTH]; }
+    std::vector<uint8_t>& GetLog() { return _slots[_head.load(std::memory_order_relaxed) % RENDER_PIPELINE_DEPTH].log; }
+
+    // Render thread copy of the PPU
+    PPUBus _ppu_bus;
+    ScanlinePPU _ppu;
+    std::unique_ptr<TileCache> _tile_cache;
+    std::vector<uint8_t> _CHR_RAM;
+    const uint8_t* _CHR_ROM;
+
+    // Banks of the last recorded scanline, emulation thread
+    bool _banks_recorded;
+    Mirroring _mirroring;
+    uint32_t _chr_offsets[PATTERN_TABLES_SIZE / PPU_PAGE_SIZE];
+
+    Slot _slots[RENDER_PIPELINE_DEPTH];
+    std::atomic<uint64_t> _head; // Frames ended by the emulation thread
+    std::atomic<uint64_t> _tail; // Frames drawn by the render thread
+    std::atomic<bool> _stop;
+    std::atomic<bool> _frame_hashing;
+    std::atomic<bool> _dirty_tracking;
+    std::thread _thread;
+};
+
+#endif // RenderPipeline_h__
@@ -0,0 +1,357 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "RomCache.h"
+#include "Hash.h"
+#include "MappedFile.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <direct.h>
+#include <process.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+namespace
+{
+    const char ROM_CACHE_MAGIC[8] = { 'N', 'E', 'S', 'E', 'R', 'O', 'M', 'C' };
+    const char ROM_INDEX_MAGIC[8] = { 'N', 'E', 'S', 'E', 'R', 'O', 'M', 'I' };
+
+    uint64_t HeaderChecksum(const RomCache::RomCacheHeader& header)
+    {
+        return XXH64(&header, offsetof(RomCache::RomCacheHeader, checksum));
+    }
+
+    uint64_t IndexChecksum(const RomCache::RomCacheIndex& index)
+    {
+        return XXH64(&index, offsetof(RomCache::RomCacheIndex, checksum));
+    }
+
+    bool GetFileIdentity(const std::string& path, RomCache::FileIdentity& identity)
+    {
+        std::memset(&identity, 0, sizeof(identity));
+
+#ifndef _WIN32
+        struct stat file_stat;
+        if (stat(path.c_str(), &file_stat) != 0)
+            return false;
+
+#ifdef __APPLE__
+        identity.mtime_ns = int64_t(file_stat.st_mtimespec.tv_sec) * 1000000000 + file_stat.st_mtimespec.tv_nsec;
+        identity.ctime_ns = int64_t(file_stat.st_ctimespec.tv_sec) * 1000000000 + file_stat.st_ctimespec.tv_nsec;
+#else
+        identity.mtime_ns = int64_t(file_stat.st_mtim.tv_sec) * 1000000000 + file_stat.st_mtim.tv_nsec;
+        identity.ctime_ns = int64_t(file_stat.st_ctim.tv_sec) * 1000000000 + file_stat.st_ctim.tv_nsec;
+#endif
+        identity.inode = static_cast<uint64_t>(file_stat.st_ino);
+        identity.device = static_cast<uint64_t>(file_stat.st_dev);
+#else
+        struct _stat64 file_stat;
+        if (_stat64(path.c_str(), &file_stat) != 0)
+            return false;
+
+        // No inode here, and only second resolution
+        identity.mtime_ns = int64_t(file_stat.st_mtime) * 1000000000;
+        identity.ctime_ns = int64_t(file_stat.st_ctime) * 1000000000;
+#endif
+        identity.size = static_cast<uint64_t>(file_stat.st_size);
+        return true;
+    }
+
+    void MakeDirectory(const std::string& directory)
+    {
+#ifndef _WIN32
+        mkdir(directory.c_str(), 0755);
+#else
+        _mkdir(directory.c_str());
+#endif
+    }
+
+    // Unique per process and per call, so concurrent writers never share a temporary file
+    std::string TemporaryName(const std::string& entry_path)
+    {
+        static std::atomic<uint32_t> counter(0);
+
+#ifndef _WIN32
+        long pid = static_cast<long>(getpid());
+#else
+        long pid = static_cast<long>(_getpid());
+#endif
+        uint64_t nonce = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+
+        std::ostringstream name;
+        name << entry_path << "." << pid << "." << counter++ << "." << std::hex << nonce << ".tmp";
+        return name.str();
+    }
+
+    bool WriteWhole(const std::string& path, const std::vector<uint8_t>& prefix, const uint8_t* data, size_t size)
+    {
+#ifndef _WIN32
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd < 0)
+            return false;
+
+        bool ok = true;
+        const uint8_t* chunks[2] = { prefix.data(), data };
+        size_t chunk_sizes[2] = { prefix.size(), size };
+
+        for (int i = 0; i < 2 && ok; ++i)
+        {
+            const uint8_t* cursor = chunks[i];
+            size_t remaining = chunk_sizes[i];
+
+            while (remaining > 0)
+            {
+                ssize_t written = write(fd, cursor, remaining);
+                if (written < 0 && errno == EINTR)
+                    continue;
+                if (written <= 0)
+                {
+                    ok = false;
+                    break;
+                }
+
+                cursor += written;
+                remaining -= static_cast<size_t>(written);
+            }
+        }
+
+        // The entry must be complete on disk before it becomes visible under its final name
+        if (ok && fsync(fd) != 0)
+            ok = false;
+
+        close(fd);
+        return ok;
+#else
+        std::ofstream file_stream(path, std::ios::binary | std::ios::trunc);
+        if (!file_stream.is_open())
+            return false;
+
+        file_stream.write(reinterpret_cast<const char*>(prefix.data()), prefix.size());
+        file_stream.write(reinterpret_cast<const char*>(data), size);
+        return file_stream.good();
+#endif
+    }
+
+    // Written to a private temporary file and renamed into place, readers never see a partial file
+    bool WriteAtomically(const std::string& path, const std::vector<uint8_t>& prefix, const uint8_t* data, size_t size)
+    {
+        std::string temporary_path = TemporaryName(path);
+
+        if (!WriteWhole(temporary_path, prefix, data, size))
+        {
+            std::remove(temporary_path.c_str());
+            return false;
+        }
+
+        // Atomic on POSIX, a racing writer just replaces an identical file
+        if (std::rename(temporary_path.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temporary_path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+}
+
+RomCache::RomCache(std::string directory) : hits(0), misses(0), index_misses(0), _directory(directory)
+{
+    MakeDirectory(_directory);
+}
+
+std::string RomCache::GetEntryPath(uint64_t rom_hash) const
+{
+    std::ostringstream path;
+    path << _directory << "/" << std::hex << std::setw(16) << std::setfill('0') << rom_hash << ".nesc";
+    return path.str();
+}
+
+std::string RomCache::GetIndexPath(const std::string& rom_path) const
+{
+    std::ostringstream path;
+    path << _directory << "/" << std::hex << std::setw(16) << std::setfill('0') << XXH64(rom_path.data(), rom_path.size()) << ".nesi";
+    return path.str();
+}
+
+std::unique_ptr<Cartridge> RomCache::Load(const std::string& rom_path)
+{
+    FileIdentity identity;
+    bool has_identity = GetFileIdentity(rom_path, identity);
+
+    uint64_t rom_hash = 0;
+    std::unique_ptr<Cartridge> cartridge;
+
+    // Fast path, the rom isn't even read
+    if (has_identity && LookupIndex(rom_path, identity, rom_hash))
+    {
+        cartridge = LoadEntry(rom_hash, identity.size);
+        if (cartridge)
+        {
+            ++hits;
+            return cartridge;
+        }
+    }
+
+    ++index_misses;
+
+    MappedFile rom;
+    if (!rom.Open(rom_path, MappedFile::Mode::ReadOnly))
+    {
+        std::cerr << "Cant open the file\n";
+        return nullptr;
+    }
+
+    rom_hash = XXH64(rom.data(), rom.size());
+
+    cartridge = LoadEntry(rom_hash, rom.size());
+    if (cartridge)
+        ++hits;
+    else
+    {
+        ++misses;
+
+        cartridge.reset(new Cartridge(rom.data(), rom.size()));
+        if (!cartridge->IsLoaded())
+            return nullptr;
+
+        // A failed store only costs the next startup, the cartridge is fine
+        if (!StoreEntry(rom_hash, rom.size(), *cartridge))
+            std::cerr << "ROM Cache> Can't store the entry for " << rom_path << "\n";
+    }
+
+    // Only when the file didn't change while it was hashed, otherwise the hash may belong to neither version
+    FileIdentity hashed_identity;
+    if (has_identity && GetFileIdentity(rom_path, hashed_identity) && hashed_identity == identity && hashed_identity.size == rom.size())
+        StoreIndex(rom_path, identity, rom_hash);
+
+    return cartridge;
+}
+
+bool RomCache::LookupIndex(const std::string& rom_path, const FileIdentity& identity, uint64_t& rom_hash)
+{
+    std::string index_path = GetIndexPath(rom_path);
+
+    std::ifstream index_stream(index_path, std::ios::binary);
+    if (!index_stream.is_open())
+        return false;
+
+    RomCacheIndex index;
+    if (!index_stream.read(reinterpret_cast<char*>(&index), sizeof(index)))
+        return false;
+
+    if (std::memcmp(index.magic, ROM_INDEX_MAGIC, sizeof(index.magic)) != 0 || index.version != ROM_CACHE_VERSION
+        || index.checksum != IndexChecksum(index))
+        return false;
+
+    if (index.path_hash != XXH64(rom_path.data(), rom_path.size()) || !(index.identity == identity))
+        return false;
+
+    // A write in the same timestamp tick as the index would leave the identity unchanged,
+    // only trust roms last modified strictly before the index was written
+    FileIdentity index_identity;
+    if (!GetFileIdentity(index_path, index_identity) || identity.mtime_ns >= index_identity.mtime_ns)
+        return false;
+
+    rom_hash = index.rom_hash;
+    return true;
+}
+
+bool RomCache::StoreIndex(const std::string& rom_path, const FileIdentity& identity, uint64_t rom_hash)
+{
+    RomCacheIndex index;
+    std::memset(&index, 0, sizeof(index));
+    std::memcpy(index.magic, ROM_INDEX_MAGIC, sizeof(index.magic));
+    index.version = ROM_CACHE_VERSION;
+    index.path_hash = XXH64(rom_path.data(), rom_path.size());
+    index.identity = identity;
+    index.rom_hash = rom_hash;
+    index.checksum = IndexChecksum(index);
+
+    std::vector<uint8_t> prefix(sizeof(index));
+    std::memcpy(prefix.data(), &index, sizeof(index));
+
+    return WriteAtomically(GetIndexPath(rom_path), prefix, nullptr, 0);
+}
+
+std::unique_ptr<Cartridge> RomCache::LoadEntry(uint64_t rom_hash, uint64_t rom_size)
+{
+    std::unique_ptr<MappedFile> entry(new MappedFile());
+    if (!entry->Open(GetEntryPath(rom_hash), MappedFile::Mode::CopyOnWrite))
+        return nullptr;
+
+    if (entry->size() < sizeof(RomCacheHeader))
+        return nullptr;
+
+    RomCacheHeader header;
+    std::memcpy(&header, entry->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, ROM_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != ROM_CACHE_VERSION
+        || header.header_size != sizeof(RomCacheHeader) || header.checksum != HeaderChecksum(header))
+        return nullptr;
+
+    if (header.rom_hash != rom_hash || header.rom_size != rom_size)
+        return nullptr;
+
+    if (header.arena_offset != ROM_CACHE_ARENA_OFFSET || header.arena_size != header.layout.GetArenaSize()
+        || entry->size() < header.arena_offset + header.arena_size)
+        return nullptr;
+
+    std::unique_ptr<Cartridge> cartridge(new Cartridge(header.format_header, header.layout, std::move(entry), header.arena_offset));
+    if (!cartridge->IsLoaded() || cartridge->mapper_id != header.mapper_id || cartridge->submapper_id != header.submapper_id)
+        return nullptr;
+
+    return cartridge;
+}
+
+bool RomCache::StoreEntry(uint64_t rom_hash, uint64_t rom_size, const Cartridge& cartridge)
+{
+    RomCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, ROM_CACHE_MAGIC, sizeof(header.magic));
+    header.version = ROM_CACHE_VERSION;
+    header.header_size = sizeof(RomCacheHeader);
+    header.rom_hash = rom_hash;
+    header.rom_size = rom_size;
+    header.format_header = cartridge.format_header;
+    header.mapper_id = cartridge.mapper_id;
+    header.submapper_id = cartridge.submapper_id;
+    header.layout = cartridge.GetArenaLayout();
+    header.arena_offset = ROM_CACHE_ARENA_OFFSET;
+    header.arena_size = cartridge.GetArenaSize();
+    header.checksum = HeaderChecksum(header);
+
+    std::vector<uint8_t> prefix(ROM_CACHE_ARENA_OFFSET, 0);
+    std::memcpy(prefix.data(), &header, sizeof(header));
+
+    return WriteAtomically(GetEntryPath(rom_hash), prefix, cartridge.GetArena(), cartridge.GetArenaSize());
+}
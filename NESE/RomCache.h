@@ -0,0 +1,115 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RomCache_h__
+#define RomCache_h__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "Cartridge.h"
+
+constexpr uint32_t ROM_CACHE_VERSION = 1;
+
+// The arena starts on a page boundary so it can be used straight from the mapping
+constexpr uint32_t ROM_CACHE_ARENA_OFFSET = 4096;
+
+/** ROM CACHE
+*  Directory of pre-parsed cartridges keyed by the hash of the rom file.
+*  Each entry is "<hash>.nesc": a RomCacheHeader followed, at ROM_CACHE_ARENA_OFFSET,
+*  by the cartridge arena exactly as Cartridge lays it out. A hit is a single mmap
+*  plus a header check, the arena is mapped copy on write so the cartridge RAM never
+*  reaches the file.
+*  Hashing the rom would cost as much as parsing it, so the hash is found through a small
+*  "<path hash>.nesi" index holding the size, timestamps and inode of the rom the last time
+*  it was hashed. The rom is only read again when any of them changed, or when it was
+*  modified too close to the index write for the timestamps to tell (like git's racy check).
+*  Entries are written to a private temporary file and renamed into place, so any
+*  number of processes can share the directory and readers never see a partial entry.
+**/
+class RomCache
+{
+public:
+    RomCache(std::string directory);
+
+    struct RomCacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_size;
+        uint64_t rom_hash;
+        uint64_t rom_size;
+        Cartridge::NES_2_0 format_header; // Normalized header
+        uint16_t mapper_id;
+        uint8_t submapper_id;
+        uint8_t reserved;
+        Cartridge::ArenaLayout layout;
+        uint64_t arena_offset;
+        uint64_t arena_size;
+        uint64_t checksum; // XXH64 of every previous field
+    };
+
+    // What stat says about the rom file, any change means the rom must be hashed again
+    struct FileIdentity
+    {
+        uint64_t size;
+        int64_t mtime_ns;
+        int64_t ctime_ns;
+        uint64_t inode;
+        uint64_t device;
+
+        bool operator==(const FileIdentity& other) const
+        {
+            return size == other.size && mtime_ns == other.mtime_ns && ctime_ns == other.ctime_ns
+                && inode == other.inode && device == other.device;
+        }
+    };
+
+    struct RomCacheIndex
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t path_hash;
+        FileIdentity identity;
+        uint64_t rom_hash;
+        uint64_t checksum; // XXH64 of every previous field
+    };
+
+    // Returns the cartridge, nullptr when the rom can't be loaded.
+    // Misses parse the rom and store it for the next time.
+    std::unique_ptr<Cartridge> Load(const std::string& rom_path);
+
+    std::string GetEntryPath(uint64_t rom_hash) const;
+    std::string GetIndexPath(const std::string& rom_path) const;
+
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t index_misses; // Loads that had to hash the whole rom
+
+private:
+    std::unique_ptr<Cartridge> LoadEntry(uint64_t rom_hash, uint64_t rom_size);
+    bool StoreEntry(uint64_t rom_hash, uint64_t rom_size, const Cartridge& cartridge);
+
+    bool LookupIndex(const std::string& rom_path, const FileIdentity& identity, uint64_t& rom_hash);
+    bool StoreIndex(const std::string& rom_path, const FileIdentity& identity, uint64_t rom_hash);
+
+    std::string _directory;
+};
+
+#endif // RomCache_h__
@@ -0,0 +1,135 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "RomPager.h"
+#include "Bus.h"
+#include "PPUBus.h"
+#include "TileCache.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+RomPager::RomPager(const std::string& rom_path, uint64_t PGR_file_offset, uint32_t PGR_size,
+    uint64_t CHR_file_offset, uint32_t CHR_size, uint32_t max_resident_chunks)
+    : faults(0), evictions(0), _PGR_file_offset(PGR_file_offset), _PGR_size(PGR_size),
+    _CHR_file_offset(CHR_file_offset), _CHR_size(CHR_size), _use_clock(0), _tile_cache(nullptr)
+{
+    _PGR_chunk_count = (PGR_size + ROM_PAGER_CHUNK_SIZE - 1) / ROM_PAGER_CHUNK_SIZE;
+    uint32_t CHR_chunk_count = (CHR_size + ROM_PAGER_CHUNK_SIZE - 1) / ROM_PAGER_CHUNK_SIZE;
+
+    _max_resident_chunks = std::max(max_resident_chunks, ROM_PAGER_MIN_RESIDENT_CHUNKS);
+    _chunk_slots.assign(_PGR_chunk_count + CHR_chunk_count, -1);
+    _page_slots.assign(CPU_PAGE_COUNT + PPU_PAGE_COUNT, -1);
+    _slots.reserve(_max_resident_chunks);
+
+    _file_stream.open(rom_path, std::ios::binary);
+    if (!_file_stream.is_open())
+        std::cerr << "ERROR> Can't open " << rom_path << " for lazy loading.\n";
+}
+
+uint8_t* RomPager::MapPage(Owner owner, uint32_t page_index, Region region, uint32_t offset)
+{
+    uint32_t chunk = offset / ROM_PAGER_CHUNK_SIZE + (region == Region::CHR_ROM ? _PGR_chunk_count : 0);
+    int32_t& page_slot = _page_slots[(owner == Owner::PPU ? CPU_PAGE_COUNT : 0) + page_index];
+
+    // Released first, a page remapped to another chunk may free the slot it needs
+    Unpin(page_slot);
+    page_slot = -1;
+
+    int32_t slot = _chunk_slots[chunk];
+    if (slot < 0)
+        slot = Fault(chunk);
+
+    Slot& resident = _slots[slot];
+    ++resident.pins;
+    resident.last_use = ++_use_clock;
+    page_slot = slot;
+
+    return resident.data.get() + offset % ROM_PAGER_CHUNK_SIZE;
+}
+
+uint32_t RomPager::GetResidentChunks() const
+{
+    return static_cast<uint32_t>(std::count_if(_slots.begin(), _slots.end(), [](const Slot& slot) { return slot.chunk >= 0; }));
+}
+
+int32_t RomPager::Fault(uint32_t chunk)
+{
+    int32_t slot = -1;
+
+    if (_slots.size() < _max_resident_chunks)
+    {
+        slot = static_cast<int32_t>(_slots.size());
+        _slots.push_back(Slot{ -1, 0, 0, std::unique_ptr<uint8_t[]>(new uint8_t[ROM_PAGER_CHUNK_SIZE]) });
+    }
+    else
+    {
+        for (size_t i = 0; i < _slots.size(); ++i)
+        {
+            if (_slots[i].pins == 0 && (slot < 0 || _slots[i].last_use < _slots[slot].last_use))
+                slot = static_cast<int32_t>(i);
+        }
+
+        // Can't happen with ROM_PAGER_MIN_RESIDENT_CHUNKS, every page pins a single chunk
+        if (slot < 0)
+        {
+            std::cerr << "ERROR> Every resident rom chunk is mapped, growing the resident set.\n";
+            slot = static_cast<int32_t>(_slots.size());
+            _slots.push_back(Slot{ -1, 0, 0, std::unique_ptr<uint8_t[]>(new uint8_t[ROM_PAGER_CHUNK_SIZE]) });
+        }
+        else
+        {
+            uint32_t evicted = static_cast<uint32_t>(_slots[slot].chunk);
+            if (_tile_cache && evicted >= _PGR_chunk_count)
+                _tile_cache->Release((evicted - _PGR_chunk_count) * ROM_PAGER_CHUNK_SIZE, ROM_PAGER_CHUNK_SIZE);
+
+            _chunk_slots[evicted] = -1;
+            ++evictions;
+        }
+    }
+
+    bool is_CHR = chunk >= _PGR_chunk_count;
+    uint32_t region_offset = (chunk - (is_CHR ? _PGR_chunk_count : 0)) * ROM_PAGER_CHUNK_SIZE;
+    uint32_t region_size = is_CHR ? _CHR_size : _PGR_size;
+    uint64_t file_offset = (is_CHR ? _CHR_file_offset : _PGR_file_offset) + region_offset;
+    uint32_t length = std::min(ROM_PAGER_CHUNK_SIZE, region_size - region_offset);
+
+    uint8_t* data = _slots[slot].data.get();
+    std::memset(data + length, 0, ROM_PAGER_CHUNK_SIZE - length);
+
+    _file_stream.clear();
+    _file_stream.seekg(static_cast<std::streamoff>(file_offset));
+    if (!_file_stream.read(reinterpret_cast<char*>(data), length))
+    {
+        std::cerr << "ERROR> Can't read rom chunk " << chunk << ".\n";
+        std::memset(data, 0, length);
+    }
+
+    _slots[slot].chunk = static_cast<int32_t>(chunk);
+    _slots[slot].pins = 0;
+    _chunk_slots[chunk] = slot;
+    ++faults;
+
+    return slot;
+}
+
+void RomPager::Unpin(int32_t slot)
+{
+    if (slot >= 0 && _slots[slot].pins > 0)
+        --_slots[slot].pins;
+}
@@ -0,0 +1,107 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RomPager_h__
+#define RomPager_h__
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TileCache;
+
+// Unit of residency, the same as a CPU page so a PRG window is never split
+constexpr uint32_t ROM_PAGER_CHUNK_SIZE = 8192;
+
+// The CPU (4 PRG pages) and PPU (8 pattern pages) can pin at most 12 chunks at once
+constexpr uint32_t ROM_PAGER_MIN_RESIDENT_CHUNKS = 16;
+constexpr uint32_t ROM_PAGER_DEFAULT_RESIDENT_CHUNKS = 64;
+
+/** ROM PAGER
+*  Lazy backing for PGR_ROM and CHR ROM, banks are read from the rom file the first time
+*  a mapper maps them and kept in a bounded set of chunks. Every bus page pointing into a
+*  chunk pins it, only unpinned chunks are evicted (least recently mapped first), so the
+*  pointers handed to the address maps stay valid for as long as they are mapped.
+*  The tiles decoded from a CHR chunk go with it, the connected tile cache releases them.
+**/
+class RomPager
+{
+public:
+    enum class Region
+    {
+        PGR_ROM,
+        CHR_ROM,
+    };
+
+    // Address map holding the pointer, pages are indexed like in Bus and PPUBus
+    enum class Owner
+    {
+        CPU,
+        PPU,
+    };
+
+    RomPager(const std::string& rom_path, uint64_t PGR_file_offset, uint32_t PGR_size,
+        uint64_t CHR_file_offset, uint32_t CHR_size, uint32_t max_resident_chunks);
+
+    bool IsOpen() const { return _file_stream.is_open(); }
+
+    // Points page_index of owner to offset inside region, faulting the chunk in when needed.
+    // The returned memory holds at least the rest of the chunk.
+    uint8_t* MapPage(Owner owner, uint32_t page_index, Region region, uint32_t offset);
+
+    uint32_t GetResidentChunks() const;
+    uint32_t GetMaxResidentChunks() const { return _max_resident_chunks; }
+
+    // Cache of the CHR ROM tiles, set by the mapper
+    void ConnectTileCache(TileCache* tile_cache) { _tile_cache = tile_cache; }
+    void DisconnectTileCache() { _tile_cache = nullptr; }
+
+    uint32_t faults;
+    uint32_t evictions;
+
+private:
+    struct Slot
+    {
+        int32_t chunk; // -1 when free
+        uint32_t pins;
+        uint64_t last_use;
+        std::unique_ptr<uint8_t[]> data; // Allocated on first use
+    };
+
+    int32_t Fault(uint32_t chunk);
+    void Unpin(int32_t slot);
+
+    std::ifstream _file_stream;
+    uint64_t _PGR_file_offset;
+    uint32_t _PGR_size;
+    uint64_t _CHR_file_offset;
+    uint32_t _CHR_size;
+    uint32_t _PGR_chunk_count;
+    uint32_t _max_resident_chunks;
+
+    std::vector<int32_t> _chunk_slots; // Per chunk, PGR chunks first, -1 when not resident
+    std::vector<Slot> _slots;
+    std::vector<int32_t> _page_slots;  // Per CPU page then per PPU page
+    uint64_t _use_clock;
+
+    TileCache* _tile_cache;
+};
+
+#endif // RomPager_h__
@@ -0,0 +1,159 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SaveFile.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+SaveFile::SaveFile(std::chrono::milliseconds flush_interval) : flushes(0), _flush_interval(flush_interval), _stop(false)
+{
+}
+
+SaveFile::~SaveFile()
+{
+    if (!_flusher.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+
+    _wake.notify_one();
+    _flusher.join();
+
+    // Whatever the rate limit held back
+    Update();
+    Flush();
+}
+
+bool SaveFile::Attach(Cartridge& cartridge, const std::string& path)
+{
+    if (_file.IsOpen())
+    {
+        std::cerr << "ERROR> Save file already attached.\n";
+        return false;
+    }
+
+    uint32_t size = cartridge.PGR_NVRAM.size();
+    if (size == 0)
+    {
+        std::cerr << "ERROR> The cartridge has no battery backed RAM.\n";
+        return false;
+    }
+
+    bool exists = std::ifstream(path, std::ios::binary).is_open();
+
+    if (!_file.Open(path, MappedFile::Mode::Shared, size))
+    {
+        std::cerr << "ERROR> Can't map save file " << path << ".\n";
+        return false;
+    }
+
+    if (!exists)
+    {
+        std::memcpy(_file.data(), cartridge.PGR_NVRAM.data(), size);
+        _file.Sync(0, size);
+    }
+
+    cartridge.PGR_NVRAM = CartridgeRegion(_file.data(), size);
+    _snapshot.assign(_file.data(), _file.data() + size);
+
+    _flusher = std::thread(&SaveFile::FlusherLoop, this);
+
+    return true;
+}
+
+void SaveFile::Update()
+{
+    if (!_file.IsOpen())
+        return;
+
+    std::vector<uint32_t> changed;
+
+    for (uint32_t offset = 0; offset < _snapshot.size(); offset += SAVE_PAGE_SIZE)
+    {
+        uint32_t length = std::min<uint32_t>(SAVE_PAGE_SIZE, static_cast<uint32_t>(_snapshot.size()) - offset);
+        if (std::memcmp(_file.data() + offset, _snapshot.data() + offset, length) == 0)
+            continue;
+
+        std::memcpy(_snapshot.data() + offset, _file.data() + offset, length);
+        changed.push_back(offset / SAVE_PAGE_SIZE);
+    }
+
+    // Most frames don't touch the save, the flusher is only bothered when something changed
+    if (changed.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _dirty_pages.insert(_dirty_pages.end(), changed.begin(), changed.end());
+    }
+
+    _wake.notify_one();
+}
+
+bool SaveFile::Flush()
+{
+    if (!_file.IsOpen())
+        return false;
+
+    return _file.Sync(0, _file.size());
+}
+
+void SaveFile::FlusherLoop()
+{
+    std::chrono::steady_clock::time_point last_flush = std::chrono::steady_clock::now() - _flush_interval;
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true)
+    {
+        _wake.wait(lock, [this] { return _stop || !_dirty_pages.empty(); });
+
+        // Rate limit, pages dirtied meanwhile join this batch
+        if (_wake.wait_until(lock, last_flush + _flush_interval, [this] { return _stop; }))
+            break;
+
+        std::vector<uint32_t> pages;
+        pages.swap(_dirty_pages);
+        lock.unlock();
+
+        std::sort(pages.begin(), pages.end());
+        pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+        // Adjacent pages go in a single msync
+        for (size_t first = 0; first < pages.size();)
+        {
+            size_t last = first;
+            while (last + 1 < pages.size() && pages[last + 1] == pages[last] + 1)
+                ++last;
+
+            size_t length = (pages[last] - pages[first] + 1) * size_t(SAVE_PAGE_SIZE);
+            if (!_file.Sync(pages[first] * size_t(SAVE_PAGE_SIZE), length))
+                std::cerr << "ERROR> Save file sync failed.\n";
+
+            first = last + 1;
+        }
+
+        ++flushes;
+        last_flush = std::chrono::steady_clock::now();
+        lock.lock();
+    }
+}
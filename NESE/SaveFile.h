@@ -0,0 +1,80 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SaveFile_h__
+#define SaveFile_h__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Cartridge.h"
+#include "MappedFile.h"
+
+// Granularity of the dirty tracking, small enough that a save slot write syncs little more than itself
+constexpr uint32_t SAVE_PAGE_SIZE = 1024;
+
+/** SAVE FILE
+*  Battery backed PRG RAM living directly on a shared mapping of the ".sav" file.
+*  The game writes straight into the page cache, so a crash of the emulator loses nothing.
+*  Once per frame the emulation thread compares the RAM against a snapshot (a memcmp of
+*  a few KB) and hands the changed pages to a flusher thread, which msyncs them at most
+*  once per flush interval. The emulation thread never waits on the disk.
+**/
+class SaveFile
+{
+public:
+    SaveFile(std::chrono::milliseconds flush_interval = std::chrono::milliseconds(1000));
+    ~SaveFile();
+
+    SaveFile(const SaveFile&) = delete;
+    SaveFile& operator=(const SaveFile&) = delete;
+
+    // Moves the cartridge PGR_NVRAM onto the save file, must be done before the mapper is created.
+    // An existing save is loaded, a new one starts with the current cartridge content.
+    bool Attach(Cartridge& cartridge, const std::string& path);
+
+    // Emulation thread, once per frame
+    void Update();
+
+    // Blocks until the whole save is on disk
+    bool Flush();
+
+    bool IsAttached() const { return _file.IsOpen(); }
+
+    std::atomic<uint32_t> flushes; // msync batches done by the flusher
+
+private:
+    void FlusherLoop();
+
+    MappedFile _file;
+    std::vector<uint8_t> _snapshot;
+
+    std::chrono::milliseconds _flush_interval;
+    std::thread _flusher;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::vector<uint32_t> _dirty_pages; // Guarded by _mutex
+    bool _stop;                         // Guarded by _mutex
+};
+
+#endif // SaveFile_h__
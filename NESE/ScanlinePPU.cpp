@@ -0,0 +1,513 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ScanlinePPU.h"
+#include "RenderPipeline.h"
+#include "TileDecoder.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+ScanlinePPU::ScanlinePPU(PPUBus& ppu_bus) : PPU(ppu_bus)
+{
+    _next_checkpoint = NextCheckpoint(0);
+    _sprite_zero_hit_time = NO_EVENT;
+    _sprite_list_height = 0;
+    _sprite_list_frame = UINT64_MAX;
+    std::memset(_drawn_inputs, 0, sizeof(_drawn_inputs));
+    std::memset(_drawn_at, 0, sizeof(_drawn_at));
+}
+
+void ScanlinePPU::Reset()
+{
+    PPU::Reset();
+    _sprite_zero_hit_time = NO_EVENT;
+
+    // The framebuffer was cleared
+    std::memset(_drawn_at, 0, sizeof(_drawn_at));
+}
+
+void ScanlinePPU::Run(uint64_t time)
+{
+    while (_next_checkpoint <= time)
+    {
+        _time = _next_checkpoint;
+
+        uint32_t position = static_cast<uint32_t>(_time % PPU_DOTS_PER_FRAME);
+        Checkpoint(position / PPU_DOTS_PER_SCANLINE, position % PPU_DOTS_PER_SCANLINE);
+
+        _next_checkpoint = NextCheckpoint(_time);
+    }
+
+    if (time > _time)
+        _time = time;
+}
+
+uint64_t ScanlinePPU::NextCheckpoint(uint64_t time)
+{
+    uint64_t frame_start = time - time % PPU_DOTS_PER_FRAME;
+    uint32_t position = static_cast<uint32_t>(time % PPU_DOTS_PER_FRAME);
+    uint32_t scanline = position / PPU_DOTS_PER_SCANLINE;
+    uint32_t dot = position % PPU_DOTS_PER_SCANLINE;
+
+    if (scanline < PPU_VISIBLE_SCANLINES)
+    {
+        if (dot < 1)
+            return frame_start + scanline * PPU_DOTS_PER_SCANLINE + 1;
+        if (dot < 257)
+            return frame_start + scanline * PPU_DOTS_PER_SCANLINE + 257;
+        if (scanline + 1 < PPU_VISIBLE_SCANLINES)
+            return frame_start + (scanline + 1) * PPU_DOTS_PER_SCANLINE + 1;
+
+        return frame_start + PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE + 1;
+    }
+
+    if (scanline < PPU_VBLANK_SCANLINE || (scanline == PPU_VBLANK_SCANLINE && dot < 1))
+        return frame_start + PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE + 1;
+
+    uint64_t prerender_start = frame_start + PPU_PRERENDER_SCANLINE * PPU_DOTS_PER_SCANLINE;
+    if (scanline < PPU_PRERENDER_SCANLINE || dot < 1)
+        return prerender_start + 1;
+    if (dot < 257)
+        return prerender_start + 257;
+    if (dot < 304)
+        return prerender_start + 304;
+
+    return frame_start + PPU_DOTS_PER_FRAME + 1;
+}
+
+void ScanlinePPU::Checkpoint(uint32_t scanline, uint32_t dot)
+{
+    if (scanline < PPU_VISIBLE_SCANLINES)
+    {
+        if (dot == 1)
+        {
+            RenderScanline(scanline);
+            HashScanline(scanline);
+        }
+        else if (IsRenderingEnabled())
+        {
+            // Dots 256 and 257
+            IncrementY();
+            CopyHorizontal();
+        }
+    }
+    else if (scanline == PPU_VBLANK_SCANLINE)
+        StartVBlank();
+    else if (dot == 1)
+    {
+        StartPrerender();
+        _sprite_zero_hit_time = NO_EVENT;
+    }
+    else if (IsRenderingEnabled())
+    {
+        if (dot == 257)
+            CopyHorizontal();
+        else
+            CopyVertical(); // Dots 280-304 end with the last copy
+    }
+}
+
+uint8_t ScanlinePPU::ReadRegister(uint16_t address)
+{
+    if ((address & 0x07) == 2 && _time >= _sprite_zero_hit_time)
+        _status |= PPUSTATUS_SPRITE_ZERO_HIT;
+
+    return PPU::ReadRegister(address);
+}
+
+void ScanlinePPU::ReplayScanline(uint32_t scanline, uint8_t control, uint8_t mask, uint16_t v, uint8_t fine_x)
+{
+    _control = control;
+    _mask = mask;
+    _v = v;
+    _fine_x = fine_x;
+
+    RenderScanline(scanline);
+    HashScanline(scanline);
+}
+
+void ScanlinePPU::RenderScanline(uint32_t scanline)
+{
+    if (_pipeline)
+        _pipeline->RecordScanline(_ppu_bus, scanline, _control, _mask, _v, _fine_x);
+
+    if (_headless || !IsScanlineOfInterest(scanline))
+    {
+        if (IsRenderingEnabled())
+            EvaluateScanline(scanline);
+
+        _drawn_at[scanline] = 0;
+        MarkDirty(scanline, 0);
+        return;
+    }
+
+    // Spans of pixels to draw: the region, or the runs of dirty block columns
+    uint32_t spans[DIRTY_COLUMNS][2];
+    uint32_t span_count = 0;
+    uint32_t columns;
+
+    if (_dirty_tracking && IsFullWidth())
+    {
+        columns = FindDirtyColumns(scanline);
+
+        for (uint32_t blocks = columns; blocks != 0; ++span_count)
+        {
+            uint32_t first = CountTrailingZeros(blocks);
+            uint32_t run = blocks >> first;
+            uint32_t length = run == ALL_DIRTY_COLUMNS ? DIRTY_COLUMNS : CountTrailingZeros(~run);
+            blocks = length == DIRTY_COLUMNS ? 0 : blocks & ~(((1u << length) - 1) << first);
+
+            spans[span_count][0] = first * DIRTY_BLOCK_SIZE;
+            spans[span_count][1] = (first + length) * DIRTY_BLOCK_SIZE;
+        }
+    }
+    else
+    {
+        _drawn_at[scanline] = 0;
+
+        uint32_t last_x = _region.x + _region.width - 1;
+        columns = (ALL_DIRTY_COLUMNS >> (DIRTY_COLUMNS - 1 - last_x / DIRTY_BLOCK_SIZE)) & (ALL_DIRTY_COLUMNS << (_region.x / DIRTY_BLOCK_SIZE));
+
+        spans[0][0] = _region.x;
+        spans[0][1] = _region.x + _region.width;
+        span_count = 1;
+    }
+
+    MarkDirty(scanline, columns);
+
+    // Nothing changed, only the flags are needed
+    if (span_count == 0)
+    {
+        if (IsRenderingEnabled())
+            EvaluateScanline(scanline);
+        return;
+    }
+
+    _emphasis[scanline] = _mask >> PPUMASK_EMPHASIS_SHIFT;
+
+    uint8_t* row = _framebuffer + scanline * SCREEN_WIDTH;
+    if (!IsRenderingEnabled())
+    {
+        for (uint32_t span = 0; span < span_count; ++span)
+            std::memset(row + spans[span][0], GetBackdropColor(), spans[span][1] - spans[span][0]);
+        return;
+    }
+
+    uint8_t background[SCREEN_WIDTH];
+    uint8_t sprites[SCREEN_WIDTH];
+
+    if (span_count == 1 && spans[0][0] == 0 && spans[0][1] == SCREEN_WIDTH)
+    {
+        RenderBackground(background, 0, SCREEN_WIDTH);
+        int32_t sprite_zero_x = RenderSprites(scanline, background, sprites);
+
+        // Pixel x is output on dot x + 1, the scanline is rendered on dot 1
+        if (sprite_zero_x >= 0 && _sprite_zero_hit_time == NO_EVENT)
+            _sprite_zero_hit_time = _time + sprite_zero_x;
+    }
+    else
+    {
+        // Sprite 0 can hit outside the spans, the flags come from the headless evaluation
+        std::memset(background, 0, sizeof(background));
+        for (uint32_t span = 0; span < span_count; ++span)
+            RenderBackground(background, spans[span][0], spans[span][1]);
+
+        RenderSprites(scanline, background, sprites);
+        EvaluateScanline(scanline);
+    }
+
+    uint8_t color_mask = GetColorMask();
+
+    for (uint32_t span = 0; span < span_count; ++span)
+    {
+        for (uint32_t x = spans[span][0]; x < spans[span][1]; ++x)
+        {
+            uint8_t sprite = sprites[x];
+            uint8_t index = background[x];
+
+            if ((sprite & 0x03) != 0 && ((index & 0x03) == 0 || (sprite & SPRITE_BEHIND_BACKGROUND) == 0))
+                index = sprite & 0x1F;
+            else if ((index & 0x03) == 0)
+                index = 0;
+
+            row[x] = _palette[index] & color_mask;
+        }
+    }
+}
+
+uint32_t ScanlinePPU::FindDirtyColumns(uint32_t scanline)
+{
+    UpdateSpriteLists();
+
+    ScanlineInputs inputs;
+    std::memset(&inputs, 0, sizeof(inputs)); // Compared whole, padding included
+    inputs.v = _v;
+    inputs.fine_x = _fine_x;
+    inputs.control = _control;
+    inputs.mask = _mask;
+    inputs.sprite_count = _sprite_list_sizes[scanline];
+
+    for (uint32_t i = 0; i < inputs.sprite_count; ++i)
+        std::memcpy(inputs.sprites + i * 4, OAM + _sprite_lists[scanline][i] * 4, 4);
+
+    for (uint32_t page = 0; page < sizeof(inputs.pages) / sizeof(inputs.pages[0]); ++page)
+        inputs.pages[page] = _ppu_bus.GetPage(static_cast<uint16_t>(page * PPU_PAGE_SIZE)).read;
+
+    ScanlineInputs& drawn = _drawn_inputs[scanline];
+    uint64_t drawn_at = _drawn_at[scanline];
+    _drawn_at[scanline] = ++_scanlines_drawn;
+
+    // Writes stamped from the last drawing on happened after it
+    uint32_t columns = 0;
+    bool same_registers = drawn_at != 0 && std::memcmp(&inputs, &drawn, offsetof(ScanlineInputs, sprite_count)) == 0 &&
+        std::memcmp(inputs.pages, drawn.pages, sizeof(inputs.pages)) == 0;
+
+    if (!same_registers || _palette_write >= drawn_at || _memory_write >= drawn_at)
+        columns = ALL_DIRTY_COLUMNS;
+    else if (IsRenderingEnabled())
+    {
+        // Tile t of the 33 fetched covers the pixels from t * 8 - fine x on
+        if ((_mask & PPUMASK_SHOW_BACKGROUND) != 0 && _CIRAM_write >= drawn_at)
+        {
+            uint16_t v = _v;
+            for (uint32_t tile = 0; tile < 33; ++tile)
+            {
+                uint32_t name = GetCIRAMIndex(NAMETABLES_START | (v & 0x0FFF));
+                uint32_t attribute = GetCIRAMIndex(0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+
+                if ((name < CIRAM_SIZE && _CIRAM_writes[name] >= drawn_at) || (attribute < CIRAM_SIZE && _CIRAM_writes[attribute] >= drawn_at))
+                {
+                    uint32_t first_x = tile * 8 > _fine_x ? tile * 8 - _fine_x : 0;
+                    uint32_t last_x = std::min(tile * 8 + 7 - _fine_x, SCREEN_WIDTH - 1);
+                    if (first_x < SCREEN_WIDTH)
+                        columns |= (2u << (last_x / DIRTY_BLOCK_SIZE)) - (1u << (first_x / DIRTY_BLOCK_SIZE));
+                }
+
+                if ((v & 0x001F) == 31)
+                    v = (v & ~0x001F) ^ 0x0400;
+                else
+                    ++v;
+            }
+        }
+
+        // Sprites moved or changed, both where they were and where they are now
+        if (std::memcmp(&inputs.sprite_count, &drawn.sprite_count, 1 + sizeof(inputs.sprites)) != 0)
+        {
+            for (const ScanlineInputs* sprites : { &inputs, &drawn })
+            {
+                for (uint32_t i = 0; i < sprites->sprite_count; ++i)
+                {
+                    uint32_t x = sprites->sprites[i * 4 + 3];
+                    columns |= 1u << (x / DIRTY_BLOCK_SIZE);
+                    if (x + 7 < SCREEN_WIDTH)
+                        columns |= 1u << ((x + 7) / DIRTY_BLOCK_SIZE);
+                }
+            }
+        }
+    }
+
+    drawn = inputs;
+    return columns;
+}
+
+void ScanlinePPU::EvaluateScanline(uint32_t scanline)
+{
+    UpdateSpriteLists();
+
+    uint32_t height = GetSpriteHeight();
+    if (_sprite_list_overflows[scanline])
+        _status |= PPUSTATUS_SPRITE_OVERFLOW;
+
+    bool can_hit = (_mask & (PPUMASK_SHOW_BACKGROUND | PPUMASK_SHOW_SPRITES)) == (PPUMASK_SHOW_BACKGROUND | PPUMASK_SHOW_SPRITES);
+    uint32_t sprite_zero_row = scanline - (OAM[0] + 1u);
+    if (!can_hit || sprite_zero_row >= height || _sprite_zero_hit_time != NO_EVENT)
+        return;
+
+    // Opaque masks of the sprite row and of the background under its 8 pixels, bit i is
+    // pixel x + i, so the first hit is the lowest bit set on all of them
+    uint32_t x = OAM[3];
+    uint8_t low;
+    uint8_t high;
+    FetchSpriteRow(OAM, sprite_zero_row, low, high);
+    uint32_t sprite_mask = ReverseBits(low | high);
+
+    // The 8 pixels straddle two background tiles
+    uint32_t position = x + _fine_x;
+    uint32_t background_mask = (GetBackgroundOpaqueMask(position / 8) | GetBackgroundOpaqueMask(position / 8 + 1) << 8) >> (position & 0x07);
+
+    // Nothing left of first_hit_x nor from x = 255 on
+    uint32_t first_hit_x = (_mask & (PPUMASK_BACKGROUND_LEFT | PPUMASK_SPRITES_LEFT)) == (PPUMASK_BACKGROUND_LEFT | PPUMASK_SPRITES_LEFT) ? 0 : 8;
+    uint32_t valid_mask = (0xFFu << (first_hit_x > x ? first_hit_x - x : 0)) & (0xFFu >> (x > 247 ? x - 247 : 0));
+
+    uint32_t hits = sprite_mask & background_mask & valid_mask;
+    if (hits != 0)
+        _sprite_zero_hit_time = _time + x + CountTrailingZeros(hits);
+}
+
+uint8_t ScanlinePPU::GetBackgroundOpaqueMask(uint32_t tile) const
+{
+    // Coarse x, wrapping into the horizontal nametable
+    uint32_t coarse_x = (_v & 0x001F) + tile;
+    uint16_t v = static_cast<uint16_t>((_v & ~0x001F) | (coarse_x & 0x1F));
+    if ((coarse_x & 0x20) != 0)
+        v ^= 0x0400;
+
+    uint16_t pattern_base = (_control & PPUCTRL_BACKGROUND_TABLE) != 0 ? 0x1000 : 0x0000;
+    uint16_t pattern = static_cast<uint16_t>(pattern_base + _ppu_bus.Read(NAMETABLES_START | (v & 0x0FFF)) * 16 + ((v >> 12) & 0x07));
+
+    return ReverseBits(_ppu_bus.Read(pattern) | _ppu_bus.Read(pattern + 8));
+}
+
+void ScanlinePPU::RenderBackground(uint8_t* pixels, uint32_t first_x, uint32_t end_x)
+{
+    if ((_mask & PPUMASK_SHOW_BACKGROUND) == 0)
+    {
+        std::memset(pixels + first_x, 0, end_x - first_x);
+        return;
+    }
+
+    // 33 tiles cover the scanline for any fine x, the pixel rows come from the tile cache.
+    // Only the ones under first_x to end_x are fetched, starting from the tile v points to.
+    uint8_t tiles[33 * 8];
+    uint32_t first_tile = (first_x + _fine_x) / 8;
+    uint32_t end_tile = (end_x - 1 + _fine_x) / 8 + 1;
+    uint16_t pattern_base = (_control & PPUCTRL_BACKGROUND_TABLE) != 0 ? 0x1000 : 0x0000;
+    uint16_t fine_y = (_v >> 12) & 0x07;
+
+    uint32_t coarse_x = (_v & 0x001F) + first_tile;
+    uint16_t v = static_cast<uint16_t>((_v & ~0x001F) | (coarse_x & 0x1F));
+    if (coarse_x >= 32)
+        v ^= 0x0400;
+
+    for (uint32_t tile = first_tile; tile < end_tile; ++tile)
+    {
+        uint8_t tile_index = _ppu_bus.Read(NAMETABLES_START | (v & 0x0FFF));
+        uint8_t attribute = _ppu_bus.Read(0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+        uint8_t palette = static_cast<uint8_t>(((attribute >> (((v >> 4) & 0x04) | (v & 0x02))) & 0x03) << 2);
+
+        // The palette goes on the opaque pixels only, 8 at a time
+        uint64_t row;
+        std::memcpy(&row, _ppu_bus.GetPatternRow(static_cast<uint16_t>(pattern_base + tile_index * 16 + fine_y), false), sizeof(row));
+        row |= ((row | row >> 1) & 0x0101010101010101ULL) * palette;
+        std::memcpy(tiles + tile * 8, &row, sizeof(row));
+
+        // Coarse x, wrapping into the horizontal nametable
+        if ((v & 0x001F) == 31)
+            v = (v & ~0x001F) ^ 0x0400;
+        else
+            ++v;
+    }
+
+    std::memcpy(pixels + first_x, tiles + _fine_x + first_x, end_x - first_x);
+
+    if ((_mask & PPUMASK_BACKGROUND_LEFT) == 0 && first_x < 8)
+        std::memset(pixels + first_x, 0, std::min(end_x, 8u) - first_x);
+}
+
+int32_t ScanlinePPU::RenderSprites(uint32_t scanline, const uint8_t* background, uint8_t* pixels)
+{
+    std::memset(pixels, 0, SCREEN_WIDTH);
+    UpdateSpriteLists();
+
+    // The evaluation stops looking after the 9th sprite
+    if (_sprite_list_overflows[scanline])
+        _status |= PPUSTATUS_SPRITE_OVERFLOW;
+
+    int32_t sprite_zero_x = -1;
+    bool show_sprites = (_mask & PPUMASK_SHOW_SPRITES) != 0;
+    uint32_t first_x = (_mask & PPUMASK_SPRITES_LEFT) != 0 ? 0 : 8;
+
+    // Hits need both layers, and never happen on x = 255 nor where either layer is clipped
+    bool can_hit = (_mask & PPUMASK_SHOW_BACKGROUND) != 0 && show_sprites;
+    uint32_t first_hit_x = (_mask & (PPUMASK_BACKGROUND_LEFT | PPUMASK_SPRITES_LEFT)) == (PPUMASK_BACKGROUND_LEFT | PPUMASK_SPRITES_LEFT) ? 0 : 8;
+
+    if (!show_sprites)
+        return sprite_zero_x;
+
+    for (uint32_t i = 0; i < _sprite_list_sizes[scanline]; ++i)
+    {
+        uint32_t sprite = _sprite_lists[scanline][i];
+        const uint8_t* entry = OAM + sprite * 4;
+
+        // Sprites are drawn one scanline below their Y
+        uint32_t row = scanline - (entry[0] + 1u);
+        uint8_t attributes = entry[2];
+        uint32_t x = entry[3];
+
+        const uint8_t* sprite_pixels = _ppu_bus.GetPatternRow(GetSpritePatternAddress(entry, row), (attributes & SPRITE_FLIP_HORIZONTAL) != 0);
+
+        uint8_t palette_bits = static_cast<uint8_t>(0x10 | (attributes & SPRITE_PALETTE) << 2 | (attributes & SPRITE_BEHIND_BACKGROUND));
+
+        for (uint32_t pixel = 0; pixel < 8 && x + pixel < SCREEN_WIDTH; ++pixel)
+        {
+            uint32_t pixel_x = x + pixel;
+            if (sprite_pixels[pixel] == 0 || pixel_x < first_x)
+                continue;
+
+            if (sprite == 0 && can_hit && sprite_zero_x < 0 && pixel_x >= first_hit_x && pixel_x != 255 && (background[pixel_x] & 0x03) != 0)
+                sprite_zero_x = static_cast<int32_t>(pixel_x);
+
+            // Lower OAM entries win
+            if ((pixels[pixel_x] & 0x03) == 0)
+                pixels[pixel_x] = palette_bits | sprite_pixels[pixel];
+        }
+    }
+
+    return sprite_zero_x;
+}
+
+void ScanlinePPU::UpdateSpriteLists()
+{
+    // Writes straight to OAM, once per frame
+    if (_sprite_list_frame != _frame_count)
+    {
+        _sprite_list_frame = _frame_count;
+        for (uint32_t sprite = 0; sprite < OAM_SIZE / 4; ++sprite)
+            _OAM_changed |= OAM[sprite * 4] != _sprite_list_Y[sprite];
+    }
+
+    if (_OAM_changed || GetSpriteHeight() != _sprite_list_height)
+        BuildSpriteLists();
+}
+
+void ScanlinePPU::BuildSpriteLists()
+{
+    uint32_t height = GetSpriteHeight();
+    std::memset(_sprite_list_sizes, 0, sizeof(_sprite_list_sizes));
+    std::memset(_sprite_list_overflows, 0, sizeof(_sprite_list_overflows));
+
+    // Each sprite goes on the scanlines it covers, one below its Y
+    for (uint32_t sprite = 0; sprite < OAM_SIZE / 4; ++sprite)
+    {
+        uint8_t y = OAM[sprite * 4];
+        _sprite_list_Y[sprite] = y;
+
+        for (uint32_t scanline = y + 1u; scanline < y + 1u + height && scanline < SCREEN_HEIGHT; ++scanline)
+        {
+            uint8_t& size = _sprite_list_sizes[scanline];
+            if (size == MAX_SPRITES_PER_SCANLINE)
+                _sprite_list_overflows[scanline] = true;
+            else
+                _sprite_lists[scanline][size++] = static_cast<uint8_t>(sprite);
+        }
+    }
+
+    _sprite_list_height = height;
+    _OAM_changed = false;
+}
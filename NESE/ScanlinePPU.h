@@ -0,0 +1,115 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ScanlinePPU_h__
+#define ScanlinePPU_h__
+
+#include <cstdint>
+#include "PPU.h"
+#include "Scheduler.h"
+
+/** SCANLINE PPU
+*  Every visible scanline is drawn as a whole on its dot 1, from the registers as they are
+*  at that moment, the rest of the frame only has a few fixed points (the scroll updates
+*  on dots 257/304, VBlank on 241 and the flag clear on 261).
+*  Run() advances straight from one of those points to the next, so the cost is per
+*  scanline and not per dot.
+*  Scroll uses the internal v/t/x/w registers, so $2005/$2006 writes during HBlank apply
+*  to the next scanline like on the real PPU, writes in the middle of a visible scanline
+*  show up one scanline late.
+*  Sprite 0 hit is found while rendering and only becomes visible on $2002 at the dot of
+*  the hit pixel, so polling loops for raster splits see it at the right time. Scanlines
+*  not drawn find it from 8 bit opaque masks of the sprite and background rows instead.
+*  Sprite evaluation comes from lists of the sprites on each scanline, bucketed by Y and
+*  rebuilt only when OAM or the sprite height change, so a scanline touches its own sprites only.
+*  With dirty tracking a scanline keeps what it was drawn from, and draws again only the
+*  8 pixel columns under a tile, attribute or sprite that changed since.
+**/
+class ScanlinePPU final : public PPU
+{
+public:
+    ScanlinePPU(PPUBus& ppu_bus);
+
+    void Reset();
+
+    // Advances to time, in PPU dots since power on
+    void Run(uint64_t time);
+
+    uint8_t ReadRegister(uint16_t address);
+
+    // Draws a scanline recorded by a RenderPipeline, with the registers it had then
+    void ReplayScanline(uint32_t scanline, uint8_t control, uint8_t mask, uint16_t v, uint8_t fine_x);
+
+private:
+    void Checkpoint(uint32_t scanline, uint32_t dot);
+    static uint64_t NextCheckpoint(uint64_t time);
+
+    void RenderScanline(uint32_t scanline);
+
+    // Block columns of the scanline whose inputs changed since it was last drawn, all of them
+    // the first time. Records the inputs for the next frame.
+    uint32_t FindDirtyColumns(uint32_t scanline);
+
+    // What RenderScanline() changes on the status, for scanlines not drawn: overflow and sprite 0 hit
+    void EvaluateScanline(uint32_t scanline);
+
+    // Opaque pixels of a background tile of the scanline as bits, leftmost pixel in bit 0.
+    // tile counts from the one v points to.
+    uint8_t GetBackgroundOpaqueMask(uint32_t tile) const;
+
+    // Background pixels first_x to end_x of the scanline as palette << 2 | color, 0 is transparent
+    void RenderBackground(uint8_t* pixels, uint32_t first_x, uint32_t end_x);
+
+    // Sprite pixels as 0x10 | palette << 2 | color (0 transparent) plus the priority bit
+    // on SPRITE_BEHIND_BACKGROUND, returns the x of the sprite 0 hit or -1
+    int32_t RenderSprites(uint32_t scanline, const uint8_t* background, uint8_t* pixels);
+
+    // Rebuilds the sprite lists if they are stale
+    void UpdateSpriteLists();
+    void BuildSpriteLists();
+
+    uint64_t _next_checkpoint;
+    uint64_t _sprite_zero_hit_time; // NO_EVENT when there is no hit this frame
+
+    // First 8 sprites of each scanline in OAM order, and whether the evaluation finds a 9th
+    uint8_t _sprite_lists[SCREEN_HEIGHT][MAX_SPRITES_PER_SCANLINE];
+    uint8_t _sprite_list_sizes[SCREEN_HEIGHT];
+    bool _sprite_list_overflows[SCREEN_HEIGHT];
+
+    // What the lists were built from, the Y are checked once per frame for writes straight to OAM
+    uint8_t _sprite_list_Y[OAM_SIZE / 4];
+    uint32_t _sprite_list_height;
+    uint64_t _sprite_list_frame;
+
+    // What a scanline was drawn from, besides the memory the write stamps cover
+    struct ScanlineInputs
+    {
+        uint16_t v;
+        uint8_t fine_x;
+        uint8_t control;
+        uint8_t mask;
+        uint8_t sprite_count;
+        uint8_t sprites[MAX_SPRITES_PER_SCANLINE * 4]; // OAM entries, in the list order
+        const uint8_t* pages[PATTERN_TABLES_SIZE / PPU_PAGE_SIZE + 4]; // Banks of the pattern tables and nametables
+    };
+
+    ScanlineInputs _drawn_inputs[SCREEN_HEIGHT];
+    uint64_t _drawn_at[SCREEN_HEIGHT]; // _scanlines_drawn when the scanline was, 0 to draw it whole
+};
+
+#endif // ScanlinePPU_h__
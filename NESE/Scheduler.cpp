@@ -0,0 +1,61 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Scheduler.h"
+
+Scheduler::Scheduler() : _now(0), _next_event(NO_EVENT)
+{
+    for (uint64_t& event : _events)
+        event = NO_EVENT;
+}
+
+void Scheduler::Schedule(EventType type, uint64_t time)
+{
+    _events[static_cast<uint8_t>(type)] = time;
+    UpdateNextEvent();
+}
+
+bool Scheduler::PopDueEvent(EventType& type)
+{
+    if (_next_event > _now)
+        return false;
+
+    for (uint8_t i = 0; i < static_cast<uint8_t>(EventType::Count); ++i)
+    {
+        if (_events[i] == _next_event)
+        {
+            type = static_cast<EventType>(i);
+            _events[i] = NO_EVENT;
+            UpdateNextEvent();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Scheduler::UpdateNextEvent()
+{
+    _next_event = NO_EVENT;
+
+    for (uint64_t event : _events)
+    {
+        if (event < _next_event)
+            _next_event = event;
+    }
+}
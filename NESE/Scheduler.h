@@ -0,0 +1,65 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef Scheduler_h__
+#define Scheduler_h__
+
+#include <cstdint>
+
+constexpr uint64_t NO_EVENT = UINT64_MAX;
+
+enum class EventType : uint8_t
+{
+    MapperIRQ,
+    PPUVBlank,
+    APUIRQ,     // Frame counter IRQ or DMC fetch, which can raise the DMC IRQ
+    Count,
+};
+
+/** SCHEDULER
+*  Future events of the system, timestamps are PPU dots since power on.
+*  There is a single slot per event type, scheduling again just moves the event.
+*  The console runs the CPU up to the next event instead of polling every device.
+**/
+class Scheduler
+{
+public:
+    Scheduler();
+
+    // Current time, updated by the console before any device can observe it
+    uint64_t GetNow() const { return _now; }
+    void SetNow(uint64_t now) { _now = now; }
+
+    void Schedule(EventType type, uint64_t time);
+    void Cancel(EventType type) { Schedule(type, NO_EVENT); }
+
+    uint64_t GetEventTime(EventType type) const { return _events[static_cast<uint8_t>(type)]; }
+    uint64_t GetNextEventTime() const { return _next_event; }
+
+    // Removes and returns the earliest event due at the current time
+    bool PopDueEvent(EventType& type);
+
+private:
+    void UpdateNextEvent();
+
+    uint64_t _now;
+    uint64_t _next_event;
+    uint64_t _events[static_cast<uint8_t>(EventType::Count)];
+};
+
+#endif // Scheduler_h__
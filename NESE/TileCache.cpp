@@ -0,0 +1,67 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "TileCache.h"
+#include "TileDecoder.h"
+#include <algorithm>
+#include <cstring>
+
+TileCache::TileCache(uint32_t chr_size) : _resident_blocks(0), _decode_count(0)
+{
+    _tile_count = (chr_size + TILE_SIZE - 1) / TILE_SIZE;
+    _blocks.resize((chr_size + TILE_CACHE_BLOCK_SIZE - 1) / TILE_CACHE_BLOCK_SIZE);
+}
+
+void TileCache::Release(uint32_t chr_offset, uint32_t size)
+{
+    uint32_t first = chr_offset / TILE_CACHE_BLOCK_SIZE;
+    uint32_t last = std::min<uint32_t>((chr_offset + size + TILE_CACHE_BLOCK_SIZE - 1) / TILE_CACHE_BLOCK_SIZE, static_cast<uint32_t>(_blocks.size()));
+
+    for (uint32_t i = first; i < last; ++i)
+    {
+        if (_blocks[i])
+        {
+            _blocks[i].reset();
+            --_resident_blocks;
+        }
+    }
+}
+
+TileCache::Block* TileCache::Decode(uint32_t chr_offset, const uint8_t* tile)
+{
+    std::unique_ptr<Block>& block = _blocks[chr_offset / TILE_CACHE_BLOCK_SIZE];
+    if (!block)
+    {
+        // The pixels are written before anything reads them, only the flags need clearing
+        block.reset(new Block);
+        std::memset(block->decoded, 0, sizeof(block->decoded));
+        ++_resident_blocks;
+    }
+
+    // Low plane rows come first, the high plane rows 8 bytes later
+    uint32_t index = chr_offset % TILE_CACHE_BLOCK_SIZE / TILE_SIZE;
+    uint8_t* pixels = block->pixels + index * 2 * TILE_PIXELS_SIZE;
+    DecodeTileRows(tile, tile + 8, 8, pixels);
+    DecodeTileRowsFlipped(tile, tile + 8, 8, pixels + TILE_PIXELS_SIZE);
+
+    block->decoded[index] = 1;
+    ++_decode_count;
+
+    return block.get();
+}
@@ -0,0 +1,92 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TileCache_h__
+#define TileCache_h__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+constexpr uint32_t TILE_SIZE = 16;          // Bytes of CHR per tile
+constexpr uint32_t TILE_PIXELS_SIZE = 64;   // 8x8 pixels, one byte each
+constexpr uint32_t NO_CHR_OFFSET = UINT32_MAX;
+
+// Decoded tiles are allocated per 1 KB of CHR, the smallest bank any mapper switches
+constexpr uint32_t TILE_CACHE_BLOCK_SIZE = 1024;
+constexpr uint32_t TILE_CACHE_BLOCK_TILES = TILE_CACHE_BLOCK_SIZE / TILE_SIZE;
+
+/** TILE CACHE
+*  The tiles of the cartridge CHR memory expanded to one byte per pixel, plain and
+*  horizontally flipped. Tiles are keyed by their offset in the CHR memory, so every bank
+*  has its own entries and a bank switch does not touch the cache.
+*  A tile is decoded the first time one of its rows is read, and decoded again only after
+*  a write to its CHR RAM bytes marks it stale. The decoded pixels take 8 times the CHR
+*  they come from, so they live in blocks created on the first read of a tile of their
+*  1 KB of CHR, only the block table is sized for the whole CHR memory. A paged CHR ROM
+*  releases the blocks of the chunks it evicts, bounding the cache like the ROM itself.
+**/
+class TileCache
+{
+public:
+    TileCache(uint32_t chr_size);
+
+    // Row (0-7) of the tile at chr_offset, tile points to its 16 bytes in the CHR memory
+    const uint8_t* GetRow(uint32_t chr_offset, const uint8_t* tile, uint32_t row, bool flipped)
+    {
+        Block* block = _blocks[chr_offset / TILE_CACHE_BLOCK_SIZE].get();
+        uint32_t index = chr_offset % TILE_CACHE_BLOCK_SIZE / TILE_SIZE;
+        if (!block || !block->decoded[index])
+            block = Decode(chr_offset, tile);
+
+        return block->pixels + (index * 2 + (flipped ? 1 : 0)) * TILE_PIXELS_SIZE + row * 8;
+    }
+
+    // CHR RAM write at chr_offset
+    void Invalidate(uint32_t chr_offset)
+    {
+        Block* block = _blocks[chr_offset / TILE_CACHE_BLOCK_SIZE].get();
+        if (block)
+            block->decoded[chr_offset % TILE_CACHE_BLOCK_SIZE / TILE_SIZE] = 0;
+    }
+
+    // Frees the blocks of [chr_offset, chr_offset + size), its tiles are decoded again on the next read
+    void Release(uint32_t chr_offset, uint32_t size);
+
+    uint32_t GetTileCount() const { return _tile_count; }
+    uint32_t GetDecodeCount() const { return _decode_count; } // Tiles decoded since creation
+    uint32_t GetResidentBlocks() const { return _resident_blocks; }
+    size_t GetResidentSize() const { return _resident_blocks * sizeof(Block); }
+
+private:
+    struct Block
+    {
+        uint8_t pixels[TILE_CACHE_BLOCK_TILES * 2 * TILE_PIXELS_SIZE]; // Plain then flipped pixels of every tile
+        uint8_t decoded[TILE_CACHE_BLOCK_TILES];
+    };
+
+    Block* Decode(uint32_t chr_offset, const uint8_t* tile);
+
+    std::vector<std::unique_ptr<Block>> _blocks; // Per 1 KB of CHR, null until a tile is read
+    uint32_t _tile_count;
+    uint32_t _resident_blocks;
+    uint32_t _decode_count;
+};
+
+#endif // TileCache_h__
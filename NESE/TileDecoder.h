@@ -0,0 +1,170 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TileDecoder_h__
+#define TileDecoder_h__
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/** TILE DECODER
+*  Two CHR bitplanes of a tile row to 8 pixels of 2 bits, one byte per pixel, leftmost
+*  pixel first (the flipped variants put the rightmost first).
+*  The single row versions spread the 8 bits of a plane over 8 bytes with PDEP when the
+*  compiler targets BMI2, or with one multiply otherwise. The batch versions decode 4 rows
+*  per AVX2 or 2 rows per SSE2 instruction sequence. The instruction set is the one the
+*  compiler targets, the NativeCPU build option enables AVX2/BMI2 on the build machine.
+**/
+
+// Reference version, one bit at a time
+inline void DecodeTileRowBitwise(uint8_t low, uint8_t high, uint8_t* pixels)
+{
+    for (int32_t x = 0; x < 8; ++x)
+        pixels[x] = static_cast<uint8_t>(((low >> (7 - x)) & 0x01) | (((high >> (7 - x)) & 0x01) << 1));
+}
+
+inline uint8_t ReverseBits(uint8_t value)
+{
+    value = static_cast<uint8_t>((value & 0xF0) >> 4 | (value & 0x0F) << 4);
+    value = static_cast<uint8_t>((value & 0xCC) >> 2 | (value & 0x33) << 2);
+    return static_cast<uint8_t>((value & 0xAA) >> 1 | (value & 0x55) << 1);
+}
+
+// Index of the lowest set bit, value must not be 0
+inline uint32_t CountTrailingZeros(uint32_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return static_cast<uint32_t>(__builtin_ctz(value));
+#endif
+}
+
+// Byte i of the result (the i-th in memory on a little endian host) is 0 or 1 for pixel i
+template <bool Flipped>
+inline uint64_t SpreadBits(uint8_t bits)
+{
+#if defined(__BMI2__)
+    // PDEP puts bit 0 in byte 0, the leftmost pixel is bit 7
+    uint64_t spread = _pdep_u64(bits, 0x0101010101010101ULL);
+    return Flipped ? spread : __builtin_bswap64(spread);
+#else
+    // Every byte gets a copy of bits and keeps the bit of its pixel, the add carries it to bit 7
+    uint64_t spread = (bits * 0x0101010101010101ULL) & (Flipped ? 0x8040201008040201ULL : 0x0102040810204080ULL);
+    return ((spread + 0x7F7F7F7F7F7F7F7FULL) >> 7) & 0x0101010101010101ULL;
+#endif
+}
+
+template <bool Flipped>
+inline uint64_t TileRowPixels(uint8_t low, uint8_t high)
+{
+    return SpreadBits<Flipped>(low) | SpreadBits<Flipped>(high) << 1;
+}
+
+// The plane byte copied to the 8 bytes of a vector lane
+inline long long BroadcastPlane(uint8_t plane)
+{
+    return static_cast<long long>(plane * 0x0101010101010101ULL);
+}
+
+template <bool Flipped>
+inline void DecodeTileRowImpl(uint8_t low, uint8_t high, uint8_t* pixels)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    DecodeTileRowBitwise(Flipped ? ReverseBits(low) : low, Flipped ? ReverseBits(high) : high, pixels);
+#else
+    uint64_t row = TileRowPixels<Flipped>(low, high);
+    std::memcpy(pixels, &row, sizeof(row));
+#endif
+}
+
+inline void DecodeTileRow(uint8_t low, uint8_t high, uint8_t* pixels)
+{
+    DecodeTileRowImpl<false>(low, high, pixels);
+}
+
+inline void DecodeTileRowFlipped(uint8_t low, uint8_t high, uint8_t* pixels)
+{
+    DecodeTileRowImpl<true>(low, high, pixels);
+}
+
+// Count rows from the planes low[i]/high[i], 8 pixels per row
+template <bool Flipped>
+inline void DecodeTileRowsImpl(const uint8_t* low, const uint8_t* high, uint32_t count, uint8_t* pixels)
+{
+    uint32_t row = 0;
+
+    // Every byte gets its plane byte and keeps the bit of its pixel: compare against the
+    // bit itself leaves 0xFF on set pixels
+#if defined(__AVX2__)
+    const __m256i bits_256 = Flipped ? _mm256_set1_epi64x(0x8040201008040201LL) : _mm256_set1_epi64x(0x0102040810204080LL);
+    for (; row + 4 <= count; row += 4)
+    {
+        __m256i low_planes = _mm256_set_epi64x(BroadcastPlane(low[row + 3]), BroadcastPlane(low[row + 2]),
+            BroadcastPlane(low[row + 1]), BroadcastPlane(low[row]));
+        __m256i high_planes = _mm256_set_epi64x(BroadcastPlane(high[row + 3]), BroadcastPlane(high[row + 2]),
+            BroadcastPlane(high[row + 1]), BroadcastPlane(high[row]));
+
+        __m256i low_set = _mm256_cmpeq_epi8(_mm256_and_si256(low_planes, bits_256), bits_256);
+        __m256i high_set = _mm256_cmpeq_epi8(_mm256_and_si256(high_planes, bits_256), bits_256);
+        __m256i result = _mm256_or_si256(_mm256_and_si256(low_set, _mm256_set1_epi8(0x01)), _mm256_and_si256(high_set, _mm256_set1_epi8(0x02)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + row * 8), result);
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i bits_128 = Flipped ? _mm_set1_epi64x(0x8040201008040201LL) : _mm_set1_epi64x(0x0102040810204080LL);
+    for (; row + 2 <= count; row += 2)
+    {
+        __m128i low_planes = _mm_set_epi64x(BroadcastPlane(low[row + 1]), BroadcastPlane(low[row]));
+        __m128i high_planes = _mm_set_epi64x(BroadcastPlane(high[row + 1]), BroadcastPlane(high[row]));
+
+        __m128i low_set = _mm_cmpeq_epi8(_mm_and_si128(low_planes, bits_128), bits_128);
+        __m128i high_set = _mm_cmpeq_epi8(_mm_and_si128(high_planes, bits_128), bits_128);
+        __m128i result = _mm_or_si128(_mm_and_si128(low_set, _mm_set1_epi8(0x01)), _mm_and_si128(high_set, _mm_set1_epi8(0x02)));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + row * 8), result);
+    }
+#endif
+
+    for (; row < count; ++row)
+        DecodeTileRowImpl<Flipped>(low[row], high[row], pixels + row * 8);
+}
+
+inline void DecodeTileRows(const uint8_t* low, const uint8_t* high, uint32_t count, uint8_t* pixels)
+{
+    DecodeTileRowsImpl<false>(low, high, count, pixels);
+}
+
+inline void DecodeTileRowsFlipped(const uint8_t* low, const uint8_t* high, uint32_t count, uint8_t* pixels)
+{
+    DecodeTileRowsImpl<true>(low, high, count, pixels);
+}
+
+#endif // TileDecoder_h__
@@ -0,0 +1,250 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include "APU.h"
+#include "BlipBuffer.h"
+
+TEST(BlipBufferTest, Step) {
+    BlipBuffer blip;
+    ASSERT_TRUE(blip.SetRates(CPU_CLOCK_RATE, 48000, 4096));
+
+    blip.AddDelta(1000, 10000);
+    blip.EndFrame(29781);
+
+    std::vector<int16_t> samples(blip.GetSamplesAvailable());
+    ASSERT_EQ(blip.ReadSamples(samples.data(), static_cast<uint32_t>(samples.size())), samples.size());
+
+    // The step lands at sample 26.8 plus the kernel latency, with little ringing around it
+    uint32_t step = static_cast<uint32_t>(1000 * 48000 / CPU_CLOCK_RATE) + BLIP_WIDTH / 2;
+    for (uint32_t i = 0; i < step - 4; ++i)
+        EXPECT_LT(std::abs(samples[i]), 200) << i;
+
+    int16_t peak = *std::max_element(samples.begin(), samples.end());
+    EXPECT_GT(peak, 9800);
+    EXPECT_LT(peak, 11000);
+
+    EXPECT_GT(samples[step + 4], 9500);
+    EXPECT_LT(samples[step + 4], 10300);
+
+    // The DC blocker brings it back to zero
+    EXPECT_LT(samples.back(), samples[step + 4] / 2);
+}
+
+TEST(BlipBufferTest, SamplesPerFrame) {
+    BlipBuffer blip;
+    ASSERT_TRUE(blip.SetRates(CPU_CLOCK_RATE, 44100, 4096));
+    EXPECT_FALSE(blip.SetRates(CPU_CLOCK_RATE, 0, 4096));
+
+    // One second of NTSC frames, the fractions add up
+    uint32_t samples = 0;
+    for (uint32_t frame = 0; frame < 60; ++frame)
+    {
+        blip.EndFrame(frame % 3 == 2 ? 29781 : 29780);
+        samples += blip.ReadSamples(nullptr, 4096);
+    }
+
+    EXPECT_NEAR(samples, 60 * 29780.67 * 44100 / CPU_CLOCK_RATE, 1.0);
+    EXPECT_EQ(blip.GetSamplesAvailable(), 0u);
+}
+
+TEST(APUTest, LengthCounter) {
+    Bus bus;
+    APU apu(bus);
+
+    // Loads only while enabled
+    apu.WriteRegister(0x4003, 0x00);
+    EXPECT_EQ(apu.ReadStatus() & 0x01, 0);
+
+    // Length 10, two half frames per sequence
+    apu.WriteRegister(APU_STATUS, 0x01);
+    apu.WriteRegister(0x4003, 0x00);
+    EXPECT_EQ(apu.ReadStatus() & 0x01, 0x01);
+
+    apu.Run(4 * 29830);
+    EXPECT_EQ(apu.ReadStatus() & 0x01, 0x01);
+    apu.Run(5 * 29830);
+    EXPECT_EQ(apu.ReadStatus() & 0x01, 0);
+
+    // Halted, then disabled
+    apu.WriteRegister(0x4000, 0x20);
+    apu.WriteRegister(0x4003, 0x00);
+    apu.Run(10 * 29830);
+    EXPECT_EQ(apu.ReadStatus() & 0x01, 0x01);
+    apu.WriteRegister(APU_STATUS, 0x00);
+    EXPECT_EQ(apu.ReadStatus() & 0x01, 0);
+}
+
+TEST(APUTest, FrameIRQ) {
+    Bus bus;
+    APU apu(bus);
+
+    apu.Run(FRAME_COUNTER_4_STEP_LAST - 1);
+    EXPECT_FALSE(apu.IRQAsserted());
+    apu.Run(FRAME_COUNTER_4_STEP_LAST);
+    EXPECT_TRUE(apu.IRQAsserted());
+
+    // Reading the status acknowledges it
+    EXPECT_EQ(apu.ReadStatus() & APU_STATUS_FRAME_IRQ, APU_STATUS_FRAME_IRQ);
+    EXPECT_FALSE(apu.IRQAsserted());
+    EXPECT_EQ(apu.ReadStatus() & APU_STATUS_FRAME_IRQ, 0);
+
+    // Neither inhibited nor in 5 step mode
+    apu.WriteRegister(APU_FRAME_COUNTER, FRAME_COUNTER_IRQ_INHIBIT);
+    apu.Run(apu.GetTime() + 3 * 29830);
+    EXPECT_FALSE(apu.IRQAsserted());
+
+    apu.WriteRegister(APU_FRAME_COUNTER, FRAME_COUNTER_5_STEP);
+    apu.Run(apu.GetTime() + 3 * 37282);
+    EXPECT_FALSE(apu.IRQAsserted());
+}
+
+TEST(APUTest, DMC) {
+    Bus bus;
+    APU apu(bus);
+
+    // 17 bytes at $C040, fastest rate with the IRQ on
+    for (uint16_t i = 0; i < 17; ++i)
+        bus[0xC040 + i] = 0xFF;
+
+    apu.WriteRegister(0x4010, 0x8F);
+    apu.WriteRegister(0x4012, 0x01);
+    apu.WriteRegister(0x4013, 0x01);
+    apu.WriteRegister(APU_STATUS, 0x10);
+
+    // The first byte is fetched at once
+    EXPECT_EQ(apu.TakeStallCycles(), DMC_FETCH_CYCLES);
+    EXPECT_EQ(apu.ReadStatus() & APU_STATUS_DMC_ACTIVE, APU_STATUS_DMC_ACTIVE);
+
+    // The next ones every 8 bits of 54 cycles, after the timer runs out the power on period (428)
+    apu.Run(428 + 54 * (8 * 15 - 1));
+    EXPECT_EQ(apu.TakeStallCycles(), 15 * DMC_FETCH_CYCLES);
+    EXPECT_FALSE(apu.IRQAsserted());
+
+    apu.Run(428 + 54 * (8 * 16 - 1));
+    EXPECT_EQ(apu.TakeStallCycles(), DMC_FETCH_CYCLES);
+    EXPECT_EQ(apu.ReadStatus(), APU_STATUS_DMC_IRQ);
+    EXPECT_TRUE(apu.IRQAsserted());
+
+    // Writing $4015 acknowledges it
+    apu.WriteRegister(APU_STATUS, 0x00);
+    EXPECT_FALSE(apu.IRQAsserted());
+}
+
+// Rising zero crossings after the first tenth of a second, with some hysteresis for the
+// ringing of the steps
+static uint32_t CountCycles(const std::vector<int16_t>& samples, uint32_t sample_rate)
+{
+    uint32_t cycles = 0;
+    bool low = false;
+    for (size_t i = sample_rate / 10; i < samples.size(); ++i)
+    {
+        if (samples[i] < -500)
+            low = true;
+        else if (low && samples[i] > 500)
+        {
+            low = false;
+            ++cycles;
+        }
+    }
+
+    return cycles;
+}
+
+static std::vector<int16_t> RunAudio(APU& apu, uint32_t frames)
+{
+    std::vector<int16_t> samples;
+    for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+        apu.Run(apu.GetTime() + 29781);
+        apu.EndFrame();
+
+        size_t size = samples.size();
+        samples.resize(size + apu.GetSamplesAvailable());
+        apu.ReadSamples(samples.data() + size, apu.GetSamplesAvailable());
+    }
+
+    return samples;
+}
+
+TEST(APUTest, PulseTone) {
+    Bus bus;
+    APU apu(bus);
+    ASSERT_TRUE(apu.SetSampleRate(DEFAULT_SAMPLE_RATE));
+
+    // 50% duty, halted length, constant volume 15, period 253: 440.4 Hz
+    apu.WriteRegister(APU_STATUS, 0x01);
+    apu.WriteRegister(0x4000, 0xBF);
+    apu.WriteRegister(0x4002, 253);
+    apu.WriteRegister(0x4003, 0x00);
+
+    std::vector<int16_t> samples = RunAudio(apu, 66);
+    ASSERT_GT(samples.size(), DEFAULT_SAMPLE_RATE);
+
+    samples.resize(DEFAULT_SAMPLE_RATE + DEFAULT_SAMPLE_RATE / 10);
+    EXPECT_NEAR(CountCycles(samples, DEFAULT_SAMPLE_RATE), 440, 2);
+
+    // A full volume pulse is about a quarter of full scale, centered by the DC blocker
+    int16_t peak = *std::max_element(samples.begin() + DEFAULT_SAMPLE_RATE / 10, samples.end());
+    EXPECT_GT(peak, 3000);
+    EXPECT_LT(peak, 6000);
+
+    // Disabled, it goes quiet
+    apu.WriteRegister(APU_STATUS, 0x00);
+    samples = RunAudio(apu, 30);
+    EXPECT_LT(std::abs(samples.back()), 200);
+}
+
+TEST(APUTest, TriangleTone) {
+    Bus bus;
+    APU apu(bus);
+    ASSERT_TRUE(apu.SetSampleRate(44100));
+
+    // Linear counter halted, period 126: 32 steps of 127 cycles, 440.4 Hz
+    apu.WriteRegister(APU_STATUS, 0x04);
+    apu.WriteRegister(0x4008, 0xFF);
+    apu.WriteRegister(0x400A, 126);
+    apu.WriteRegister(0x400B, 0x00);
+
+    std::vector<int16_t> samples = RunAudio(apu, 66);
+    samples.resize(44100 + 4410);
+    EXPECT_NEAR(CountCycles(samples, 44100), 440, 2);
+}
+
+TEST(APUTest, Silence) {
+    Bus bus;
+    APU apu(bus);
+    ASSERT_TRUE(apu.SetSampleRate(DEFAULT_SAMPLE_RATE));
+
+    // Only the DC step of the triangle output at power on, then nothing
+    std::vector<int16_t> samples = RunAudio(apu, 120);
+    for (size_t i = samples.size() / 2; i < samples.size(); ++i)
+        ASSERT_LT(std::abs(samples[i]), 16) << i;
+
+    // Nobody reads, the oldest samples are dropped
+    for (uint32_t frame = 0; frame < 120; ++frame)
+    {
+        apu.Run(apu.GetTime() + 29781);
+        apu.EndFrame();
+    }
+    EXPECT_LE(apu.GetSamplesAvailable(), DEFAULT_SAMPLE_RATE / 4);
+}
@@ -0,0 +1,155 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include "Cartridge.h"
+#include "TestRom.h"
+
+static bool IsArenaAligned(const CartridgeRegion& region)
+{
+    return reinterpret_cast<uintptr_t>(region.data()) % ARENA_ALIGNMENT == 0;
+}
+
+TEST(CartridgeTest, iNES) {
+    std::vector<uint8_t> image = MakeINESHeader(2, 1, 0x11, 0x00);
+    image.resize(INES_HEADER_SIZE + 2 * 16384 + 8192, 0);
+    image[INES_HEADER_SIZE] = 0xAB;
+    image[INES_HEADER_SIZE + 2 * 16384] = 0xCD;
+
+    Cartridge cart(image);
+    ASSERT_TRUE(cart.IsLoaded());
+    EXPECT_EQ(cart.detected_format, Cartridge::FormatType::iNES);
+    EXPECT_EQ(cart.mapper_id, 1);
+    EXPECT_EQ(cart.PGR_ROM.size(), 2u * 16384);
+    EXPECT_EQ(cart.CHR_ROM_RAM.size(), 8192u);
+    EXPECT_EQ(cart.PGR_RAM.size(), 8192u);
+    EXPECT_EQ(cart.PGR_NVRAM.size(), 0u);
+    EXPECT_FALSE(cart.chr_is_ram);
+    EXPECT_EQ(cart.PGR_ROM[0], 0xAB);
+    EXPECT_EQ(cart.CHR_ROM_RAM[0], 0xCD);
+}
+
+TEST(CartridgeTest, iNESTrainerAndBattery) {
+    std::vector<uint8_t> image = MakeINESHeader(1, 0, 0b00000110, 0x00);
+    image.resize(INES_HEADER_SIZE + TRAINER_SIZE + 16384, 0);
+    image[INES_HEADER_SIZE] = 0x12;
+    image[INES_HEADER_SIZE + TRAINER_SIZE] = 0x34;
+
+    Cartridge cart(image);
+    ASSERT_TRUE(cart.IsLoaded());
+    EXPECT_EQ(cart.Trainer.size(), TRAINER_SIZE);
+    EXPECT_EQ(cart.Trainer[0], 0x12);
+    EXPECT_EQ(cart.PGR_ROM[0], 0x34);
+    EXPECT_TRUE(cart.chr_is_ram);
+    EXPECT_EQ(cart.CHR_ROM_RAM.size(), 8192u);
+    EXPECT_TRUE(cart.has_battery);
+    EXPECT_EQ(cart.PGR_NVRAM.size(), 8192u);
+    EXPECT_EQ(cart.PGR_RAM.size(), 0u);
+}
+
+TEST(CartridgeTest, NES20Sizes) {
+    std::vector<uint8_t> image = MakeINESHeader(0x00, 0x00, 0x40, 0x08);
+    image[8] = 0x21; // Submapper 2, mapper bits 8-11 = 1
+    image[9] = 0x11; // PRG 256 units, CHR 256 units
+    image[10] = 0x97; // PRG NVRAM 64 << 9, PRG RAM 64 << 7
+    image[11] = 0x07; // CHR RAM 64 << 7, ignored because of CHR ROM
+
+    Cartridge cart_declared(image);
+    EXPECT_FALSE(cart_declared.IsLoaded()); // Truncated
+
+    image.resize(INES_HEADER_SIZE + 256 * 16384 + 256 * 8192, 0);
+
+    Cartridge cart(image);
+    ASSERT_TRUE(cart.IsLoaded());
+    EXPECT_EQ(cart.detected_format, Cartridge::FormatType::NES20);
+    EXPECT_EQ(cart.mapper_id, 0x104);
+    EXPECT_EQ(cart.submapper_id, 2);
+    EXPECT_EQ(cart.PGR_ROM.size(), 256u * 16384);
+    EXPECT_EQ(cart.CHR_ROM_RAM.size(), 256u * 8192);
+    EXPECT_EQ(cart.PGR_RAM.size(), 64u << 7);
+    EXPECT_EQ(cart.PGR_NVRAM.size(), 64u << 9);
+}
+
+TEST(CartridgeTest, NES20ExponentMultiplier) {
+    std::vector<uint8_t> image = MakeINESHeader((10 << 2) | 0x01, 0x00, 0x00, 0x08);
+    image[9] = 0x0F; // PRG uses exponent-multiplier: 2^10 * 3
+    image[11] = 0x70; // CHR NVRAM 64 << 7
+
+    image.resize(INES_HEADER_SIZE + 3072, 0);
+
+    Cartridge cart(image);
+    ASSERT_TRUE(cart.IsLoaded());
+    EXPECT_EQ(cart.PGR_ROM.size(), 3072u);
+    EXPECT_TRUE(cart.chr_is_ram);
+    EXPECT_EQ(cart.CHR_ROM_RAM.size(), 64u << 7);
+    EXPECT_EQ(cart.PGR_RAM.size(), 0u);
+}
+
+TEST(CartridgeTest, NES20ExponentOverflow) {
+    // Exponents above 32 can't be represented, exponent 32 with multiplier 7 overflows the regions
+    const uint8_t LSBs[] = { uint8_t(40 << 2), uint8_t(63 << 2) | 0x03, uint8_t(32 << 2) | 0x03 };
+    for (uint8_t LSB : LSBs)
+    {
+        std::vector<uint8_t> image = MakeINESHeader(LSB, 0x00, 0x00, 0x08);
+        image[9] = 0x0F;
+        image.resize(INES_HEADER_SIZE + 16384, 0);
+
+        Cartridge cart(image);
+        EXPECT_FALSE(cart.IsLoaded());
+        EXPECT_EQ(cart.detected_format, Cartridge::FormatType::Unk);
+    }
+
+    // Same thing on the CHR side
+    std::vector<uint8_t> image = MakeINESHeader(0x01, uint8_t(40 << 2), 0x00, 0x08);
+    image[9] = 0xF0;
+    image.resize(INES_HEADER_SIZE + 16384, 0);
+
+    Cartridge cart(image);
+    EXPECT_FALSE(cart.IsLoaded());
+}
+
+TEST(CartridgeTest, ArenaLayout) {
+    std::vector<uint8_t> image = MakeINESHeader(0x01, 0x00, 0x04, 0x08);
+    image[9] = 0x00;
+    image[10] = 0x31; // PRG NVRAM 512 bytes, PRG RAM 128 bytes
+    image.resize(INES_HEADER_SIZE + TRAINER_SIZE + 16384, 0);
+
+    Cartridge cart(image);
+    ASSERT_TRUE(cart.IsLoaded());
+
+    EXPECT_TRUE(IsArenaAligned(cart.Trainer));
+    EXPECT_TRUE(IsArenaAligned(cart.PGR_ROM));
+    EXPECT_TRUE(IsArenaAligned(cart.CHR_ROM_RAM));
+    EXPECT_TRUE(IsArenaAligned(cart.PGR_RAM));
+    EXPECT_TRUE(IsArenaAligned(cart.PGR_NVRAM));
+
+    // Everything lives in a single block, in the documented order
+    EXPECT_EQ(cart.Trainer.data(), cart.GetArena());
+    EXPECT_LT(cart.Trainer.data(), cart.PGR_ROM.data());
+    EXPECT_LT(cart.PGR_ROM.data(), cart.CHR_ROM_RAM.data());
+    EXPECT_LT(cart.CHR_ROM_RAM.data(), cart.PGR_RAM.data());
+    EXPECT_LT(cart.PGR_RAM.data(), cart.PGR_NVRAM.data());
+    EXPECT_LE(cart.PGR_NVRAM.data() + cart.PGR_NVRAM.size(), cart.GetArena() + cart.GetArenaSize());
+}
+
+TEST(CartridgeTest, UnknownFormat) {
+    std::vector<uint8_t> image(64, 0);
+
+    Cartridge cart(image);
+    EXPECT_FALSE(cart.IsLoaded());
+}
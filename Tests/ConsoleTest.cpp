@@ -0,0 +1,378 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include "Console.h"
+#include "TestRom.h"
+
+// NROM/UxROM image with a program at $8000: INC $10, JMP $8000
+static std::vector<uint8_t> MakeLoopRom(uint8_t mapper, uint8_t CHR_8KB_units = 1)
+{
+    std::vector<uint8_t> image = MakeTestRom(mapper, 2, CHR_8KB_units);
+
+    uint8_t* prg = image.data() + INES_HEADER_SIZE;
+    prg[0x0000] = static_cast<uint8_t>(Opcode::INC_ZP);
+    prg[0x0001] = 0x10;
+    prg[0x0002] = static_cast<uint8_t>(Opcode::JMP_ABS);
+    prg[0x0003] = 0x00;
+    prg[0x0004] = 0x80;
+
+    // Both 16 KB banks point the reset vector to $8000
+    prg[0x3FFD] = 0x80;
+    prg[0x7FFD] = 0x80;
+
+    return image;
+}
+
+TEST(ConsoleTest, FactoryPicksMapper) {
+    for (uint8_t mapper : { 0, 1, 2, 3, 4, 7 })
+    {
+        Cartridge cart(MakeLoopRom(mapper));
+        std::unique_ptr<ConsoleBase> console = CreateConsole(cart);
+        ASSERT_TRUE(console);
+        EXPECT_EQ(console->GetCPU().PC, 0x8000);
+    }
+
+    Cartridge unsupported(MakeLoopRom(99));
+    EXPECT_FALSE(CreateConsole(unsupported));
+}
+
+TEST(ConsoleTest, RunFrame) {
+    Cartridge cart(MakeLoopRom(0));
+    std::unique_ptr<ConsoleBase> console = CreateConsole(cart);
+    ASSERT_TRUE(console);
+
+    uint32_t cycles = console->RunFrame();
+
+    // A NTSC frame is 29780.67 CPU cycles, the last instruction may overshoot
+    EXPECT_GE(cycles, PPU_DOTS_PER_FRAME / PPU_DOTS_PER_CPU_CYCLE);
+    EXPECT_LT(cycles, PPU_DOTS_PER_FRAME / PPU_DOTS_PER_CPU_CYCLE + 8);
+    EXPECT_EQ(console->GetFrame(), 1u);
+
+    // INC zp (5) + JMP abs (3) per loop
+    EXPECT_EQ(console->GetBus().Read(0x0010), static_cast<uint8_t>((cycles + 7) / 8));
+}
+
+TEST(ConsoleTest, VBlankNMI) {
+    std::vector<uint8_t> image = MakeLoopRom(0);
+    uint8_t* prg = image.data() + INES_HEADER_SIZE;
+
+    // LDA #$80, STA $2000, JMP $8010 (spin)
+    prg[0x0000] = static_cast<uint8_t>(Opcode::LDA_IM);
+    prg[0x0001] = PPUCTRL_NMI_ENABLE;
+    prg[0x0002] = static_cast<uint8_t>(Opcode::STA_ABS);
+    prg[0x0003] = 0x00;
+    prg[0x0004] = 0x20;
+    prg[0x0005] = static_cast<uint8_t>(Opcode::JMP_ABS);
+    prg[0x0006] = 0x05;
+    prg[0x0007] = 0x80;
+
+    // NMI handler: INC $10, RTI
+    prg[0x0020] = static_cast<uint8_t>(Opcode::INC_ZP);
+    prg[0x0021] = 0x10;
+    prg[0x0022] = static_cast<uint8_t>(Opcode::RTI);
+    prg[0x7FFA] = 0x20;
+    prg[0x7FFB] = 0x80;
+
+    Cartridge cart(image);
+    std::unique_ptr<ConsoleBase> console = CreateConsole(cart);
+    ASSERT_TRUE(console);
+
+    for (int frame = 0; frame < 3; ++frame)
+        console->RunFrame();
+
+    EXPECT_EQ(console->GetBus().Read(0x0010), 3);
+}
+
+TEST(ConsoleTest, APUFrameIRQ) {
+    std::vector<uint8_t> image = MakeLoopRom(0);
+    uint8_t* prg = image.data() + INES_HEADER_SIZE;
+
+    // CLI, then INC $10, JMP $8001
+    prg[0x0000] = static_cast<uint8_t>(Opcode::CLI);
+    prg[0x0001] = static_cast<uint8_t>(Opcode::INC_ZP);
+    prg[0x0002] = 0x10;
+    prg[0x0003] = static_cast<uint8_t>(Opcode::JMP_ABS);
+    prg[0x0004] = 0x01;
+    prg[0x0005] = 0x80;
+
+    // IRQ handler: INC $11, LDA $4015 (acknowledges the frame IRQ), RTI
+    prg[0x0020] = static_cast<uint8_t>(Opcode::INC_ZP);
+    prg[0x0021] = 0x11;
+    prg[0x0022] = static_cast<uint8_t>(Opcode::LDA_ABS);
+    prg[0x0023] = 0x15;
+    prg[0x0024] = 0x40;
+    prg[0x0025] = static_cast<uint8_t>(Opcode::RTI);
+    prg[0x7FFE] = 0x20;
+    prg[0x7FFF] = 0x80;
+
+    Cartridge cart(image);
+    std::unique_ptr<ConsoleBase> console = CreateConsole(cart);
+    ASSERT_TRUE(console);
+
+    // The 4 step sequence is 29830 cycles, a frame 29780.67: one IRQ per frame but the first
+    for (int frame = 0; frame < 10; ++frame)
+        console->RunFrame();
+
+    EXPECT_EQ(console->GetBus().Read(0x0011), 9);
+
+    // Inhibited, the IRQs stop
+    console->GetBus().Write(APU_FRAME_COUNTER, FRAME_COUNTER_IRQ_INHIBIT);
+    for (int frame = 0; frame < 3; ++frame)
+        console->RunFrame();
+
+    EXPECT_EQ(console->GetBus().Read(0x0011), 9);
+}
+
+// CNROM image with mid-frame register traffic of all kinds: status polling, scroll and mask
+// writes at varying times, palette writes and OAM DMA from the NMI handler, CHR bank switches
+static std::vector<uint8_t> MakeRasterRom()
+{
+    std::vector<uint8_t> image = MakeLoopRom(3, 2);
+
+    uint8_t* chr = image.data() + INES_HEADER_SIZE + 2 * 16384;
+    uint32_t seed = 7;
+    for (uint32_t i = 0; i < 2 * 8192; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        chr[i] = static_cast<uint8_t>(seed >> 16);
+    }
+
+    uint8_t* prg = image.data() + INES_HEADER_SIZE;
+    const uint8_t program[] = {
+        // $8000: LDA #$1E, STA $2001, LDA #$80, STA $2000
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x1E, static_cast<uint8_t>(Opcode::STA_ABS), 0x01, 0x20,
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x80, static_cast<uint8_t>(Opcode::STA_ABS), 0x00, 0x20,
+        // $800A: LDA $2002, INC $10, LDA $10, STA $2005, STA $2005, STA $2001, STA $8000, JMP $800A
+        static_cast<uint8_t>(Opcode::LDA_ABS), 0x02, 0x20, static_cast<uint8_t>(Opcode::INC_ZP), 0x10,
+        static_cast<uint8_t>(Opcode::LDA_ZP), 0x10, static_cast<uint8_t>(Opcode::STA_ABS), 0x05, 0x20,
+        static_cast<uint8_t>(Opcode::STA_ABS), 0x05, 0x20, static_cast<uint8_t>(Opcode::STA_ABS), 0x01, 0x20,
+        static_cast<uint8_t>(Opcode::STA_ABS), 0x00, 0x80, static_cast<uint8_t>(Opcode::JMP_ABS), 0x0A, 0x80,
+    };
+    std::memcpy(prg, program, sizeof(program));
+
+    // NMI handler at $8040: palette write, OAM DMA from page 0, RTI
+    const uint8_t handler[] = {
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x3F, static_cast<uint8_t>(Opcode::STA_ABS), 0x06, 0x20,
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x01, static_cast<uint8_t>(Opcode::STA_ABS), 0x06, 0x20,
+        static_cast<uint8_t>(Opcode::LDA_ZP), 0x10, static_cast<uint8_t>(Opcode::STA_ABS), 0x07, 0x20,
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x00, static_cast<uint8_t>(Opcode::STA_ABS), 0x14, 0x40,
+        static_cast<uint8_t>(Opcode::RTI),
+    };
+    std::memcpy(prg + 0x40, handler, sizeof(handler));
+    prg[0x7FFA] = 0x40;
+    prg[0x7FFB] = 0x80;
+
+    return image;
+}
+
+template <class PPUType>
+static void ExpectLazyMatchesEager()
+{
+    std::vector<uint8_t> image = MakeRasterRom();
+    Cartridge eager_cart(image);
+    Cartridge lazy_cart(image);
+    std::unique_ptr<ConsoleBase> eager = CreateConsole<PPUType>(eager_cart);
+    std::unique_ptr<ConsoleBase> lazy = CreateConsole<PPUType>(lazy_cart);
+    ASSERT_TRUE(eager && lazy);
+    eager->SetEagerPPUSync(true);
+
+    for (int frame = 0; frame < 8; ++frame)
+    {
+        EXPECT_EQ(eager->RunFrame(), lazy->RunFrame());
+        EXPECT_EQ(eager->GetBus().Read(0x0010), lazy->GetBus().Read(0x0010));
+        EXPECT_EQ(eager->GetCPU().PC, lazy->GetCPU().PC);
+        EXPECT_EQ(std::memcmp(eager->GetFramebuffer(), lazy->GetFramebuffer(), SCREEN_WIDTH * SCREEN_HEIGHT), 0) << "frame " << frame;
+    }
+}
+
+TEST(ConsoleTest, LazyPPUSyncMatchesEager) {
+    ExpectLazyMatchesEager<ScanlinePPU>();
+    ExpectLazyMatchesEager<DotPPU>();
+}
+
+// NROM image playing every channel: a DMC sample looping through its IRQ, the frame IRQ
+// and the periods rewritten on every loop. Without the DMC only the frame IRQ comes and
+// the loop leaves the APU alone, nothing but the scheduler catches it up.
+static std::vector<uint8_t> MakeAudioRom(bool DMC)
+{
+    std::vector<uint8_t> image = MakeLoopRom(0);
+    uint8_t* prg = image.data() + INES_HEADER_SIZE;
+
+    const uint8_t program[] = {
+        // $8000: enable the channels, DMC IRQ at the fastest rate, 33 bytes from $C000
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x0F, static_cast<uint8_t>(Opcode::STA_ABS), 0x15, 0x40,
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x8F, static_cast<uint8_t>(Opcode::STA_ABS), 0x10, 0x40,
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x00, static_cast<uint8_t>(Opcode::STA_ABS), 0x12, 0x40,
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x02, static_cast<uint8_t>(Opcode::STA_ABS), 0x13, 0x40,
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x1F, static_cast<uint8_t>(Opcode::STA_ABS), 0x15, 0x40,
+        // $8019: pulse, triangle and noise at constant volume with halted lengths
+        static_cast<uint8_t>(Opcode::LDA_IM), 0xBF, static_cast<uint8_t>(Opcode::STA_ABS), 0x00, 0x40,
+        static_cast<uint8_t>(Opcode::LDA_IM), 0xFF, static_cast<uint8_t>(Opcode::STA_ABS), 0x08, 0x40,
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x3F, static_cast<uint8_t>(Opcode::STA_ABS), 0x0C, 0x40,
+        static_cast<uint8_t>(Opcode::CLI),
+        // $8029: INC $10, LDA $10, STA $4002, STA $400A, STA $400E, STA $400B, JMP $8029
+        static_cast<uint8_t>(Opcode::INC_ZP), 0x10, static_cast<uint8_t>(Opcode::LDA_ZP), 0x10,
+        static_cast<uint8_t>(Opcode::STA_ABS), 0x02, 0x40, static_cast<uint8_t>(Opcode::STA_ABS), 0x0A, 0x40,
+        static_cast<uint8_t>(Opcode::STA_ABS), 0x0E, 0x40, static_cast<uint8_t>(Opcode::STA_ABS), 0x0B, 0x40,
+        static_cast<uint8_t>(Opcode::JMP_ABS), 0x29, 0x80,
+    };
+    std::memcpy(prg, program, sizeof(program));
+
+    // IRQ handler at $8060: INC $11, LDA $4015, STA $12, restart the DMC, copy $10 (when the
+    // IRQ came) to $13, RTI
+    const uint8_t handler[] = {
+        static_cast<uint8_t>(Opcode::INC_ZP), 0x11, static_cast<uint8_t>(Opcode::LDA_ABS), 0x15, 0x40,
+        static_cast<uint8_t>(Opcode::STA_ZP), 0x12,
+        static_cast<uint8_t>(Opcode::LDA_IM), 0x1F, static_cast<uint8_t>(Opcode::STA_ABS), 0x15, 0x40,
+        static_cast<uint8_t>(Opcode::LDA_ZP), 0x10, static_cast<uint8_t>(Opcode::STA_ZP), 0x13,
+        static_cast<uint8_t>(Opcode::RTI),
+    };
+    std::memcpy(prg + 0x60, handler, sizeof(handler));
+    prg[0x7FFE] = 0x60;
+    prg[0x7FFF] = 0x80;
+
+    // Both $4015 writes leave the DMC off, JMP $8029 after LDA $10
+    if (!DMC)
+    {
+        prg[0x0015] = 0x0F;
+        prg[0x0068] = 0x0F;
+        prg[0x002D] = static_cast<uint8_t>(Opcode::JMP_ABS);
+        prg[0x002E] = 0x29;
+        prg[0x002F] = 0x80;
+    }
+
+    uint32_t seed = 3;
+    for (uint32_t i = 0; i < 33; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        prg[0x4000 + i] = static_cast<uint8_t>(seed >> 16);
+    }
+
+    return image;
+}
+
+static void ExpectLazyAPUMatchesEager(bool DMC)
+{
+    std::vector<uint8_t> image = MakeAudioRom(DMC);
+    Cartridge eager_cart(image);
+    Cartridge lazy_cart(image);
+    std::unique_ptr<ConsoleBase> eager = CreateConsole(eager_cart);
+    std::unique_ptr<ConsoleBase> lazy = CreateConsole(lazy_cart);
+    ASSERT_TRUE(eager && lazy);
+    eager->SetEagerPPUSync(true);
+    ASSERT_TRUE(eager->SetAudioSampleRate(DEFAULT_SAMPLE_RATE));
+    ASSERT_TRUE(lazy->SetAudioSampleRate(DEFAULT_SAMPLE_RATE));
+
+    for (int frame = 0; frame < 20; ++frame)
+    {
+        if (frame == 12)
+        {
+            eager->Reset();
+            lazy->Reset();
+        }
+
+        EXPECT_EQ(eager->RunFrame(), lazy->RunFrame()) << "frame " << frame;
+        EXPECT_EQ(eager->GetCPU().PC, lazy->GetCPU().PC);
+        for (uint16_t address = 0x10; address <= 0x13; ++address)
+            EXPECT_EQ(eager->GetBus().Read(address), lazy->GetBus().Read(address)) << "frame " << frame;
+
+        std::vector<int16_t> eager_samples(eager->GetAudioSamplesAvailable());
+        std::vector<int16_t> lazy_samples(lazy->GetAudioSamplesAvailable());
+        eager->ReadAudio(eager_samples.data(), static_cast<uint32_t>(eager_samples.size()));
+        lazy->ReadAudio(lazy_samples.data(), static_cast<uint32_t>(lazy_samples.size()));
+        EXPECT_EQ(eager_samples, lazy_samples) << "frame " << frame;
+    }
+
+    // The IRQs kept coming
+    EXPECT_GT(lazy->GetBus().Read(0x0011), 8);
+}
+
+TEST(ConsoleTest, LazyAPUSyncMatchesEager) {
+    ExpectLazyAPUMatchesEager(true);
+    ExpectLazyAPUMatchesEager(false);
+}
+
+TEST(ConsoleTest, PipelinedRenderingMatchesDirect) {
+    for (bool chr_ram : { false, true })
+    {
+        std::vector<uint8_t> image = MakeRasterRom();
+        if (chr_ram)
+        {
+            image[5] = 0;
+            image.resize(INES_HEADER_SIZE + 2 * 16384);
+        }
+
+        Cartridge direct_cart(image);
+        Cartridge pipelined_cart(image);
+        if (chr_ram)
+        {
+            for (uint32_t i = 0; i < direct_cart.CHR_ROM_RAM.size(); ++i)
+            {
+                direct_cart.CHR_ROM_RAM[i] = static_cast<uint8_t>(i * 37 + (i >> 4));
+                pipelined_cart.CHR_ROM_RAM[i] = direct_cart.CHR_ROM_RAM[i];
+            }
+        }
+
+        std::unique_ptr<ConsoleBase> direct = CreateConsole<ScanlinePPU>(direct_cart);
+        std::unique_ptr<ConsoleBase> pipelined = CreateConsole<ScanlinePPU>(pipelined_cart);
+        ASSERT_TRUE(direct && pipelined);
+        ASSERT_TRUE(pipelined->SetPipelinedRendering(true));
+        direct->SetFrameHashing(true);
+        pipelined->SetFrameHashing(true);
+
+        // Both redraw only what changed, the render thread finds the same blocks
+        direct->SetDirtyTracking(true);
+        pipelined->SetDirtyTracking(true);
+
+        for (int frame = 0; frame < 10; ++frame)
+        {
+            // The render thread starts over after a reset
+            if (frame == 6)
+            {
+                direct->Reset();
+                pipelined->Reset();
+            }
+
+            EXPECT_EQ(direct->RunFrame(), pipelined->RunFrame());
+            EXPECT_EQ(direct->GetBus().Read(0x0010), pipelined->GetBus().Read(0x0010));
+
+            pipelined->WaitForRendering();
+            EXPECT_EQ(std::memcmp(direct->GetFramebuffer(), pipelined->GetFramebuffer(), SCREEN_WIDTH * SCREEN_HEIGHT), 0) << "frame " << frame;
+            EXPECT_EQ(std::memcmp(direct->GetEmphasis(), pipelined->GetEmphasis(), SCREEN_HEIGHT), 0) << "frame " << frame;
+            EXPECT_NE(direct->GetFrameHash(), 0u);
+            EXPECT_EQ(direct->GetFrameHash(), pipelined->GetFrameHash()) << "frame " << frame;
+
+            const std::vector<DirtyRect>& rects = direct->GetDirtyRects();
+            ASSERT_EQ(rects.size(), pipelined->GetDirtyRects().size()) << "frame " << frame;
+            for (size_t i = 0; i < rects.size(); ++i)
+            {
+                EXPECT_EQ(rects[i].x, pipelined->GetDirtyRects()[i].x);
+                EXPECT_EQ(rects[i].y, pipelined->GetDirtyRects()[i].y);
+                EXPECT_EQ(rects[i].width, pipelined->GetDirtyRects()[i].width);
+                EXPECT_EQ(rects[i].height, pipelined->GetDirtyRects()[i].height);
+            }
+        }
+    }
+
+    Cartridge cart(MakeLoopRom(0));
+    std::unique_ptr<ConsoleBase> dot = CreateConsole<DotPPU>(cart);
+    ASSERT_TRUE(dot);
+    EXPECT_FALSE(dot->SetPipelinedRendering(true));
+}
@@ -0,0 +1,127 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+#include "FrameConverter.h"
+#include "PPU.h"
+
+// Random indices on every row and every emphasis, so the vector loops and the tails all run
+class FrameConverterTest : public testing::Test
+{
+protected:
+    FrameConverterTest() : framebuffer(SCREEN_WIDTH * SCREEN_HEIGHT), emphasis(SCREEN_HEIGHT)
+    {
+        uint32_t seed = 5;
+        for (uint8_t& index : framebuffer)
+        {
+            seed = seed * 1103515245 + 12345;
+            index = static_cast<uint8_t>(seed >> 16) & 0x3F;
+        }
+
+        for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+            emphasis[y] = static_cast<uint8_t>(y & 0x07);
+    }
+
+    FrameConverter converter;
+    std::vector<uint8_t> framebuffer;
+    std::vector<uint8_t> emphasis;
+};
+
+TEST_F(FrameConverterTest, ThirtyTwoBitFormats) {
+    std::vector<uint8_t> rgba(SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+    std::vector<uint8_t> bgra(SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+    converter.Convert(framebuffer.data(), emphasis.data(), PixelFormat::RGBA8888, rgba.data());
+    converter.Convert(framebuffer.data(), emphasis.data(), PixelFormat::BGRA8888, bgra.data());
+
+    for (uint32_t i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i)
+    {
+        uint32_t color = converter.GetColor(framebuffer[i], emphasis[i / SCREEN_WIDTH]);
+        const uint8_t expected[4] = { static_cast<uint8_t>(color), static_cast<uint8_t>(color >> 8), static_cast<uint8_t>(color >> 16), 0xFF };
+
+        ASSERT_EQ(std::memcmp(&rgba[i * 4], expected, 4), 0) << "pixel " << i;
+        ASSERT_EQ(bgra[i * 4], expected[2]);
+        ASSERT_EQ(bgra[i * 4 + 1], expected[1]);
+        ASSERT_EQ(bgra[i * 4 + 2], expected[0]);
+        ASSERT_EQ(bgra[i * 4 + 3], 0xFF);
+    }
+
+    // Index $0F is black on any emphasis, $30 white until emphasis darkens it
+    EXPECT_EQ(converter.GetColor(0x0F, 0) & 0xFFFFFF, 0u);
+    EXPECT_EQ(converter.GetColor(0x30, 0) & 0xFFFFFF, 0xFFFFFFu);
+    EXPECT_EQ(converter.GetColor(0x30, 1) & 0xFF, 0xFFu);
+    EXPECT_LT(converter.GetColor(0x30, 1) >> 8 & 0xFF, 0xFFu);
+}
+
+TEST_F(FrameConverterTest, SmallFormatsAndPitch) {
+    // Pitch wider than the row, the gap stays untouched
+    const size_t pitch = SCREEN_WIDTH * 2 + 6;
+    std::vector<uint8_t> rgb565(pitch * SCREEN_HEIGHT, 0xEE);
+    std::vector<uint8_t> gray(SCREEN_WIDTH * SCREEN_HEIGHT);
+    converter.Convert(framebuffer.data(), emphasis.data(), PixelFormat::RGB565, rgb565.data(), pitch);
+    converter.Convert(framebuffer.data(), emphasis.data(), PixelFormat::Grayscale, gray.data());
+
+    for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+    {
+        for (uint32_t x = 0; x < SCREEN_WIDTH; ++x)
+        {
+            uint32_t color = converter.GetColor(framebuffer[y * SCREEN_WIDTH + x], emphasis[y]);
+            uint32_t r = color & 0xFF;
+            uint32_t g = color >> 8 & 0xFF;
+            uint32_t b = color >> 16 & 0xFF;
+
+            uint16_t word;
+            std::memcpy(&word, &rgb565[y * pitch + x * 2], sizeof(word));
+            ASSERT_EQ(word, (r >> 3) << 11 | (g >> 2) << 5 | (b >> 3)) << "x " << x << " y " << y;
+            ASSERT_EQ(gray[y * SCREEN_WIDTH + x], (r * 77 + g * 150 + b * 29) >> 8);
+        }
+
+        for (size_t gap = SCREEN_WIDTH * 2; gap < pitch; ++gap)
+            ASSERT_EQ(rgb565[y * pitch + gap], 0xEE);
+    }
+
+    // Short rows only take the scalar tail
+    uint8_t row[7];
+    converter.ConvertRow(framebuffer.data(), 7, 3, PixelFormat::Grayscale, row);
+    for (uint32_t x = 0; x < 7; ++x)
+    {
+        uint32_t color = converter.GetColor(framebuffer[x], 3);
+        EXPECT_EQ(row[x], ((color & 0xFF) * 77 + (color >> 8 & 0xFF) * 150 + (color >> 16 & 0xFF) * 29) >> 8);
+    }
+}
+
+TEST_F(FrameConverterTest, RowLengths) {
+    // Every split between the vector loops and the tail matches converting pixel by pixel
+    const PixelFormat formats[] = { PixelFormat::RGBA8888, PixelFormat::BGRA8888, PixelFormat::RGB565, PixelFormat::Grayscale };
+    for (PixelFormat format : formats)
+    {
+        uint32_t bytes_per_pixel = GetBytesPerPixel(format);
+        for (uint32_t count = 1; count <= 40; ++count)
+        {
+            std::vector<uint8_t> row(count * bytes_per_pixel);
+            std::vector<uint8_t> expected(count * bytes_per_pixel);
+            converter.ConvertRow(framebuffer.data() + count, count, 5, format, row.data());
+            for (uint32_t x = 0; x < count; ++x)
+                converter.ConvertRow(framebuffer.data() + count + x, 1, 5, format, expected.data() + x * bytes_per_pixel);
+
+            ASSERT_EQ(row, expected) << "format " << static_cast<int>(format) << " count " << count;
+        }
+    }
+}
@@ -0,0 +1,247 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "FrameDumper.h"
+
+static std::vector<uint8_t> ReadFile(const std::string& path)
+{
+    std::ifstream file_stream(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file_stream), {});
+}
+
+static uint32_t ReadBE32(const uint8_t* data)
+{
+    return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+// Frame n has index n on every pixel, emphasis 0
+static std::vector<uint8_t> MakeFrame(uint8_t index)
+{
+    return std::vector<uint8_t>(SCREEN_WIDTH * SCREEN_HEIGHT, index);
+}
+
+TEST(FrameDumperTest, Y4MKeepsSubmissionOrder) {
+    std::string path = testing::TempDir() + "nese_dump.y4m";
+    std::remove(path.c_str());
+
+    std::vector<uint8_t> emphasis(SCREEN_HEIGHT, 0);
+    const uint32_t frames = 12;
+
+    // Black and white frames, 3 encoders finish them out of order
+    FrameDumper dumper;
+    ASSERT_TRUE(dumper.Open(path, DumpFormat::Y4M, Backpressure::Block, 3, 4));
+    for (uint32_t i = 0; i < frames; ++i)
+        EXPECT_TRUE(dumper.Submit(MakeFrame(i & 1 ? 0x30 : 0x0F).data(), emphasis.data()));
+
+    ASSERT_TRUE(dumper.Close());
+    EXPECT_EQ(dumper.frames_written, frames);
+    EXPECT_EQ(dumper.frames_dropped, 0u);
+
+    std::vector<uint8_t> contents = ReadFile(path);
+    std::string header = "YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C444\n";
+    const size_t frame_size = 6 + 3 * SCREEN_WIDTH * SCREEN_HEIGHT;
+    ASSERT_EQ(contents.size(), header.size() + frames * frame_size);
+    EXPECT_EQ(std::string(contents.begin(), contents.begin() + header.size()), header);
+
+    for (uint32_t i = 0; i < frames; ++i)
+    {
+        const uint8_t* frame = contents.data() + header.size() + i * frame_size;
+        EXPECT_EQ(std::string(frame, frame + 6), "FRAME\n");
+
+        // Limited range luma, chroma of a gray is neutral
+        const uint8_t* Y = frame + 6;
+        const uint8_t* U = Y + SCREEN_WIDTH * SCREEN_HEIGHT;
+        if (i & 1)
+            EXPECT_GE(Y[0], 230);
+        else
+            EXPECT_EQ(Y[0], 16);
+
+        EXPECT_EQ(Y[SCREEN_WIDTH * SCREEN_HEIGHT - 1], Y[0]);
+        EXPECT_NEAR(U[0], 128, 2);
+    }
+}
+
+TEST(FrameDumperTest, PNGSequence) {
+    std::string prefix = testing::TempDir() + "nese_dump_";
+    std::vector<uint8_t> framebuffer(SCREEN_WIDTH * SCREEN_HEIGHT);
+    std::vector<uint8_t> emphasis(SCREEN_HEIGHT);
+    for (uint32_t i = 0; i < framebuffer.size(); ++i)
+        framebuffer[i] = static_cast<uint8_t>(i * 7) & 0x3F;
+
+    for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+        emphasis[y] = static_cast<uint8_t>(y & 0x07);
+
+    FrameDumper dumper;
+    ASSERT_TRUE(dumper.Open(prefix, DumpFormat::PNG, Backpressure::Block, 2, 2));
+    for (uint32_t i = 0; i < 3; ++i)
+        EXPECT_TRUE(dumper.Submit(framebuffer.data(), emphasis.data()));
+
+    ASSERT_TRUE(dumper.Close());
+    EXPECT_EQ(dumper.frames_written, 3u);
+
+    FrameConverter converter;
+
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        std::string path = prefix + "00000" + std::to_string(i) + ".png";
+        std::vector<uint8_t> png = ReadFile(path);
+        std::remove(path.c_str());
+        ASSERT_GT(png.size(), 8u + 25 + 12 + 12);
+
+        const uint8_t signature[] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+        EXPECT_EQ(memcmp(png.data(), signature, 8), 0);
+
+        // IHDR
+        const uint8_t* chunk = png.data() + 8;
+        EXPECT_EQ(ReadBE32(chunk), 13u);
+        EXPECT_EQ(memcmp(chunk + 4, "IHDR", 4), 0);
+        EXPECT_EQ(ReadBE32(chunk + 8), SCREEN_WIDTH);
+        EXPECT_EQ(ReadBE32(chunk + 12), SCREEN_HEIGHT);
+        EXPECT_EQ(chunk[16], 8);
+        EXPECT_EQ(chunk[17], 2);
+
+        // IEND has the same CRC in every PNG
+        const uint8_t* end = png.data() + png.size() - 12;
+        EXPECT_EQ(memcmp(end + 4, "IEND", 4), 0);
+        EXPECT_EQ(ReadBE32(end + 8), 0xAE426082u);
+
+        // Unpack the stored blocks of IDAT and check every pixel
+        chunk += 12 + 13;
+        ASSERT_EQ(memcmp(chunk + 4, "IDAT", 4), 0);
+        const uint8_t* data = chunk + 8 + 2;
+        std::vector<uint8_t> raw;
+        bool final_block = false;
+        while (!final_block)
+        {
+            final_block = data[0] & 1;
+            ASSERT_EQ(data[0] & 0x06, 0);
+            uint16_t length = data[1] | (data[2] << 8);
+            EXPECT_EQ(static_cast<uint16_t>(~(data[3] | (data[4] << 8))), length);
+            raw.insert(raw.end(), data + 5, data + 5 + length);
+            data += 5 + length;
+        }
+
+        ASSERT_EQ(raw.size(), SCREEN_HEIGHT * (1 + SCREEN_WIDTH * 3));
+        for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+        {
+            const uint8_t* row = raw.data() + y * (1 + SCREEN_WIDTH * 3);
+            ASSERT_EQ(row[0], 0);
+
+            for (uint32_t x = 0; x < SCREEN_WIDTH; ++x)
+            {
+                uint32_t color = converter.GetColor(framebuffer[y * SCREEN_WIDTH + x], emphasis[y]);
+                uint32_t pixel = row[1 + x * 3] | (row[2 + x * 3] << 8) | (row[3 + x * 3] << 16);
+                ASSERT_EQ(pixel, color & 0xFFFFFF) << "x " << x << " y " << y;
+            }
+        }
+
+        // Adler-32 of the raw rows
+        uint32_t s1 = 1;
+        uint32_t s2 = 0;
+        for (uint8_t byte : raw)
+        {
+            s1 = (s1 + byte) % 65521;
+            s2 = (s2 + s1) % 65521;
+        }
+
+        EXPECT_EQ(ReadBE32(data), (s2 << 16) | s1);
+    }
+}
+
+TEST(FrameDumperTest, Backpressure) {
+    std::string path = testing::TempDir() + "nese_backpressure.y4m";
+    std::vector<uint8_t> framebuffer = MakeFrame(0x21);
+    std::vector<uint8_t> emphasis(SCREEN_HEIGHT, 0);
+    const uint32_t frames = 40;
+
+    // Dropping never waits, every frame is either written or counted as dropped
+    FrameDumper dropping;
+    ASSERT_TRUE(dropping.Open(path, DumpFormat::Y4M, Backpressure::Drop, 1, 1));
+    uint32_t accepted = 0;
+    for (uint32_t i = 0; i < frames; ++i)
+        accepted += dropping.Submit(framebuffer.data(), emphasis.data());
+
+    ASSERT_TRUE(dropping.Close());
+    EXPECT_GE(accepted, 1u);
+    EXPECT_EQ(dropping.frames_written, accepted);
+    EXPECT_EQ(dropping.frames_written + dropping.frames_dropped, frames);
+    EXPECT_EQ(ReadFile(path).size(), 50 + accepted * (6 + 3 * SCREEN_WIDTH * SCREEN_HEIGHT));
+
+    // Blocking with a single buffer still gets everything out
+    FrameDumper blocking;
+    ASSERT_TRUE(blocking.Open(path, DumpFormat::Y4M, Backpressure::Block, 1, 1));
+    for (uint32_t i = 0; i < frames; ++i)
+        EXPECT_TRUE(blocking.Submit(framebuffer.data(), emphasis.data()));
+
+    ASSERT_TRUE(blocking.Close());
+    EXPECT_EQ(blocking.frames_written, frames);
+    EXPECT_EQ(blocking.frames_dropped, 0u);
+    EXPECT_EQ(ReadFile(path).size(), 50 + frames * (6 + 3 * SCREEN_WIDTH * SCREEN_HEIGHT));
+    std::remove(path.c_str());
+
+    // Submitting without an open dump is a drop
+    EXPECT_FALSE(blocking.Submit(framebuffer.data(), emphasis.data()));
+    EXPECT_FALSE(blocking.Open(path, DumpFormat::Y4M, Backpressure::Block, 0, 1));
+}
+
+TEST(FrameDumperTest, NTSCFilter) {
+    std::string path = testing::TempDir() + "nese_ntsc.y4m";
+    std::string prefix = testing::TempDir() + "nese_ntsc_";
+    std::vector<uint8_t> framebuffer = MakeFrame(0x30);
+    std::vector<uint8_t> emphasis(SCREEN_HEIGHT, 0);
+
+    // Twice as wide, half the pixel aspect
+    FrameDumper y4m;
+    y4m.SetNTSCFilter(true);
+    ASSERT_TRUE(y4m.Open(path, DumpFormat::Y4M, Backpressure::Block, 2, 2));
+    for (uint32_t i = 0; i < 3; ++i)
+        EXPECT_TRUE(y4m.Submit(framebuffer.data(), emphasis.data()));
+
+    ASSERT_TRUE(y4m.Close());
+
+    std::vector<uint8_t> contents = ReadFile(path);
+    std::remove(path.c_str());
+    std::string header = "YUV4MPEG2 W512 H240 F39375000:655171 Ip A4:7 C444\n";
+    const size_t frame_size = 6 + 3 * NTSC_WIDTH * SCREEN_HEIGHT;
+    ASSERT_EQ(contents.size(), header.size() + 3 * frame_size);
+    EXPECT_EQ(std::string(contents.begin(), contents.begin() + header.size()), header);
+
+    // White away from the edges, whose windows are cut short
+    const uint8_t* Y = contents.data() + header.size() + 6;
+    EXPECT_EQ(Y[100 * NTSC_WIDTH + 200], 235);
+    EXPECT_LT(Y[100 * NTSC_WIDTH], 235);
+
+    FrameDumper png;
+    png.SetNTSCFilter(true);
+    ASSERT_TRUE(png.Open(prefix, DumpFormat::PNG, Backpressure::Block, 1, 1));
+    EXPECT_TRUE(png.Submit(framebuffer.data(), emphasis.data()));
+    ASSERT_TRUE(png.Close());
+
+    std::vector<uint8_t> image = ReadFile(prefix + "000000.png");
+    std::remove((prefix + "000000.png").c_str());
+    ASSERT_GT(image.size(), 24u);
+    EXPECT_EQ(ReadBE32(&image[16]), NTSC_WIDTH);
+    EXPECT_EQ(ReadBE32(&image[20]), SCREEN_HEIGHT);
+    EXPECT_EQ(image.size(), 8 + 25 + 12 + 2 + 5 * 6 + SCREEN_HEIGHT * (1 + NTSC_WIDTH * 3) + 4 + 12);
+}
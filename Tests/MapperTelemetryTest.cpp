@@ -0,0 +1,80 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include "MapperTelemetry.h"
+#include "Console.h"
+#include "TestRom.h"
+
+TEST(MapperTelemetryTest, Counters) {
+    MapperTelemetry telemetry;
+    telemetry.Reset(128 * 1024, 8 * 1024);
+
+    telemetry.RecordPGRMap(4, 0x0000);
+    telemetry.RecordPGRMap(4, 0x0000); // Same bank, not a switch
+    telemetry.RecordPGRMap(4, 0x4000);
+    telemetry.RecordCHRMap(0, 0x0400);
+    EXPECT_EQ(telemetry.GetFrameSwitches(), 3u);
+
+    telemetry.AddCycles(0x8123, 7);
+    telemetry.AddCycles(0x0200, 3); // Internal RAM
+    telemetry.EndFrame();
+
+    telemetry.RecordPGRMap(4, 0x0000);
+    telemetry.EndFrame();
+
+    EXPECT_EQ(telemetry.GetPGRMapCounts()[0], 2u);
+    EXPECT_EQ(telemetry.GetPGRMapCounts()[2], 1u);
+    EXPECT_EQ(telemetry.GetCHRMapCounts()[1], 1u);
+    EXPECT_EQ(telemetry.GetPGRCycles()[2], 7u);
+    EXPECT_EQ(telemetry.GetUnbankedCycles(), 3u);
+    EXPECT_EQ(telemetry.GetLastFrameSwitches(), 1u);
+    EXPECT_EQ(telemetry.GetMaxFrameSwitches(), 3u);
+    EXPECT_EQ(telemetry.GetTotalSwitches(), 4u);
+    EXPECT_EQ(telemetry.GetFrames(), 2u);
+
+    std::ostringstream dump;
+    telemetry.Dump(dump);
+    EXPECT_NE(dump.str().find("Switches: 4"), std::string::npos);
+}
+
+#ifdef NESE_MAPPER_TELEMETRY
+TEST(MapperTelemetryTest, ConsoleFeedsTelemetry) {
+    // UxROM running INC $10, JMP $8000 from bank 0
+    std::vector<uint8_t> image = MakeTestRom(2, 4, 0);
+
+    uint8_t* prg = image.data() + INES_HEADER_SIZE;
+    prg[0] = static_cast<uint8_t>(Opcode::INC_ZP);
+    prg[1] = 0x10;
+    prg[2] = static_cast<uint8_t>(Opcode::JMP_ABS);
+    prg[3] = 0x00;
+    prg[4] = 0x80;
+    prg[3 * 16384 + 0x3FFD] = 0x80;
+
+    Cartridge cart(image);
+    std::unique_ptr<ConsoleBase> console = CreateConsole(cart);
+    ASSERT_TRUE(console);
+    console->RunFrame();
+
+    const MapperTelemetry& telemetry = console->GetMapper().GetTelemetry();
+    EXPECT_EQ(telemetry.GetFrames(), 1u);
+    EXPECT_GT(telemetry.GetPGRCycles()[0], 29000u);
+    EXPECT_EQ(telemetry.GetUnbankedCycles(), 0u);
+}
+#endif
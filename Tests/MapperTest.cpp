@@ -0,0 +1,337 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include "Mappers.h"
+#include "CPU.h"
+#include "PPU.h"
+#include "Scheduler.h"
+#include "TestRom.h"
+#include <random>
+
+// Every 1 KB of PRG and CHR starts with its own index, so the mapped bank can be read back
+static std::vector<uint8_t> MakeMapperRom(uint8_t mapper, uint8_t PGR_16KB_units, uint8_t CHR_8KB_units, uint8_t flag_6 = 0)
+{
+    std::vector<uint8_t> image = MakeTestRom(mapper, PGR_16KB_units, CHR_8KB_units, flag_6);
+
+    uint8_t* prg = image.data() + INES_HEADER_SIZE;
+    for (uint32_t kb = 0; kb < PGR_16KB_units * 16u; ++kb)
+        prg[kb * 1024] = static_cast<uint8_t>(kb);
+
+    uint8_t* chr = prg + PGR_16KB_units * 16384u;
+    for (uint32_t kb = 0; kb < CHR_8KB_units * 8u; ++kb)
+        chr[kb * 1024] = static_cast<uint8_t>(kb);
+
+    return image;
+}
+
+// 1 KB page index of the PRG ROM mapped on address
+static uint8_t PGRPage(Bus& bus, uint16_t address)
+{
+    return bus.Read(address & 0xFC00);
+}
+
+static uint8_t CHRPage(PPUBus& ppu_bus, uint16_t address)
+{
+    return ppu_bus.Read(address & 0xFC00);
+}
+
+static void MMC1Write(Bus& bus, uint16_t address, uint8_t data)
+{
+    for (int i = 0; i < 5; ++i)
+        bus.Write(address, (data >> i) & 0x01);
+}
+
+TEST(MapperTest, NROMAndInternalRAM) {
+    Cartridge cart(MakeMapperRom(0, 1, 1, 0x01));
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+    ASSERT_TRUE(mapper);
+
+    // 16 KB PRG is mirrored on $C000
+    EXPECT_EQ(PGRPage(bus, 0x8000), 0);
+    EXPECT_EQ(PGRPage(bus, 0xBC00), 15);
+    EXPECT_EQ(PGRPage(bus, 0xC000), 0);
+    EXPECT_EQ(PGRPage(bus, 0xFC00), 15);
+
+    // ROM is not writable
+    bus.Write(0x8000, 0x77);
+    EXPECT_EQ(bus.Read(0x8000), 0);
+
+    // Internal RAM mirrored each 2 KB
+    bus.Write(0x0012, 0x34);
+    EXPECT_EQ(bus.Read(0x0812), 0x34);
+    EXPECT_EQ(bus.Read(0x1812), 0x34);
+
+    // PRG RAM
+    bus.Write(0x6001, 0x56);
+    EXPECT_EQ(bus.Read(0x6001), 0x56);
+    EXPECT_EQ(cart.PGR_RAM[1], 0x56);
+
+    EXPECT_EQ(ppu_bus.GetMirroring(), Mirroring::Vertical);
+    EXPECT_EQ(CHRPage(ppu_bus, 0x1C00), 7);
+}
+
+TEST(MapperTest, CPURunsFromCartridge) {
+    std::vector<uint8_t> image = MakeMapperRom(0, 2, 1);
+    // Reset vector at $FFFC points to $8010: LDA #$42, STA $0200
+    size_t prg = INES_HEADER_SIZE;
+    image[prg + 0x7FFC] = 0x10;
+    image[prg + 0x7FFD] = 0x80;
+    image[prg + 0x0010] = static_cast<uint8_t>(Opcode::LDA_IM);
+    image[prg + 0x0011] = 0x42;
+    image[prg + 0x0012] = static_cast<uint8_t>(Opcode::STA_ABS);
+    image[prg + 0x0013] = 0x00;
+    image[prg + 0x0014] = 0x02;
+
+    Cartridge cart(image);
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+    CPU cpu(bus);
+
+    EXPECT_EQ(cpu.PC, 0x8010);
+    cpu.Run(2);
+    EXPECT_EQ(bus.Read(0x0200), 0x42);
+}
+
+TEST(MapperTest, UxROM) {
+    Cartridge cart(MakeMapperRom(2, 8, 0));
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+
+    EXPECT_EQ(PGRPage(bus, 0x8000), 0);
+    EXPECT_EQ(PGRPage(bus, 0xC000), 7 * 16);
+
+    bus.Write(0x8000, 3);
+    EXPECT_EQ(PGRPage(bus, 0x8000), 3 * 16);
+    EXPECT_EQ(PGRPage(bus, 0xA000), 3 * 16 + 8);
+    EXPECT_EQ(PGRPage(bus, 0xC000), 7 * 16);
+
+    // CHR RAM is writable
+    ppu_bus.Write(0x0123, 0x99);
+    EXPECT_EQ(ppu_bus.Read(0x0123), 0x99);
+}
+
+TEST(MapperTest, CNROM) {
+    Cartridge cart(MakeMapperRom(3, 2, 4));
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+
+    EXPECT_EQ(CHRPage(ppu_bus, 0x0000), 0);
+    bus.Write(0x8000, 2);
+    EXPECT_EQ(CHRPage(ppu_bus, 0x0000), 16);
+    EXPECT_EQ(CHRPage(ppu_bus, 0x1C00), 23);
+
+    // CHR ROM is not writable
+    ppu_bus.Write(0x0000, 0x99);
+    EXPECT_EQ(CHRPage(ppu_bus, 0x0000), 16);
+}
+
+TEST(MapperTest, AxROM) {
+    Cartridge cart(MakeMapperRom(7, 8, 0));
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+
+    EXPECT_EQ(ppu_bus.GetMirroring(), Mirroring::SingleScreenLow);
+    bus.Write(0x8000, 0x12);
+    EXPECT_EQ(PGRPage(bus, 0x8000), 2 * 32);
+    EXPECT_EQ(PGRPage(bus, 0xFC00), 2 * 32 + 31);
+    EXPECT_EQ(ppu_bus.GetMirroring(), Mirroring::SingleScreenHigh);
+}
+
+TEST(MapperTest, MMC1) {
+    Cartridge cart(MakeMapperRom(1, 8, 2));
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+
+    // Power on: last bank fixed on $C000
+    EXPECT_EQ(PGRPage(bus, 0xC000), 7 * 16);
+
+    MMC1Write(bus, 0xE000, 5);
+    EXPECT_EQ(PGRPage(bus, 0x8000), 5 * 16);
+
+    // Control: vertical mirroring, 32 KB PRG, 4 KB CHR
+    MMC1Write(bus, 0x8000, 0b10010);
+    EXPECT_EQ(ppu_bus.GetMirroring(), Mirroring::Vertical);
+    EXPECT_EQ(PGRPage(bus, 0x8000), 4 * 16);
+    EXPECT_EQ(PGRPage(bus, 0xC000), 5 * 16);
+
+    MMC1Write(bus, 0xA000, 3);
+    MMC1Write(bus, 0xC000, 1);
+    EXPECT_EQ(CHRPage(ppu_bus, 0x0000), 12);
+    EXPECT_EQ(CHRPage(ppu_bus, 0x1000), 4);
+
+    // A reset in the middle of a serial write is discarded
+    bus.Write(0xE000, 1);
+    bus.Write(0xE000, 0x80);
+    EXPECT_EQ(PGRPage(bus, 0xC000), 7 * 16);
+}
+
+TEST(MapperTest, MMC3) {
+    Cartridge cart(MakeMapperRom(4, 8, 4));
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+
+    EXPECT_EQ(PGRPage(bus, 0xC000), 14 * 8);
+    EXPECT_EQ(PGRPage(bus, 0xE000), 15 * 8);
+
+    bus.Write(0x8000, 6);
+    bus.Write(0x8001, 3);
+    EXPECT_EQ(PGRPage(bus, 0x8000), 3 * 8);
+
+    // PRG mode 1 swaps $8000 and $C000
+    bus.Write(0x8000, 0x46);
+    EXPECT_EQ(PGRPage(bus, 0x8000), 14 * 8);
+    EXPECT_EQ(PGRPage(bus, 0xC000), 3 * 8);
+
+    bus.Write(0x8000, 0x02);
+    bus.Write(0x8001, 9);
+    EXPECT_EQ(CHRPage(ppu_bus, 0x1000), 9);
+
+    // CHR inversion
+    bus.Write(0x8000, 0x80);
+    EXPECT_EQ(CHRPage(ppu_bus, 0x0000), 9);
+
+    bus.Write(0xA000, 1);
+    EXPECT_EQ(ppu_bus.GetMirroring(), Mirroring::Horizontal);
+
+    // PRG RAM write protection
+    bus.Write(0x6000, 0x11);
+    bus.Write(0xA001, 0xC0);
+    bus.Write(0x6000, 0x22);
+    EXPECT_EQ(bus.Read(0x6000), 0x11);
+}
+
+TEST(MapperTest, MMC3ScanlineIRQ) {
+    Cartridge cart(MakeMapperRom(4, 2, 1));
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+    MMC3* mmc3 = static_cast<MMC3*>(mapper.get());
+
+    bus.Write(0xC000, 2);
+    bus.Write(0xC001, 0);
+    bus.Write(0xE001, 0);
+
+    mmc3->ClockScanlineCounter(); // Reload to 2
+    mmc3->ClockScanlineCounter();
+    EXPECT_FALSE(mapper->IRQAsserted());
+    mmc3->ClockScanlineCounter();
+    EXPECT_TRUE(mapper->IRQAsserted());
+
+    bus.Write(0xE000, 0);
+    EXPECT_FALSE(mapper->IRQAsserted());
+}
+
+TEST(MapperTest, MMC3PredictedIRQ) {
+    Cartridge cart(MakeMapperRom(4, 2, 1));
+    Bus bus;
+    PPUBus ppu_bus;
+    Scheduler scheduler;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+    mapper->AttachScheduler(&scheduler);
+    mapper->Reset();
+
+    // Sprites on $1000, A12 rises on dot 260
+    mapper->PPUConfigurationChanged(0x08, 0x18);
+    bus.Write(0xC000, 10);
+    bus.Write(0xC001, 0);
+    bus.Write(0xE001, 0);
+
+    // Reload on scanline 0, zero on scanline 10
+    uint64_t expected = 10 * PPU_DOTS_PER_SCANLINE + 260;
+    EXPECT_EQ(scheduler.GetNextEventTime(), expected);
+
+    scheduler.SetNow(expected - 1);
+    mapper->CatchUp();
+    EXPECT_FALSE(mapper->IRQAsserted());
+
+    scheduler.SetNow(expected);
+    mapper->CatchUp();
+    EXPECT_TRUE(mapper->IRQAsserted());
+
+    // Next zero 11 clocks later
+    EXPECT_EQ(scheduler.GetNextEventTime(), expected + 11 * PPU_DOTS_PER_SCANLINE);
+
+    // Rendering off stops the counter
+    mapper->PPUConfigurationChanged(0x08, 0x00);
+    EXPECT_EQ(scheduler.GetNextEventTime(), NO_EVENT);
+}
+
+TEST(MapperTest, MMC3PredictionMatchesClocking) {
+    Cartridge cart(MakeMapperRom(4, 2, 1));
+    Bus predicted_bus, clocked_bus;
+    PPUBus predicted_ppu_bus, clocked_ppu_bus;
+    Scheduler scheduler;
+    std::unique_ptr<Mapper> predicted = CreateMapper(cart, predicted_bus, predicted_ppu_bus);
+    std::unique_ptr<Mapper> clocked = CreateMapper(cart, clocked_bus, clocked_ppu_bus);
+    predicted->AttachScheduler(&scheduler);
+    predicted->Reset();
+    predicted->PPUConfigurationChanged(0x08, 0x18); // Background on $0000, sprites on $1000
+
+    std::mt19937 rng(1234);
+    uint64_t now = 0;
+
+    // Step a few frames scanline by scanline, with random IRQ register writes in between
+    for (uint32_t step = 0; step < 3 * PPU_SCANLINES_PER_FRAME; ++step)
+    {
+        uint32_t scanline = step % PPU_SCANLINES_PER_FRAME;
+        uint64_t line_start = uint64_t(step) * PPU_DOTS_PER_SCANLINE;
+
+        if (rng() % 4 == 0)
+        {
+            uint16_t address = static_cast<uint16_t>(0xC000 + (rng() % 4 / 2) * 0x2000 + rng() % 2);
+            uint8_t data = static_cast<uint8_t>(rng() % 8);
+
+            now = line_start + rng() % 200;
+            scheduler.SetNow(now);
+            predicted_bus.Write(address, data);
+            clocked_bus.Write(address, data);
+        }
+
+        if (scanline < PPU_VISIBLE_SCANLINES || scanline == PPU_PRERENDER_SCANLINE)
+            static_cast<MMC3*>(clocked.get())->ClockScanlineCounter();
+
+        now = line_start + 300;
+        scheduler.SetNow(now);
+        predicted->CatchUp();
+        ASSERT_EQ(predicted->IRQAsserted(), clocked->IRQAsserted()) << "scanline " << step;
+
+        if (clocked->IRQAsserted())
+        {
+            predicted_bus.Write(0xE000, 0);
+            predicted_bus.Write(0xE001, 0);
+            clocked_bus.Write(0xE000, 0);
+            clocked_bus.Write(0xE001, 0);
+        }
+    }
+}
+
+TEST(MapperTest, UnsupportedMapper) {
+    Cartridge cart(MakeMapperRom(99, 2, 1));
+    Bus bus;
+    PPUBus ppu_bus;
+    EXPECT_FALSE(CreateMapper(cart, bus, ppu_bus));
+}
@@ -0,0 +1,184 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "NTSCFilter.h"
+
+// Straight from the definition: every sample of the scanline, then a 12 sample window per output pixel
+static void ReferenceRow(const uint8_t* indices, uint8_t emphasis, uint32_t line_phase, uint8_t* destination)
+{
+    static const double levels[8] = { 0.350, 0.518, 0.962, 1.550, 1.094, 1.506, 1.962, 1.962 };
+    const double black = 0.518;
+    const double white = 1.962;
+    const double pi = 3.14159265358979323846;
+
+    std::vector<double> signal(SCREEN_WIDTH * 8);
+    for (uint32_t p = 0; p < signal.size(); ++p)
+    {
+        uint8_t index = indices[p / 8];
+        uint32_t phase = (line_phase + p) % 12;
+        uint32_t color = index & 0x0F;
+        uint32_t level = color > 13 ? 1 : (index >> 4) & 0x03;
+        double low = color == 0 ? levels[4 + level] : levels[level];
+        double high = color > 12 ? levels[level] : levels[4 + level];
+
+        auto InColorPhase = [phase](uint32_t hue) { return (hue + phase) % 12 < 6; };
+        double value = InColorPhase(color) ? high : low;
+        if (((emphasis & 1) && InColorPhase(12)) || ((emphasis & 2) && InColorPhase(4)) || ((emphasis & 4) && InColorPhase(8)))
+            value *= 0.746;
+
+        signal[p] = (value - black) / (white - black);
+    }
+
+    for (uint32_t x = 0; x < NTSC_WIDTH; ++x)
+    {
+        int32_t center = x * 4;
+        double Y = 0.0;
+        double I = 0.0;
+        double Q = 0.0;
+        for (int32_t p = std::max(center - 6, 0); p < std::min<int32_t>(center + 6, static_cast<int32_t>(signal.size())); ++p)
+        {
+            double level = signal[p] / 12.0;
+            Y += level;
+            I += level * std::cos(pi * (line_phase + p + 3.9) / 6.0);
+            Q += level * std::sin(pi * (line_phase + p + 3.9) / 6.0);
+        }
+
+        double rgb[3] = { Y + 0.946882 * I + 0.623557 * Q, Y - 0.274788 * I - 0.635691 * Q, Y - 1.108545 * I + 1.709007 * Q };
+        for (uint32_t channel = 0; channel < 3; ++channel)
+        {
+            double value = std::floor(rgb[channel] * 255.0 + 0.5);
+            destination[x * 4 + channel] = static_cast<uint8_t>(value < 0.0 ? 0.0 : value > 255.0 ? 255.0 : value);
+        }
+
+        destination[x * 4 + 3] = 255;
+    }
+}
+
+class NTSCFilterTest : public testing::Test
+{
+protected:
+    NTSCFilterTest() : framebuffer(SCREEN_WIDTH * SCREEN_HEIGHT), emphasis(SCREEN_HEIGHT), pixels(NTSC_WIDTH * SCREEN_HEIGHT * 4)
+    {
+        uint32_t seed = 9;
+        for (uint8_t& index : framebuffer)
+        {
+            seed = seed * 1103515245 + 12345;
+            index = static_cast<uint8_t>(seed >> 16) & 0x3F;
+        }
+
+        for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+            emphasis[y] = static_cast<uint8_t>(y & 0x07);
+    }
+
+    std::vector<uint8_t> framebuffer;
+    std::vector<uint8_t> emphasis;
+    std::vector<uint8_t> pixels;
+};
+
+TEST_F(NTSCFilterTest, MatchesReference) {
+    NTSCFilter filter;
+    std::vector<uint8_t> expected(NTSC_WIDTH * 4);
+
+    // Both frame parities shift the phase of every scanline
+    for (uint64_t frame = 0; frame < 2; ++frame)
+    {
+        filter.Filter(framebuffer.data(), emphasis.data(), frame, pixels.data());
+
+        for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+        {
+            ReferenceRow(&framebuffer[y * SCREEN_WIDTH], emphasis[y], 4 * ((frame + y) % 3), expected.data());
+
+            // The kernels are rounded to 1/64
+            for (uint32_t i = 0; i < expected.size(); ++i)
+                ASSERT_LE(std::abs(pixels[y * NTSC_WIDTH * 4 + i] - expected[i]), 1) << "frame " << frame << " y " << y << " byte " << i;
+        }
+    }
+}
+
+TEST_F(NTSCFilterTest, Colors) {
+    NTSCFilter filter;
+    std::vector<uint8_t> solid(SCREEN_WIDTH * SCREEN_HEIGHT);
+    std::vector<uint8_t> no_emphasis(SCREEN_HEIGHT, 0);
+
+    // Grays have no chroma, black and white are the ends of the range
+    const uint8_t grays[] = { 0x0F, 0x00, 0x10, 0x20, 0x30 };
+    for (uint8_t gray : grays)
+    {
+        std::fill(solid.begin(), solid.end(), gray);
+        filter.Filter(solid.data(), no_emphasis.data(), 0, pixels.data());
+
+        const uint8_t* pixel = &pixels[(100 * NTSC_WIDTH + 200) * 4];
+        EXPECT_NEAR(pixel[0], pixel[1], 1);
+        EXPECT_NEAR(pixel[0], pixel[2], 1);
+        EXPECT_EQ(pixel[3], 255);
+
+        if (gray == 0x0F)
+        {
+            EXPECT_EQ(pixel[0], 0);
+        }
+        if (gray == 0x30)
+        {
+            EXPECT_EQ(pixel[0], 255);
+        }
+    }
+
+    // Red, green and blue hues
+    const uint8_t hues[3] = { 0x16, 0x1A, 0x12 };
+    for (uint32_t channel = 0; channel < 3; ++channel)
+    {
+        std::fill(solid.begin(), solid.end(), hues[channel]);
+        filter.Filter(solid.data(), no_emphasis.data(), 0, pixels.data());
+
+        const uint8_t* pixel = &pixels[(100 * NTSC_WIDTH + 200) * 4];
+        for (uint32_t other = 0; other < 3; ++other)
+        {
+            if (other != channel)
+            {
+                EXPECT_GT(pixel[channel], pixel[other]) << "hue " << static_cast<int>(hues[channel]);
+            }
+        }
+    }
+}
+
+TEST_F(NTSCFilterTest, Bands) {
+    NTSCFilter single;
+    single.Filter(framebuffer.data(), emphasis.data(), 1, pixels.data());
+
+    // Uneven bands, a padded pitch and several frames through the same pool
+    for (uint32_t threads : { 2u, 3u, 7u })
+    {
+        NTSCFilter banded(threads);
+        EXPECT_EQ(banded.GetThreads(), threads);
+
+        const size_t pitch = NTSC_WIDTH * 4 + 32;
+        std::vector<uint8_t> padded(pitch * SCREEN_HEIGHT, 0xAA);
+        for (uint32_t frame = 0; frame < 3; ++frame)
+            banded.Filter(framebuffer.data(), emphasis.data(), 1, padded.data(), pitch);
+
+        for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+        {
+            ASSERT_EQ(memcmp(&padded[y * pitch], &pixels[y * NTSC_WIDTH * 4], NTSC_WIDTH * 4), 0) << "threads " << threads << " y " << y;
+            EXPECT_EQ(padded[y * pitch + NTSC_WIDTH * 4], 0xAA);
+        }
+    }
+}
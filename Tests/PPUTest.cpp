@@ -0,0 +1,757 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+#include "DotPPU.h"
+#include "ScanlinePPU.h"
+
+// PPU on its own bus: 8 KB of CHR RAM, vertical mirroring. Every test runs on both backends.
+template <class PPUType>
+class PPUTest : public testing::Test
+{
+protected:
+    PPUTest() : ppu(ppu_bus)
+    {
+        std::memset(CHR, 0, sizeof(CHR));
+        ppu_bus.MapPages(0x0000, PATTERN_TABLES_SIZE, CHR, CHR);
+        ppu_bus.SetMirroring(Mirroring::Vertical);
+
+        // Tile 1 is solid color 1, tile 2 solid color 2
+        for (uint32_t row = 0; row < 8; ++row)
+        {
+            CHR[1 * 16 + row] = 0xFF;
+            CHR[2 * 16 + 8 + row] = 0xFF;
+        }
+    }
+
+    void SetAddress(uint16_t address)
+    {
+        ppu.WriteRegister(0x2006, address >> 8);
+        ppu.WriteRegister(0x2006, address & 0xFF);
+    }
+
+    void WriteVRAM(uint16_t address, uint8_t data)
+    {
+        SetAddress(address);
+        ppu.WriteRegister(0x2007, data);
+    }
+
+    // Nametable 0 full of tile_index, palettes set and scroll back to 0,0
+    void FillNametable(uint8_t tile_index)
+    {
+        SetAddress(0x2000);
+        for (uint32_t i = 0; i < 960; ++i)
+            ppu.WriteRegister(0x2007, tile_index);
+
+        WriteVRAM(0x3F00, 0x0F);
+        WriteVRAM(0x3F01, 0x16);
+        WriteVRAM(0x3F02, 0x2A);
+        WriteVRAM(0x3F11, 0x30);
+
+        ppu.WriteRegister(0x2000, 0x00);
+        ppu.WriteRegister(0x2005, 0);
+        ppu.WriteRegister(0x2005, 0);
+    }
+
+    uint8_t Pixel(uint32_t x, uint32_t y) const { return ppu.GetFramebuffer()[y * SCREEN_WIDTH + x]; }
+
+    uint8_t CHR[PATTERN_TABLES_SIZE];
+    PPUBus ppu_bus;
+    PPUType ppu;
+};
+
+using PPUTypes = testing::Types<ScanlinePPU, DotPPU>;
+TYPED_TEST_SUITE(PPUTest, PPUTypes);
+
+TYPED_TEST(PPUTest, VRAMAccess) {
+    this->WriteVRAM(0x2105, 0x42);
+
+    // Reads go through the buffer
+    this->SetAddress(0x2105);
+    this->ppu.ReadRegister(0x2007);
+    EXPECT_EQ(this->ppu.ReadRegister(0x2007), 0x42);
+
+    // Vertical mirroring: $2800 is $2000
+    this->WriteVRAM(0x2000, 0x11);
+    this->SetAddress(0x2800);
+    this->ppu.ReadRegister(0x2007);
+    EXPECT_EQ(this->ppu.ReadRegister(0x2007), 0x11);
+
+    // Palette reads are immediate, $3F10 mirrors $3F00
+    this->WriteVRAM(0x3F10, 0x21);
+    this->SetAddress(0x3F00);
+    EXPECT_EQ(this->ppu.ReadRegister(0x2007) & 0x3F, 0x21);
+
+    // Increment of 32
+    this->ppu.WriteRegister(0x2000, PPUCTRL_INCREMENT_32);
+    this->SetAddress(0x2000);
+    this->ppu.WriteRegister(0x2007, 0x01);
+    this->ppu.WriteRegister(0x2007, 0x02);
+    EXPECT_EQ(this->ppu_bus.Read(0x2020), 0x02);
+}
+
+TYPED_TEST(PPUTest, BackgroundAndFineScroll) {
+    this->FillNametable(0);
+    this->WriteVRAM(0x2000, 1);
+    this->WriteVRAM(0x2001, 2);
+    this->ppu.WriteRegister(0x2005, 0);
+    this->ppu.WriteRegister(0x2005, 0);
+    this->ppu.WriteRegister(0x2001, PPUMASK_SHOW_BACKGROUND | PPUMASK_BACKGROUND_LEFT);
+
+    // v only gets the scroll on the pre-render scanline, the first frame starts wherever $2006 left it
+    this->ppu.Run(2 * PPU_DOTS_PER_FRAME);
+    EXPECT_EQ(this->Pixel(0, 0), 0x16);
+    EXPECT_EQ(this->Pixel(7, 7), 0x16);
+    EXPECT_EQ(this->Pixel(8, 0), 0x2A);
+    EXPECT_EQ(this->Pixel(16, 0), 0x0F);
+    EXPECT_EQ(this->Pixel(0, 8), 0x0F);
+
+    // Fine x of 4, taken by the pre-render scanline
+    this->ppu.WriteRegister(0x2005, 4);
+    this->ppu.WriteRegister(0x2005, 0);
+    this->ppu.Run(3 * PPU_DOTS_PER_FRAME);
+    EXPECT_EQ(this->Pixel(3, 0), 0x16);
+    EXPECT_EQ(this->Pixel(4, 0), 0x2A);
+    EXPECT_EQ(this->Pixel(12, 0), 0x0F);
+
+    // Left column clipping shows the backdrop
+    this->ppu.WriteRegister(0x2001, PPUMASK_SHOW_BACKGROUND);
+    this->ppu.Run(4 * PPU_DOTS_PER_FRAME);
+    EXPECT_EQ(this->Pixel(3, 0), 0x0F);
+    EXPECT_EQ(this->Pixel(8, 0), 0x2A);
+}
+
+TYPED_TEST(PPUTest, SpriteZeroHitSplit) {
+    this->FillNametable(1);
+
+    // Column 1 of the nametable uses tile 2, an x scroll of 8 brings it to the left edge
+    for (uint16_t row = 0; row < 30; ++row)
+        this->WriteVRAM(static_cast<uint16_t>(0x2001 + row * 32), 2);
+    this->ppu.WriteRegister(0x2005, 0);
+    this->ppu.WriteRegister(0x2005, 0);
+
+    // Sprite 0 at x 40 on scanline 30
+    this->ppu.OAM[0] = 29;
+    this->ppu.OAM[1] = 1;
+    this->ppu.OAM[2] = 0;
+    this->ppu.OAM[3] = 40;
+    for (uint32_t i = 4; i < OAM_SIZE; ++i)
+        this->ppu.OAM[i] = 0xFF;
+
+    this->ppu.WriteRegister(0x2001, 0x1E);
+    this->ppu.Run(PPU_DOTS_PER_FRAME);
+
+    uint64_t hit_time = PPU_DOTS_PER_FRAME + 30 * PPU_DOTS_PER_SCANLINE + 1 + 40;
+    this->ppu.Run(hit_time - 1);
+    EXPECT_EQ(this->ppu.ReadRegister(0x2002) & PPUSTATUS_SPRITE_ZERO_HIT, 0);
+    this->ppu.Run(hit_time);
+    EXPECT_NE(this->ppu.ReadRegister(0x2002) & PPUSTATUS_SPRITE_ZERO_HIT, 0);
+
+    // Scroll written right after the hit applies from the next scanline
+    this->ppu.WriteRegister(0x2005, 8);
+    this->ppu.WriteRegister(0x2005, 0);
+    this->ppu.Run(2 * PPU_DOTS_PER_FRAME);
+
+    EXPECT_EQ(this->Pixel(8, 30), 0x2A);
+    EXPECT_EQ(this->Pixel(0, 30), 0x16);
+    EXPECT_EQ(this->Pixel(0, 31), 0x2A);
+    EXPECT_EQ(this->Pixel(8, 31), 0x16);
+    EXPECT_EQ(this->Pixel(41, 30), 0x30); // Sprite in front
+
+    // Cleared by the pre-render scanline
+    EXPECT_EQ(this->ppu.ReadRegister(0x2002) & PPUSTATUS_SPRITE_ZERO_HIT, 0);
+}
+
+TYPED_TEST(PPUTest, VBlankAndNMI) {
+    this->ppu.WriteRegister(0x2000, PPUCTRL_NMI_ENABLE);
+
+    uint64_t vblank_time = PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE + 1;
+    this->ppu.Run(vblank_time - 1);
+    EXPECT_FALSE(this->ppu.TakeNMI());
+    this->ppu.Run(vblank_time);
+    EXPECT_TRUE(this->ppu.TakeNMI());
+    EXPECT_FALSE(this->ppu.TakeNMI());
+    EXPECT_EQ(this->ppu.GetFrameCount(), 1u);
+
+    // Reading the status clears VBlank
+    EXPECT_NE(this->ppu.ReadRegister(0x2002) & PPUSTATUS_VBLANK, 0);
+    EXPECT_EQ(this->ppu.ReadRegister(0x2002) & PPUSTATUS_VBLANK, 0);
+
+    // Enabling NMI during VBlank fires it at once
+    this->ppu.Run(PPU_DOTS_PER_FRAME + vblank_time);
+    this->ppu.TakeNMI();
+    this->ppu.WriteRegister(0x2000, 0);
+    this->ppu.WriteRegister(0x2000, PPUCTRL_NMI_ENABLE);
+    EXPECT_TRUE(this->ppu.TakeNMI());
+}
+
+TYPED_TEST(PPUTest, VBlankReadRace) {
+    this->ppu.WriteRegister(0x2000, PPUCTRL_NMI_ENABLE);
+    uint64_t vblank_time = PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE + 1;
+
+    // One dot before: neither the flag nor the NMI happen this frame
+    this->ppu.Run(vblank_time - 1);
+    EXPECT_EQ(this->ppu.ReadRegister(0x2002) & PPUSTATUS_VBLANK, 0);
+    this->ppu.Run(vblank_time + 100);
+    EXPECT_EQ(this->ppu.ReadRegister(0x2002) & PPUSTATUS_VBLANK, 0);
+    EXPECT_FALSE(this->ppu.TakeNMI());
+    EXPECT_EQ(this->ppu.GetFrameCount(), 1u);
+
+    // On the dot and on the next one the flag is read but the NMI is cancelled
+    for (uint64_t delay = 0; delay <= 2; ++delay)
+    {
+        uint64_t time = (delay + 1) * PPU_DOTS_PER_FRAME + vblank_time + delay;
+        this->ppu.Run(time);
+        EXPECT_NE(this->ppu.ReadRegister(0x2002) & PPUSTATUS_VBLANK, 0);
+        EXPECT_EQ(this->ppu.TakeNMI(), delay == 2);
+    }
+}
+
+TYPED_TEST(PPUTest, SpriteOverflow) {
+    this->FillNametable(0);
+    for (uint32_t i = 0; i < OAM_SIZE; ++i)
+        this->ppu.OAM[i] = 0xFF;
+
+    for (uint32_t sprite = 0; sprite < 9; ++sprite)
+    {
+        this->ppu.OAM[sprite * 4] = 100;
+        this->ppu.OAM[sprite * 4 + 3] = static_cast<uint8_t>(sprite * 10);
+    }
+
+    this->ppu.WriteRegister(0x2001, PPUMASK_SHOW_SPRITES);
+    this->ppu.Run(100 * PPU_DOTS_PER_SCANLINE);
+    EXPECT_EQ(this->ppu.ReadRegister(0x2002) & PPUSTATUS_SPRITE_OVERFLOW, 0);
+    this->ppu.Run(102 * PPU_DOTS_PER_SCANLINE);
+    EXPECT_NE(this->ppu.ReadRegister(0x2002) & PPUSTATUS_SPRITE_OVERFLOW, 0);
+}
+
+TYPED_TEST(PPUTest, OAMChangesMidFrame) {
+    this->FillNametable(0);
+    this->WriteVRAM(0x3F12, 0x21);
+    this->ppu.WriteRegister(0x2005, 0);
+    this->ppu.WriteRegister(0x2005, 0);
+
+    // Tile 3 is solid color 1, the bottom half of tile 2 in 8x16 mode
+    for (uint32_t row = 0; row < 8; ++row)
+        this->CHR[3 * 16 + row] = 0xFF;
+
+    uint8_t page[OAM_SIZE];
+    std::memset(page, 0xFF, sizeof(page));
+    page[0] = 49;
+    page[1] = 2;
+    page[2] = 0;
+    page[3] = 40;
+    this->ppu.WriteOAMDMA(page);
+    this->ppu.WriteRegister(0x2001, PPUMASK_SHOW_SPRITES | PPUMASK_SPRITES_LEFT);
+
+    // $2004 moves the sprite down, then the DMA and 8x16 sprites below that
+    this->ppu.Run(100 * PPU_DOTS_PER_SCANLINE);
+    this->ppu.WriteRegister(0x2003, 0);
+    this->ppu.WriteRegister(0x2004, 149);
+
+    this->ppu.Run(200 * PPU_DOTS_PER_SCANLINE);
+    page[0] = 209;
+    this->ppu.WriteRegister(0x2003, 0);
+    this->ppu.WriteOAMDMA(page);
+    this->ppu.WriteRegister(0x2000, PPUCTRL_SPRITE_SIZE);
+    this->ppu.Run(PPU_DOTS_PER_FRAME);
+
+    EXPECT_EQ(this->Pixel(40, 50), 0x21);
+    EXPECT_EQ(this->Pixel(40, 150), 0x21);
+    EXPECT_EQ(this->Pixel(40, 159), 0x0F);
+    EXPECT_EQ(this->Pixel(40, 210), 0x21);
+    EXPECT_EQ(this->Pixel(40, 220), 0x30);
+}
+
+TYPED_TEST(PPUTest, EmphasisPerScanline) {
+    this->ppu.WriteRegister(0x2001, PPUMASK_SHOW_BACKGROUND | 0xA0);
+    this->ppu.Run(100 * PPU_DOTS_PER_SCANLINE);
+
+    // Taken when the scanline starts
+    this->ppu.WriteRegister(0x2001, PPUMASK_SHOW_BACKGROUND | 0x40);
+    this->ppu.Run(PPU_DOTS_PER_FRAME);
+
+    EXPECT_EQ(this->ppu.GetEmphasis()[0], 0x05);
+    EXPECT_EQ(this->ppu.GetEmphasis()[99], 0x05);
+    EXPECT_EQ(this->ppu.GetEmphasis()[100], 0x02);
+    EXPECT_EQ(this->ppu.GetEmphasis()[SCREEN_HEIGHT - 1], 0x02);
+}
+
+TYPED_TEST(PPUTest, FrameHash) {
+    this->FillNametable(1);
+    this->ppu.WriteRegister(0x2001, PPUMASK_SHOW_BACKGROUND | PPUMASK_BACKGROUND_LEFT | 0x20);
+    this->ppu.SetFrameHashing(true);
+
+    // The scroll is only loaded on the pre-render scanline, the first frame starts off it
+    this->ppu.Run(2 * PPU_DOTS_PER_FRAME);
+
+    // Rows, then the emphasis of each scanline
+    std::vector<uint8_t> frame(this->ppu.GetFramebuffer(), this->ppu.GetFramebuffer() + SCREEN_WIDTH * SCREEN_HEIGHT);
+    frame.insert(frame.end(), this->ppu.GetEmphasis(), this->ppu.GetEmphasis() + SCREEN_HEIGHT);
+    uint64_t hash = this->ppu.GetFrameHash();
+    EXPECT_EQ(hash, XXH64(frame.data(), frame.size()));
+
+    // The scroll goes back to 0,0 after each palette write
+    this->WriteVRAM(0x3F01, 0x17);
+    this->SetAddress(0x0000);
+    this->ppu.Run(3 * PPU_DOTS_PER_FRAME);
+    EXPECT_NE(this->ppu.GetFrameHash(), hash);
+
+    // Nothing drawn, nothing hashed
+    this->WriteVRAM(0x3F01, 0x16);
+    this->SetAddress(0x0000);
+    this->ppu.SetHeadless(true);
+    uint64_t last_hash = this->ppu.GetFrameHash();
+    this->ppu.Run(4 * PPU_DOTS_PER_FRAME);
+    EXPECT_EQ(this->ppu.GetFrameHash(), last_hash);
+
+    this->ppu.SetHeadless(false);
+    this->ppu.Run(5 * PPU_DOTS_PER_FRAME);
+    EXPECT_EQ(this->ppu.GetFrameHash(), hash);
+}
+
+// Runs 6 frames of random tiles on two PPUs sharing the bus, each frame moves sprite 0 and
+// changes clipping and scroll. The status is polled all along and must be the same on both.
+template <class PPUType>
+static void ExpectSameStatus(uint8_t* CHR, PPUType& ppu, PPUType& other)
+{
+    uint32_t seed = 99;
+    for (uint32_t i = 0; i < PATTERN_TABLES_SIZE; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        CHR[i] = static_cast<uint8_t>(seed >> 16);
+    }
+
+    auto write = [&](uint16_t address, uint8_t data)
+    {
+        ppu.WriteRegister(address, data);
+        other.WriteRegister(address, data);
+    };
+
+    write(0x2006, 0x20);
+    write(0x2006, 0x00);
+    for (uint32_t i = 0; i < 0x0800; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        write(0x2007, static_cast<uint8_t>(seed >> 16));
+    }
+
+    for (uint32_t i = 0; i < OAM_SIZE; ++i)
+    {
+        ppu.OAM[i] = static_cast<uint8_t>(i * 37);
+        other.OAM[i] = ppu.OAM[i];
+    }
+
+    const uint8_t masks[] = { 0x1E, 0x18, 0x1A, 0x1C, 0x08, 0x1A };
+    for (uint32_t frame = 0; frame < 6; ++frame)
+    {
+        for (PPUType* each : { &ppu, &other })
+        {
+            each->OAM[0] = static_cast<uint8_t>(20 + frame * 30);
+            each->OAM[3] = static_cast<uint8_t>(frame * 50);
+        }
+        write(0x2000, static_cast<uint8_t>(frame & 0x01 ? PPUCTRL_SPRITE_SIZE : PPUCTRL_SPRITE_TABLE));
+        write(0x2005, static_cast<uint8_t>(frame * 13));
+        write(0x2005, static_cast<uint8_t>(frame * 7));
+        write(0x2001, masks[frame]);
+
+        for (uint64_t time = frame * PPU_DOTS_PER_FRAME; time < (frame + 1) * PPU_DOTS_PER_FRAME; time += 11)
+        {
+            ppu.Run(time);
+            other.Run(time);
+            ASSERT_EQ(ppu.ReadRegister(0x2002), other.ReadRegister(0x2002)) << "frame " << frame << " time " << time;
+        }
+    }
+}
+
+TYPED_TEST(PPUTest, HeadlessSpriteZeroHitTime) {
+    uint32_t seed = 5;
+    auto random = [&seed]() { seed = seed * 1103515245 + 12345; return static_cast<uint8_t>(seed >> 16); };
+    for (uint8_t& data : this->CHR)
+        data = random() & random(); // Some transparent pixels on most rows
+
+    TypeParam headless_ppu(this->ppu_bus);
+    headless_ppu.SetHeadless(true);
+
+    auto write = [&](uint16_t address, uint8_t data)
+    {
+        this->ppu.WriteRegister(address, data);
+        headless_ppu.WriteRegister(address, data);
+    };
+
+    write(0x2006, 0x20);
+    write(0x2006, 0x00);
+    for (uint32_t i = 0; i < 0x0800; ++i)
+        write(0x2007, random());
+
+    // Sprite 0 on scanline 100 at the edges and across tiles, for every fine x and flip
+    const uint8_t xs[] = { 0, 3, 7, 8, 100, 246, 247, 248, 250, 254, 255 };
+    uint64_t frame_start = 0;
+    for (uint32_t i = 0; i < sizeof(xs) * 8; ++i)
+    {
+        this->ppu.Run(frame_start + PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE);
+        headless_ppu.Run(frame_start + PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE);
+
+        const uint8_t sprite[] = { 99, random(), static_cast<uint8_t>(i & 0x01 ? SPRITE_FLIP_HORIZONTAL : 0), xs[i / 8] };
+        std::memcpy(this->ppu.OAM, sprite, sizeof(sprite));
+        std::memcpy(headless_ppu.OAM, sprite, sizeof(sprite));
+        write(0x2005, static_cast<uint8_t>((random() & 0xF8) | (i & 0x07)));
+        write(0x2005, random());
+        write(0x2001, i & 0x02 ? 0x1E : 0x18);
+
+        frame_start += PPU_DOTS_PER_FRAME;
+        for (uint64_t time = frame_start + 100 * PPU_DOTS_PER_SCANLINE; time < frame_start + 101 * PPU_DOTS_PER_SCANLINE; ++time)
+        {
+            this->ppu.Run(time);
+            headless_ppu.Run(time);
+            ASSERT_EQ(this->ppu.ReadRegister(0x2002) & PPUSTATUS_SPRITE_ZERO_HIT, headless_ppu.ReadRegister(0x2002) & PPUSTATUS_SPRITE_ZERO_HIT)
+                << "x " << static_cast<uint32_t>(xs[i / 8]) << " case " << i << " time " << time;
+        }
+    }
+}
+
+TYPED_TEST(PPUTest, HeadlessKeepsFlags) {
+    TypeParam headless_ppu(this->ppu_bus);
+    headless_ppu.SetHeadless(true);
+    ExpectSameStatus(this->CHR, this->ppu, headless_ppu);
+
+    // Nothing drawn
+    for (uint32_t i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i)
+        ASSERT_EQ(headless_ppu.GetFramebuffer()[i], 0);
+}
+
+TYPED_TEST(PPUTest, RegionOfInterest) {
+    // Off the 8 pixel tiles, over the left clipping, sprite 0 hits mostly outside
+    TypeParam region_ppu(this->ppu_bus);
+    region_ppu.SetRegionOfInterest({ 5, 30, 61, 150, 3 });
+    ExpectSameStatus(this->CHR, this->ppu, region_ppu);
+
+    for (uint32_t y = 0; y < SCREEN_HEIGHT; ++y)
+    {
+        bool drawn_line = y >= 30 && y < 180 && (y - 30) % 3 == 0;
+        for (uint32_t x = 0; x < SCREEN_WIDTH; ++x)
+        {
+            uint8_t expected = drawn_line && x >= 5 && x < 66 ? this->Pixel(x, y) : 0;
+            ASSERT_EQ(region_ppu.GetFramebuffer()[y * SCREEN_WIDTH + x], expected) << x << ", " << y;
+        }
+
+        ASSERT_EQ(region_ppu.GetEmphasis()[y], drawn_line ? this->ppu.GetEmphasis()[y] : 0);
+    }
+
+    // Clamped to the screen
+    region_ppu.SetRegionOfInterest({ 200, 230, 100, 100, 0 });
+    EXPECT_EQ(region_ppu.GetRegionOfInterest().width, 56u);
+    EXPECT_EQ(region_ppu.GetRegionOfInterest().height, 10u);
+    EXPECT_EQ(region_ppu.GetRegionOfInterest().stride, 1u);
+}
+
+// Each frame changes a few nametable entries, attributes and sprites, now and then the palette,
+// a pattern, the mask or the scroll, and splits the screen halfway some frames. A PPU that
+// redraws only the dirty blocks must draw the same frames, and every pixel that changed must
+// be under one of its rects.
+TEST(PPUDirtyTrackingTest, MatchesFullRedraw) {
+    uint32_t seed = 77;
+    auto random = [&seed]() { seed = seed * 1103515245 + 12345; return static_cast<uint8_t>(seed >> 16); };
+
+    uint8_t CHR[PATTERN_TABLES_SIZE];
+    for (uint8_t& data : CHR)
+        data = random() & random();
+
+    uint8_t tracked_CHR[PATTERN_TABLES_SIZE];
+    std::memcpy(tracked_CHR, CHR, sizeof(CHR));
+
+    PPUBus bus;
+    PPUBus tracked_bus;
+    bus.MapPages(0x0000, PATTERN_TABLES_SIZE, CHR, CHR);
+    tracked_bus.MapPages(0x0000, PATTERN_TABLES_SIZE, tracked_CHR, tracked_CHR);
+    bus.SetMirroring(Mirroring::Vertical);
+    tracked_bus.SetMirroring(Mirroring::Vertical);
+
+    ScanlinePPU ppu(bus);
+    ScanlinePPU tracked_ppu(tracked_bus);
+    tracked_ppu.SetDirtyTracking(true);
+
+    auto write = [&](uint16_t address, uint8_t data)
+    {
+        ppu.WriteRegister(address, data);
+        tracked_ppu.WriteRegister(address, data);
+    };
+
+    auto write_VRAM = [&](uint16_t address, uint8_t data)
+    {
+        write(0x2006, static_cast<uint8_t>(address >> 8));
+        write(0x2006, static_cast<uint8_t>(address));
+        write(0x2007, data);
+    };
+
+    write(0x2006, 0x20);
+    write(0x2006, 0x00);
+    for (uint32_t i = 0; i < 0x0800; ++i)
+        write(0x2007, random());
+
+    write(0x2006, 0x3F);
+    write(0x2006, 0x00);
+    for (uint32_t i = 0; i < PALETTE_SIZE; ++i)
+        write(0x2007, random());
+
+    for (uint32_t i = 0; i < OAM_SIZE; ++i)
+    {
+        ppu.OAM[i] = random();
+        tracked_ppu.OAM[i] = ppu.OAM[i];
+    }
+
+    uint8_t scroll_x = 0;
+    uint8_t scroll_y = 0;
+    uint8_t mask = 0x1E;
+    std::vector<uint8_t> previous(SCREEN_WIDTH * SCREEN_HEIGHT, 0);
+    uint32_t static_frames = 0;
+
+    for (uint32_t frame = 0; frame < 60; ++frame)
+    {
+        uint64_t frame_start = frame * static_cast<uint64_t>(PPU_DOTS_PER_FRAME);
+
+        // VBlank changes, none on every fifth frame
+        if (frame % 5 != 4)
+        {
+            for (uint32_t i = random() % 4; i > 0; --i)
+                write_VRAM(static_cast<uint16_t>(0x2000 + ((random() << 8 | random()) & 0x0FFF)), random());
+
+            for (uint32_t i = random() % 3; i > 0; --i)
+            {
+                uint8_t sprite = random() & 0x3F;
+                for (ScanlinePPU* each : { &ppu, &tracked_ppu })
+                {
+                    each->OAM[sprite * 4] = static_cast<uint8_t>(frame * 4 + i);
+                    each->OAM[sprite * 4 + 3] = static_cast<uint8_t>(frame * 9 + i * 40);
+                }
+            }
+
+            if (frame % 7 == 3)
+                write_VRAM(static_cast<uint16_t>(0x3F00 + (random() & 0x1F)), random());
+            if (frame % 11 == 5)
+                write_VRAM(static_cast<uint16_t>(((random() << 4) & 0x1FF0) | (random() & 0x0F)), random());
+            if (frame % 13 == 6)
+                mask ^= PPUMASK_BACKGROUND_LEFT;
+            if (frame % 9 == 8)
+            {
+                scroll_x = random();
+                scroll_y = random() % 240;
+            }
+        }
+
+        write(0x2000, frame % 17 == 10 ? PPUCTRL_SPRITE_SIZE : 0);
+        write(0x2001, mask);
+        write(0x2005, scroll_x);
+        write(0x2005, scroll_y);
+
+        // Half the screen scrolled differently, in the HBlank of scanline 120
+        if (frame % 3 == 1)
+        {
+            uint64_t split = frame_start + (PPU_PRERENDER_SCANLINE + 1) * PPU_DOTS_PER_SCANLINE + 120 * PPU_DOTS_PER_SCANLINE + 260;
+            ppu.Run(split);
+            tracked_ppu.Run(split);
+            write(0x2005, static_cast<uint8_t>(scroll_x + 64));
+            write(0x2005, scroll_y);
+        }
+
+        uint64_t frame_end = frame_start + PPU_DOTS_PER_FRAME + PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE;
+        ppu.Run(frame_end);
+        tracked_ppu.Run(frame_end);
+
+        const uint8_t* framebuffer = tracked_ppu.GetFramebuffer();
+        ASSERT_EQ(std::memcmp(framebuffer, ppu.GetFramebuffer(), SCREEN_WIDTH * SCREEN_HEIGHT), 0) << "frame " << frame;
+
+        const std::vector<DirtyRect>& rects = tracked_ppu.GetDirtyRects();
+        for (uint32_t i = 0; i < previous.size(); ++i)
+        {
+            if (framebuffer[i] == previous[i])
+                continue;
+
+            uint32_t x = i % SCREEN_WIDTH;
+            uint32_t y = i / SCREEN_WIDTH;
+            bool covered = false;
+            for (const DirtyRect& rect : rects)
+                covered |= x - rect.x < rect.width && y - rect.y < rect.height;
+
+            ASSERT_TRUE(covered) << "frame " << frame << " pixel " << x << ", " << y;
+        }
+
+        static_frames += rects.empty();
+        previous.assign(framebuffer, framebuffer + previous.size());
+
+        // The untracked PPU draws everything
+        ASSERT_EQ(ppu.GetDirtyRects().size(), 1u);
+        EXPECT_EQ(ppu.GetDirtyRects()[0].width, SCREEN_WIDTH);
+        EXPECT_EQ(ppu.GetDirtyRects()[0].height, SCREEN_HEIGHT);
+    }
+
+    // Frames without changes and without the split draw nothing
+    EXPECT_GT(static_frames, 0u);
+}
+
+TEST(PPUDirtyTrackingTest, Rects) {
+    uint8_t CHR[PATTERN_TABLES_SIZE] = {};
+    for (uint32_t row = 0; row < 8; ++row)
+        CHR[1 * 16 + row] = 0xFF;
+
+    PPUBus bus;
+    bus.MapPages(0x0000, PATTERN_TABLES_SIZE, CHR, CHR);
+    bus.SetMirroring(Mirroring::Horizontal);
+
+    ScanlinePPU ppu(bus);
+    ppu.SetDirtyTracking(true);
+
+    auto write_VRAM = [&](uint16_t address, uint8_t data)
+    {
+        ppu.WriteRegister(0x2006, static_cast<uint8_t>(address >> 8));
+        ppu.WriteRegister(0x2006, static_cast<uint8_t>(address));
+        ppu.WriteRegister(0x2007, data);
+    };
+
+    auto run_frame = [&](uint32_t frame)
+    {
+        ppu.WriteRegister(0x2000, 0);
+        ppu.WriteRegister(0x2005, 0);
+        ppu.WriteRegister(0x2005, 0);
+        ppu.Run((frame + 1) * static_cast<uint64_t>(PPU_DOTS_PER_FRAME) + PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE);
+    };
+
+    write_VRAM(0x3F01, 0x16);
+    std::memset(ppu.OAM, 0xFF, OAM_SIZE);
+    ppu.WriteRegister(0x2001, PPUMASK_SHOW_BACKGROUND | PPUMASK_SHOW_SPRITES | PPUMASK_BACKGROUND_LEFT | PPUMASK_SPRITES_LEFT);
+
+    // Everything the first time, nothing once the screen is static
+    run_frame(0);
+    ASSERT_EQ(ppu.GetDirtyRects().size(), 1u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].height, SCREEN_HEIGHT);
+    run_frame(1);
+    EXPECT_TRUE(ppu.GetDirtyRects().empty());
+
+    // One tile, its block only
+    write_VRAM(0x2000 + 3 * 32 + 5, 1);
+    run_frame(2);
+    ASSERT_EQ(ppu.GetDirtyRects().size(), 1u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].x, 40u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].y, 24u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].width, 8u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].height, 8u);
+    EXPECT_EQ(ppu.GetFramebuffer()[24 * SCREEN_WIDTH + 40], 0x16);
+
+    // An attribute byte covers 4x4 tiles, 2 tiles in a row make one rect
+    write_VRAM(0x23C0 + 2 * 8 + 1, 0x55);
+    write_VRAM(0x2000 + 20 * 32 + 10, 1);
+    write_VRAM(0x2000 + 20 * 32 + 11, 1);
+    run_frame(3);
+    ASSERT_EQ(ppu.GetDirtyRects().size(), 2u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].x, 32u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].y, 64u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].width, 32u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].height, 32u);
+    EXPECT_EQ(ppu.GetDirtyRects()[1].x, 80u);
+    EXPECT_EQ(ppu.GetDirtyRects()[1].y, 160u);
+    EXPECT_EQ(ppu.GetDirtyRects()[1].width, 16u);
+    EXPECT_EQ(ppu.GetDirtyRects()[1].height, 8u);
+
+    // A sprite moving right, from where it was to where it is
+    ppu.OAM[0] = 99;
+    ppu.OAM[3] = 16;
+    run_frame(4);
+    ppu.OAM[3] = 20;
+    run_frame(5);
+    ASSERT_EQ(ppu.GetDirtyRects().size(), 1u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].x, 16u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].y, 96u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].width, 16u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].height, 16u);
+
+    // The palette is everywhere
+    write_VRAM(0x3F00, 0x21);
+    run_frame(6);
+    ASSERT_EQ(ppu.GetDirtyRects().size(), 1u);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].width, SCREEN_WIDTH);
+    EXPECT_EQ(ppu.GetDirtyRects()[0].height, SCREEN_HEIGHT);
+}
+
+// Without mid-scanline writes the backends draw the same frames
+TEST(PPUBackendTest, ScanlineMatchesDot) {
+    uint8_t CHR[PATTERN_TABLES_SIZE];
+    uint32_t seed = 12345;
+    auto random = [&seed]() { seed = seed * 1103515245 + 12345; return static_cast<uint8_t>(seed >> 16); };
+    for (uint8_t& data : CHR)
+        data = random();
+
+    PPUBus scanline_bus;
+    PPUBus dot_bus;
+    scanline_bus.MapPages(0x0000, PATTERN_TABLES_SIZE, CHR, CHR);
+    dot_bus.MapPages(0x0000, PATTERN_TABLES_SIZE, CHR, CHR);
+    scanline_bus.SetMirroring(Mirroring::Horizontal);
+    dot_bus.SetMirroring(Mirroring::Horizontal);
+
+    ScanlinePPU scanline_ppu(scanline_bus);
+    DotPPU dot_ppu(dot_bus);
+
+    auto write = [&](uint16_t address, uint8_t data)
+    {
+        scanline_ppu.WriteRegister(address, data);
+        dot_ppu.WriteRegister(address, data);
+    };
+
+    write(0x2006, 0x20);
+    write(0x2006, 0x00);
+    for (uint32_t i = 0; i < 0x1000 + PALETTE_SIZE; ++i)
+    {
+        // Nametables then the palette
+        if (i == 0x1000)
+        {
+            write(0x2006, 0x3F);
+            write(0x2006, 0x00);
+        }
+        write(0x2007, random());
+    }
+
+    for (uint32_t i = 0; i < OAM_SIZE; ++i)
+    {
+        scanline_ppu.OAM[i] = random();
+        dot_ppu.OAM[i] = scanline_ppu.OAM[i];
+    }
+
+    write(0x2000, PPUCTRL_SPRITE_TABLE | 0x01);
+    write(0x2005, 13);
+    write(0x2005, 37);
+    write(0x2001, 0x1E);
+
+    for (uint64_t frame = 1; frame <= 3; ++frame)
+    {
+        // Frame 1 starts from the address left by $2006
+        uint64_t vblank_time = (frame - 1) * PPU_DOTS_PER_FRAME + PPU_VBLANK_SCANLINE * PPU_DOTS_PER_SCANLINE;
+        scanline_ppu.Run(vblank_time);
+        dot_ppu.Run(vblank_time);
+
+        EXPECT_EQ(scanline_ppu.ReadRegister(0x2002), dot_ppu.ReadRegister(0x2002));
+        if (frame > 1)
+        {
+            EXPECT_EQ(std::memcmp(scanline_ppu.GetFramebuffer(), dot_ppu.GetFramebuffer(), SCREEN_WIDTH * SCREEN_HEIGHT), 0);
+        }
+
+        // 8x16 sprites on the last frame
+        if (frame == 2)
+            write(0x2000, PPUCTRL_SPRITE_SIZE | 0x01);
+    }
+}
@@ -0,0 +1,187 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "RomCache.h"
+#include "Hash.h"
+#include "TestRom.h"
+
+#ifndef _WIN32
+#include <ctime>
+#include <utime.h>
+#endif
+
+static std::string WriteTestRom(const std::string& name, uint8_t seed)
+{
+    std::vector<uint8_t> image = MakeTestRom(2, 2, 1, 0x01); // Vertical mirroring
+
+    for (size_t i = INES_HEADER_SIZE; i < image.size(); ++i)
+        image[i] = static_cast<uint8_t>(i * seed);
+
+    std::string path = testing::TempDir() + name;
+    std::ofstream file_stream(path, std::ios::binary | std::ios::trunc);
+    file_stream.write(reinterpret_cast<const char*>(image.data()), image.size());
+
+    return path;
+}
+
+TEST(RomCacheTest, XXH64) {
+    EXPECT_EQ(XXH64("", 0), 0xEF46DB3751D8E999ULL);
+    EXPECT_EQ(XXH64("abc", 3), 0x44BC2CF5AD770999ULL);
+}
+
+TEST(RomCacheTest, XXH64Streaming) {
+    std::vector<uint8_t> data(1000);
+    for (uint32_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<uint8_t>(i * 7 + (i >> 3));
+
+    // Pieces shorter, longer and not multiple of the 32 byte stripes
+    for (size_t size : { 0, 3, 31, 32, 33, 100, 1000 })
+    {
+        for (size_t piece : { 1, 5, 32, 64, 1000 })
+        {
+            XXH64State state(11);
+            for (size_t offset = 0; offset < size; offset += piece)
+                state.Update(data.data() + offset, std::min(piece, size - offset));
+
+            EXPECT_EQ(state.Digest(), XXH64(data.data(), size, 11)) << size << " in pieces of " << piece;
+        }
+    }
+}
+
+TEST(RomCacheTest, MissThenHit) {
+    std::string rom_path = WriteTestRom("nese_cache_rom.nes", 7);
+    RomCache rom_cache(testing::TempDir() + "nese_rom_cache");
+
+    // Start from a cold cache
+    std::ifstream rom_stream(rom_path, std::ios::binary);
+    std::vector<uint8_t> image(std::istreambuf_iterator<char>(rom_stream), {});
+    std::string entry_path = rom_cache.GetEntryPath(XXH64(image.data(), image.size()));
+    std::remove(entry_path.c_str());
+
+    std::unique_ptr<Cartridge> parsed = rom_cache.Load(rom_path);
+    ASSERT_TRUE(parsed);
+    EXPECT_EQ(rom_cache.misses, 1u);
+    EXPECT_EQ(rom_cache.hits, 0u);
+
+    std::unique_ptr<Cartridge> cached = rom_cache.Load(rom_path);
+    ASSERT_TRUE(cached);
+    EXPECT_EQ(rom_cache.hits, 1u);
+
+    EXPECT_EQ(cached->mapper_id, 2);
+    EXPECT_EQ(cached->GetArenaLayout(), parsed->GetArenaLayout());
+    EXPECT_EQ(0, std::memcmp(cached->PGR_ROM.data(), parsed->PGR_ROM.data(), parsed->PGR_ROM.size()));
+    EXPECT_EQ(0, std::memcmp(cached->CHR_ROM_RAM.data(), parsed->CHR_ROM_RAM.data(), parsed->CHR_ROM_RAM.size()));
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(cached->PGR_ROM.data()) % ARENA_ALIGNMENT, 0u);
+
+    // Cartridge RAM is private to the process, it must never reach the entry
+    cached->PGR_RAM[0] = 0x55;
+    std::unique_ptr<Cartridge> again = rom_cache.Load(rom_path);
+    ASSERT_TRUE(again);
+    EXPECT_EQ(again->PGR_RAM[0], 0);
+
+    std::remove(rom_path.c_str());
+    std::remove(entry_path.c_str());
+    std::remove(rom_cache.GetIndexPath(rom_path).c_str());
+}
+
+TEST(RomCacheTest, CorruptEntryIsRebuilt) {
+    std::string rom_path = WriteTestRom("nese_cache_corrupt.nes", 13);
+    RomCache rom_cache(testing::TempDir() + "nese_rom_cache");
+
+    ASSERT_TRUE(rom_cache.Load(rom_path));
+
+    std::ifstream rom_stream(rom_path, std::ios::binary);
+    std::vector<uint8_t> image(std::istreambuf_iterator<char>(rom_stream), {});
+    std::string entry_path = rom_cache.GetEntryPath(XXH64(image.data(), image.size()));
+
+    {
+        std::fstream entry_stream(entry_path, std::ios::binary | std::ios::in | std::ios::out);
+        entry_stream.seekp(20);
+        entry_stream.put(0x7F);
+    }
+
+    uint32_t misses = rom_cache.misses;
+    std::unique_ptr<Cartridge> cartridge = rom_cache.Load(rom_path);
+    ASSERT_TRUE(cartridge);
+    EXPECT_EQ(rom_cache.misses, misses + 1);
+    EXPECT_EQ(cartridge->PGR_ROM[1], image[INES_HEADER_SIZE + 1]);
+
+    std::remove(rom_path.c_str());
+    std::remove(entry_path.c_str());
+    std::remove(rom_cache.GetIndexPath(rom_path).c_str());
+}
+
+#ifndef _WIN32
+// Moves the modification time out of the racy window, as if the rom was copied long ago
+static void Backdate(const std::string& path, time_t seconds_ago)
+{
+    struct utimbuf times;
+    times.actime = time(nullptr) - seconds_ago;
+    times.modtime = times.actime;
+    utime(path.c_str(), &times);
+}
+
+TEST(RomCacheTest, IndexSkipsHashing) {
+    std::string rom_path = WriteTestRom("nese_cache_index.nes", 17);
+    Backdate(rom_path, 3600);
+
+    RomCache rom_cache(testing::TempDir() + "nese_rom_cache");
+    std::remove(rom_cache.GetIndexPath(rom_path).c_str());
+
+    std::ifstream rom_stream(rom_path, std::ios::binary);
+    std::vector<uint8_t> image(std::istreambuf_iterator<char>(rom_stream), {});
+    std::string entry_path = rom_cache.GetEntryPath(XXH64(image.data(), image.size()));
+    std::remove(entry_path.c_str());
+
+    ASSERT_TRUE(rom_cache.Load(rom_path));
+    EXPECT_EQ(rom_cache.misses, 1u);
+    EXPECT_EQ(rom_cache.index_misses, 1u);
+
+    // The hash comes from the index, the rom itself is never read
+    std::unique_ptr<Cartridge> cached = rom_cache.Load(rom_path);
+    ASSERT_TRUE(cached);
+    EXPECT_EQ(rom_cache.hits, 1u);
+    EXPECT_EQ(rom_cache.index_misses, 1u);
+    EXPECT_EQ(cached->PGR_ROM[1], image[INES_HEADER_SIZE + 1]);
+
+    // Same path and size, different contents: the index must not hand out the old entry
+    std::string rewritten_path = WriteTestRom("nese_cache_index.nes", 23);
+    Backdate(rewritten_path, 7200);
+
+    std::ifstream rewritten_stream(rewritten_path, std::ios::binary);
+    std::vector<uint8_t> rewritten(std::istreambuf_iterator<char>(rewritten_stream), {});
+    std::string rewritten_entry_path = rom_cache.GetEntryPath(XXH64(rewritten.data(), rewritten.size()));
+    std::remove(rewritten_entry_path.c_str());
+
+    std::unique_ptr<Cartridge> reloaded = rom_cache.Load(rom_path);
+    ASSERT_TRUE(reloaded);
+    EXPECT_EQ(rom_cache.index_misses, 2u);
+    EXPECT_EQ(rom_cache.misses, 2u);
+    EXPECT_EQ(reloaded->PGR_ROM[1], rewritten[INES_HEADER_SIZE + 1]);
+
+    std::remove(rom_path.c_str());
+    std::remove(entry_path.c_str());
+    std::remove(rewritten_entry_path.c_str());
+    std::remove(rom_cache.GetIndexPath(rom_path).c_str());
+}
+#endif
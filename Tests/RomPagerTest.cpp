@@ -0,0 +1,110 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include "Cartridge.h"
+#include "Mappers.h"
+#include "TestRom.h"
+
+// Every 1 KB of PRG and CHR starts with its own index, like the mapper test roms
+static std::string WriteLargeRom(const std::string& name, uint8_t mapper, uint8_t PGR_16KB_units, uint8_t CHR_8KB_units)
+{
+    std::vector<uint8_t> image = MakeTestRom(mapper, PGR_16KB_units, CHR_8KB_units);
+    std::fill(image.begin() + INES_HEADER_SIZE, image.end(), 0xEE);
+
+    uint32_t kilobytes = PGR_16KB_units * 16u + CHR_8KB_units * 8u;
+    for (uint32_t kb = 0; kb < kilobytes; ++kb)
+        image[INES_HEADER_SIZE + kb * 1024] = static_cast<uint8_t>(kb);
+
+    std::string path = testing::TempDir() + name;
+    std::ofstream file_stream(path, std::ios::binary | std::ios::trunc);
+    file_stream.write(reinterpret_cast<const char*>(image.data()), image.size());
+
+    return path;
+}
+
+TEST(RomPagerTest, BanksAreFaultedOnMap) {
+    std::string rom_path = WriteLargeRom("nese_lazy_uxrom.nes", 2, 64, 0);
+
+    Cartridge cart(rom_path, Cartridge::LoadMode::Lazy, ROM_PAGER_MIN_RESIDENT_CHUNKS);
+    ASSERT_TRUE(cart.IsLoaded());
+    ASSERT_TRUE(cart.GetPager());
+    EXPECT_EQ(cart.PGR_ROM.size(), 64u * 16384);
+    EXPECT_EQ(cart.PGR_ROM.data(), nullptr);
+    EXPECT_LT(cart.GetArenaSize(), 64u * 1024);
+
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+    RomPager& pager = *cart.GetPager();
+
+    // Only what power on mapped is resident
+    EXPECT_LE(pager.GetResidentChunks(), 6u);
+    EXPECT_EQ(bus.Read(0xC000), static_cast<uint8_t>(63 * 16));
+
+    // Walk every bank twice, the resident set never grows past its bound
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (uint8_t bank = 0; bank < 64; ++bank)
+        {
+            bus.Write(0x8000, bank);
+            EXPECT_EQ(bus.Read(0x8000), static_cast<uint8_t>(bank * 16));
+            EXPECT_EQ(bus.Read(0xA000), static_cast<uint8_t>(bank * 16 + 8));
+            EXPECT_EQ(bus.Read(0xA001), 0xEE);
+            EXPECT_LE(pager.GetResidentChunks(), ROM_PAGER_MIN_RESIDENT_CHUNKS);
+        }
+    }
+
+    EXPECT_GT(pager.evictions, 0u);
+
+    // The fixed bank stayed pinned the whole time
+    EXPECT_EQ(bus.Read(0xE000), static_cast<uint8_t>(63 * 16 + 8));
+
+    std::remove(rom_path.c_str());
+}
+
+TEST(RomPagerTest, ResidentBanksAreReused) {
+    std::string rom_path = WriteLargeRom("nese_lazy_mmc3.nes", 4, 8, 8);
+
+    Cartridge cart(rom_path, Cartridge::LoadMode::Lazy);
+    ASSERT_TRUE(cart.IsLoaded());
+
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+    RomPager& pager = *cart.GetPager();
+
+    // 1 KB CHR bank 13 of the 64 KB CHR ROM
+    bus.Write(0x8000, 0x02);
+    bus.Write(0x8001, 13);
+    EXPECT_EQ(ppu_bus.Read(0x1000), static_cast<uint8_t>(8 * 16 + 13));
+
+    uint32_t faults = pager.faults;
+    bus.Write(0x8001, 12);
+    EXPECT_EQ(ppu_bus.Read(0x1000), static_cast<uint8_t>(8 * 16 + 12));
+    EXPECT_EQ(pager.faults, faults);
+
+    // CHR ROM is still read only
+    ppu_bus.Write(0x1000, 0x55);
+    EXPECT_EQ(ppu_bus.Read(0x1000), static_cast<uint8_t>(8 * 16 + 12));
+
+    std::remove(rom_path.c_str());
+}
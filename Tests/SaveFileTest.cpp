@@ -0,0 +1,107 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include "SaveFile.h"
+#include "Mappers.h"
+#include "TestRom.h"
+
+// Mapper 0 with battery, 8 KB of PRG NVRAM on $6000
+static std::vector<uint8_t> MakeBatteryRom()
+{
+    return MakeTestRom(0, 1, 1, 0x02);
+}
+
+static std::vector<uint8_t> ReadFile(const std::string& path)
+{
+    std::ifstream file_stream(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file_stream), {});
+}
+
+TEST(SaveFileTest, WritesReachTheFile) {
+    std::string save_path = testing::TempDir() + "nese_battery.sav";
+    std::remove(save_path.c_str());
+
+    {
+        Cartridge cart(MakeBatteryRom());
+        ASSERT_EQ(cart.PGR_NVRAM.size(), 8192u);
+
+        SaveFile save_file(std::chrono::milliseconds(0));
+        ASSERT_TRUE(save_file.Attach(cart, save_path));
+
+        Bus bus;
+        PPUBus ppu_bus;
+        std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+
+        bus.Write(0x6000, 0x12);
+        bus.Write(0x7FFF, 0x34);
+        save_file.Update();
+
+        // New saves are created with the full size, writes are visible without any flush
+        std::vector<uint8_t> contents = ReadFile(save_path);
+        ASSERT_EQ(contents.size(), 8192u);
+        EXPECT_EQ(contents[0], 0x12);
+        EXPECT_EQ(contents[0x1FFF], 0x34);
+    }
+
+    // A new session starts from the saved content
+    Cartridge cart(MakeBatteryRom());
+    SaveFile save_file;
+    ASSERT_TRUE(save_file.Attach(cart, save_path));
+
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+    EXPECT_EQ(bus.Read(0x6000), 0x12);
+    EXPECT_EQ(bus.Read(0x7FFF), 0x34);
+
+    std::remove(save_path.c_str());
+}
+
+TEST(SaveFileTest, FlushesOnlyWhenDirty) {
+    std::string save_path = testing::TempDir() + "nese_battery_dirty.sav";
+    std::remove(save_path.c_str());
+
+    Cartridge cart(MakeBatteryRom());
+    SaveFile save_file(std::chrono::milliseconds(0));
+    ASSERT_TRUE(save_file.Attach(cart, save_path));
+
+    save_file.Update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(save_file.flushes, 0u);
+
+    cart.PGR_NVRAM[100] = 1;
+    save_file.Update();
+
+    for (int i = 0; i < 200 && save_file.flushes == 0; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ(save_file.flushes, 1u);
+
+    std::remove(save_path.c_str());
+}
+
+TEST(SaveFileTest, NoBatteryRAM) {
+    std::vector<uint8_t> image = MakeBatteryRom();
+    image[6] = 0;
+    Cartridge cart(image);
+
+    SaveFile save_file;
+    EXPECT_FALSE(save_file.Attach(cart, testing::TempDir() + "nese_no_battery.sav"));
+}
@@ -0,0 +1,53 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TestRom_h__
+#define TestRom_h__
+
+#include <cstdint>
+#include <vector>
+#include "Cartridge.h"
+
+// Bare iNES header, the size bytes and flags are written as given
+inline std::vector<uint8_t> MakeINESHeader(uint8_t PGR_LSB, uint8_t CHR_LSB, uint8_t flag_6, uint8_t flag_7)
+{
+    std::vector<uint8_t> image(INES_HEADER_SIZE, 0);
+    image[0] = 'N';
+    image[1] = 'E';
+    image[2] = 'S';
+    image[3] = 0x1A;
+    image[4] = PGR_LSB;
+    image[5] = CHR_LSB;
+    image[6] = flag_6;
+    image[7] = flag_7;
+
+    return image;
+}
+
+// iNES image for mapper with zero filled PRG and CHR ROM (no CHR units is CHR RAM).
+// flag_6 holds the mirroring, battery and trainer bits, the mapper nibbles are added to it.
+inline std::vector<uint8_t> MakeTestRom(uint8_t mapper, uint8_t PGR_16KB_units, uint8_t CHR_8KB_units, uint8_t flag_6 = 0)
+{
+    std::vector<uint8_t> image = MakeINESHeader(PGR_16KB_units, CHR_8KB_units,
+        static_cast<uint8_t>((mapper << 4) | flag_6), mapper & 0xF0);
+    image.resize(INES_HEADER_SIZE + PGR_16KB_units * 16384u + CHR_8KB_units * 8192u, 0);
+
+    return image;
+}
+
+#endif // TestRom_h__
@@ -0,0 +1,153 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "Mappers.h"
+#include "TileDecoder.h"
+#include "TestRom.h"
+
+// 32 KB of PRG, CHR_8KB_units of CHR ROM (none is CHR RAM). Tile 1 of bank n has row 0 = n.
+static std::vector<uint8_t> MakeTileRom(uint8_t mapper, uint8_t CHR_8KB_units)
+{
+    std::vector<uint8_t> image = MakeTestRom(mapper, 2, CHR_8KB_units);
+
+    uint8_t* chr = image.data() + INES_HEADER_SIZE + 2 * 16384;
+    for (uint32_t bank = 0; bank < CHR_8KB_units; ++bank)
+    {
+        chr[bank * 8192 + 16] = static_cast<uint8_t>(bank);
+        chr[bank * 8192 + 24] = 0x80;
+    }
+
+    return image;
+}
+
+static void ExpectRow(PPUBus& ppu_bus, uint16_t address, uint8_t low, uint8_t high)
+{
+    uint8_t expected[8];
+    DecodeTileRowBitwise(low, high, expected);
+    EXPECT_EQ(std::memcmp(ppu_bus.GetPatternRow(address, false), expected, 8), 0) << "address " << address;
+
+    DecodeTileRowBitwise(ReverseBits(low), ReverseBits(high), expected);
+    EXPECT_EQ(std::memcmp(ppu_bus.GetPatternRow(address, true), expected, 8), 0) << "address " << address;
+}
+
+TEST(TileCacheTest, CHRROMBanks) {
+    Cartridge cart(MakeTileRom(3, 4));
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+    ASSERT_TRUE(mapper);
+
+    for (uint8_t bank = 0; bank < 4; ++bank)
+    {
+        bus.Write(0x8000, bank);
+        ExpectRow(ppu_bus, 0x0010, bank, 0x80);
+        ExpectRow(ppu_bus, 0x0011, 0x00, 0x00);
+    }
+
+    // One decode per tile and bank, switching back reuses them
+    ASSERT_NE(ppu_bus.GetTileCache(), nullptr);
+    EXPECT_EQ(ppu_bus.GetTileCache()->GetTileCount(), 4u * 8192 / TILE_SIZE);
+    EXPECT_EQ(ppu_bus.GetTileCache()->GetDecodeCount(), 4u);
+
+    // Only the 1 KB blocks holding a read tile are allocated
+    EXPECT_EQ(ppu_bus.GetTileCache()->GetResidentBlocks(), 4u);
+
+    bus.Write(0x8000, 1);
+    ExpectRow(ppu_bus, 0x0010, 1, 0x80);
+    EXPECT_EQ(ppu_bus.GetTileCache()->GetDecodeCount(), 4u);
+
+    // ROM is read only, the cache keeps the tile
+    ppu_bus.Write(0x0010, 0xFF);
+    ExpectRow(ppu_bus, 0x0010, 1, 0x80);
+}
+
+TEST(TileCacheTest, CHRRAMWriteInvalidation) {
+    Cartridge cart(MakeTileRom(0, 0));
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+    ASSERT_TRUE(mapper);
+    ASSERT_TRUE(cart.chr_is_ram);
+
+    ExpectRow(ppu_bus, 0x1020, 0x00, 0x00);
+    ExpectRow(ppu_bus, 0x1030, 0x00, 0x00);
+    EXPECT_EQ(ppu_bus.GetTileCache()->GetDecodeCount(), 2u);
+
+    // High plane of row 3 of tile $102
+    ppu_bus.Write(0x102B, 0x0F);
+    ExpectRow(ppu_bus, 0x1023, 0x00, 0x0F);
+    ExpectRow(ppu_bus, 0x1030, 0x00, 0x00);
+    EXPECT_EQ(ppu_bus.GetTileCache()->GetDecodeCount(), 3u);
+
+    // The cache goes away with the mapper, rows are decoded from the bus
+    mapper.reset();
+    EXPECT_EQ(ppu_bus.GetTileCache(), nullptr);
+}
+
+TEST(TileCacheTest, LazyCartridgeStaysBounded) {
+    // 256 KB of CHR ROM, twice what the resident chunks can hold
+    std::vector<uint8_t> image = MakeTileRom(4, 32);
+    std::string rom_path = testing::TempDir() + "nese_lazy_tiles.nes";
+    {
+        std::ofstream file_stream(rom_path, std::ios::binary | std::ios::trunc);
+        file_stream.write(reinterpret_cast<const char*>(image.data()), image.size());
+    }
+
+    Cartridge cart(rom_path, Cartridge::LoadMode::Lazy, ROM_PAGER_MIN_RESIDENT_CHUNKS);
+    ASSERT_TRUE(cart.IsLoaded());
+    ASSERT_TRUE(cart.GetPager());
+
+    Bus bus;
+    PPUBus ppu_bus;
+    std::unique_ptr<Mapper> mapper = CreateMapper(cart, bus, ppu_bus);
+    ASSERT_TRUE(mapper);
+
+    RomPager& pager = *cart.GetPager();
+    const TileCache& tile_cache = *ppu_bus.GetTileCache();
+    const uint32_t max_blocks = pager.GetMaxResidentChunks() * (ROM_PAGER_CHUNK_SIZE / TILE_CACHE_BLOCK_SIZE);
+
+    // Every tile of every 1 KB bank through $1000, twice so evicted chunks come back
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (uint32_t bank = 0; bank < 256; ++bank)
+        {
+            bus.Write(0x8000, 0x02);
+            bus.Write(0x8001, static_cast<uint8_t>(bank));
+
+            for (uint16_t tile = 0; tile < 64; ++tile)
+                ppu_bus.GetPatternRow(static_cast<uint16_t>(0x1000 + tile * 16), false);
+
+            if (bank % 8 == 0)
+                ExpectRow(ppu_bus, 0x1010, static_cast<uint8_t>(bank / 8), 0x80);
+
+            EXPECT_LE(pager.GetResidentChunks(), pager.GetMaxResidentChunks());
+            ASSERT_LE(tile_cache.GetResidentBlocks(), max_blocks) << "bank " << bank;
+        }
+    }
+
+    EXPECT_GT(pager.evictions, 0u);
+    EXPECT_LT(tile_cache.GetResidentSize(), tile_cache.GetTileCount() * 2u * TILE_PIXELS_SIZE);
+
+    mapper.reset();
+    std::remove(rom_path.c_str());
+}
@@ -0,0 +1,83 @@
+/*
+    NES - MOS 6502 Emulator
+    Copyright (C) 2021 JDavid(Blackhack) <davidaristi.0504@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include "TileDecoder.h"
+
+TEST(TileDecoderTest, SingleRows) {
+    for (uint32_t planes = 0; planes < 0x10000; ++planes)
+    {
+        uint8_t low = planes & 0xFF;
+        uint8_t high = planes >> 8;
+
+        uint8_t expected[8];
+        uint8_t expected_flipped[8];
+        DecodeTileRowBitwise(low, high, expected);
+        DecodeTileRowBitwise(ReverseBits(low), ReverseBits(high), expected_flipped);
+
+        uint8_t pixels[8];
+        DecodeTileRow(low, high, pixels);
+        ASSERT_EQ(std::memcmp(pixels, expected, 8), 0) << "planes " << planes;
+
+        DecodeTileRowFlipped(low, high, pixels);
+        ASSERT_EQ(std::memcmp(pixels, expected_flipped, 8), 0) << "planes " << planes;
+    }
+
+    uint8_t pixels[8];
+    DecodeTileRow(0xC3, 0x81, pixels);
+    const uint8_t expected[8] = { 3, 1, 0, 0, 0, 0, 1, 3 };
+    EXPECT_EQ(std::memcmp(pixels, expected, 8), 0);
+}
+
+TEST(TileDecoderTest, Batches) {
+    uint8_t low[37];
+    uint8_t high[37];
+    for (uint32_t i = 0; i < 37; ++i)
+    {
+        low[i] = static_cast<uint8_t>(i * 73 + 5);
+        high[i] = static_cast<uint8_t>(i * 151 + 9);
+    }
+
+    // Every count, so the vector loops and the tail all run
+    for (uint32_t count = 0; count <= 37; ++count)
+    {
+        uint8_t pixels[37 * 8 + 1];
+        uint8_t flipped[37 * 8 + 1];
+        pixels[count * 8] = 0xAA;
+        flipped[count * 8] = 0xAA;
+
+        DecodeTileRows(low, high, count, pixels);
+        DecodeTileRowsFlipped(low, high, count, flipped);
+
+        for (uint32_t row = 0; row < count; ++row)
+        {
+            uint8_t expected[8];
+            DecodeTileRowBitwise(low[row], high[row], expected);
+            ASSERT_EQ(std::memcmp(pixels + row * 8, expected, 8), 0) << "count " << count << " row " << row;
+
+            DecodeTileRowBitwise(ReverseBits(low[row]), ReverseBits(high[row]), expected);
+            ASSERT_EQ(std::memcmp(flipped + row * 8, expected, 8), 0) << "count " << count << " row " << row;
+        }
+
+        // Nothing written past the last row
+        EXPECT_EQ(pixels[count * 8], 0xAA);
+        EXPECT_EQ(flipped[count * 8], 0xAA);
+    }
+}